@@ -18,4 +18,9 @@
 #define LOGW(fmt, ...) cloudlog(CLOUDLOG_WARNING, fmt, ## __VA_ARGS__)
 #define LOGE(fmt, ...) cloudlog(CLOUDLOG_ERROR, fmt, ## __VA_ARGS__)
 
+#define LOGD_100(fmt, ...) LOGD(fmt, ## __VA_ARGS__)
+#define LOG_100(fmt, ...) LOG(fmt, ## __VA_ARGS__)
+#define LOGW_100(fmt, ...) LOGW(fmt, ## __VA_ARGS__)
+#define LOGE_100(fmt, ...) LOGE(fmt, ## __VA_ARGS__)
+
 #endif
@@ -100,6 +100,8 @@ private:
 class MessageBuilder : public capnp::MallocMessageBuilder {
 public:
   MessageBuilder() = default;
+  // the first segment in the given zeroed memory, it's zeroed again when the builder is destroyed
+  explicit MessageBuilder(kj::ArrayPtr<capnp::word> first_segment) : capnp::MallocMessageBuilder(first_segment) {}
 
   cereal::Event::Builder initEvent(bool valid = true) {
     cereal::Event::Builder event = initRoot<cereal::Event>();
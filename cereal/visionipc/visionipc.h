@@ -1,9 +1,11 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <cstddef>
 
 constexpr int VISIONIPC_MAX_FDS = 128;
+constexpr int VISIONIPC_MAX_CLIENTS = 16;
 
 struct VisionIpcBufExtra {
   uint32_t frame_id;
@@ -14,5 +16,27 @@ struct VisionIpcBufExtra {
 struct VisionIpcPacket {
   uint64_t server_id;
   size_t idx;
+  uint64_t write_seq;  // write_seq of the buffer when it was sent
   struct VisionIpcBufExtra extra;
 };
+
+struct VisionIpcLeaseClient {
+  std::atomic<int32_t> pid;  // 0 if the slot is free
+  std::atomic<uint32_t> last_frame_id;
+  std::atomic<uint64_t> leased[VISIONIPC_MAX_FDS / 64];  // bitmask of the buffers this client is reading
+};
+
+// Shared memory between the server and the clients of a stream. A client leases a buffer
+// while reading it, the server doesn't hand out leased buffers for writing.
+struct VisionIpcLeaseTable {
+  std::atomic<uint32_t> writing[VISIONIPC_MAX_FDS];
+  std::atomic<uint64_t> write_seq[VISIONIPC_MAX_FDS];  // number of times each buffer was handed out for writing
+  VisionIpcLeaseClient clients[VISIONIPC_MAX_CLIENTS];
+};
+
+struct VisionIpcClientStats {
+  int pid;
+  int leased;  // number of buffers leased by the client
+  uint32_t last_frame_id;
+  int64_t lag;  // frames between the last sent and the last received buffer
+};
@@ -3,6 +3,8 @@
 #include <iostream>
 #include <thread>
 
+#include <sys/mman.h>
+
 #include "cereal/visionipc/ipc.h"
 #include "cereal/visionipc/visionipc_client.h"
 #include "cereal/visionipc/visionipc_server.h"
@@ -27,19 +29,33 @@ VisionIpcClient::VisionIpcClient(std::string name, VisionStreamType type, bool c
   poller->registerSocket(sock);
 }
 
-// Connect is not thread safe. Do not use the buffers while calling connect
-bool VisionIpcClient::connect(bool blocking){
-  connected = false;
-
-  // Cleanup old buffers on reconnect
+void VisionIpcClient::free_buffers() {
   for (size_t i = 0; i < num_buffers; i++){
     if (buffers[i].free() != 0) {
       LOGE("Failed to free buffer %zu", i);
     }
   }
-
   num_buffers = 0;
 
+  if (lease_table) {
+    for (auto &l : lease->leased) l = 0;
+    lease->pid = 0;
+    munmap(lease_table, sizeof(VisionIpcLeaseTable));
+    close(lease_fd);
+  }
+  lease_fd = -1;
+  lease_table = nullptr;
+  lease = nullptr;
+  leased_buf = nullptr;
+}
+
+// Connect is not thread safe. Do not use the buffers while calling connect
+bool VisionIpcClient::connect(bool blocking){
+  connected = false;
+
+  // Cleanup old buffers on reconnect
+  free_buffers();
+
   int socket_fd = connect_to_vipc_server(name, blocking);
   if (socket_fd < 0) {
     return false;
@@ -49,13 +65,33 @@ bool VisionIpcClient::connect(bool blocking){
   assert(r == sizeof(type));
 
   // Get FDs
-  int fds[VISIONIPC_MAX_FDS];
+  int fds[VISIONIPC_MAX_FDS + 1];
   VisionBuf bufs[VISIONIPC_MAX_FDS];
-  r = ipc_sendrecv_with_fds(false, socket_fd, &bufs, sizeof(bufs), fds, VISIONIPC_MAX_FDS, &num_buffers);
+  int num_fds = 0;
+  r = ipc_sendrecv_with_fds(false, socket_fd, &bufs, sizeof(bufs), fds, VISIONIPC_MAX_FDS + 1, &num_fds);
 
-  assert(num_buffers >= 0);
+  // The last fd is the lease table
+  assert(num_fds >= 1);
+  num_buffers = num_fds - 1;
   assert(r == sizeof(VisionBuf) * num_buffers);
 
+  lease_fd = fds[num_buffers];
+  void *addr = mmap(NULL, sizeof(VisionIpcLeaseTable), PROT_READ | PROT_WRITE, MAP_SHARED, lease_fd, 0);
+  assert(addr != MAP_FAILED);
+  lease_table = (VisionIpcLeaseTable *)addr;
+
+  // Claim a client slot. Without a slot buffers are read without leasing them
+  for (auto &c : lease_table->clients) {
+    int32_t expected = 0;
+    if (c.pid.compare_exchange_strong(expected, getpid())) {
+      lease = &c;
+      break;
+    }
+  }
+  if (!lease) {
+    LOGW("no free lease slot for stream %d, buffers may be overwritten while reading", type);
+  }
+
   // Import buffers
   for (size_t i = 0; i < num_buffers; i++){
     buffers[i] = bufs[i];
@@ -100,6 +136,22 @@ VisionBuf * VisionIpcClient::recv(VisionIpcBufExtra * extra, const int timeout_m
     return nullptr;
   }
 
+  if (lease) {
+    // Lease before checking the writing flag, the server checks them in the opposite order.
+    // The previous buffer stays leased until this one is accepted, the caller may still be reading it
+    const uint64_t bit = 1ULL << (packet->idx % 64);
+    lease->leased[packet->idx / 64] |= bit;
+    if (lease_table->writing[packet->idx] || lease_table->write_seq[packet->idx] != packet->write_seq) {
+      // the server is already writing, or has written, a newer frame to this buffer
+      if (buf != leased_buf) lease->leased[packet->idx / 64] &= ~bit;
+      delete r;
+      return nullptr;
+    }
+    if (leased_buf != buf) release(leased_buf);
+    lease->last_frame_id = packet->extra.frame_id;
+    leased_buf = buf;
+  }
+
   if (extra) {
     *extra = packet->extra;
   }
@@ -129,12 +181,15 @@ std::set<VisionStreamType> VisionIpcClient::getAvailableStreams(const std::strin
   return std::set<VisionStreamType>(available_streams, available_streams + r / sizeof(VisionStreamType));
 }
 
+void VisionIpcClient::release(VisionBuf * buf) {
+  if (!buf || !lease) return;
+
+  lease->leased[buf->idx / 64] &= ~(1ULL << (buf->idx % 64));
+  if (buf == leased_buf) leased_buf = nullptr;
+}
+
 VisionIpcClient::~VisionIpcClient(){
-  for (size_t i = 0; i < num_buffers; i++){
-    if (buffers[i].free() != 0) {
-      LOGE("Failed to free buffer %zu", i);
-    }
-  }
+  free_buffers();
 
   delete sock;
   delete poller;
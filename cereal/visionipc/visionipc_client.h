@@ -19,7 +19,14 @@ private:
   cl_device_id device_id = nullptr;
   cl_context ctx = nullptr;
 
+  int lease_fd = -1;
+  VisionIpcLeaseTable *lease_table = nullptr;
+  VisionIpcLeaseClient *lease = nullptr;
+  VisionBuf *leased_buf = nullptr;
+
   void init_msgq(bool conflate);
+  friend class VisionIpcSyncClient;
+  void free_buffers();
 
 public:
   bool connected = false;
@@ -30,6 +37,9 @@ public:
   ~VisionIpcClient();
   VisionBuf * recv(VisionIpcBufExtra * extra=nullptr, const int timeout_ms=100);
   bool connect(bool blocking=true);
+  // release the buffer returned by the last recv, the server can reuse it for new frames.
+  // this is done implicitly by the next recv.
+  void release(VisionBuf * buf);
   bool is_connected() { return connected; }
   static std::set<VisionStreamType> getAvailableStreams(const std::string &name, bool blocking = true);
 };
@@ -1,10 +1,14 @@
 #include <iostream>
 #include <chrono>
 #include <cassert>
+#include <cerrno>
 #include <random>
 #include <limits>
 
+#include <fcntl.h>
 #include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -22,6 +26,26 @@ std::string get_endpoint_name(std::string name, VisionStreamType type){
   }
 }
 
+static VisionIpcLeaseTable *create_lease_table(VisionStreamType type, int *fd) {
+  char full_path[0x100];
+#ifdef __APPLE__
+  snprintf(full_path, sizeof(full_path)-1, "/tmp/visionipc_lease_%d_%d", getpid(), type);
+#else
+  snprintf(full_path, sizeof(full_path)-1, "/dev/shm/visionipc_lease_%d_%d", getpid(), type);
+#endif
+
+  *fd = open(full_path, O_RDWR | O_CREAT | O_TRUNC, 0664);
+  assert(*fd >= 0);
+  unlink(full_path);
+
+  // zero filled, all buffers are free
+  int err = ftruncate(*fd, sizeof(VisionIpcLeaseTable));
+  assert(err == 0);
+  void *addr = mmap(NULL, sizeof(VisionIpcLeaseTable), PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+  assert(addr != MAP_FAILED);
+  return (VisionIpcLeaseTable *)addr;
+}
+
 VisionIpcServer::VisionIpcServer(std::string name, cl_device_id device_id, cl_context ctx) : name(name), device_id(device_id), ctx(ctx) {
   msg_ctx = Context::create();
 
@@ -69,6 +93,10 @@ void VisionIpcServer::create_buffers_with_sizes(VisionStreamType type, size_t nu
 
   cur_idx[type] = 0;
 
+  int lease_fd = -1;
+  VisionIpcLeaseTable *table = create_lease_table(type, &lease_fd);
+  lease_tables[type] = {lease_fd, table};
+
   // Create msgq publisher for each of the `name` + type combos
   // TODO: compute port number directly if using zmq
   sockets[type] = PubSocket::create(msg_ctx, get_endpoint_name(name, type), false);
@@ -131,11 +159,11 @@ void VisionIpcServer::listener(){
       continue;
     }
 
-    int fds[VISIONIPC_MAX_FDS];
-    int num_fds = buffers[type].size();
+    int fds[VISIONIPC_MAX_FDS + 1];
+    int num_bufs = buffers[type].size();
     VisionBuf bufs[VISIONIPC_MAX_FDS];
 
-    for (int i = 0; i < num_fds; i++){
+    for (int i = 0; i < num_bufs; i++){
       fds[i] = buffers[type][i]->fd;
       bufs[i] = *buffers[type][i];
 
@@ -147,7 +175,9 @@ void VisionIpcServer::listener(){
       bufs[i].server_id = server_id;
     }
 
-    r = ipc_sendrecv_with_fds(true, fd, &bufs, sizeof(VisionBuf) * num_fds, fds, num_fds, nullptr);
+    // the lease table is sent after the buffers
+    fds[num_bufs] = lease_tables[type].first;
+    r = ipc_sendrecv_with_fds(true, fd, &bufs, sizeof(VisionBuf) * num_bufs, fds, num_bufs + 1, nullptr);
 
     close(fd);
   }
@@ -158,11 +188,70 @@ void VisionIpcServer::listener(){
 
 
 
+bool VisionIpcServer::is_leased(VisionIpcLeaseTable *table, size_t idx) {
+  for (auto &c : table->clients) {
+    if (c.pid != 0 && (c.leased[idx / 64] & (1ULL << (idx % 64)))) return true;
+  }
+  return false;
+}
+
+void VisionIpcServer::release_dead_clients(VisionIpcLeaseTable *table) {
+  for (auto &c : table->clients) {
+    int pid = c.pid;
+    if (pid != 0 && kill(pid, 0) != 0 && errno == ESRCH) {
+      for (auto &l : c.leased) l = 0;
+      c.pid = 0;
+    }
+  }
+}
+
 VisionBuf * VisionIpcServer::get_buffer(VisionStreamType type){
-  // Do we want to keep track if the buffer has been sent out yet and warn user?
   assert(buffers.count(type));
-  auto b = buffers[type];
-  return b[cur_idx[type]++ % b.size()];
+  auto &b = buffers[type];
+  VisionIpcLeaseTable *table = lease_tables[type].second;
+
+  // Skip the buffers that are still being read by clients. The writing flag is set
+  // before checking the leases, so a client can't lease the buffer after the check.
+  for (size_t i = 0; i < b.size(); i++) {
+    size_t idx = cur_idx[type]++ % b.size();
+    table->writing[idx] = 1;
+    if (!is_leased(table, idx)) {
+      table->write_seq[idx]++;
+      return b[idx];
+    }
+    table->writing[idx] = 0;
+
+    if (i == 0) release_dead_clients(table);
+  }
+
+  // All buffers are leased, overwrite the oldest one
+  overruns[type]++;
+  LOGW("all %zu buffers of stream %d are leased by clients", b.size(), type);
+  size_t idx = cur_idx[type]++ % b.size();
+  table->writing[idx] = 1;
+  table->write_seq[idx]++;
+  return b[idx];
+}
+
+std::vector<VisionIpcClientStats> VisionIpcServer::get_client_stats(VisionStreamType type) {
+  assert(lease_tables.count(type));
+  VisionIpcLeaseTable *table = lease_tables[type].second;
+
+  std::vector<VisionIpcClientStats> stats;
+  for (auto &c : table->clients) {
+    if (c.pid == 0) continue;
+
+    int leased = 0;
+    for (auto &l : c.leased) leased += __builtin_popcountll(l);
+    uint32_t frame_id = c.last_frame_id;
+    stats.push_back({
+      .pid = c.pid,
+      .leased = leased,
+      .last_frame_id = frame_id,
+      .lag = (int64_t)last_frame_id[type] - (int64_t)frame_id,
+    });
+  }
+  return stats;
 }
 
 void VisionIpcServer::send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync){
@@ -180,6 +269,10 @@ void VisionIpcServer::send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync
   packet.idx = buf->idx;
   packet.extra = *extra;
 
+  VisionIpcLeaseTable *table = lease_tables[buf->type].second;
+  packet.write_seq = table->write_seq[buf->idx];
+  last_frame_id[buf->type] = extra->frame_id;
+  table->writing[buf->idx] = 0;
   sockets[buf->type]->send((char*)&packet, sizeof(packet));
 }
 
@@ -197,6 +290,11 @@ VisionIpcServer::~VisionIpcServer(){
     }
   }
 
+  for (auto const& [type, table] : lease_tables) {
+    munmap(table.second, sizeof(VisionIpcLeaseTable));
+    close(table.first);
+  }
+
   // Messaging cleanup
   for (auto const& [type, sock] : sockets) {
     delete sock;
@@ -24,11 +24,16 @@ class VisionIpcServer {
   std::map<VisionStreamType, std::atomic<size_t> > cur_idx;
   std::map<VisionStreamType, std::vector<VisionBuf*> > buffers;
   std::map<VisionStreamType, std::map<VisionBuf*, size_t> > idxs;
+  std::map<VisionStreamType, std::pair<int, VisionIpcLeaseTable*> > lease_tables;
+  std::map<VisionStreamType, uint32_t> last_frame_id;
+  std::map<VisionStreamType, uint64_t> overruns;
 
   Context * msg_ctx;
   std::map<VisionStreamType, PubSocket*> sockets;
 
   void listener(void);
+  bool is_leased(VisionIpcLeaseTable *table, size_t idx);
+  void release_dead_clients(VisionIpcLeaseTable *table);
 
  public:
   VisionIpcServer(std::string name, cl_device_id device_id=nullptr, cl_context ctx=nullptr);
@@ -40,4 +45,6 @@ class VisionIpcServer {
   void create_buffers_with_sizes(VisionStreamType type, size_t num_buffers, bool rgb, size_t width, size_t height, size_t size, size_t stride, size_t uv_offset);
   void send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync=true);
   void start_listener();
+  std::vector<VisionIpcClientStats> get_client_stats(VisionStreamType type);
+  uint64_t get_overruns(VisionStreamType type) { return overruns[type]; }
 };
@@ -0,0 +1,99 @@
+#include "cereal/visionipc/visionipc_sync_client.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#include "cereal/logger/logger.h"
+
+VisionIpcSyncClient::VisionIpcSyncClient(std::string name, const std::vector<VisionStreamType> &types, VisionIpcSyncPolicy policy,
+                                         cl_device_id device_id, cl_context ctx) : policy(policy), pending(types.size()) {
+  assert(!types.empty());
+  poller.reset(Poller::create());
+  for (auto type : types) {
+    // conflating is done here, so the frames can be counted as dropped
+    clients.emplace_back(new VisionIpcClient(name, type, false, device_id, ctx));
+    poller->registerSocket(clients.back()->sock);
+  }
+}
+
+bool VisionIpcSyncClient::connect(bool blocking) {
+  // frames of a previous server can't be paired with the ones of a new one
+  if (!is_connected()) {
+    for (auto &f : pending) f = {};
+  }
+  for (auto &c : clients) {
+    if (!c->connected && !c->connect(blocking)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool VisionIpcSyncClient::is_connected() {
+  return std::all_of(clients.begin(), clients.end(), [](auto &c) { return c->connected; });
+}
+
+void VisionIpcSyncClient::drain(size_t i) {
+  VisionIpcBufExtra extra = {};
+  while (VisionBuf *buf = clients[i]->recv(&extra, 0)) {
+    if (pending[i].buf) dropped++;
+    pending[i] = {buf, extra};
+  }
+}
+
+bool VisionIpcSyncClient::match(std::vector<VisionIpcSyncFrame> &frames) {
+  auto key = [this](const VisionIpcSyncFrame &f) -> uint64_t {
+    return policy.match_frame_id ? f.extra.frame_id : f.extra.timestamp_sof;
+  };
+
+  uint64_t newest = 0;
+  for (auto &f : pending) {
+    if (!f.buf) return false;
+    newest = std::max(newest, key(f));
+  }
+
+  // drop the frames that are too old to be paired with the newest one, and wait for their successors
+  const uint64_t max_skew = policy.match_frame_id ? 0 : policy.max_skew_ns;
+  bool stale = false;
+  for (auto &f : pending) {
+    if (newest - key(f) > max_skew) {
+      f.buf = nullptr;
+      dropped++;
+      stale = true;
+    }
+  }
+  if (stale) return false;
+
+  auto [first, last] = std::minmax_element(pending.begin(), pending.end(), [](auto &a, auto &b) {
+    return a.extra.timestamp_sof < b.extra.timestamp_sof;
+  });
+  if (last->extra.timestamp_sof - first->extra.timestamp_sof > policy.warn_skew_ns) {
+    misaligned++;
+    LOGE("frames out of sync! %d (%.5f), %d (%.5f)",
+      first->extra.frame_id, double(first->extra.timestamp_sof) / 1e9,
+      last->extra.frame_id, double(last->extra.timestamp_sof) / 1e9);
+  }
+
+  frames = pending;
+  for (auto &f : pending) {
+    f.buf = nullptr;
+  }
+  return true;
+}
+
+bool VisionIpcSyncClient::recv(std::vector<VisionIpcSyncFrame> &frames) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(policy.timeout_ms);
+  while (is_connected()) {
+    int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    for (auto sock : poller->poll(std::max(remaining, 0))) {
+      for (size_t i = 0; i < clients.size(); i++) {
+        if (clients[i]->sock == sock) drain(i);
+      }
+    }
+
+    if (match(frames)) return true;
+    if (remaining <= 0) break;
+  }
+  return false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cereal/messaging/messaging.h"
+#include "cereal/visionipc/visionipc.h"
+#include "cereal/visionipc/visionipc_client.h"
+
+struct VisionIpcSyncPolicy {
+  bool match_frame_id = false;            // match on frame_id instead of timestamp_sof
+  uint64_t max_skew_ns = 25000000ULL;     // frames further apart than this are never paired
+  uint64_t warn_skew_ns = 10000000ULL;    // paired frames further apart than this are counted as misaligned
+  int timeout_ms = 100;
+};
+
+struct VisionIpcSyncFrame {
+  VisionBuf *buf = nullptr;
+  VisionIpcBufExtra extra = {};
+};
+
+// Receives from several streams of a server and returns the frames that belong together.
+// Only the newest frame of each stream is kept, older ones are counted as dropped.
+class VisionIpcSyncClient {
+private:
+  VisionIpcSyncPolicy policy;
+  std::vector<std::unique_ptr<VisionIpcClient>> clients;
+  std::unique_ptr<Poller> poller;
+  std::vector<VisionIpcSyncFrame> pending;
+  uint64_t dropped = 0;
+  uint64_t misaligned = 0;
+
+  void drain(size_t i);
+  bool match(std::vector<VisionIpcSyncFrame> &frames);
+
+public:
+  VisionIpcSyncClient(std::string name, const std::vector<VisionStreamType> &types, VisionIpcSyncPolicy policy={},
+                      cl_device_id device_id=nullptr, cl_context ctx=nullptr);
+  // connects to all streams, returns true once every stream is connected
+  bool connect(bool blocking=true);
+  bool is_connected();
+  // frames are in the same order as the stream types. returns false on timeout
+  bool recv(std::vector<VisionIpcSyncFrame> &frames);
+  VisionIpcClient &client(size_t i) { return *clients[i]; }
+  uint64_t get_dropped() const { return dropped; }
+  uint64_t get_misaligned() const { return misaligned; }
+};
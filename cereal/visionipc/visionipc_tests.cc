@@ -4,6 +4,7 @@
 #include "catch2/catch.hpp"
 #include "cereal/visionipc/visionipc_server.h"
 #include "cereal/visionipc/visionipc_client.h"
+#include "cereal/visionipc/visionipc_sync_client.h"
 
 static void zmq_sleep(int milliseconds=1000){
   if (messaging_use_zmq()){
@@ -146,3 +147,204 @@ TEST_CASE("Test conflate"){
   recv_buf = client.recv(&extra_recv);
   REQUIRE(recv_buf == nullptr);
 }
+
+TEST_CASE("Leased buffers are not reused"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 2, true, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_ROAD, false);
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  VisionBuf * buf = server.get_buffer(VISION_STREAM_ROAD);
+  VisionIpcBufExtra extra = {0};
+  extra.frame_id = 1;
+  server.send(buf, &extra);
+
+  VisionBuf * recv_buf = client.recv();
+  REQUIRE(recv_buf != nullptr);
+  REQUIRE(recv_buf->idx == buf->idx);
+
+  // the leased buffer is skipped
+  REQUIRE(server.get_buffer(VISION_STREAM_ROAD)->idx != buf->idx);
+  REQUIRE(server.get_buffer(VISION_STREAM_ROAD)->idx != buf->idx);
+
+  auto stats = server.get_client_stats(VISION_STREAM_ROAD);
+  REQUIRE(stats.size() == 1);
+  REQUIRE(stats[0].leased == 1);
+  REQUIRE(stats[0].last_frame_id == 1);
+  REQUIRE(stats[0].lag == 0);
+
+  client.release(recv_buf);
+  REQUIRE(server.get_client_stats(VISION_STREAM_ROAD)[0].leased == 0);
+  REQUIRE(server.get_overruns(VISION_STREAM_ROAD) == 0);
+}
+
+TEST_CASE("Buffers being written are not received"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 1, true, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_ROAD, false);
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  VisionBuf * buf = server.get_buffer(VISION_STREAM_ROAD);
+  VisionIpcBufExtra extra = {0};
+  extra.frame_id = 1;
+  server.send(buf, &extra);
+
+  // the frame is overwritten before the client reads it
+  REQUIRE(server.get_buffer(VISION_STREAM_ROAD) == buf);
+  REQUIRE(client.recv() == nullptr);
+
+  extra.frame_id = 2;
+  server.send(buf, &extra);
+  VisionIpcBufExtra extra_recv = {0};
+  REQUIRE(client.recv(&extra_recv) != nullptr);
+  REQUIRE(extra_recv.frame_id == 2);
+}
+
+TEST_CASE("Stale frames are not received"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 1, true, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_ROAD, false);
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  VisionBuf * buf = server.get_buffer(VISION_STREAM_ROAD);
+  VisionIpcBufExtra extra = {0};
+  extra.frame_id = 1;
+  server.send(buf, &extra);
+
+  // the buffer is rewritten and sent again before the client reads the first frame
+  REQUIRE(server.get_buffer(VISION_STREAM_ROAD) == buf);
+  extra.frame_id = 2;
+  server.send(buf, &extra);
+
+  VisionIpcBufExtra extra_recv = {0};
+  REQUIRE(client.recv(&extra_recv) == nullptr);
+  REQUIRE(client.recv(&extra_recv) != nullptr);
+  REQUIRE(extra_recv.frame_id == 2);
+}
+
+TEST_CASE("A rejected frame keeps the previous buffer leased"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 2, true, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_ROAD, false);
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  VisionBuf * buf = server.get_buffer(VISION_STREAM_ROAD);
+  VisionIpcBufExtra extra = {0};
+  extra.frame_id = 1;
+  server.send(buf, &extra);
+  VisionBuf * recv_buf = client.recv();
+  REQUIRE(recv_buf == &client.buffers[buf->idx]);
+
+  // the next frame is rewritten before the client reads it
+  VisionBuf * other = server.get_buffer(VISION_STREAM_ROAD);
+  REQUIRE(other != buf);
+  extra.frame_id = 2;
+  server.send(other, &extra);
+  REQUIRE(server.get_buffer(VISION_STREAM_ROAD) == other);
+  REQUIRE(client.recv() == nullptr);
+
+  // the first frame is still being read, so it isn't reused
+  REQUIRE(server.get_client_stats(VISION_STREAM_ROAD)[0].leased == 1);
+  REQUIRE(server.get_buffer(VISION_STREAM_ROAD) == other);
+  REQUIRE(server.get_overruns(VISION_STREAM_ROAD) == 0);
+}
+
+TEST_CASE("Sync multiple streams"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 4, false, 100, 100);
+  server.create_buffers(VISION_STREAM_WIDE_ROAD, 4, false, 100, 100);
+  server.start_listener();
+
+  VisionIpcSyncClient client("camerad", {VISION_STREAM_ROAD, VISION_STREAM_WIDE_ROAD});
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  auto send = [&](VisionStreamType type, uint32_t frame_id, uint64_t timestamp_sof) {
+    VisionIpcBufExtra extra = {.frame_id = frame_id, .timestamp_sof = timestamp_sof};
+    server.send(server.get_buffer(type), &extra);
+  };
+
+  // wide frame 1 is missing, road frame 1 is dropped
+  send(VISION_STREAM_ROAD, 1, 50000000ULL);
+  send(VISION_STREAM_ROAD, 2, 100000000ULL);
+  send(VISION_STREAM_WIDE_ROAD, 2, 101000000ULL);
+
+  std::vector<VisionIpcSyncFrame> frames;
+  REQUIRE(client.recv(frames));
+  REQUIRE(frames.size() == 2);
+  REQUIRE(frames[0].extra.frame_id == 2);
+  REQUIRE(frames[1].extra.frame_id == 2);
+  REQUIRE(frames[0].buf->type == VISION_STREAM_ROAD);
+  REQUIRE(frames[1].buf->type == VISION_STREAM_WIDE_ROAD);
+  REQUIRE(client.get_dropped() == 1);
+  REQUIRE(client.get_misaligned() == 0);
+
+  // road frame 3 is too old to pair with wide frame 4
+  send(VISION_STREAM_ROAD, 3, 150000000ULL);
+  send(VISION_STREAM_WIDE_ROAD, 4, 200000000ULL);
+  REQUIRE_FALSE(client.recv(frames));
+  REQUIRE(client.get_dropped() == 2);
+
+  send(VISION_STREAM_ROAD, 4, 215000000ULL);
+  REQUIRE(client.recv(frames));
+  REQUIRE(frames[0].extra.frame_id == 4);
+  REQUIRE(frames[1].extra.frame_id == 4);
+  REQUIRE(client.get_misaligned() == 1);
+}
+
+TEST_CASE("Sync frames are not paired across servers"){
+  VisionIpcSyncClient client("camerad", {VISION_STREAM_ROAD, VISION_STREAM_WIDE_ROAD});
+  std::vector<VisionIpcSyncFrame> frames;
+  auto send = [&](VisionIpcServer &server, VisionStreamType type, uint32_t frame_id, uint64_t timestamp_sof) {
+    VisionIpcBufExtra extra = {.frame_id = frame_id, .timestamp_sof = timestamp_sof};
+    server.send(server.get_buffer(type), &extra);
+  };
+
+  {
+    VisionIpcServer server("camerad");
+    server.create_buffers(VISION_STREAM_ROAD, 4, false, 100, 100);
+    server.create_buffers(VISION_STREAM_WIDE_ROAD, 4, false, 100, 100);
+    server.start_listener();
+    REQUIRE(client.connect());
+    zmq_sleep();
+
+    REQUIRE_FALSE(client.recv(frames));
+    send(server, VISION_STREAM_ROAD, 1, 100000000ULL);
+    REQUIRE_FALSE(client.recv(frames));
+  }
+
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 4, false, 100, 100);
+  server.create_buffers(VISION_STREAM_WIDE_ROAD, 4, false, 100, 100);
+  server.start_listener();
+
+  // the client notices the new server on the first frames, once its readers caught up with the new queues
+  REQUIRE_FALSE(client.recv(frames));
+  send(server, VISION_STREAM_ROAD, 1, 100000000ULL);
+  send(server, VISION_STREAM_WIDE_ROAD, 1, 100000000ULL);
+  REQUIRE_FALSE(client.recv(frames));
+  REQUIRE_FALSE(client.is_connected());
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  // the road frame of the previous server isn't paired with this one
+  send(server, VISION_STREAM_WIDE_ROAD, 2, 101000000ULL);
+  REQUIRE_FALSE(client.recv(frames));
+
+  send(server, VISION_STREAM_ROAD, 2, 100000000ULL);
+  REQUIRE(client.recv(frames));
+  REQUIRE(frames[0].extra.frame_id == 2);
+  REQUIRE(frames[1].extra.frame_id == 2);
+}
@@ -1,11 +1,23 @@
 #include "common/params.h"
 
 #include <dirent.h>
+#include <poll.h>
 #include <sys/file.h>
+#include <sys/inotify.h>
+
+#include <sys/stat.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cstring>
 #include <csignal>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "common/swaglog.h"
 #include "common/util.h"
@@ -72,7 +84,7 @@ std::string ensure_params_path(const std::string &prefix, const std::string &pat
 class FileLock {
 public:
   FileLock(const std::string &fn) {
-    fd_ = HANDLE_EINTR(open(fn.c_str(), O_CREAT, 0775));
+    fd_ = HANDLE_EINTR(open(fn.c_str(), O_CREAT | O_CLOEXEC, 0775));
     if (fd_ < 0 || HANDLE_EINTR(flock(fd_, LOCK_EX)) < 0) {
       LOGE("Failed to lock file %s, errno=%d", fn.c_str(), errno);
     }
@@ -84,178 +96,447 @@ private:
 };
 
 std::unordered_map<std::string, uint32_t> keys = {
-    {"AccessToken", CLEAR_ON_MANAGER_START | DONT_LOG},
-    {"AdjustableFollowDistance", PERSISTENT},
-    {"AdjustableFollowDistanceProfile", PERSISTENT},
-    {"AssistNowToken", PERSISTENT},
-    {"AthenadPid", PERSISTENT},
-    {"AthenadUploadQueue", PERSISTENT},
-    {"BackButton", PERSISTENT},
-    {"CalibrationParams", PERSISTENT},
-    {"CameraDebugExpGain", CLEAR_ON_MANAGER_START},
-    {"CameraDebugExpTime", CLEAR_ON_MANAGER_START},
-    {"CarBatteryCapacity", PERSISTENT},
-    {"CarParams", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"CarParamsCache", CLEAR_ON_MANAGER_START},
-    {"CarParamsPersistent", PERSISTENT},
-    {"CarVin", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"Compass", PERSISTENT},
-    {"CompletedTrainingVersion", PERSISTENT},
-    {"ConditionalExperimentalMode", PERSISTENT},
-    {"ConditionalExperimentalModeCurves", PERSISTENT},
-    {"ConditionalExperimentalModeCurvesLead", PERSISTENT},
-    {"ConditionalExperimentalModeSignal", PERSISTENT},
-    {"ConditionalExperimentalModeSpeed", PERSISTENT},
-    {"ConditionalExperimentalModeSpeedLead", PERSISTENT},
-    {"ConditionalExperimentalModeStopLights", PERSISTENT},
-    {"ConditionalStatus", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"ControlsReady", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"CurrentBootlog", PERSISTENT},
-    {"CurrentRoute", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"CustomRoadUI", PERSISTENT},
-    {"DeviceShutdownTimer", PERSISTENT},
-    {"DisableInternetCheck", PERSISTENT},
-    {"DisableLogging", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"DisablePowerDown", PERSISTENT},
-    {"ExperimentalMode", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"ExperimentalModeConfirmed", PERSISTENT},
-    {"ExperimentalModeOverride", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"ExperimentalModeViaWheel", PERSISTENT},
-    {"ExperimentalLongitudinalEnabled", PERSISTENT},
-    {"ExperimentalPersonalTune", PERSISTENT},
-    {"DisableAd", PERSISTENT},
-    {"DisableUpdates", PERSISTENT},
-    {"DisengageOnAccelerator", PERSISTENT},
-    {"DongleId", PERSISTENT},
-    {"DoReboot", CLEAR_ON_MANAGER_START},
-    {"DoShutdown", CLEAR_ON_MANAGER_START},
-    {"DoUninstall", CLEAR_ON_MANAGER_START},
-    {"FireTheBabysitter", PERSISTENT},
-    {"FirmwareQueryDone", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"ForcePowerDown", CLEAR_ON_MANAGER_START},
-    {"FrogColors", PERSISTENT},
-    {"FrogIcons", PERSISTENT},
-    {"FrogPilotTogglesUpdated", CLEAR_ON_MANAGER_START | CLEAR_ON_OFFROAD_TRANSITION},
-    {"FrogSignals", PERSISTENT},
-    {"FrogSounds", PERSISTENT},
-    {"FrogTheme", PERSISTENT},
-    {"GitBranch", PERSISTENT},
-    {"GitCommit", PERSISTENT},
-    {"GitDiff", PERSISTENT},
-    {"GithubSshKeys", PERSISTENT},
-    {"GithubUsername", PERSISTENT},
-    {"GitRemote", PERSISTENT},
-    {"GsmApn", PERSISTENT},
-    {"GsmMetered", PERSISTENT},
-    {"GsmRoaming", PERSISTENT},
-    {"HardwareSerial", PERSISTENT},
-    {"HasAcceptedTerms", PERSISTENT},
-    {"IMEI", PERSISTENT},
-    {"InstallDate", PERSISTENT},
-    {"IsDriverViewEnabled", CLEAR_ON_MANAGER_START},
-    {"IsEngaged", PERSISTENT},
-    {"IsLdwEnabled", PERSISTENT},
-    {"IsMetric", PERSISTENT},
-    {"IsOffroad", CLEAR_ON_MANAGER_START},
-    {"IsOnroad", PERSISTENT},
-    {"IsRhdDetected", PERSISTENT},
-    {"IsTakingSnapshot", CLEAR_ON_MANAGER_START},
-    {"IsTestedBranch", CLEAR_ON_MANAGER_START},
-    {"IsReleaseBranch", CLEAR_ON_MANAGER_START},
-    {"IsUpdateAvailable", CLEAR_ON_MANAGER_START},
-    {"JoystickDebugMode", CLEAR_ON_MANAGER_START | CLEAR_ON_OFFROAD_TRANSITION},
-    {"LaikadEphemerisV3", PERSISTENT | DONT_LOG},
-    {"LaneDetection", PERSISTENT},
-    {"LaneLinesWidth", PERSISTENT},
-    {"LanguageSetting", PERSISTENT},
-    {"LastAthenaPingTime", CLEAR_ON_MANAGER_START},
-    {"LastGPSPosition", PERSISTENT},
-    {"LastManagerExitReason", CLEAR_ON_MANAGER_START},
-    {"LastPowerDropDetected", CLEAR_ON_MANAGER_START},
-    {"LastSystemShutdown", CLEAR_ON_MANAGER_START},
-    {"LastUpdateException", CLEAR_ON_MANAGER_START},
-    {"LastUpdateTime", PERSISTENT},
-    {"LiveParameters", PERSISTENT},
-    {"LiveTorqueCarParams", PERSISTENT},
-    {"LiveTorqueParameters", PERSISTENT | DONT_LOG},
-    {"MuteDM", PERSISTENT},
-    {"MuteDoor", PERSISTENT},
-    {"MuteSeatbelt", PERSISTENT},
-    {"MuteSystemOverheat", PERSISTENT},
-    {"NavDestination", CLEAR_ON_MANAGER_START | CLEAR_ON_OFFROAD_TRANSITION},
-    {"NavDestinationWaypoints", CLEAR_ON_MANAGER_START | CLEAR_ON_OFFROAD_TRANSITION},
-    {"NavSettingTime24h", PERSISTENT},
-    {"NavSettingLeftSide", PERSISTENT},
-    {"NavdRender", PERSISTENT},
-    {"NudgelessLaneChange", PERSISTENT},
-    {"NumericalTemp", PERSISTENT},
-    {"ObdMultiplexingChanged", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"ObdMultiplexingEnabled", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"OneLaneChange", PERSISTENT},
-    {"OpenpilotEnabledToggle", PERSISTENT},
-    {"PandaHeartbeatLost", CLEAR_ON_MANAGER_START | CLEAR_ON_OFFROAD_TRANSITION},
-    {"PandaSignatures", CLEAR_ON_MANAGER_START},
-    {"Passive", PERSISTENT},
-    {"PathEdgeWidth", PERSISTENT},
-    {"PathWidth", PERSISTENT},
-    {"PersonalTune", PERSISTENT},
-    {"PrimeType", PERSISTENT},
-    {"RecordFront", PERSISTENT},
-    {"RecordFrontLock", PERSISTENT},  // for the internal fleet
-    {"ReplayControlsState", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"RoadEdgesWidth", PERSISTENT},
-    {"RotatingWheel", PERSISTENT},
-    {"ScreenBrightness", PERSISTENT},
-    {"ShouldDoUpdate", CLEAR_ON_MANAGER_START},
-    {"SnoozeUpdate", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"Sidebar", PERSISTENT},
-    {"SshEnabled", PERSISTENT},
-    {"SteeringWheel", PERSISTENT},
-    {"SubscriberInfo", PERSISTENT},
-    {"TermsVersion", PERSISTENT},
-    {"Timezone", PERSISTENT},
-    {"TrainingVersion", PERSISTENT},
-    {"UbloxAvailable", PERSISTENT},
-    {"UnlimitedLength", PERSISTENT},
-    {"UpdateAvailable", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"Updated", PERSISTENT},
-    {"UpdateFailedCount", CLEAR_ON_MANAGER_START},
-    {"UpdaterState", CLEAR_ON_MANAGER_START},
-    {"UpdaterFetchAvailable", CLEAR_ON_MANAGER_START},
-    {"UpdaterTargetBranch", CLEAR_ON_MANAGER_START},
-    {"UpdaterAvailableBranches", CLEAR_ON_MANAGER_START},
-    {"UpdaterCurrentDescription", CLEAR_ON_MANAGER_START},
-    {"UpdaterCurrentReleaseNotes", CLEAR_ON_MANAGER_START},
-    {"UpdaterNewDescription", CLEAR_ON_MANAGER_START},
-    {"UpdaterNewReleaseNotes", CLEAR_ON_MANAGER_START},
-    {"Version", PERSISTENT},
-    {"VisionRadarToggle", PERSISTENT},
-    {"WideCameraDisable", PERSISTENT},
-    {"WideCameraOnly", PERSISTENT},
-    {"ApiCache_Device", PERSISTENT},
-    {"ApiCache_DriveStats", PERSISTENT},
-    {"ApiCache_NavDestinations", PERSISTENT},
-    {"ApiCache_Owner", PERSISTENT},
-    {"Offroad_BadNvme", CLEAR_ON_MANAGER_START},
-    {"Offroad_CarUnrecognized", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"Offroad_ConnectivityNeeded", CLEAR_ON_MANAGER_START},
-    {"Offroad_ConnectivityNeededPrompt", CLEAR_ON_MANAGER_START},
-    {"Offroad_InvalidTime", CLEAR_ON_MANAGER_START},
-    {"Offroad_IsTakingSnapshot", CLEAR_ON_MANAGER_START},
-    {"Offroad_NeosUpdate", CLEAR_ON_MANAGER_START},
-    {"Offroad_NoFirmware", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
-    {"Offroad_StorageMissing", CLEAR_ON_MANAGER_START},
-    {"Offroad_TemperatureTooHigh", CLEAR_ON_MANAGER_START},
-    {"Offroad_UnofficialHardware", CLEAR_ON_MANAGER_START},
-    {"Offroad_UpdateFailed", CLEAR_ON_MANAGER_START},
+#define PARAM_KEY_ENTRY(name, flags, type) {#name, flags},
+  PARAMS_KEYS(PARAM_KEY_ENTRY)
+#undef PARAM_KEY_ENTRY
+};
+
+// keys that are read or written outside Params, by sshd, the installer and the QFileSystemWatcher of
+// the software settings. they stay a file per key with the log
+const std::unordered_set<std::string> FILE_KEYS = {
+  "GithubSshKeys", "SshEnabled", "RecordFrontLock",
+  "LastUpdateTime", "UpdateFailedCount", "UpdaterState", "UpdateAvailable",
 };
 
+// events for a key being written or removed, put renames the value into place
+const uint32_t PARAMS_WATCH_MASK = IN_MOVED_TO | IN_MOVED_FROM | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE;
+// events for the log being appended to or replaced by compaction
+const uint32_t PARAMS_LOG_WATCH_MASK = IN_MODIFY | IN_MOVED_TO;
+
+const uint32_t LOG_RECORD_MAGIC = 0x314d5250;  // "PRM1"
+const uint8_t LOG_OP_PUT = 1;
+const uint8_t LOG_OP_REMOVE = 2;
+// compacted once past this and twice the size of the current values
+const size_t LOG_COMPACT_MIN_SIZE = 256 * 1024;
+
+struct LogRecordHeader {
+  uint32_t magic;
+  uint32_t size;  // of the entries after the header
+  uint32_t crc;   // of the entries
+};
+
+uint32_t crc32(const char *data, size_t size) {
+  static const auto table = [] {
+    std::array<uint32_t, 256> t;
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < size; i++) {
+    crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFF;
+}
+
+// reads the pending events of an inotify fd, calls f with the name of each, or "" when the queue overflowed
+template <class F>
+bool read_inotify_events(int fd, F f) {
+  alignas(struct inotify_event) char buf[4096];
+  ssize_t len = HANDLE_EINTR(read(fd, buf, sizeof(buf)));
+  if (len <= 0) return false;
+
+  for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+    const struct inotify_event *event = (struct inotify_event *)p;
+    if (event->mask & IN_Q_OVERFLOW) {
+      f(std::string());
+    } else if (event->len > 0 && event->name[0] != '.') {
+      f(std::string(event->name));
+    }
+  }
+  return true;
+}
+
 } // namespace
 
+// Params in a single append-only file instead of a file per key. A write of any number of keys is
+// one checksummed record, appended with one write and one fdatasync. Readers replay the records
+// appended since they last looked, a record that is incomplete or fails its checksum ends the log
+// and is cut off by the next write. Once the file is mostly overwritten values, it's compacted into
+// a new file with one record of the current values, which replaces it with a rename.
+// Entries of a record are an op byte, the key and value sizes as uint32 and the key and value.
+class ParamsLog {
+public:
+  // std::nullopt removes the key
+  typedef std::vector<std::pair<std::string, std::optional<std::string>>> Batch;
+
+  // returns the log at path, shared by the process. If it doesn't exist yet, it's created with the
+  // per-file params in import_dir except FILE_KEYS, which are left as they are.
+  static ParamsLog *get(const std::string &path, const std::string &lock_path, const std::string &import_dir) {
+    static std::mutex lock;
+    static std::unordered_map<std::string, ParamsLog *> logs;
+
+    std::lock_guard lk(lock);
+    auto it = logs.find(path);
+    if (it != logs.end()) return it->second;
+
+    ParamsLog *log = new ParamsLog(path, lock_path);
+    if (!util::file_exists(path)) {
+      FileLock file_lock(lock_path);
+      if (!util::file_exists(path)) {
+        log->values = util::read_files_in_dir(import_dir);
+        for (auto &key : FILE_KEYS) log->values.erase(key);
+        if (log->write_snapshot() != 0) {
+          LOGE("Failed to create params log %s, errno=%d", path.c_str(), errno);
+        }
+      }
+    }
+    return logs[path] = log;
+  }
+
+  std::string get(const std::string &key) {
+    std::lock_guard lk(lock);
+    refresh();
+    auto it = values.find(key);
+    return it == values.end() ? std::string() : it->second;
+  }
 
-Params::Params(const std::string &path) {
+  std::map<std::string, std::string> readAll() {
+    std::lock_guard lk(lock);
+    refresh();
+    return values;
+  }
+
+  int write(const Batch &batch) {
+    std::lock_guard lk(lock);
+    FileLock file_lock(lock_path);
+    if (!refresh()) return -1;
+    return append(batch);
+  }
+
+  // removes the keys remove returns true for
+  int remove_if(std::function<bool(const std::string &key)> remove) {
+    std::lock_guard lk(lock);
+    FileLock file_lock(lock_path);
+    if (!refresh()) return -1;
+
+    Batch batch;
+    for (auto &[key, value] : values) {
+      if (remove(key)) batch.push_back({key, std::nullopt});
+    }
+    return batch.empty() ? 0 : append(batch);
+  }
+
+private:
+  ParamsLog(const std::string &log_path, const std::string &lock_file) : path(log_path), lock_path(lock_file) {
+    dir = path.substr(0, path.rfind('/'));
+  }
+
+  // reads what was appended since the last time, or all of it if the file was replaced
+  bool refresh() {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+
+    if (fd < 0 || st.st_ino != ino) {
+      if (fd >= 0) close(fd);
+      fd = HANDLE_EINTR(open(path.c_str(), O_RDWR | O_CLOEXEC));
+      if (fd < 0) return false;
+      ino = st.st_ino;
+      valid_size = 0;
+      live_size = 0;
+      values.clear();
+    }
+    file_size = st.st_size;
+    if (file_size <= valid_size) return true;
+
+    std::string buf(file_size - valid_size, '\0');
+    ssize_t len = HANDLE_EINTR(pread(fd, buf.data(), buf.size(), valid_size));
+    size_t pos = 0;
+    while (len > 0 && pos + sizeof(LogRecordHeader) <= (size_t)len) {
+      LogRecordHeader header;
+      memcpy(&header, buf.data() + pos, sizeof(header));
+      const char *entries = buf.data() + pos + sizeof(header);
+      if (header.magic != LOG_RECORD_MAGIC || pos + sizeof(header) + header.size > (size_t)len ||
+          crc32(entries, header.size) != header.crc) {
+        break;
+      }
+      apply(entries, header.size);
+      pos += sizeof(header) + header.size;
+    }
+    valid_size += pos;
+    return true;
+  }
+
+  void apply(const char *entries, size_t size) {
+    size_t pos = 0;
+    while (pos + 9 <= size) {
+      uint8_t op = entries[pos];
+      uint32_t key_size, value_size;
+      memcpy(&key_size, entries + pos + 1, 4);
+      memcpy(&value_size, entries + pos + 5, 4);
+      pos += 9;
+      if (pos + key_size + value_size > size) break;
+
+      std::string key(entries + pos, key_size);
+      auto it = values.find(key);
+      if (it != values.end()) {
+        live_size -= 9 + key.size() + it->second.size();
+      }
+      if (op == LOG_OP_PUT) {
+        live_size += 9 + key_size + value_size;
+        values[key].assign(entries + pos + key_size, value_size);
+      } else if (it != values.end()) {
+        values.erase(it);
+      }
+      pos += key_size + value_size;
+    }
+  }
+
+  static void encode(std::string &record, uint8_t op, const std::string &key, const std::string &value) {
+    const uint32_t sizes[2] = {(uint32_t)key.size(), (uint32_t)value.size()};
+    record.push_back(op);
+    record.append((const char *)sizes, sizeof(sizes));
+    record.append(key);
+    record.append(value);
+  }
+
+  static void finish_record(std::string &record) {
+    LogRecordHeader header = {.magic = LOG_RECORD_MAGIC, .size = (uint32_t)(record.size() - sizeof(LogRecordHeader))};
+    header.crc = crc32(record.data() + sizeof(header), header.size);
+    memcpy(record.data(), &header, sizeof(header));
+  }
+
+  // with both locks held and the values refreshed
+  int append(const Batch &batch) {
+    std::string record(sizeof(LogRecordHeader), '\0');
+    for (auto &[key, value] : batch) {
+      encode(record, value ? LOG_OP_PUT : LOG_OP_REMOVE, key, value ? *value : std::string());
+    }
+    finish_record(record);
+
+    // cut off what's left of a write that didn't complete
+    if (file_size > valid_size && ftruncate(fd, valid_size) != 0) return -1;
+
+    ssize_t written = HANDLE_EINTR(pwrite(fd, record.data(), record.size(), valid_size));
+    if (written < 0 || (size_t)written != record.size()) {
+      file_size = valid_size + std::max<ssize_t>(written, 0);
+      return -20;
+    }
+    if (fdatasync(fd) < 0) return -1;
+
+    apply(record.data() + sizeof(LogRecordHeader), record.size() - sizeof(LogRecordHeader));
+    valid_size += record.size();
+    file_size = valid_size;
+
+    if ((size_t)valid_size > LOG_COMPACT_MIN_SIZE && (size_t)valid_size > 2 * live_size) {
+      if (write_snapshot() != 0) {
+        LOGE("Failed to compact params log %s, errno=%d", path.c_str(), errno);
+      }
+    }
+    return 0;
+  }
+
+  // replaces the file with one record of the current values, with the file lock held
+  int write_snapshot() {
+    std::string record(sizeof(LogRecordHeader), '\0');
+    for (auto &[key, value] : values) {
+      encode(record, LOG_OP_PUT, key, value);
+    }
+    finish_record(record);
+
+    std::string tmp_path = dir + "/.tmp_log_XXXXXX";
+    int tmp_fd = mkstemp((char *)tmp_path.c_str());
+    if (tmp_fd < 0) return -1;
+
+    int result = -1;
+    do {
+      ssize_t written = HANDLE_EINTR(::write(tmp_fd, record.data(), record.size()));
+      if (written < 0 || (size_t)written != record.size()) {
+        result = -20;
+        break;
+      }
+      if ((result = fsync(tmp_fd)) < 0) break;
+      if ((result = rename(tmp_path.c_str(), path.c_str())) < 0) break;
+      result = fsync_dir(dir);
+
+      // the new file, already read
+      struct stat st;
+      if (fd >= 0) close(fd);
+      fd = tmp_fd;
+      tmp_fd = -1;
+      fstat(fd, &st);
+      ino = st.st_ino;
+      valid_size = file_size = record.size();
+      live_size = record.size() - sizeof(LogRecordHeader);
+    } while (false);
+
+    if (tmp_fd >= 0) {
+      close(tmp_fd);
+      ::unlink(tmp_path.c_str());
+    }
+    return result;
+  }
+
+  std::mutex lock;
+  std::string path, lock_path, dir;
+  int fd = -1;
+  ino_t ino = 0;
+  off_t file_size = 0;
+  off_t valid_size = 0;  // end of the last complete record
+  size_t live_size = 0;  // of the current values as entries
+  std::map<std::string, std::string> values;
+};
+
+// Cached values and subscriptions of a params directory, one per directory for the process. It is
+// never destroyed, the thread blocks in read on the inotify fd until the process exits. With a log,
+// dir is the one the log is in, and changed keys are found by comparing its values.
+class ParamsWatcher {
+public:
+  // returns the watcher of dir, starting it if create
+  static ParamsWatcher *get(const std::string &dir, bool create = true, ParamsLog *log = nullptr) {
+    static std::mutex lock;
+    static std::unordered_map<std::string, ParamsWatcher *> watchers;
+
+    std::lock_guard lk(lock);
+    auto it = watchers.find(dir);
+    if (it != watchers.end()) return it->second;
+    if (!create) return nullptr;
+
+    // the watch is added before any value is cached, so no change can be missed
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dir.c_str(), log ? PARAMS_LOG_WATCH_MASK : PARAMS_WATCH_MASK) < 0) {
+      LOGE("Failed to watch params %s, errno=%d", dir.c_str(), errno);
+      if (fd >= 0) close(fd);
+      return nullptr;
+    }
+    ParamsWatcher *watcher = new ParamsWatcher();
+    if (log) {
+      watcher->log = log;
+      watcher->log_values = log->readAll();
+    }
+    std::thread(&ParamsWatcher::watch, watcher, fd).detach();
+    return watchers[dir] = watcher;
+  }
+
+  bool lookup(const std::string &key, std::string &value, uint64_t &gen) {
+    std::lock_guard lk(lock);
+    gen = generation;
+    auto it = values.find(key);
+    if (it == values.end()) return false;
+    value = it->second;
+    return true;
+  }
+
+  // value was read after lookup returned gen, it's stale if anything changed since
+  void store(const std::string &key, const std::string &value, uint64_t gen) {
+    std::lock_guard lk(lock);
+    if (gen == generation) {
+      values[key] = value;
+    }
+  }
+
+  // key changed, or all keys if empty
+  void invalidate(const std::string &key) {
+    std::lock_guard lk(lock);
+    generation++;
+    if (key.empty()) {
+      values.clear();
+    } else {
+      values.erase(key);
+    }
+  }
+
+  int subscribe(const std::string &key, std::function<void(const std::string &key)> callback) {
+    std::lock_guard lk(lock);
+    // unique across the watchers, Params::unsubscribe doesn't know which one has it
+    static std::atomic<int> last_id = 0;
+    int id = ++last_id;
+    subscriptions[id] = {key, callback};
+    return id;
+  }
+
+  void unsubscribe(int id) {
+    std::lock_guard lk(lock);
+    subscriptions.erase(id);
+  }
+
+private:
+  struct Subscription {
+    std::string key;
+    std::function<void(const std::string &key)> callback;
+  };
+
+  void watch(int fd) {
+    std::vector<Subscription> notify;
+    std::vector<std::string> changed;
+    while (true) {
+      changed.clear();
+      if (!read_inotify_events(fd, [&](const std::string &key) { changed.push_back(key); })) {
+        LOGE("Failed to read params events, errno=%d", errno);
+        util::sleep_for(100);
+        continue;
+      }
+      if (log && !changed.empty()) {
+        changed_log_keys(changed);
+      }
+
+      for (const std::string &key : changed) {
+        invalidate(key);
+
+        // called without the lock, so callbacks can use Params
+        notify.clear();
+        {
+          std::lock_guard lk(lock);
+          for (auto &[id, sub] : subscriptions) {
+            if (key.empty() || sub.key == key) notify.push_back(sub);
+          }
+        }
+        for (auto &sub : notify) {
+          sub.callback(sub.key);
+        }
+      }
+    }
+  }
+
+  // replaces changed with the keys whose values differ from the last time
+  void changed_log_keys(std::vector<std::string> &changed) {
+    changed.clear();
+    std::map<std::string, std::string> current = log->readAll();
+    for (auto &[key, value] : current) {
+      auto it = log_values.find(key);
+      if (it == log_values.end() || it->second != value) changed.push_back(key);
+    }
+    for (auto &[key, value] : log_values) {
+      if (current.find(key) == current.end()) changed.push_back(key);
+    }
+    log_values = std::move(current);
+  }
+
+  ParamsLog *log = nullptr;
+  std::map<std::string, std::string> log_values;
+
+  std::mutex lock;
+  uint64_t generation = 0;
+  std::unordered_map<std::string, std::string> values;
+  std::map<int, Subscription> subscriptions;
+};
+
+
+Params::Params(const std::string &path, bool cached) {
   prefix = "/" + util::getenv("OPENPILOT_PREFIX", "d");
   params_path = ensure_params_path(prefix, path);
+  key_dir = getParamPath() + "/";
+
+  if (util::getenv("OPENPILOT_PARAMS_LOG", 0)) {
+    log = ParamsLog::get(params_path + prefix + ".log", params_path + "/.lock", getParamPath());
+  } else if (cached) {
+    // the log is already in memory
+    watcher = ParamsWatcher::get(getParamPath());
+  }
 }
 
 std::vector<std::string> Params::allKeys() const {
@@ -274,7 +555,15 @@ ParamKeyType Params::getKeyType(const std::string &key) {
   return static_cast<ParamKeyType>(keys[key]);
 }
 
+ParamsLog *Params::logOf(const std::string &key) const {
+  return log && FILE_KEYS.find(key) == FILE_KEYS.end() ? log : nullptr;
+}
+
 int Params::put(const char* key, const char* value, size_t value_size) {
+  if (ParamsLog *l = logOf(key)) {
+    return l->write({{key, std::string(value, value_size)}});
+  }
+
   // Information about safely and atomically writing a file: https://lwn.net/Articles/457667/
   // 1) Create temp file
   // 2) Write data to temp file
@@ -297,31 +586,153 @@ int Params::put(const char* key, const char* value, size_t value_size) {
     // fsync to force persist the changes.
     if ((result = fsync(tmp_fd)) < 0) break;
 
+    // closed before the rename, so watchers of the directory get a single event
+    close(tmp_fd);
+    tmp_fd = -1;
+
     FileLock file_lock(params_path + "/.lock");
 
     // Move temp into place.
     if ((result = rename(tmp_path.c_str(), getParamPath(key).c_str())) < 0) break;
+    invalidate_cached(key);
 
     // fsync parent directory
     result = fsync_dir(getParamPath());
   } while (false);
 
-  close(tmp_fd);
+  if (tmp_fd >= 0) close(tmp_fd);
   ::unlink(tmp_path.c_str());
   return result;
 }
 
+int Params::putBatch(const std::map<std::string, std::string> &values) {
+  ParamsLog::Batch batch;
+  std::vector<std::pair<std::string, std::string>> tmp_paths;  // temp file, key
+  int result = 0;
+  for (auto &[key, value] : values) {
+    if (logOf(key)) {
+      batch.push_back({key, value});
+      continue;
+    }
+
+    // same as put, up to the rename
+    std::string tmp_path = params_path + "/.tmp_value_XXXXXX";
+    int tmp_fd = mkstemp((char*)tmp_path.c_str());
+    if (tmp_fd < 0) {
+      result = -1;
+      break;
+    }
+    tmp_paths.push_back({tmp_path, key});
+
+    ssize_t bytes_written = HANDLE_EINTR(write(tmp_fd, value.data(), value.size()));
+    if (bytes_written < 0 || (size_t)bytes_written != value.size()) {
+      result = -20;
+    } else {
+      result = fsync(tmp_fd);
+    }
+    close(tmp_fd);
+    if (result < 0) break;
+  }
+
+  // a single record in the log
+  if (result == 0 && !batch.empty()) {
+    result = log->write(batch);
+  }
+
+  // the renames under one lock, which readAll takes as well, and one fsync of the directory
+  if (result == 0 && !tmp_paths.empty()) {
+    FileLock file_lock(params_path + "/.lock");
+    for (auto &[tmp_path, key] : tmp_paths) {
+      if ((result = rename(tmp_path.c_str(), getParamPath(key).c_str())) < 0) break;
+      invalidate_cached(key);
+    }
+    if (result == 0) {
+      result = fsync_dir(getParamPath());
+    }
+  }
+
+  for (auto &[tmp_path, key] : tmp_paths) {
+    ::unlink(tmp_path.c_str());
+  }
+  return result;
+}
+
+void Params::readShort(ParamKey key, char *buf, size_t size) {
+  buf[0] = '\0';
+  static const std::vector<std::string> key_strings(std::begin(PARAM_KEY_NAMES), std::end(PARAM_KEY_NAMES));
+  if (logOf(key_strings[(int)key]) || watcher) {
+    // short values fit in the string itself, so this doesn't allocate either
+    std::string value = get(key_strings[(int)key]);
+    if (value.size() < size) {
+      memcpy(buf, value.c_str(), value.size() + 1);
+    }
+    return;
+  }
+
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s%s", key_dir.c_str(), PARAM_KEY_NAMES[(int)key]) >= (int)sizeof(path)) return;
+  int fd = HANDLE_EINTR(open(path, O_RDONLY | O_CLOEXEC));
+  if (fd < 0) return;
+  ssize_t len = HANDLE_EINTR(read(fd, buf, size));
+  close(fd);
+  buf[(len > 0 && (size_t)len < size) ? len : 0] = '\0';
+}
+
+template <>
+bool Params::getValue<bool>(ParamKey key) {
+  char buf[16];
+  readShort(key, buf, sizeof(buf));
+  return strcmp(buf, "1") == 0;
+}
+
+template <>
+int Params::getValue<int>(ParamKey key) {
+  char buf[32];
+  readShort(key, buf, sizeof(buf));
+  return strtol(buf, nullptr, 10);
+}
+
+template <>
+float Params::getValue<float>(ParamKey key) {
+  char buf[64];
+  readShort(key, buf, sizeof(buf));
+  return strtof(buf, nullptr);
+}
+
+template <>
+std::string Params::getValue<std::string>(ParamKey key) {
+  return get(PARAM_KEY_NAMES[(int)key]);
+}
+
 int Params::remove(const std::string &key) {
+  if (ParamsLog *l = logOf(key)) {
+    return l->write({{key, std::nullopt}});
+  }
+
   FileLock file_lock(params_path + "/.lock");
   int result = unlink(getParamPath(key).c_str());
   if (result != 0) {
     return result;
   }
+  invalidate_cached(key);
   return fsync_dir(getParamPath());
 }
 
 std::string Params::get(const std::string &key, bool block) {
+  ParamsLog *l = logOf(key);
   if (!block) {
+    if (l) {
+      return l->get(key);
+    }
+    if (watcher) {
+      std::string value;
+      uint64_t generation;
+      if (!watcher->lookup(key, value, generation)) {
+        value = util::read_file(getParamPath(key));
+        watcher->store(key, value, generation);
+      }
+      return value;
+    }
     return util::read_file(getParamPath(key));
   } else {
     // blocking read until successful
@@ -329,14 +740,31 @@ std::string Params::get(const std::string &key, bool block) {
     void (*prev_handler_sigint)(int) = std::signal(SIGINT, params_sig_handler);
     void (*prev_handler_sigterm)(int) = std::signal(SIGTERM, params_sig_handler);
 
+    // woken up by writes to the directory, falls back to polling if it can't be watched
+    int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    const std::string watch_path = l ? params_path : getParamPath();
+    if (fd >= 0 && inotify_add_watch(fd, watch_path.c_str(), l ? PARAMS_LOG_WATCH_MASK : PARAMS_WATCH_MASK) < 0) {
+      close(fd);
+      fd = -1;
+    }
+
     std::string value;
     while (!params_do_exit) {
-      if (value = util::read_file(getParamPath(key)); !value.empty()) {
+      if (value = l ? l->get(key) : util::read_file(getParamPath(key)); !value.empty()) {
         break;
       }
-      util::sleep_for(100);  // 0.1 s
+      if (fd >= 0) {
+        // the timeout is for a signal that comes right before poll
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (poll(&pfd, 1, 100) > 0) {
+          read_inotify_events(fd, [](const std::string &) {});
+        }
+      } else {
+        util::sleep_for(100);  // 0.1 s
+      }
     }
 
+    if (fd >= 0) close(fd);
     std::signal(SIGINT, prev_handler_sigint);
     std::signal(SIGTERM, prev_handler_sigterm);
     return value;
@@ -344,11 +772,29 @@ std::string Params::get(const std::string &key, bool block) {
 }
 
 std::map<std::string, std::string> Params::readAll() {
+  if (log) {
+    std::map<std::string, std::string> values = log->readAll();
+    for (auto &key : FILE_KEYS) {
+      if (std::string value = util::read_file(getParamPath(key)); !value.empty()) {
+        values[key] = value;
+      }
+    }
+    return values;
+  }
+
   FileLock file_lock(params_path + "/.lock");
   return util::read_files_in_dir(getParamPath());
 }
 
 void Params::clearAll(ParamKeyType key_type) {
+  // with the log, the files are FILE_KEYS and what the log was created from
+  if (log) {
+    log->remove_if([&](const std::string &key) {
+      auto it = keys.find(key);
+      return it == keys.end() || (it->second & key_type);
+    });
+  }
+
   FileLock file_lock(params_path + "/.lock");
 
   // 1) delete params of key_type
@@ -365,6 +811,29 @@ void Params::clearAll(ParamKeyType key_type) {
     }
     closedir(d);
   }
+  invalidate_cached({});
 
   fsync_dir(getParamPath());
 }
+
+int Params::subscribe(const std::string &key, std::function<void(const std::string &key)> callback) {
+  ParamsLog *l = logOf(key);
+  ParamsWatcher *w = l ? ParamsWatcher::get(params_path, true, l) : ParamsWatcher::get(getParamPath());
+  return w ? w->subscribe(key, callback) : -1;
+}
+
+void Params::unsubscribe(int id) {
+  // FILE_KEYS are watched in the directory even with the log
+  for (const std::string &dir : {params_path, getParamPath()}) {
+    if (ParamsWatcher *w = ParamsWatcher::get(dir, false)) {
+      w->unsubscribe(id);
+    }
+  }
+}
+
+void Params::invalidate_cached(const std::string &key) {
+  // any cache of the directory, not only this one's
+  if (ParamsWatcher *w = watcher ? watcher : ParamsWatcher::get(getParamPath(), false)) {
+    w->invalidate(key);
+  }
+}
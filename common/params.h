@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
@@ -13,9 +14,23 @@ enum ParamKeyType {
   ALL = 0xFFFFFFFF
 };
 
+#include "common/params_keys.h"
+
+class ParamsLog;
+class ParamsWatcher;
+
 class Params {
 public:
-  Params(const std::string &path = {});
+  // Params are a file per key in getParamPath(), or with OPENPILOT_PARAMS_LOG=1, entries in a single
+  // log file next to it, see ParamsLog. The log is created with the values of the files, which aren't
+  // updated after that, so it has to be set for every process. Keys that are read outside Params,
+  // e.g. by sshd, stay a file per key.
+  // With cached, values are read from a cache shared by the process, which an inotify watcher thread
+  // updates as the params directory changes. For readers that poll, a read is then a map lookup
+  // instead of an open/read/close. Writes through any Params of the process are seen right away,
+  // writes by other processes once the watcher has handled them, usually within a millisecond.
+  // The log is read from memory after a stat either way, so it isn't cached.
+  Params(const std::string &path = {}, bool cached = false);
   std::vector<std::string> allKeys() const;
   bool checkKey(const std::string &key);
   ParamKeyType getKeyType(const std::string &key);
@@ -27,7 +42,7 @@ public:
   int remove(const std::string &key);
   void clearAll(ParamKeyType type);
 
-  // helpers for reading values
+  // helpers for reading values, a blocking get wakes up on writes to the params directory
   std::string get(const std::string &key, bool block = false);
   inline bool getBool(const std::string &key, bool block = false) {
     return get(key, block) == "1";
@@ -42,6 +57,16 @@ public:
   }
   std::map<std::string, std::string> readAll();
 
+  // typed access to a key, a bool, int or float is read without allocating
+  template <ParamKey K>
+  inline typename ParamKeyTraits<K>::Type get() {
+    return getValue<typename ParamKeyTraits<K>::Type>(K);
+  }
+  template <ParamKey K>
+  inline int put(const typename ParamKeyTraits<K>::Type &val) {
+    return putValue(K, val);
+  }
+
   // helpers for writing values
   int put(const char *key, const char *val, size_t value_size);
   inline int put(const std::string &key, const std::string &val) {
@@ -56,8 +81,37 @@ public:
   inline int putInt(const std::string &key, int val) {
     return put(key.c_str(), std::to_string(val).c_str(), std::to_string(val).size());
   }
+  // writes all values at once, e.g. the settings of a screen. With the log they're a single record
+  // with a single fsync, files are renamed into place under one lock. Either way readAll sees all of
+  // them or none.
+  int putBatch(const std::map<std::string, std::string> &values);
+
+  // Calls callback from the watcher thread each time key is written or removed, by any process,
+  // until unsubscribed with the returned id. Callbacks of a key run in order, one at a time.
+  int subscribe(const std::string &key, std::function<void(const std::string &key)> callback);
+  void unsubscribe(int id);
 
 private:
+  template <class T>
+  T getValue(ParamKey key);
+  // reads a value that fits in buf, "" if missing or longer
+  void readShort(ParamKey key, char *buf, size_t size);
+  inline int putValue(ParamKey key, bool val) { return putBool(PARAM_KEY_NAMES[(int)key], val); }
+  inline int putValue(ParamKey key, int val) { return putInt(PARAM_KEY_NAMES[(int)key], val); }
+  inline int putValue(ParamKey key, float val) { return putFloat(PARAM_KEY_NAMES[(int)key], val); }
+  inline int putValue(ParamKey key, const std::string &val) { return put(PARAM_KEY_NAMES[(int)key], val); }
+  void invalidate_cached(const std::string &key);
+  // the log, unless key isn't stored in it
+  ParamsLog *logOf(const std::string &key) const;
+
   std::string params_path;
   std::string prefix;
+  std::string key_dir;  // getParamPath() + "/"
+  ParamsLog *log = nullptr;
+  ParamsWatcher *watcher = nullptr;  // only when cached
 };
+
+template <> bool Params::getValue<bool>(ParamKey key);
+template <> int Params::getValue<int>(ParamKey key);
+template <> float Params::getValue<float>(ParamKey key);
+template <> std::string Params::getValue<std::string>(ParamKey key);
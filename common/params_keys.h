@@ -0,0 +1,199 @@
+#pragma once
+
+#include <string>
+
+// Every param with its ParamKeyType flags and the type of its value. params.cc builds its table of
+// keys from this list, and Params::get<ParamKey::Name>() returns the type of the key, so a
+// misspelled key is a compile error.
+#define PARAMS_KEYS(X) \
+  X(AccessToken,                           CLEAR_ON_MANAGER_START | DONT_LOG,                    std::string) \
+  X(AdjustableFollowDistance,              PERSISTENT,                                           bool) \
+  X(AdjustableFollowDistanceProfile,       PERSISTENT,                                           int) \
+  X(AssistNowToken,                        PERSISTENT,                                           std::string) \
+  X(AthenadPid,                            PERSISTENT,                                           int) \
+  X(AthenadUploadQueue,                    PERSISTENT,                                           std::string) \
+  X(BackButton,                            PERSISTENT,                                           bool) \
+  X(CalibrationParams,                     PERSISTENT,                                           std::string) \
+  X(CameraDebugExpGain,                    CLEAR_ON_MANAGER_START,                               std::string) \
+  X(CameraDebugExpTime,                    CLEAR_ON_MANAGER_START,                               std::string) \
+  X(CarBatteryCapacity,                    PERSISTENT,                                           int) \
+  X(CarParams,                             CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  std::string) \
+  X(CarParamsCache,                        CLEAR_ON_MANAGER_START,                               std::string) \
+  X(CarParamsPersistent,                   PERSISTENT,                                           std::string) \
+  X(CarVin,                                CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  std::string) \
+  X(Compass,                               PERSISTENT,                                           bool) \
+  X(CompletedTrainingVersion,              PERSISTENT,                                           std::string) \
+  X(ConditionalExperimentalMode,           PERSISTENT,                                           bool) \
+  X(ConditionalExperimentalModeCurves,     PERSISTENT,                                           bool) \
+  X(ConditionalExperimentalModeCurvesLead, PERSISTENT,                                           bool) \
+  X(ConditionalExperimentalModeSignal,     PERSISTENT,                                           bool) \
+  X(ConditionalExperimentalModeSpeed,      PERSISTENT,                                           int) \
+  X(ConditionalExperimentalModeSpeedLead,  PERSISTENT,                                           int) \
+  X(ConditionalExperimentalModeStopLights, PERSISTENT,                                           bool) \
+  X(ConditionalStatus,                     CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  int) \
+  X(ControlsReady,                         CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  bool) \
+  X(CurrentBootlog,                        PERSISTENT,                                           std::string) \
+  X(CurrentRoute,                          CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  std::string) \
+  X(CustomRoadUI,                          PERSISTENT,                                           bool) \
+  X(DeviceShutdownTimer,                   PERSISTENT,                                           int) \
+  X(DisableInternetCheck,                  PERSISTENT,                                           bool) \
+  X(DisableLogging,                        CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  bool) \
+  X(DisablePowerDown,                      PERSISTENT,                                           bool) \
+  X(ExperimentalMode,                      CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  bool) \
+  X(ExperimentalModeConfirmed,             PERSISTENT,                                           bool) \
+  X(ExperimentalModeOverride,              CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  int) \
+  X(ExperimentalModeViaWheel,              PERSISTENT,                                           bool) \
+  X(ExperimentalLongitudinalEnabled,       PERSISTENT,                                           bool) \
+  X(ExperimentalPersonalTune,              PERSISTENT,                                           bool) \
+  X(DisableAd,                             PERSISTENT,                                           bool) \
+  X(DisableUpdates,                        PERSISTENT,                                           bool) \
+  X(DisengageOnAccelerator,                PERSISTENT,                                           bool) \
+  X(DongleId,                              PERSISTENT,                                           std::string) \
+  X(DoReboot,                              CLEAR_ON_MANAGER_START,                               bool) \
+  X(DoShutdown,                            CLEAR_ON_MANAGER_START,                               bool) \
+  X(DoUninstall,                           CLEAR_ON_MANAGER_START,                               bool) \
+  X(FireTheBabysitter,                     PERSISTENT,                                           bool) \
+  X(FirmwareQueryDone,                     CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  bool) \
+  X(ForcePowerDown,                        CLEAR_ON_MANAGER_START,                               bool) \
+  X(FrogColors,                            PERSISTENT,                                           bool) \
+  X(FrogIcons,                             PERSISTENT,                                           bool) \
+  X(FrogPilotTogglesUpdated,               CLEAR_ON_MANAGER_START | CLEAR_ON_OFFROAD_TRANSITION, bool) \
+  X(FrogSignals,                           PERSISTENT,                                           bool) \
+  X(FrogSounds,                            PERSISTENT,                                           bool) \
+  X(FrogTheme,                             PERSISTENT,                                           bool) \
+  X(GitBranch,                             PERSISTENT,                                           std::string) \
+  X(GitCommit,                             PERSISTENT,                                           std::string) \
+  X(GitDiff,                               PERSISTENT,                                           std::string) \
+  X(GithubSshKeys,                         PERSISTENT,                                           std::string) \
+  X(GithubUsername,                        PERSISTENT,                                           std::string) \
+  X(GitRemote,                             PERSISTENT,                                           std::string) \
+  X(GsmApn,                                PERSISTENT,                                           std::string) \
+  X(GsmMetered,                            PERSISTENT,                                           bool) \
+  X(GsmRoaming,                            PERSISTENT,                                           bool) \
+  X(HardwareSerial,                        PERSISTENT,                                           std::string) \
+  X(HasAcceptedTerms,                      PERSISTENT,                                           std::string) \
+  X(IMEI,                                  PERSISTENT,                                           std::string) \
+  X(InstallDate,                           PERSISTENT,                                           std::string) \
+  X(IsDriverViewEnabled,                   CLEAR_ON_MANAGER_START,                               bool) \
+  X(IsEngaged,                             PERSISTENT,                                           bool) \
+  X(IsLdwEnabled,                          PERSISTENT,                                           bool) \
+  X(IsMetric,                              PERSISTENT,                                           bool) \
+  X(IsOffroad,                             CLEAR_ON_MANAGER_START,                               bool) \
+  X(IsOnroad,                              PERSISTENT,                                           bool) \
+  X(IsRhdDetected,                         PERSISTENT,                                           bool) \
+  X(IsTakingSnapshot,                      CLEAR_ON_MANAGER_START,                               bool) \
+  X(IsTestedBranch,                        CLEAR_ON_MANAGER_START,                               bool) \
+  X(IsReleaseBranch,                       CLEAR_ON_MANAGER_START,                               bool) \
+  X(IsUpdateAvailable,                     CLEAR_ON_MANAGER_START,                               std::string) \
+  X(JoystickDebugMode,                     CLEAR_ON_MANAGER_START | CLEAR_ON_OFFROAD_TRANSITION, bool) \
+  X(LaikadEphemerisV3,                     PERSISTENT | DONT_LOG,                                std::string) \
+  X(LaneDetection,                         PERSISTENT,                                           bool) \
+  X(LaneLinesWidth,                        PERSISTENT,                                           float) \
+  X(LanguageSetting,                       PERSISTENT,                                           std::string) \
+  X(LastAthenaPingTime,                    CLEAR_ON_MANAGER_START,                               std::string) \
+  X(LastGPSPosition,                       PERSISTENT,                                           std::string) \
+  X(LastManagerExitReason,                 CLEAR_ON_MANAGER_START,                               std::string) \
+  X(LastPowerDropDetected,                 CLEAR_ON_MANAGER_START,                               std::string) \
+  X(LastSystemShutdown,                    CLEAR_ON_MANAGER_START,                               std::string) \
+  X(LastUpdateException,                   CLEAR_ON_MANAGER_START,                               std::string) \
+  X(LastUpdateTime,                        PERSISTENT,                                           std::string) \
+  X(LiveParameters,                        PERSISTENT,                                           std::string) \
+  X(LiveTorqueCarParams,                   PERSISTENT,                                           std::string) \
+  X(LiveTorqueParameters,                  PERSISTENT | DONT_LOG,                                std::string) \
+  X(MuteDM,                                PERSISTENT,                                           bool) \
+  X(MuteDoor,                              PERSISTENT,                                           bool) \
+  X(MuteSeatbelt,                          PERSISTENT,                                           bool) \
+  X(MuteSystemOverheat,                    PERSISTENT,                                           bool) \
+  X(NavDestination,                        CLEAR_ON_MANAGER_START | CLEAR_ON_OFFROAD_TRANSITION, std::string) \
+  X(NavDestinationWaypoints,               CLEAR_ON_MANAGER_START | CLEAR_ON_OFFROAD_TRANSITION, std::string) \
+  X(NavSettingTime24h,                     PERSISTENT,                                           bool) \
+  X(NavSettingLeftSide,                    PERSISTENT,                                           bool) \
+  X(NavdRender,                            PERSISTENT,                                           std::string) \
+  X(NudgelessLaneChange,                   PERSISTENT,                                           bool) \
+  X(NumericalTemp,                         PERSISTENT,                                           bool) \
+  X(ObdMultiplexingChanged,                CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  bool) \
+  X(ObdMultiplexingEnabled,                CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  bool) \
+  X(OneLaneChange,                         PERSISTENT,                                           bool) \
+  X(OpenpilotEnabledToggle,                PERSISTENT,                                           bool) \
+  X(PandaHeartbeatLost,                    CLEAR_ON_MANAGER_START | CLEAR_ON_OFFROAD_TRANSITION, bool) \
+  X(PandaSignatures,                       CLEAR_ON_MANAGER_START,                               std::string) \
+  X(Passive,                               PERSISTENT,                                           bool) \
+  X(PathEdgeWidth,                         PERSISTENT,                                           int) \
+  X(PathWidth,                             PERSISTENT,                                           float) \
+  X(PersonalTune,                          PERSISTENT,                                           bool) \
+  X(PrimeType,                             PERSISTENT,                                           int) \
+  X(RecordFront,                           PERSISTENT,                                           bool) \
+  X(RecordFrontLock,                       PERSISTENT,                                           bool) \
+  X(ReplayControlsState,                   CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  std::string) \
+  X(RoadEdgesWidth,                        PERSISTENT,                                           float) \
+  X(RotatingWheel,                         PERSISTENT,                                           bool) \
+  X(ScreenBrightness,                      PERSISTENT,                                           int) \
+  X(ShouldDoUpdate,                        CLEAR_ON_MANAGER_START,                               std::string) \
+  X(SnoozeUpdate,                          CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  bool) \
+  X(Sidebar,                               PERSISTENT,                                           bool) \
+  X(SshEnabled,                            PERSISTENT,                                           bool) \
+  X(SteeringWheel,                         PERSISTENT,                                           int) \
+  X(SubscriberInfo,                        PERSISTENT,                                           std::string) \
+  X(TermsVersion,                          PERSISTENT,                                           std::string) \
+  X(Timezone,                              PERSISTENT,                                           std::string) \
+  X(TrainingVersion,                       PERSISTENT,                                           std::string) \
+  X(UbloxAvailable,                        PERSISTENT,                                           bool) \
+  X(UnlimitedLength,                       PERSISTENT,                                           bool) \
+  X(UpdateAvailable,                       CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  bool) \
+  X(Updated,                               PERSISTENT,                                           std::string) \
+  X(UpdateFailedCount,                     CLEAR_ON_MANAGER_START,                               int) \
+  X(UpdaterState,                          CLEAR_ON_MANAGER_START,                               std::string) \
+  X(UpdaterFetchAvailable,                 CLEAR_ON_MANAGER_START,                               bool) \
+  X(UpdaterTargetBranch,                   CLEAR_ON_MANAGER_START,                               std::string) \
+  X(UpdaterAvailableBranches,              CLEAR_ON_MANAGER_START,                               std::string) \
+  X(UpdaterCurrentDescription,             CLEAR_ON_MANAGER_START,                               std::string) \
+  X(UpdaterCurrentReleaseNotes,            CLEAR_ON_MANAGER_START,                               std::string) \
+  X(UpdaterNewDescription,                 CLEAR_ON_MANAGER_START,                               std::string) \
+  X(UpdaterNewReleaseNotes,                CLEAR_ON_MANAGER_START,                               std::string) \
+  X(Version,                               PERSISTENT,                                           std::string) \
+  X(VisionRadarToggle,                     PERSISTENT,                                           std::string) \
+  X(WideCameraDisable,                     PERSISTENT,                                           bool) \
+  X(WideCameraOnly,                        PERSISTENT,                                           bool) \
+  X(ApiCache_Device,                       PERSISTENT,                                           std::string) \
+  X(ApiCache_DriveStats,                   PERSISTENT,                                           std::string) \
+  X(ApiCache_NavDestinations,              PERSISTENT,                                           std::string) \
+  X(ApiCache_Owner,                        PERSISTENT,                                           std::string) \
+  X(Offroad_BadNvme,                       CLEAR_ON_MANAGER_START,                               std::string) \
+  X(Offroad_CarUnrecognized,               CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  std::string) \
+  X(Offroad_ConnectivityNeeded,            CLEAR_ON_MANAGER_START,                               std::string) \
+  X(Offroad_ConnectivityNeededPrompt,      CLEAR_ON_MANAGER_START,                               std::string) \
+  X(Offroad_InvalidTime,                   CLEAR_ON_MANAGER_START,                               std::string) \
+  X(Offroad_IsTakingSnapshot,              CLEAR_ON_MANAGER_START,                               std::string) \
+  X(Offroad_NeosUpdate,                    CLEAR_ON_MANAGER_START,                               std::string) \
+  X(Offroad_NoFirmware,                    CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION,  std::string) \
+  X(Offroad_StorageMissing,                CLEAR_ON_MANAGER_START,                               std::string) \
+  X(Offroad_TemperatureTooHigh,            CLEAR_ON_MANAGER_START,                               std::string) \
+  X(Offroad_UnofficialHardware,            CLEAR_ON_MANAGER_START,                               std::string) \
+  X(Offroad_UpdateFailed,                  CLEAR_ON_MANAGER_START,                               std::string)
+
+enum class ParamKey {
+#define PARAM_KEY_ENUM(name, flags, type) name,
+  PARAMS_KEYS(PARAM_KEY_ENUM)
+#undef PARAM_KEY_ENUM
+};
+
+#define PARAM_KEY_COUNT_ONE(name, flags, type) +1
+const int PARAM_KEY_COUNT = 0 PARAMS_KEYS(PARAM_KEY_COUNT_ONE);
+#undef PARAM_KEY_COUNT_ONE
+
+inline constexpr const char *PARAM_KEY_NAMES[] = {
+#define PARAM_KEY_NAME(name, flags, type) #name,
+  PARAMS_KEYS(PARAM_KEY_NAME)
+#undef PARAM_KEY_NAME
+};
+
+template <ParamKey K>
+struct ParamKeyTraits;
+
+#define PARAM_KEY_TRAITS(key, flags, type) \
+  template <>                             \
+  struct ParamKeyTraits<ParamKey::key> {  \
+    typedef type Type;                    \
+  };
+PARAMS_KEYS(PARAM_KEY_TRAITS)
+#undef PARAM_KEY_TRAITS
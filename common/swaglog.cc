@@ -4,12 +4,23 @@
 
 #include "common/swaglog.h"
 
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cctype>
 #include <cstdarg>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <limits>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <zmq.h>
 #include "json11.hpp"
@@ -68,8 +79,8 @@ static void log(int levelnum, const char* filename, int lineno, const char* func
   zmq_send(s.sock, (levelnum_c + log_s).c_str(), log_s.length() + 1, ZMQ_NOBLOCK);
 }
 
-static void cloudlog_common(int levelnum, const char* filename, int lineno, const char* func,
-                            char* msg_buf, const json11::Json::object &msg_j={}) {
+static void cloudlog_common(int levelnum, const char* filename, int lineno, const char* func, double created,
+                            const char* msg, const json11::Json::object &msg_j={}) {
   std::lock_guard lk(s.lock);
   if (!s.initialized) s.initialize();
 
@@ -79,19 +90,443 @@ static void cloudlog_common(int levelnum, const char* filename, int lineno, cons
     {"filename", filename},
     {"lineno", lineno},
     {"funcname", func},
-    {"created", seconds_since_epoch()}
+    {"created", created}
   };
   if (msg_j.empty()) {
-    log_j["msg"] = msg_buf;
+    log_j["msg"] = msg;
   } else {
     log_j["msg"] = msg_j;
   }
 
   std::string log_s = ((json11::Json)log_j).dump();
-  log(levelnum, filename, lineno, func, msg_buf, log_s);
-  free(msg_buf);
+  log(levelnum, filename, lineno, func, msg, log_s);
+}
+
+namespace {
+
+// The LOG macros don't format, serialize or send anything on the calling thread. The format, a
+// literal, and a copy of its arguments are put in a ring buffer of the thread, and the log thread
+// formats and sends them within LOG_FLUSH_INTERVAL ms. A call then costs well under a microsecond
+// instead of the JSON and the zmq_send. A thread that fills its ring sends what's queued itself.
+// What's queued is sent at exit, and from the handlers of abort and the fatal signals, so the
+// errors that come right before an assert or a crash aren't lost.
+
+const int LOG_RING_SIZE = 128;  // records per thread
+const int LOG_ARGS_SIZE = 464;
+const int LOG_MSG_SIZE = 4096;  // longer deferred messages are truncated
+const int LOG_FLUSH_INTERVAL = 20;
+const int CRASH_LOCK_WAIT = 100;  // ms
+
+struct LogRecord {
+  const char *fmt;
+  const char *filename;
+  const char *func;
+  double created;
+  int levelnum;
+  int lineno;
+  char args[LOG_ARGS_SIZE];  // the arguments of fmt, in order
+};
+
+// written by its thread, read by the log thread
+struct LogRing {
+  LogRecord records[LOG_RING_SIZE];
+  std::atomic<uint32_t> head = 0;  // next to write
+  std::atomic<uint32_t> tail = 0;  // next to read
+  std::atomic<bool> closed = false;  // its thread exited
+};
+
+struct ThreadRing {
+  LogRing *ring = nullptr;
+  ~ThreadRing() {
+    if (ring) ring->closed = true;
+  }
+};
+thread_local ThreadRing thread_ring;
+
+// printf conversions, integers are stored as long long and the others as passed
+enum class ArgType { INT, UINT, DOUBLE, CHAR, STRING, POINTER };
+enum class ArgLength { NONE, HH, H, L, LL, J, Z, T };
+
+struct FormatSpec {
+  const char *end;  // past the conversion
+  char spec[32];    // for snprintf
+  int stars;        // int arguments for the width and precision, before the value
+  bool star_precision;  // the precision is the last of them
+  int precision;    // a literal precision, -1 if none
+  ArgType type;
+  ArgLength length;
+};
+
+// parses the conversion at p, right after the '%'. Returns false for the ones that can't be
+// deferred, like %n, %m or %ls
+bool parse_spec(const char *p, FormatSpec &spec) {
+  const char *start = p;
+  spec.stars = 0;
+  spec.star_precision = false;
+  spec.precision = -1;
+  while (*p && strchr("-+ #0'", *p)) p++;
+  if (*p == '*') {
+    spec.stars++;
+    p++;
+  } else {
+    while (isdigit(*p)) p++;
+  }
+  if (*p == '.') {
+    p++;
+    if (*p == '*') {
+      spec.stars++;
+      spec.star_precision = true;
+      p++;
+    } else {
+      spec.precision = 0;
+      while (isdigit(*p)) {
+        spec.precision = std::min(spec.precision * 10 + (*p - '0'), LOG_MSG_SIZE);
+        p++;
+      }
+    }
+  }
+  const size_t prefix_len = p - start;
+
+  spec.length = ArgLength::NONE;
+  if (p[0] == 'h' && p[1] == 'h') {
+    spec.length = ArgLength::HH;
+    p += 2;
+  } else if (p[0] == 'l' && p[1] == 'l') {
+    spec.length = ArgLength::LL;
+    p += 2;
+  } else if (*p == 'h' || *p == 'l' || *p == 'j' || *p == 'z' || *p == 't') {
+    spec.length = *p == 'h' ? ArgLength::H : *p == 'l' ? ArgLength::L : *p == 'j' ? ArgLength::J : *p == 'z' ? ArgLength::Z : ArgLength::T;
+    p++;
+  }
+
+  const char conv = *p;
+  if (!conv) {
+    return false;
+  } else if (strchr("diouxX", conv)) {
+    spec.type = conv == 'd' || conv == 'i' ? ArgType::INT : ArgType::UINT;
+  } else if (strchr("fFeEgGaA", conv)) {
+    spec.type = ArgType::DOUBLE;
+    if (spec.length != ArgLength::NONE && spec.length != ArgLength::L) return false;
+  } else if (conv == 'c' || conv == 's' || conv == 'p') {
+    spec.type = conv == 'c' ? ArgType::CHAR : conv == 's' ? ArgType::STRING : ArgType::POINTER;
+    if (spec.length != ArgLength::NONE) return false;
+  } else {
+    return false;
+  }
+  if (prefix_len + 5 > sizeof(spec.spec)) return false;
+
+  spec.spec[0] = '%';
+  memcpy(spec.spec + 1, start, prefix_len);
+  char *c = spec.spec + 1 + prefix_len;
+  if (spec.type == ArgType::INT || spec.type == ArgType::UINT) {
+    *c++ = 'l';
+    *c++ = 'l';
+  }
+  *c++ = conv;
+  *c = '\0';
+  spec.end = p + 1;
+  return true;
 }
 
+// copies the arguments of fmt to out, in order. Returns false if they can't be deferred or don't fit.
+bool capture_args(const char *fmt, va_list args, char *out, size_t size) {
+  size_t n = 0;
+  auto put = [&](const void *value, size_t len) {
+    if (n + len > size) return false;
+    memcpy(out + n, value, len);
+    n += len;
+    return true;
+  };
+
+  FormatSpec spec;
+  for (const char *p = fmt; (p = strchr(p, '%')); p = spec.end) {
+    if (p[1] == '%') {
+      spec.end = p + 2;
+      continue;
+    }
+    if (!parse_spec(p + 1, spec)) return false;
+
+    int precision = spec.precision;
+    for (int i = 0; i < spec.stars; i++) {
+      int star = va_arg(args, int);
+      if (!put(&star, sizeof(star))) return false;
+      if (spec.star_precision && i == spec.stars - 1) precision = star;  // negative is none
+    }
+
+    bool ok = true;
+    if (spec.type == ArgType::INT) {
+      long long value;
+      switch (spec.length) {
+        case ArgLength::HH: value = (signed char)va_arg(args, int); break;
+        case ArgLength::H: value = (short)va_arg(args, int); break;
+        case ArgLength::L: value = va_arg(args, long); break;
+        case ArgLength::LL: value = va_arg(args, long long); break;
+        case ArgLength::J: value = va_arg(args, intmax_t); break;
+        case ArgLength::Z: value = va_arg(args, ssize_t); break;
+        case ArgLength::T: value = va_arg(args, ptrdiff_t); break;
+        default: value = va_arg(args, int); break;
+      }
+      ok = put(&value, sizeof(value));
+    } else if (spec.type == ArgType::UINT) {
+      unsigned long long value;
+      switch (spec.length) {
+        case ArgLength::HH: value = (unsigned char)va_arg(args, unsigned int); break;
+        case ArgLength::H: value = (unsigned short)va_arg(args, unsigned int); break;
+        case ArgLength::L: value = va_arg(args, unsigned long); break;
+        case ArgLength::LL: value = va_arg(args, unsigned long long); break;
+        case ArgLength::J: value = va_arg(args, uintmax_t); break;
+        case ArgLength::Z: value = va_arg(args, size_t); break;
+        case ArgLength::T: value = va_arg(args, ptrdiff_t); break;
+        default: value = va_arg(args, unsigned int); break;
+      }
+      ok = put(&value, sizeof(value));
+    } else if (spec.type == ArgType::DOUBLE) {
+      double value = va_arg(args, double);
+      ok = put(&value, sizeof(value));
+    } else if (spec.type == ArgType::CHAR) {
+      int value = va_arg(args, int);
+      ok = put(&value, sizeof(value));
+    } else if (spec.type == ArgType::POINTER) {
+      void *value = va_arg(args, void *);
+      ok = put(&value, sizeof(value));
+    } else {
+      const char *value = va_arg(args, const char *);
+      if (!value) value = "(null)";
+      // with a precision, the string doesn't have to be terminated, e.g. %.*s of a buffer
+      const size_t len = strnlen(value, precision >= 0 ? std::min<size_t>(precision, size - n) : size - n);
+      ok = put(value, len) && put("", 1);
+    }
+    if (!ok) return false;
+  }
+  return true;
+}
+
+template <class T>
+int format_arg(char *buf, size_t size, const FormatSpec &spec, const int *stars, T value) {
+  switch (spec.stars) {
+    case 0: return snprintf(buf, size, spec.spec, value);
+    case 1: return snprintf(buf, size, spec.spec, stars[0], value);
+    default: return snprintf(buf, size, spec.spec, stars[0], stars[1], value);
+  }
+}
+
+// formats fmt with the arguments stored by capture_args
+void format_args(const char *fmt, const char *args, char *buf, size_t size) {
+  size_t n = 0;
+  auto append = [&](const char *str, size_t len) {
+    len = std::min(len, size - 1 - n);
+    memcpy(buf + n, str, len);
+    n += len;
+  };
+  auto next = [&](auto &value) {
+    memcpy(&value, args, sizeof(value));
+    args += sizeof(value);
+  };
+
+  FormatSpec spec;
+  const char *p = fmt;
+  for (const char *conv; (conv = strchr(p, '%')); p = spec.end) {
+    append(p, conv - p);
+    if (conv[1] == '%') {
+      append("%", 1);
+      spec.end = conv + 2;
+      continue;
+    }
+    parse_spec(conv + 1, spec);
+
+    int stars[2] = {};
+    for (int i = 0; i < spec.stars; i++) {
+      next(stars[i]);
+    }
+    int len = 0;
+    if (spec.type == ArgType::INT) {
+      long long value;
+      next(value);
+      len = format_arg(buf + n, size - n, spec, stars, value);
+    } else if (spec.type == ArgType::UINT) {
+      unsigned long long value;
+      next(value);
+      len = format_arg(buf + n, size - n, spec, stars, value);
+    } else if (spec.type == ArgType::DOUBLE) {
+      double value;
+      next(value);
+      len = format_arg(buf + n, size - n, spec, stars, value);
+    } else if (spec.type == ArgType::CHAR) {
+      int value;
+      next(value);
+      len = format_arg(buf + n, size - n, spec, stars, value);
+    } else if (spec.type == ArgType::POINTER) {
+      void *value;
+      next(value);
+      len = format_arg(buf + n, size - n, spec, stars, value);
+    } else {
+      len = format_arg(buf + n, size - n, spec, stars, args);
+      args += strlen(args) + 1;
+    }
+    n = std::min(n + std::max(len, 0), size - 1);
+  }
+  append(p, strlen(p));
+  buf[n] = '\0';
+}
+
+class LogQueue {
+public:
+  // never destroyed, the log thread runs until the process exits
+  static LogQueue &instance() {
+    static LogQueue *queue = new LogQueue();
+    return *queue;
+  }
+
+  // the ring of the calling thread, starts the log thread if needed
+  LogRing *ring() {
+    if (!started.load(std::memory_order_relaxed)) {
+      start();
+    }
+    if (!thread_ring.ring) {
+      thread_ring.ring = new LogRing();
+      std::lock_guard lk(rings_lock);
+      rings.push_back(thread_ring.ring);
+    }
+    return thread_ring.ring;
+  }
+
+  // sends what's queued, returns false if there was nothing
+  bool flush() {
+    std::lock_guard lk(flush_lock);
+    return flush_locked();
+  }
+
+  // from a fatal signal, on a thread that may hold any of the locks. Gives up on one that isn't
+  // released within CRASH_LOCK_WAIT ms, the crash happened while holding it.
+  void flush_on_crash() {
+    if (!wait_for(flush_lock)) return;
+    if (wait_for(rings_lock)) {
+      rings_lock.unlock();
+      if (wait_for(s.lock)) {
+        s.lock.unlock();
+        flush_locked();
+      }
+    }
+    flush_lock.unlock();
+  }
+
+  // flushes at exit, and stops before the zmq socket is closed
+  void stop() {
+    flush();
+    std::lock_guard lk(flush_lock);
+    stopped = true;
+  }
+
+private:
+  LogQueue() {
+    pthread_atfork([] { LogQueue::instance().prepare_fork(); }, [] { LogQueue::instance().after_fork(false); },
+                   [] { LogQueue::instance().after_fork(true); });
+  }
+
+  bool flush_locked() {
+    if (stopped) return false;
+
+    std::vector<LogRing *> to_flush;
+    {
+      std::lock_guard rings_lk(rings_lock);
+      to_flush = rings;
+    }
+
+    bool sent = false;
+    char msg[LOG_MSG_SIZE];
+    for (LogRing *ring : to_flush) {
+      const bool closed = ring->closed.load(std::memory_order_acquire);
+      const uint32_t head = ring->head.load(std::memory_order_acquire);
+      for (uint32_t tail = ring->tail.load(std::memory_order_relaxed); tail != head; tail++) {
+        const LogRecord &r = ring->records[tail % LOG_RING_SIZE];
+        format_args(r.fmt, r.args, msg, sizeof(msg));
+        cloudlog_common(r.levelnum, r.filename, r.lineno, r.func, r.created, msg);
+        ring->tail.store(tail + 1, std::memory_order_release);
+        sent = true;
+      }
+      if (closed) {
+        std::lock_guard rings_lk(rings_lock);
+        rings.erase(std::find(rings.begin(), rings.end(), ring));
+        delete ring;
+      }
+    }
+    return sent;
+  }
+
+  static bool wait_for(std::mutex &m) {
+    for (int i = 0; i < CRASH_LOCK_WAIT; i++) {
+      if (m.try_lock()) return true;
+      usleep(1000);
+    }
+    return false;
+  }
+
+  // flushes, then dies of the signal with the default action
+  static void crash_handler(int sig) {
+    LogQueue::instance().flush_on_crash();
+    signal(sig, SIG_DFL);
+    raise(sig);
+  }
+
+  // signals that the process handles itself are left alone
+  static void install_crash_handlers() {
+    for (int sig : {SIGABRT, SIGSEGV, SIGBUS, SIGFPE, SIGILL}) {
+      struct sigaction sa = {};
+      if (sigaction(sig, nullptr, &sa) != 0 || (sa.sa_flags & SA_SIGINFO) || sa.sa_handler != SIG_DFL) continue;
+      sa.sa_handler = crash_handler;
+      sigemptyset(&sa.sa_mask);
+      sa.sa_flags = SA_RESETHAND;
+      sigaction(sig, &sa, nullptr);
+    }
+  }
+
+  void start() {
+    std::lock_guard lk(rings_lock);
+    if (started) return;
+    if (!exit_handlers_installed) {
+      // the statics of json11 are constructed first, so they are destroyed after the last flush
+      json11::Json();
+      std::atexit([] { LogQueue::instance().stop(); });
+      install_crash_handlers();
+      exit_handlers_installed = true;
+    }
+    std::thread([this] {
+      util::set_thread_name("swaglog");
+      while (true) {
+        if (!flush()) {
+          util::sleep_for(LOG_FLUSH_INTERVAL);
+        }
+      }
+    }).detach();
+    started = true;
+  }
+
+  void prepare_fork() {
+    flush_lock.lock();
+    rings_lock.lock();
+  }
+
+  // the child has no log thread and only the ring of the forking thread
+  void after_fork(bool child) {
+    if (child) {
+      rings.clear();
+      if (thread_ring.ring) rings.push_back(thread_ring.ring);
+      started = false;
+    }
+    rings_lock.unlock();
+    flush_lock.unlock();
+  }
+
+  std::atomic<bool> started = false;
+  bool exit_handlers_installed = false;
+  bool stopped = false;
+  std::mutex flush_lock;
+  std::mutex rings_lock;
+  std::vector<LogRing *> rings;
+};
+
+}  // namespace
+
 void cloudlog_e(int levelnum, const char* filename, int lineno, const char* func,
                 const char* fmt, ...) {
   va_list args;
@@ -100,7 +535,59 @@ void cloudlog_e(int levelnum, const char* filename, int lineno, const char* func
   int ret = vasprintf(&msg_buf, fmt, args);
   va_end(args);
   if (ret <= 0 || !msg_buf) return;
-  cloudlog_common(levelnum, filename, lineno, func, msg_buf);
+  cloudlog_common(levelnum, filename, lineno, func, seconds_since_epoch(), msg_buf);
+  free(msg_buf);
+}
+
+void cloudlog_deferred_e(int levelnum, const char* filename, int lineno, const char* func,
+                         const char* fmt, ...) {
+  const double created = seconds_since_epoch();
+  LogQueue &queue = LogQueue::instance();
+  LogRing *ring = queue.ring();
+
+  va_list args;
+  va_start(args, fmt);
+  bool deferred = false;
+  if (levelnum < CLOUDLOG_CRITICAL) {
+    const uint32_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_SIZE) {
+      // only fails once stopped at exit
+      queue.flush();
+      if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_SIZE) {
+        va_end(args);
+        return;
+      }
+    }
+    LogRecord &r = ring->records[head % LOG_RING_SIZE];
+    va_list args_copy;
+    va_copy(args_copy, args);
+    deferred = capture_args(fmt, args_copy, r.args, sizeof(r.args));
+    va_end(args_copy);
+    if (deferred) {
+      r.fmt = fmt;
+      r.filename = filename;
+      r.func = func;
+      r.created = created;
+      r.levelnum = levelnum;
+      r.lineno = lineno;
+      ring->head.store(head + 1, std::memory_order_release);
+    }
+  }
+
+  // critical ones are sent right away, after everything before them. So are the ones that
+  // can't be deferred, such as with a long string.
+  if (!deferred) {
+    char* msg_buf = nullptr;
+    int ret = vasprintf(&msg_buf, fmt, args);
+    if (ret > 0 && msg_buf) {
+      if (levelnum >= CLOUDLOG_CRITICAL) {
+        queue.flush();
+      }
+      cloudlog_common(levelnum, filename, lineno, func, created, msg_buf);
+    }
+    free(msg_buf);
+  }
+  va_end(args);
 }
 
 void cloudlog_t_common(int levelnum, const char* filename, int lineno, const char* func,
@@ -117,7 +604,8 @@ void cloudlog_t_common(int levelnum, const char* filename, int lineno, const cha
     tspt_j["frame_id"] = std::to_string(frame_id);
   }
   tspt_j = json11::Json::object{{"timestamp", tspt_j}};
-  cloudlog_common(levelnum, filename, lineno, func, msg_buf, tspt_j);
+  cloudlog_common(levelnum, filename, lineno, func, seconds_since_epoch(), msg_buf, tspt_j);
+  free(msg_buf);
 }
 
 
@@ -135,4 +623,3 @@ void cloudlog_te(int levelnum, const char* filename, int lineno, const char* fun
   cloudlog_t_common(levelnum, filename, lineno, func, frame_id, fmt, args);
   va_end(args);
 }
-
@@ -12,6 +12,12 @@
 void cloudlog_e(int levelnum, const char* filename, int lineno, const char* func,
                 const char* fmt, ...) /*__attribute__ ((format (printf, 6, 7)))*/;
 
+// same as cloudlog_e, for the LOG macros. The message is formatted and sent by a background thread
+// (within a few ms, critical ones right away, and what's queued on abort or a fatal signal), so
+// filename, func and fmt have to be literals. The arguments are copied.
+void cloudlog_deferred_e(int levelnum, const char* filename, int lineno, const char* func,
+                         const char* fmt, ...) /*__attribute__ ((format (printf, 6, 7)))*/;
+
 void cloudlog_te(int levelnum, const char* filename, int lineno, const char* func,
                  const char* fmt, ...) /*__attribute__ ((format (printf, 6, 7)))*/;
 
@@ -19,9 +25,9 @@ void cloudlog_te(int levelnum, const char* filename, int lineno, const char* fun
                  uint32_t frame_id, const char* fmt, ...) /*__attribute__ ((format (printf, 6, 7)))*/;
 
 
-#define cloudlog(lvl, fmt, ...) cloudlog_e(lvl, __FILE__, __LINE__, \
-                                           __func__, \
-                                           fmt, ## __VA_ARGS__);
+#define cloudlog(lvl, fmt, ...) cloudlog_deferred_e(lvl, __FILE__, __LINE__, \
+                                                    __func__, \
+                                                    fmt, ## __VA_ARGS__);
  
 #define cloudlog_t(lvl, ...) cloudlog_te(lvl, __FILE__, __LINE__, \
                                           __func__, \
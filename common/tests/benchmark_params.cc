@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/params.h"
+#include "common/timing.h"
+#include "system/hardware/hw.h"
+
+// Measures the latency of saving 50 settings, as a settings screen does, with a put per key and with
+// putBatch, for the file per key params and the log. Run it on the storage the params are on.
+// usage: ./benchmark_params [dir] [saves]
+// dir defaults to next to the params, and is left behind.
+
+const int NUM_KEYS = 50;
+
+void benchmark(const char *name, Params &params, const std::vector<std::string> &keys, int saves, bool batch) {
+  std::vector<double> times;
+  for (int i = 0; i < saves; i++) {
+    const std::string value = std::to_string(i % 2);
+    double t1 = millis_since_boot();
+    if (batch) {
+      std::map<std::string, std::string> values;
+      for (auto &key : keys) values[key] = value;
+      params.putBatch(values);
+    } else {
+      for (auto &key : keys) params.put(key, value);
+    }
+    times.push_back(millis_since_boot() - t1);
+  }
+
+  std::sort(times.begin(), times.end());
+  double total = 0;
+  for (double t : times) total += t;
+  printf("%s: mean %.2f ms, p50 %.2f ms, max %.2f ms\n", name, total / times.size(), times[times.size() / 2], times.back());
+}
+
+int main(int argc, char *argv[]) {
+  const std::string dir = argc > 1 ? argv[1] : Path::params() + "_benchmark";
+  const int saves = argc > 2 ? atoi(argv[2]) : 20;
+
+  Params file_params(dir + "/file");
+  std::vector<std::string> keys = file_params.allKeys();
+  std::sort(keys.begin(), keys.end());
+  keys.resize(std::min<size_t>(keys.size(), NUM_KEYS));
+
+  setenv("OPENPILOT_PARAMS_LOG", "1", 1);
+  Params log_params(dir + "/log");
+  unsetenv("OPENPILOT_PARAMS_LOG");
+
+  printf("saving %zu keys %d times in %s\n", keys.size(), saves, dir.c_str());
+  benchmark("file, put", file_params, keys, saves, false);
+  benchmark("file, putBatch", file_params, keys, saves, true);
+  benchmark("log, put", log_params, keys, saves, false);
+  benchmark("log, putBatch", log_params, keys, saves, true);
+  return 0;
+}
@@ -0,0 +1,182 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/params.h"
+#include "common/timing.h"
+#include "common/util.h"
+
+// Writes params from another process and checks that a cached Params sees the puts and removes,
+// that subscriptions are called, that a blocking get wakes up and that putBatch is seen all at
+// once, with files and with the log.
+// usage: ./test_params, the params are written to a temporary directory
+
+const double TIMEOUT_MS = 2000;
+
+// runs this binary with "put <dir> <key> <value>" or "remove <dir> <key>"
+void run_child(const char *self, std::vector<std::string> args) {
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    std::vector<char *> argv = {(char *)self};
+    for (auto &a : args) argv.push_back(a.data());
+    argv.push_back(nullptr);
+    execv(self, argv.data());
+    _exit(1);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+template <class F>
+bool wait_for(F condition) {
+  const double start = millis_since_boot();
+  while (!condition()) {
+    if (millis_since_boot() - start > TIMEOUT_MS) return false;
+    util::sleep_for(1);
+  }
+  return true;
+}
+
+void test(const char *self, const std::string &dir) {
+  Params params(dir, true);
+  params.remove("DongleId");
+  params.remove("GithubSshKeys");
+
+  // written by this process, seen right away
+  assert(params.put("DongleId", "local") == 0);
+  assert(params.get("DongleId") == "local");
+
+  std::mutex lock;
+  std::vector<std::string> notified;
+  int id = params.subscribe("DongleId", [&](const std::string &key) {
+    std::lock_guard lk(lock);
+    notified.push_back(Params(dir).get(key));
+  });
+  assert(id >= 0);
+  auto notified_value = [&](const std::string &value) {
+    std::lock_guard lk(lock);
+    return std::find(notified.begin(), notified.end(), value) != notified.end();
+  };
+
+  // written by another process, seen through the cache and by the subscription
+  run_child(self, {"put", dir, "DongleId", "remote"});
+  assert(wait_for([&] { return params.get("DongleId") == "remote"; }));
+  assert(wait_for([&] { return notified_value("remote"); }));
+
+  run_child(self, {"remove", dir, "DongleId"});
+  assert(wait_for([&] { return params.get("DongleId").empty(); }));
+  assert(wait_for([&] { return notified_value(""); }));
+
+  params.unsubscribe(id);
+  const size_t count = notified.size();
+  run_child(self, {"put", dir, "DongleId", "unsubscribed"});
+  assert(wait_for([&] { return params.get("DongleId") == "unsubscribed"; }));
+  util::sleep_for(50);
+  {
+    std::lock_guard lk(lock);
+    assert(notified.size() == count);
+  }
+
+  // a blocking get returns once another process writes the key
+  std::atomic<double> woken_up = 0;
+  std::thread reader([&] {
+    assert(params.get("GithubSshKeys", true) == "key");
+    woken_up = millis_since_boot();
+  });
+  util::sleep_for(100);
+  assert(woken_up == 0);
+  const double start = millis_since_boot();
+  run_child(self, {"put", dir, "GithubSshKeys", "key"});
+  reader.join();
+  assert(woken_up >= start);
+  printf("  blocking get woke up %.1f ms after starting the writer\n", woken_up - start);
+
+  // read outside Params, so it's a file with the log as well
+  assert(util::read_file(params.getParamPath("GithubSshKeys")) == "key");
+}
+
+// settings that a screen would save together
+const std::vector<std::string> BATCH_KEYS = {
+  "ConditionalExperimentalMode", "ConditionalExperimentalModeCurves", "ConditionalExperimentalModeCurvesLead",
+  "ConditionalExperimentalModeSignal", "ConditionalExperimentalModeSpeed", "ConditionalExperimentalModeSpeedLead",
+  "ConditionalExperimentalModeStopLights", "CustomRoadUI", "FrogColors", "FrogIcons",
+};
+
+// writes BATCH_KEYS with putBatch, all set to the number of the batch
+int put_batches(const std::string &dir, int count) {
+  Params params(dir);
+  for (int i = 0; i < count; i++) {
+    std::map<std::string, std::string> values;
+    for (auto &key : BATCH_KEYS) values[key] = std::to_string(i);
+    if (params.putBatch(values) != 0) return 1;
+  }
+  return 0;
+}
+
+void test_batch(const char *self, const std::string &dir) {
+  // a reader sees all values of a batch written by another process, or none of them
+  Params params(dir);
+  std::atomic<bool> done = false;
+  std::thread writer([&] {
+    run_child(self, {"batch", dir, "200"});
+    done = true;
+  });
+  int reads = 0, mixed = 0;
+  while (!done) {
+    std::map<std::string, std::string> values = params.readAll();
+    std::set<std::string> seen;
+    for (auto &key : BATCH_KEYS) seen.insert(values[key]);
+    mixed += seen.size() != 1;
+    reads++;
+  }
+  writer.join();
+  printf("  %d reads while writing batches, %d saw part of one\n", reads, mixed);
+  assert(mixed == 0);
+  for (auto &key : BATCH_KEYS) {
+    assert(params.get(key) == "199");
+  }
+
+  // keys that stay a file with the log are written as files
+  assert(params.putBatch({{"DongleId", "batch"}, {"GithubSshKeys", "batch"}}) == 0);
+  assert(params.get("DongleId") == "batch" && params.get("GithubSshKeys") == "batch");
+  assert(util::read_file(params.getParamPath("GithubSshKeys")) == "batch");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc == 5 && strcmp(argv[1], "put") == 0) {
+    return Params(argv[2]).put(argv[3], argv[4]) == 0 ? 0 : 1;
+  } else if (argc == 4 && strcmp(argv[1], "remove") == 0) {
+    return Params(argv[2]).remove(argv[3]) == 0 ? 0 : 1;
+  } else if (argc == 4 && strcmp(argv[1], "batch") == 0) {
+    return put_batches(argv[2], atoi(argv[3]));
+  }
+
+  char tmp_dir[] = "/tmp/test_params_XXXXXX";
+  assert(mkdtemp(tmp_dir) != nullptr);
+
+  printf("file per key\n");
+  test(argv[0], std::string(tmp_dir) + "/file");
+  test_batch(argv[0], std::string(tmp_dir) + "/file");
+
+  // inherited by the child processes
+  setenv("OPENPILOT_PARAMS_LOG", "1", 1);
+  printf("log\n");
+  test(argv[0], std::string(tmp_dir) + "/log");
+  test_batch(argv[0], std::string(tmp_dir) + "/log");
+
+  printf("passed\n");
+  return 0;
+}
@@ -0,0 +1,161 @@
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zmq.h>
+
+#include <cassert>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json11.hpp"
+
+#include "common/swaglog.h"
+#include "common/timing.h"
+#include "common/util.h"
+#include "common/version.h"
+#include "system/hardware/hw.h"
+
+// Logs from several threads through the deferred path, and checks that every message arrives once
+// with the same text as printf and the same fields as before. Also checks that strings with a
+// precision aren't read past it, that what's queued is sent when the process aborts, and times a call.
+
+const int THREADS = 4;
+const int MESSAGES = 1000;
+const std::string LONG_STRING(2000, 'x');
+
+void log_thread(int thread_id) {
+  for (int i = 0; i < MESSAGES; i++) {
+    LOGD("thread %d msg %d %s %.2f %5.1f%% %lu %c %-4hhd|%*d|%.*s", thread_id, i, "str", i * 0.5, 12.34,
+         (unsigned long)i * 1000000000UL, 'a' + thread_id, (signed char)-i, 6, i, 3, "abcdef");
+    if (i % 100 == 0) {
+      util::sleep_for(1);
+    }
+  }
+  LOGD("thread %d long %s", thread_id, LONG_STRING.c_str());
+}
+
+json11::Json recv_msg(void *sock) {
+  char buf[4096] = {};
+  int len = zmq_recv(sock, buf, sizeof(buf) - 1, 0);
+  assert(len > 1);
+  std::string err;
+  auto msg = json11::Json::parse(buf + 1, err);
+  assert(err.empty());
+  return msg;
+}
+
+std::string expected_msg(int thread_id, int i) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "thread %d msg %d %s %.2f %5.1f%% %lu %c %-4hhd|%*d|%.*s", thread_id, i, "str", i * 0.5, 12.34,
+           (unsigned long)i * 1000000000UL, 'a' + thread_id, (signed char)-i, 6, i, 3, "abcdef");
+  return buf;
+}
+
+// run as a child by main, dies with errors still queued
+void crash() {
+  LOGW("before abort");
+  LOGE("error %d", 1);
+  abort();
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && strcmp(argv[1], "crash") == 0) {
+    crash();
+  }
+  setenv("MANAGER_DAEMON", "test_swaglog", 1);
+
+  void *zctx = zmq_ctx_new();
+  void *sock = zmq_socket(zctx, ZMQ_PULL);
+  int ret = zmq_bind(sock, "ipc:///tmp/logmessage");
+  assert(ret == 0);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < THREADS; i++) {
+    threads.emplace_back(log_thread, i);
+  }
+
+  std::vector<std::vector<int>> received(THREADS, std::vector<int>(MESSAGES + 1, 0));
+  const int total = THREADS * (MESSAGES + 1);
+  int timeout = 1000;
+  zmq_setsockopt(sock, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+  for (int n = 0; n < total; n++) {
+    char buf[4096] = {};
+    int len = zmq_recv(sock, buf, sizeof(buf) - 1, 0);
+    assert(len > 1);
+    assert(buf[0] == CLOUDLOG_DEBUG);
+
+    std::string err;
+    auto msg = json11::Json::parse(buf + 1, err);
+    assert(err.empty());
+    assert(msg["levelnum"].int_value() == CLOUDLOG_DEBUG);
+    assert(msg["funcname"].string_value() == "log_thread");
+    assert(msg["filename"].string_value() == __FILE__);
+    assert(msg["created"].number_value() > 0);
+    assert(msg["ctx"]["daemon"].string_value() == "test_swaglog");
+    assert(msg["ctx"]["version"].string_value() == COMMA_VERSION);
+    assert(msg["ctx"]["device"].string_value() == Hardware::get_name());
+
+    int thread_id = -1, i = -1;
+    const std::string text = msg["msg"].string_value();
+    if (sscanf(text.c_str(), "thread %d msg %d", &thread_id, &i) == 2) {
+      assert(text == expected_msg(thread_id, i));
+    } else {
+      // too long to defer, sent right away
+      assert(text == "thread " + std::to_string(thread_id) + " long " + LONG_STRING);
+      i = MESSAGES;
+    }
+    assert(thread_id >= 0 && thread_id < THREADS && received[thread_id][i]++ == 0);
+  }
+  for (auto &t : threads) t.join();
+
+  // a buffer without a terminating NUL, right before a page that can't be read
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  char *pages = (char *)mmap(nullptr, page_size * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert(pages != MAP_FAILED);
+  assert(mprotect(pages + page_size, page_size, PROT_NONE) == 0);
+  char *unterminated = pages + page_size - 3;
+  memcpy(unterminated, "abc", 3);
+  LOGD("precision %.*s|%.3s|%.2s|%.*s", 3, unterminated, unterminated, unterminated, -1, "str");
+  assert(recv_msg(sock)["msg"].string_value() == "precision abc|abc|ab|str");
+  munmap(pages, page_size * 2);
+
+  // errors are deferred as well, and sent from the abort handler
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    execl("/proc/self/exe", argv[0], "crash", (char *)nullptr);
+    _exit(127);
+  }
+  int status = 0;
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+  assert(recv_msg(sock)["msg"].string_value() == "before abort");
+  auto error = recv_msg(sock);
+  assert(error["msg"].string_value() == "error 1" && error["levelnum"].int_value() == CLOUDLOG_ERROR);
+  assert(error["funcname"].string_value() == "crash");
+
+  // time the calls, without the formatting that happens later on the log thread. The first one
+  // of a thread allocates its ring.
+  LOGD("timing");
+  util::sleep_for(50);
+  const int CALLS = 100;
+  double total_time = 0, max_time = 0;
+  for (int i = 0; i < CALLS; i++) {
+    double t = nanos_since_boot();
+    LOGD("timing %d %s %f", i, "str", i * 1.5);
+    t = nanos_since_boot() - t;
+    total_time += t;
+    max_time = std::max(max_time, t);
+  }
+  printf("LOGD: %.0f ns mean, %.0f ns max\n", total_time / CALLS, max_time);
+
+  zmq_close(sock);
+  zmq_ctx_destroy(zctx);
+  printf("passed\n");
+  return 0;
+}
@@ -0,0 +1,206 @@
+#include "common/trace.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/swaglog.h"
+#include "common/util.h"
+
+namespace trace {
+
+const bool enabled = getenv("TRACE_DIR") != nullptr;
+
+namespace {
+
+const int TRACE_RING_SIZE = 4096;  // events per thread
+const int TRACE_FLUSH_INTERVAL = 100;  // ms
+
+struct Event {
+  const char *name;
+  uint64_t ts;
+  uint64_t dur;
+  uint64_t id;
+  double value;
+  EventType type;
+};
+
+// written by its thread, read by the collector. Full rings drop events, the collector counts them.
+struct EventRing {
+  Event events[TRACE_RING_SIZE];
+  int tid = 0;
+  std::string name;  // of the thread
+  bool named = false;
+  std::atomic<uint32_t> head = 0;  // next to write
+  std::atomic<uint32_t> tail = 0;  // next to read
+  std::atomic<uint32_t> dropped = 0;
+  std::atomic<bool> closed = false;  // its thread exited
+};
+
+struct ThreadRing {
+  EventRing *ring = nullptr;
+  ~ThreadRing() {
+    if (ring) ring->closed = true;
+  }
+};
+thread_local ThreadRing thread_ring;
+
+std::string read_comm(const std::string &path) {
+  std::string comm = util::read_file(path);
+  while (!comm.empty() && comm.back() == '\n') comm.pop_back();
+  return comm;
+}
+
+class Collector {
+public:
+  // never destroyed, closed at exit
+  static Collector &instance() {
+    static Collector *collector = new Collector();
+    return *collector;
+  }
+
+  EventRing *ring() {
+    if (!thread_ring.ring) {
+      EventRing *ring = new EventRing();
+      ring->tid = syscall(SYS_gettid);
+      ring->name = read_comm("/proc/self/task/" + std::to_string(ring->tid) + "/comm");
+      std::lock_guard lk(rings_lock);
+      rings.push_back(ring);
+      thread_ring.ring = ring;
+    }
+    return thread_ring.ring;
+  }
+
+  void flush() {
+    std::lock_guard lk(flush_lock);
+    std::vector<EventRing *> to_flush;
+    {
+      std::lock_guard rings_lk(rings_lock);
+      to_flush = rings;
+    }
+
+    for (EventRing *ring : to_flush) {
+      // named on the first flush, threads usually set their name right after starting
+      if (!ring->named) {
+        std::string name = read_comm("/proc/self/task/" + std::to_string(ring->tid) + "/comm");
+        if (name.empty()) name = ring->name;
+        write("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", pid, ring->tid, name.c_str());
+        ring->named = true;
+      }
+
+      const bool closed = ring->closed.load(std::memory_order_acquire);
+      const uint32_t head = ring->head.load(std::memory_order_acquire);
+      for (uint32_t tail = ring->tail.load(std::memory_order_relaxed); tail != head; tail++) {
+        write_event(ring->events[tail % TRACE_RING_SIZE], ring->tid);
+        ring->tail.store(tail + 1, std::memory_order_release);
+      }
+      if (uint32_t dropped = ring->dropped.exchange(0)) {
+        write_event({"trace dropped", nanos_since_boot(), 0, NO_ID, (double)dropped, EventType::COUNTER}, ring->tid);
+      }
+
+      if (closed) {
+        std::lock_guard rings_lk(rings_lock);
+        rings.erase(std::find(rings.begin(), rings.end(), ring));
+        delete ring;
+      }
+    }
+    if (f) fflush(f);
+  }
+
+  void close() {
+    flush();
+    std::lock_guard lk(flush_lock);
+    if (f) {
+      fprintf(f, "\n]}\n");
+      fclose(f);
+      f = nullptr;
+    }
+  }
+
+private:
+  Collector() {
+    pid = getpid();
+    const std::string dir = getenv("TRACE_DIR");
+    const std::string comm = read_comm("/proc/self/comm");
+    const std::string path = dir + "/" + comm + "_" + std::to_string(pid) + ".json";
+    util::create_directories(dir, 0775);
+    f = fopen(path.c_str(), "w");
+    if (!f) {
+      LOGE("failed to open trace %s", path.c_str());
+      return;
+    }
+
+    // an event per line, so a trace that wasn't closed can still be read
+    fprintf(f, "{\"traceEvents\":[");
+    write("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}", pid, comm.c_str());
+    std::atexit([] { Collector::instance().close(); });
+    std::thread([this] {
+      util::set_thread_name("trace");
+      while (true) {
+        util::sleep_for(TRACE_FLUSH_INTERVAL);
+        flush();
+      }
+    }).detach();
+  }
+
+  template <class... Args>
+  void write(const char *fmt, Args... args) {
+    if (!f) return;
+    fprintf(f, first ? "\n" : ",\n");
+    fprintf(f, fmt, args...);
+    first = false;
+  }
+
+  void write_event(const Event &e, int tid) {
+    const double ts = e.ts / 1e3;  // us
+    switch (e.type) {
+      case EventType::SPAN:
+        if (e.id != NO_ID) {
+          write("{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"frame_id\":%" PRIu64 "}}",
+                e.name, ts, e.dur / 1e3, pid, tid, e.id);
+        } else {
+          write("{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}", e.name, ts, e.dur / 1e3, pid, tid);
+        }
+        break;
+      case EventType::COUNTER:
+        write("{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"value\":%g}}", e.name, ts, pid, tid, e.value);
+        break;
+      default:
+        // bound to the enclosing span, the flows of a name are its category
+        write("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"id\":%" PRIu64 ",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"bp\":\"e\"}",
+              e.name, e.name, (char)e.type, e.id, ts, pid, tid);
+        break;
+    }
+  }
+
+  FILE *f = nullptr;
+  bool first = true;
+  int pid;
+  std::mutex flush_lock;
+  std::mutex rings_lock;
+  std::vector<EventRing *> rings;
+};
+
+}  // namespace
+
+void record(EventType type, const char *name, uint64_t ts, uint64_t dur, double value, uint64_t id) {
+  EventRing *ring = thread_ring.ring ? thread_ring.ring : Collector::instance().ring();
+  const uint32_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= TRACE_RING_SIZE) {
+    ring->dropped++;
+    return;
+  }
+  ring->events[head % TRACE_RING_SIZE] = {name, ts, dur, id, value, type};
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+}  // namespace trace
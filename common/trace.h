@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/timing.h"
+
+// Tracing of spans, counters and flows, written in the Chrome trace event format to open in
+// ui.perfetto.dev or chrome://tracing. It's off unless TRACE_DIR is set, then the macros cost a
+// branch. When on, each process writes <TRACE_DIR>/<name>_<pid>.json, with the times since boot,
+// so tools/profiling/merge_traces.py can put all processes in one timeline.
+// Events go to a ring buffer of the thread and are written by a collector thread, names must
+// be literals. Flows connect the spans of a frame across threads and processes, by frame id.
+
+namespace trace {
+
+extern const bool enabled;
+
+enum class EventType : char {
+  SPAN = 'X',
+  COUNTER = 'C',
+  FLOW_BEGIN = 's',
+  FLOW_STEP = 't',
+  FLOW_END = 'f',
+};
+
+const uint64_t NO_ID = UINT64_MAX;
+
+void record(EventType type, const char *name, uint64_t ts, uint64_t dur = 0, double value = 0, uint64_t id = NO_ID);
+
+class Span {
+public:
+  inline Span(const char *span_name, uint64_t id = NO_ID) : name(span_name), frame_id(id) {
+    if (enabled) start = nanos_since_boot();
+  }
+  inline ~Span() {
+    if (enabled) record(EventType::SPAN, name, start, nanos_since_boot() - start, 0, frame_id);
+  }
+
+private:
+  const char *name;
+  uint64_t frame_id;
+  uint64_t start = 0;
+};
+
+}  // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// a span until the end of the scope, with the frame id in its args
+#define TRACE_SCOPE(name) trace::Span TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define TRACE_SCOPE_FRAME(name, frame_id) trace::Span TRACE_CONCAT(trace_span_, __LINE__)(name, frame_id)
+
+#define TRACE_COUNTER(name, value) \
+  do { if (trace::enabled) trace::record(trace::EventType::COUNTER, name, nanos_since_boot(), 0, value); } while (0)
+
+// The flow of a frame, drawn as arrows between the spans that enclose these. It begins where the
+// frame is captured, and the spans that handle it later add steps or end it.
+#define TRACE_FLOW(type, name, frame_id) \
+  do { if (trace::enabled) trace::record(trace::EventType::type, name, nanos_since_boot(), 0, 0, frame_id); } while (0)
+#define TRACE_FLOW_BEGIN(name, frame_id) TRACE_FLOW(FLOW_BEGIN, name, frame_id)
+#define TRACE_FLOW_STEP(name, frame_id) TRACE_FLOW(FLOW_STEP, name, frame_id)
+#define TRACE_FLOW_END(name, frame_id) TRACE_FLOW(FLOW_END, name, frame_id)
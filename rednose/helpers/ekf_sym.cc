@@ -143,17 +143,27 @@ std::deque<Observation> EKFSym::rewind(double t) {
 }
 
 void EKFSym::checkpoint(Observation& obs) {
-  // push to rewinder
-  this->rewind_t.push_back(this->filter_time);
-  this->rewind_states.push_back(std::make_pair(this->x, this->P));
-  this->rewind_obscache.push_back(obs);
-
-  // only keep a certain number around
-  if (this->rewind_t.size() > REWIND_TO_KEEP) {
+  // only keep a certain number around, the oldest entry is reused to not reallocate x, P and obs
+  if (this->rewind_t.size() >= REWIND_TO_KEEP) {
+    auto state = std::move(this->rewind_states.front());
+    Observation old_obs = std::move(this->rewind_obscache.front());
     this->rewind_t.pop_front();
     this->rewind_states.pop_front();
     this->rewind_obscache.pop_front();
+
+    state.first = this->x;
+    state.second = this->P;
+    old_obs = obs;
+    this->rewind_t.push_back(this->filter_time);
+    this->rewind_states.push_back(std::move(state));
+    this->rewind_obscache.push_back(std::move(old_obs));
+    return;
   }
+
+  // push to rewinder
+  this->rewind_t.push_back(this->filter_time);
+  this->rewind_states.push_back(std::make_pair(this->x, this->P));
+  this->rewind_obscache.push_back(obs);
 }
 
 Estimate EKFSym::predict_and_update_batch(Observation& obs, bool augment) {
@@ -209,7 +219,9 @@ void EKFSym::predict(double t) {
   this->filter_time = t;
 }
 
-VectorXd EKFSym::update(int kind, VectorXd z, MatrixXdr R, std::vector<double> extra_args) {
+VectorXd EKFSym::update(int kind, const VectorXd &z_in, MatrixXdr &R, std::vector<double> &extra_args) {
+  // the update writes the innovation into z
+  VectorXd z = z_in;
   this->ekf->updates.at(kind)(this->x.data(), this->P.data(), z.data(), R.data(), extra_args.data());
   this->normalize_quaternions();
 
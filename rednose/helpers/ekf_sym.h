@@ -69,7 +69,7 @@ private:
   void checkpoint(Observation& obs);
 
   Estimate predict_and_update_batch(Observation& obs, bool augment);
-  Eigen::VectorXd update(int kind, Eigen::VectorXd z, MatrixXdr R, std::vector<double> extra_args);
+  Eigen::VectorXd update(int kind, const Eigen::VectorXd &z, MatrixXdr &R, std::vector<double> &extra_args);
 
   // stuct with linked sympy generated functions
   const EKF *ekf = NULL;
@@ -203,7 +203,13 @@ def gen_code(folder, name, f_sym, dt_sym, x_sym, obs_eqs, dim_x, dim_err, eskf_p
   post_code += f"ekf_init({name});\n"
 
   # merge code blocks
-  header += "}"
+  header += "}\n"
+
+  # fixed-size C++ filter, only for the ffi header lines starting with "void " are used
+  if not msckf and obs_eqs:
+    zmax = max(int(h_sym.shape[0]) for h_sym, _, _, _, _ in obs_eqs)
+    header += "\n#include \"rednose/helpers/ekf_sym_fixed.h\"\n"
+    header += f"typedef EKFS::EKFSymFixed<{dim_x}, {dim_err}, {zmax}> {name}_fixed_ekf;\n"
   code = "\n".join([pre_code, code, open(os.path.join(TEMPLATE_DIR, "ekf_c.c")).read(), post_code])
 
   # write to file
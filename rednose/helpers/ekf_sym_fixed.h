@@ -0,0 +1,268 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "common_ekf.h"
+#include "rednose/logger/logger.h"
+
+#ifndef REWIND_TO_KEEP
+#define REWIND_TO_KEEP 512
+#endif
+
+namespace EKFS {
+
+// what the late observations cost, see EKFSymFixed::set_max_replay
+struct RewindStats {
+  uint64_t rewinds = 0;   // late observations applied by rewinding
+  uint64_t replayed = 0;  // observations replayed after those
+  uint64_t shifted = 0;   // late observations applied at the filter time
+  uint64_t too_old = 0;   // dropped, older than the rewind window
+  double time = 0.0;      // s spent on late observations
+  double max_time = 0.0;  // s, the slowest one
+};
+
+// EKFSym for a state and error state size known when the code is generated, gen_code instantiates
+// it for each filter as <name>_fixed_ekf. State, covariance and the rewind snapshots are fixed-size
+// and allocated when constructed, so filtering doesn't allocate after that. Observations hold a
+// single measurement of at most ZMAX values, MSCKF augmentation isn't supported.
+template <int DIM, int EDIM, int ZMAX>
+class EKFSymFixed {
+public:
+  typedef Eigen::Matrix<double, DIM, 1> VectorX;
+  typedef Eigen::Matrix<double, EDIM, EDIM, Eigen::RowMajor> MatrixP;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, ZMAX, 1> VectorZ;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor, ZMAX, ZMAX> MatrixR;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  EKFSymFixed(const std::string &name, const Eigen::Ref<const Eigen::MatrixXd> &Q, const Eigen::Ref<const Eigen::VectorXd> &x_initial,
+              const Eigen::Ref<const Eigen::MatrixXd> &P_initial, std::vector<int> quaternion_idxs = std::vector<int>(),
+              double max_rewind_age = 1.0)
+      : quaternion_idxs(quaternion_idxs), max_rewind_age(max_rewind_age) {
+    this->ekf = ekf_lookup(name);
+    assert(this->ekf);
+    assert(Q.rows() == EDIM && Q.cols() == EDIM);
+
+    this->Q = Q;
+    this->snapshots.resize(REWIND_TO_KEEP);
+    this->rewound.resize(REWIND_TO_KEEP);
+    this->init_state(x_initial, P_initial, NAN);
+  }
+
+  void init_state(const Eigen::Ref<const Eigen::VectorXd> &state, const Eigen::Ref<const Eigen::MatrixXd> &covs, double filter_time) {
+    assert(state.rows() == DIM && covs.rows() == EDIM && covs.cols() == EDIM);
+    this->x = state;
+    this->P = covs;
+    this->filter_time = filter_time;
+    this->reset_rewind();
+  }
+
+  const VectorX &state() const { return this->x; }
+  const MatrixP &covs() const { return this->P; }
+  void set_filter_time(double t) { this->filter_time = t; }
+  double get_filter_time() const { return this->filter_time; }
+  void reset_rewind() { this->snapshots_start = this->snapshots_size = 0; }
+
+  // A late observation rewinds the filter and replays all observations after it, so its cost grows
+  // with how late it is. With max_replay >= 0, one that would replay more than that is instead
+  // applied at the filter time, with the innovation of the state at its timestamp (predicted from
+  // the snapshot before it). That is a single update, at the cost of ignoring how the error
+  // evolved in between, which is fine for lags well within the rewind window.
+  void set_max_replay(int max_replay) { this->max_replay = max_replay; }
+  const RewindStats &rewind_stats() const { return this->stats; }
+  void reset_rewind_stats() { this->stats = RewindStats(); }
+
+  void set_global(const std::string &global_var, double val) {
+    this->ekf->sets.at(global_var)(val);
+  }
+
+  extra_routine_t get_extra_routine(const std::string &routine) {
+    return this->ekf->extra_routines.at(routine);
+  }
+
+  void predict(double t) {
+    // initialize time
+    if (std::isnan(this->filter_time)) {
+      this->filter_time = t;
+    }
+
+    // predict
+    double dt = t - this->filter_time;
+    assert(dt >= 0.0);
+
+    this->ekf->predict(this->x.data(), this->P.data(), this->Q.data(), dt);
+    this->normalize_quaternions();
+    this->filter_time = t;
+  }
+
+  // same as EKFSym::predict_and_update_batch with a single measurement, late ones rewind the
+  // filter. Returns false if it's too old to rewind to.
+  template <class DerivedZ, class DerivedR>
+  bool predict_and_update(double t, int kind, const Eigen::MatrixBase<DerivedZ> &z, const Eigen::MatrixBase<DerivedR> &R) {
+    assert(z.rows() <= ZMAX && R.rows() == z.rows() && R.cols() == z.rows());
+
+    Observation &obs = this->new_obs;
+    obs.t = t;
+    obs.kind = kind;
+    obs.z = z;
+    obs.R = R;
+
+    if (std::isnan(this->filter_time) || t >= this->filter_time) {
+      this->predict_and_update_obs(obs);
+      return true;
+    }
+
+    if (this->snapshots_size == 0 || t < snapshot(0).t || t < snapshot(this->snapshots_size - 1).t - this->max_rewind_age) {
+      LOGD("observation too old at %f with filter at %f, ignoring!", t, this->filter_time);
+      this->stats.too_old++;
+      return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const int n_after = this->snapshots_after(t);
+    if (this->max_replay >= 0 && n_after > this->max_replay) {
+      this->shift_obs(obs, this->snapshots_size - n_after - 1);
+      this->predict_and_update_obs(obs);
+      this->stats.shifted++;
+    } else {
+      const int n_rewound = this->rewind(t);
+      this->predict_and_update_obs(obs);
+
+      // fast forward
+      for (int i = 0; i < n_rewound; i++) {
+        this->predict_and_update_obs(this->rewound[i]);
+      }
+      this->stats.rewinds++;
+      this->stats.replayed += n_rewound;
+    }
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    this->stats.time += elapsed;
+    this->stats.max_time = std::max(this->stats.max_time, elapsed);
+    return true;
+  }
+
+private:
+  struct Observation {
+    double t;
+    int kind;
+    VectorZ z;
+    MatrixR R;
+  };
+
+  struct Snapshot {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    double t;  // filter time after obs
+    VectorX x;
+    MatrixP P;
+    Observation obs;
+  };
+
+  Snapshot &snapshot(int i) {
+    return this->snapshots[(this->snapshots_start + i) % REWIND_TO_KEEP];
+  }
+
+  void normalize_quaternions(VectorX &state) {
+    for (int idx : this->quaternion_idxs) {
+      state.template segment<4>(idx).normalize();
+    }
+  }
+  void normalize_quaternions() { this->normalize_quaternions(this->x); }
+
+  void predict_and_update_obs(const Observation &obs) {
+    this->predict(obs.t);
+
+    // the update writes the innovation into z
+    this->y = obs.z;
+    this->ekf->updates.at(obs.kind)(this->x.data(), this->P.data(), this->y.data(), const_cast<double *>(obs.R.data()), nullptr);
+    this->normalize_quaternions();
+
+    this->checkpoint(obs);
+  }
+
+  void checkpoint(const Observation &obs) {
+    // overwrite the oldest one when full
+    if (this->snapshots_size == REWIND_TO_KEEP) {
+      this->snapshots_start = (this->snapshots_start + 1) % REWIND_TO_KEEP;
+      this->snapshots_size--;
+    }
+    Snapshot &s = snapshot(this->snapshots_size++);
+    s.t = this->filter_time;
+    s.x = this->x;
+    s.P = this->P;
+    s.obs = obs;
+  }
+
+  int snapshots_after(double t) {
+    int n = 0;
+    while (snapshot(this->snapshots_size - 1 - n).t > t) {
+      n++;
+    }
+    return n;
+  }
+
+  // moves a late observation to the filter time: z - h(x at obs.t) becomes the innovation of the
+  // update at the current state
+  void shift_obs(Observation &obs, int before) {
+    const Snapshot &s = snapshot(before);
+    this->ekf->f_fun(const_cast<double *>(s.x.data()), obs.t - s.t, this->x_late.data());
+    this->normalize_quaternions(this->x_late);
+
+    auto h = this->ekf->hs.at(obs.kind);
+    this->y.resize(obs.z.rows());
+    h(this->x_late.data(), nullptr, this->y.data());
+    obs.z -= this->y;
+    h(this->x.data(), nullptr, this->y.data());
+    obs.z += this->y;
+    obs.t = this->filter_time;
+  }
+
+  // moves the observations after t to rewound, in order, and returns how many
+  int rewind(double t) {
+    const int n = this->snapshots_after(t);
+    this->snapshots_size -= n;
+    for (int i = 0; i < n; i++) {
+      this->rewound[i] = snapshot(this->snapshots_size + i).obs;
+    }
+
+    // set the state to the time right before that
+    Snapshot &s = snapshot(this->snapshots_size - 1);
+    this->filter_time = s.t;
+    this->x = s.x;
+    this->P = s.P;
+    return n;
+  }
+
+  // stuct with linked sympy generated functions
+  const EKF *ekf = NULL;
+
+  VectorX x;  // state
+  MatrixP P;  // covs
+  MatrixP Q;  // process noise
+  double filter_time;
+  std::vector<int> quaternion_idxs;
+
+  // rewind ring buffer and the observations to replay
+  double max_rewind_age;
+  std::vector<Snapshot, Eigen::aligned_allocator<Snapshot>> snapshots;
+  int snapshots_start = 0, snapshots_size = 0;
+  std::vector<Observation, Eigen::aligned_allocator<Observation>> rewound;
+
+  int max_replay = -1;
+  RewindStats stats;
+
+  // workspaces
+  Observation new_obs;
+  VectorZ y;
+  VectorX x_late;
+};
+
+}
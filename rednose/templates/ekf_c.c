@@ -38,10 +38,12 @@ template <int ZDIM, int EADIM, bool MAHA_TEST>
 void update(double *in_x, double *in_P, Hfun h_fun, Hfun H_fun, Hfun Hea_fun, double *in_z, double *in_R, double *in_ea, double MAHA_THRESHOLD) {
   typedef Eigen::Matrix<double, ZDIM, ZDIM, Eigen::RowMajor> ZZM;
   typedef Eigen::Matrix<double, ZDIM, DIM, Eigen::RowMajor> ZDM;
-  typedef Eigen::Matrix<double, Eigen::Dynamic, EDIM, Eigen::RowMajor> XEM;
+  // at most ZDIM rows after the null space projection, so these are on the stack as well
+  typedef Eigen::Matrix<double, Eigen::Dynamic, EDIM, Eigen::RowMajor, ZDIM, EDIM> XEM;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, DIM, Eigen::RowMajor, ZDIM, DIM> XDM;
   //typedef Eigen::Matrix<double, EDIM, ZDIM, Eigen::RowMajor> EZM;
-  typedef Eigen::Matrix<double, Eigen::Dynamic, 1> X1M;
-  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> XXM;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, ZDIM, 1> X1M;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor, ZDIM, ZDIM> XXM;
 
   double in_hx[ZDIM] = {0};
   double in_H[ZDIM * DIM] = {0};
@@ -62,7 +64,7 @@ void update(double *in_x, double *in_P, Hfun h_fun, Hfun H_fun, Hfun Hea_fun, do
 
   // get y (y = z - hx)
   Eigen::Matrix<double, ZDIM, 1> pre_y(in_hx); pre_y = z - pre_y;
-  X1M y; XXM H; XXM R;
+  X1M y; XDM H; XXM R;
   if (Hea_fun){
     typedef Eigen::Matrix<double, ZDIM, EADIM, Eigen::RowMajor> ZAM;
     double in_Hea[ZDIM * EADIM] = {0};
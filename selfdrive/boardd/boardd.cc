@@ -25,6 +25,7 @@
 #include "common/params.h"
 #include "common/swaglog.h"
 #include "common/timing.h"
+#include "common/trace.h"
 #include "common/util.h"
 #include "system/hardware/hw.h"
 
@@ -227,6 +228,8 @@ void can_send_thread(std::vector<Panda *> pandas, bool fake_send) {
 
     //Dont send if older than 1 second
     if ((nanos_since_boot() - event.getLogMonoTime() < 1e9) && !fake_send) {
+      TRACE_SCOPE("can send");
+      TRACE_COUNTER("sendcan age ms", (nanos_since_boot() - event.getLogMonoTime()) / 1e6);
       for (const auto& panda : pandas) {
         LOGT("sending sendcan to panda: %s", (panda->hw_serial()).c_str());
         panda->can_send(event.getSendcan());
@@ -248,11 +251,13 @@ void can_recv_thread(std::vector<Panda *> pandas) {
   std::vector<can_frame> raw_can_data;
 
   while (!do_exit && check_all_connected(pandas)) {
+    const uint64_t recv_start = nanos_since_boot();
     bool comms_healthy = true;
     raw_can_data.clear();
     for (const auto& panda : pandas) {
       comms_healthy &= panda->can_receive(raw_can_data);
     }
+    TRACE_COUNTER("can recv msgs", raw_can_data.size());
 
     MessageBuilder msg;
     auto evt = msg.initEvent();
@@ -267,6 +272,7 @@ void can_recv_thread(std::vector<Panda *> pandas) {
     pm.send("can", msg);
 
     uint64_t cur_time = nanos_since_boot();
+    if (trace::enabled) trace::record(trace::EventType::SPAN, "can recv", recv_start, cur_time - recv_start);
     int64_t remaining = next_frame_time - cur_time;
     if (remaining > 0) {
       std::this_thread::sleep_for(std::chrono::nanoseconds(remaining));
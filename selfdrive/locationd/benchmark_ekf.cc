@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "common/timing.h"
+#include "common/transformations/coordinates.hpp"
+#include "selfdrive/locationd/models/live_kf.h"
+#include "tools/replay/logreader.h"
+
+// Runs the live filter on the IMU, camera odometry, standstill and GPS observations of recorded logs,
+// once with the dynamic EKFSym and once with the fixed-size live_fixed_ekf, and compares the time
+// per observation and the resulting states. Calibration is left out, the observations are the same
+// for both filters. The fixed-size filter also runs with a bounded replay, as in locationd.
+// usage (from selfdrive/locationd): ./benchmark_ekf rlog.bz2 [rlog.bz2 ...]
+
+struct Obs {
+  double t;
+  int kind;
+  Eigen::VectorXd z;
+  MatrixXdr R;
+};
+
+std::vector<Obs> load_observations(const std::vector<std::string> &paths) {
+  std::vector<Obs> observations;
+  auto R = [](int kind) -> MatrixXdr { return live_obs_noise_diag.at(kind).asDiagonal(); };
+  auto vec3 = [](auto v) { return Eigen::Vector3d(v[0], v[1], v[2]); };
+
+  for (const auto &path : paths) {
+    LogReader lr;
+    if (!lr.load(path)) {
+      printf("failed to load %s\n", path.c_str());
+      continue;
+    }
+    for (const Event *e : lr.events) {
+      const double t = e->mono_time * 1e-9;
+      auto event = e->event;
+      if (event.isAccelerometer() || event.isGyroscope()) {
+        auto sensor = event.isAccelerometer() ? event.getAccelerometer() : event.getGyroscope();
+        if (sensor.getSource() == cereal::SensorEventData::SensorSource::BMX055 || sensor.getTimestamp() == 0) continue;
+        const bool gyro = event.isGyroscope();
+        const int kind = gyro ? OBSERVATION_PHONE_GYRO : OBSERVATION_PHONE_ACCEL;
+        auto add = [&](double ts, float x, float y, float z) {
+          observations.push_back({ts, kind, Eigen::Vector3d(-z, -y, -x), R(kind)});
+        };
+        if (sensor.hasBatch()) {
+          auto timestamps = sensor.getBatch().getTimestamps();
+          auto values = sensor.getBatch().getValues();
+          for (size_t i = 0; i < timestamps.size(); i++) {
+            add(timestamps[i] * 1e-9, values[i * 3], values[i * 3 + 1], values[i * 3 + 2]);
+          }
+        } else {
+          auto v = gyro ? sensor.getGyroUncalibrated().getV() : sensor.getAcceleration().getV();
+          add(sensor.getTimestamp() * 1e-9, v[0], v[1], v[2]);
+        }
+      } else if (event.isCameraOdometry()) {
+        auto odo = event.getCameraOdometry();
+        Eigen::Vector3d rot_std = vec3(odo.getRotStd()) * 10.0, trans_std = vec3(odo.getTransStd()) * 10.0;
+        observations.push_back({t, OBSERVATION_CAMERA_ODO_ROTATION, vec3(odo.getRot()), rot_std.array().square().matrix().asDiagonal()});
+        observations.push_back({t, OBSERVATION_CAMERA_ODO_TRANSLATION, vec3(odo.getTrans()), trans_std.array().square().matrix().asDiagonal()});
+      } else if (event.isCarState() && event.getCarState().getStandstill()) {
+        observations.push_back({t, OBSERVATION_NO_ROT, Eigen::Vector3d::Zero(), R(OBSERVATION_NO_ROT)});
+        observations.push_back({t, OBSERVATION_NO_ACCEL, Eigen::Vector3d::Zero(), R(OBSERVATION_NO_ACCEL)});
+      } else if (event.isGpsLocationExternal()) {
+        // late by the ublox offset of locationd, so these rewind the filter
+        auto gps = event.getGpsLocationExternal();
+        if (gps.getFlags() % 2 == 0) continue;
+        Geodetic geodetic = { gps.getLatitude(), gps.getLongitude(), gps.getAltitude() };
+        LocalCoord converter(geodetic);
+        Eigen::VectorXd ecef_pos = converter.ned2ecef({0.0, 0.0, 0.0}).to_vector();
+        Eigen::VectorXd ecef_vel = converter.ned2ecef({gps.getVNED()[0], gps.getVNED()[1], gps.getVNED()[2]}).to_vector() - ecef_pos;
+        const double pos_var = std::pow(10.0 * gps.getAccuracy(), 2), vel_var = std::pow(10.0 * gps.getSpeedAccuracy(), 2);
+        observations.push_back({t - 0.095, OBSERVATION_ECEF_POS, ecef_pos, Eigen::Vector3d::Constant(pos_var).asDiagonal()});
+        observations.push_back({t - 0.095, OBSERVATION_ECEF_VEL, ecef_vel, Eigen::Vector3d::Constant(vel_var).asDiagonal()});
+      }
+    }
+  }
+  return observations;
+}
+
+std::vector<double> run(const char *name, const std::vector<Obs> &observations, std::function<void(const Obs &)> observe) {
+  std::vector<double> times;
+  times.reserve(observations.size());
+  for (const Obs &obs : observations) {
+    double t1 = nanos_since_boot();
+    observe(obs);
+    times.push_back((nanos_since_boot() - t1) / 1e3);
+  }
+  std::vector<double> sorted = times;
+  std::sort(sorted.begin(), sorted.end());
+  double total = 0;
+  for (double t : sorted) total += t;
+  printf("%s: %zu observations, total %.1f ms, mean %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us\n", name, sorted.size(),
+         total / 1e3, total / sorted.size(), sorted[sorted.size() / 2], sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)], sorted.back());
+  return times;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    printf("usage: %s rlog.bz2 [rlog.bz2 ...]\n", argv[0]);
+    return 1;
+  }
+  const std::vector<Obs> observations = load_observations(std::vector<std::string>(argv + 1, argv + argc));
+  if (observations.empty()) {
+    printf("no observations\n");
+    return 1;
+  }
+
+  Eigen::VectorXd x = live_initial_x;
+  MatrixXdr P = live_initial_P_diag.asDiagonal();
+  MatrixXdr Q = live_Q_diag.asDiagonal();
+  const double t0 = observations[0].t;
+
+  // same settings as LiveKalman
+  EKFSym dynamic_ekf("live", get_mapmat(Q), get_mapvec(x), get_mapmat(P), x.rows(), P.rows(), 0, 0, 0,
+                     std::vector<int>(), std::vector<int>{3}, std::vector<std::string>(), 0.8);
+  live_fixed_ekf fixed_ekf("live", Q, x, P, std::vector<int>{3}, 0.8);
+  live_fixed_ekf bounded_ekf("live", Q, x, P, std::vector<int>{3}, 0.8);
+  bounded_ekf.set_max_replay(16);
+  dynamic_ekf.set_filter_time(t0);
+  fixed_ekf.set_filter_time(t0);
+  bounded_ekf.set_filter_time(t0);
+
+  std::vector<Eigen::VectorXd> dynamic_states, fixed_states, bounded_states;
+  dynamic_states.reserve(observations.size());
+  fixed_states.reserve(observations.size());
+  bounded_states.reserve(observations.size());
+
+  run("EKFSym", observations, [&](const Obs &obs) {
+    Eigen::VectorXd z = obs.z;
+    MatrixXdr R = obs.R;
+    dynamic_ekf.predict_and_update_batch(obs.t, obs.kind, {get_mapvec(z)}, {get_mapmat(R)});
+    dynamic_states.push_back(dynamic_ekf.state());
+  });
+  run("live_fixed_ekf", observations, [&](const Obs &obs) {
+    fixed_ekf.predict_and_update(obs.t, obs.kind, obs.z, obs.R);
+    fixed_states.push_back(fixed_ekf.state());
+  });
+  run("live_fixed_ekf, max replay 16", observations, [&](const Obs &obs) {
+    bounded_ekf.predict_and_update(obs.t, obs.kind, obs.z, obs.R);
+    bounded_states.push_back(bounded_ekf.state());
+  });
+
+  auto print_stats = [](const char *name, const EKFS::RewindStats &stats) {
+    printf("%s late observations: %" PRIu64 " rewinds replaying %" PRIu64 ", %" PRIu64 " shifted, %" PRIu64 " too old, %.2f ms total, %.3f ms max\n", name,
+           stats.rewinds, stats.replayed, stats.shifted, stats.too_old, stats.time * 1e3, stats.max_time * 1e3);
+  };
+  print_stats("live_fixed_ekf", fixed_ekf.rewind_stats());
+  print_stats("live_fixed_ekf, max replay 16", bounded_ekf.rewind_stats());
+
+  double max_diff = 0, max_bounded_diff = 0;
+  for (size_t i = 0; i < observations.size(); i++) {
+    max_diff = std::max(max_diff, (dynamic_states[i] - fixed_states[i]).cwiseAbs().maxCoeff());
+    max_bounded_diff = std::max(max_bounded_diff, (fixed_states[i] - bounded_states[i]).cwiseAbs().maxCoeff());
+  }
+  const double max_P_diff = (dynamic_ekf.covs() - MatrixXdr(fixed_ekf.covs())).cwiseAbs().maxCoeff();
+  printf("max state diff %g, final covariance diff %g\n", max_diff, max_P_diff);
+  printf("max state diff with bounded replay %g\n", max_bounded_diff);
+  return 0;
+}
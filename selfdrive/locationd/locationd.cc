@@ -1,6 +1,8 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 
+#include <algorithm>
+#include <cinttypes>
 #include <cmath>
 
 #include "locationd.h"
@@ -22,6 +24,7 @@ const double SANE_GPS_UNCERTAINTY = 1500.0; // m
 const double INPUT_INVALID_THRESHOLD = 5.0; // same as reset tracker
 const double DECAY = 0.99995; // same as reset tracker
 const double MAX_FILTER_REWIND_TIME = 0.8; // s
+const size_t IMU_SAMPLES_MAX = 256;
 
 // TODO: GPS sensor time offsets are empirically calculated
 // They should be replaced with synced time from a real clock
@@ -70,6 +73,8 @@ static VectorXd rotate_std(const MatrixXdr& rot_matrix, const VectorXd& std_in)
 
 Localizer::Localizer() {
   this->kf = std::make_unique<LiveKalman>();
+  this->kf->set_max_replay(MAX_FILTER_REPLAY);
+  this->imu_samples.reserve(IMU_SAMPLES_MAX);
   this->reset_kalman();
 
   this->calib = Vector3d(0.0, 0.0, 0.0);
@@ -249,10 +254,7 @@ void Localizer::handle_sensor(double current_time, const cereal::SensorEventData
 
   // Gyro Uncalibrated
   if (log.getSensor() == SENSOR_GYRO_UNCALIBRATED && log.getType() == SENSOR_TYPE_GYROSCOPE_UNCALIBRATED) {
-    auto v = log.getGyroUncalibrated().getV();
-    auto meas = Vector3d(-v[2], -v[1], -v[0]);
-    if (meas.norm() < ROTATION_SANITY_CHECK) {
-      this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_GYRO, { meas });
+    if (this->queue_imu_samples(sensor_time, OBSERVATION_PHONE_GYRO, ROTATION_SANITY_CHECK, log.getGyroUncalibrated().getV(), log)) {
       this->observation_values_invalid["gyroscope"] *= DECAY;
     }
     else{
@@ -262,16 +264,12 @@ void Localizer::handle_sensor(double current_time, const cereal::SensorEventData
 
   // Accelerometer
   if (log.getSensor() == SENSOR_ACCELEROMETER && log.getType() == SENSOR_TYPE_ACCELEROMETER) {
-    auto v = log.getAcceleration().getV();
-
     // TODO: reduce false positives and re-enable this check
     // check if device fell, estimate 10 for g
     // 40m/s**2 is a good filter for falling detection, no false positives in 20k minutes of driving
     // this->device_fell |= (floatlist2vector(v) - Vector3d(10.0, 0.0, 0.0)).norm() > 40.0;
 
-    auto meas = Vector3d(-v[2], -v[1], -v[0]);
-    if (meas.norm() < ACCEL_SANITY_CHECK) {
-      this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_ACCEL, { meas });
+    if (this->queue_imu_samples(sensor_time, OBSERVATION_PHONE_ACCEL, ACCEL_SANITY_CHECK, log.getAcceleration().getV(), log)) {
       this->observation_values_invalid["accelerometer"] *= DECAY;
     }
     else{
@@ -280,6 +278,54 @@ void Localizer::handle_sensor(double current_time, const cereal::SensorEventData
   }
 }
 
+bool Localizer::queue_imu_samples(double sensor_time, int kind, double sanity_check,
+                                  const capnp::List<float, capnp::Kind::PRIMITIVE>::Reader& v,
+                                  const cereal::SensorEventData::Reader& log) {
+  bool valid = true;
+  auto queue = [&](double t, float x, float y, float z) {
+    auto meas = Vector3d(-z, -y, -x);
+    if (meas.norm() >= sanity_check) {
+      valid = false;
+      return;
+    }
+    // batched samples are checked one by one, like single ones in handle_sensor
+    if (!this->is_timestamp_valid(t)) {
+      this->observation_timings_invalid = true;
+      return;
+    }
+    // in order of time, samples of the other sensor may be older
+    ImuSample sample = {.t = t, .kind = kind, .meas = meas};
+    auto it = std::upper_bound(this->imu_samples.begin(), this->imu_samples.end(), sample,
+                               [](const ImuSample &a, const ImuSample &b) { return a.t < b.t; });
+    this->imu_samples.insert(it, sample);
+    if (this->imu_samples.size() >= IMU_SAMPLES_MAX) {
+      this->apply_imu_samples();
+    }
+  };
+
+  if (log.hasBatch()) {
+    // all samples since the last message, the newest is also in v
+    auto timestamps = log.getBatch().getTimestamps();
+    auto values = log.getBatch().getValues();
+    for (size_t i = 0; i < timestamps.size() && (i * 3 + 2) < values.size(); i++) {
+      queue(1e-9 * timestamps[i], values[i * 3], values[i * 3 + 1], values[i * 3 + 2]);
+    }
+  } else {
+    queue(sensor_time, v[0], v[1], v[2]);
+  }
+  return valid;
+}
+
+void Localizer::apply_imu_samples() {
+  // same result as observing them one by one, predict_and_observe_single just skips the allocations
+  for (const ImuSample &sample : this->imu_samples) {
+    if (!this->kf->predict_and_observe_single(sample.t, sample.kind, sample.meas)) {
+      this->observation_timings_invalid = true;
+    }
+  }
+  this->imu_samples.clear();
+}
+
 void Localizer::input_fake_gps_observations(double current_time) {
   // This is done to make sure that the error estimate of the position does not blow up
   // when the filter is in no-gps mode
@@ -444,6 +490,7 @@ void Localizer::handle_car_state(double current_time, const cereal::CarState::Re
   this->car_speed = std::abs(log.getVEgo());
   this->standstill = log.getStandstill();
   if (this->standstill) {
+    this->apply_imu_samples();
     this->kf->predict_and_observe(current_time, OBSERVATION_NO_ROT, { Vector3d(0.0, 0.0, 0.0) });
     this->kf->predict_and_observe(current_time, OBSERVATION_NO_ACCEL, { Vector3d(0.0, 0.0, 0.0) });
   }
@@ -571,6 +618,8 @@ void Localizer::reset_kalman(double current_time, VectorXd init_orient, VectorXd
 }
 
 void Localizer::reset_kalman(double current_time, VectorXd init_x, MatrixXdr init_P) {
+  // would have been applied before the reset
+  this->imu_samples.clear();
   this->kf->init_state(init_x, init_P, current_time);
   this->last_reset_time = current_time;
   this->reset_tracker += 1.0;
@@ -593,14 +642,18 @@ void Localizer::handle_msg(const cereal::Event::Reader& log) {
   } else if (log.isGyroscope()) {
     this->handle_sensor(t, log.getGyroscope());
   } else if (log.isGpsLocation()) {
+    this->apply_imu_samples();
     this->handle_gps(t, log.getGpsLocation(), GPS_QUECTEL_SENSOR_TIME_OFFSET);
   } else if (log.isGpsLocationExternal()) {
+    this->apply_imu_samples();
     this->handle_gps(t, log.getGpsLocationExternal(), GPS_UBLOX_SENSOR_TIME_OFFSET);
   //} else if (log.isGnssMeasurements()) {
   //  this->handle_gnss(t, log.getGnssMeasurements());
   } else if (log.isCarState()) {
     this->handle_car_state(t, log.getCarState());
   } else if (log.isCameraOdometry()) {
+    TRACE_FLOW_STEP("road frame", log.getCameraOdometry().getFrameId());
+    this->apply_imu_samples();
     this->handle_cam_odo(t, log.getCameraOdometry());
   } else if (log.isLiveCalibration()) {
     this->handle_live_calib(t, log.getLiveCalibration());
@@ -636,6 +689,10 @@ bool Localizer::critical_services_valid(std::map<std::string, double> critical_s
 
 bool Localizer::is_timestamp_valid(double current_time) {
   double filter_time = this->kf->get_filter_time();
+  // the filter is at the newest queued IMU sample once they're applied
+  if (!this->imu_samples.empty() && !(filter_time >= this->imu_samples.back().t)) {
+    filter_time = this->imu_samples.back().t;
+  }
   if (!std::isnan(filter_time) && ((filter_time - current_time) > MAX_FILTER_REWIND_TIME)) {
     LOGE("Observation timestamp is older than the max rewind threshold of the filter");
     return false;
@@ -689,6 +746,7 @@ int Localizer::locationd_thread() {
       this->observation_timings_invalid_reset();
       for (const char* service : service_list) {
         if (sm.updated(service) && sm.valid(service)){
+          TRACE_SCOPE(service);
           const cereal::Event::Reader log = sm[service];
           this->handle_msg(log);
         }
@@ -700,6 +758,8 @@ int Localizer::locationd_thread() {
     // 100Hz publish for notcars, 20Hz for cars
     const char* trigger_msg = sm["carParams"].getCarParams().getNotCar() ? "accelerometer" : "cameraOdometry";
     if (sm.updated(trigger_msg)) {
+      TRACE_SCOPE("liveLocationKalman");
+      this->apply_imu_samples();
       bool inputsOK = sm.allAliveAndValid() && this->are_inputs_ok();
       bool gpsOK = this->is_gps_ok();
       bool sensorsOK = sm.allAliveAndValid({"accelerometer", "gyroscope"});
@@ -722,15 +782,14 @@ int Localizer::locationd_thread() {
           Params().put("LastGPSPosition", gpsjson);
         }, lastGPSPosJSON).detach();
       }
+      if (cnt % 1200 == 0) {
+        const EKFS::RewindStats &stats = this->kf->get_rewind_stats();
+        LOG("late observations in the last minute: %" PRIu64 " rewinds replaying %" PRIu64 ", %" PRIu64 " shifted, %" PRIu64 " too old, %.2f ms total, %.2f ms max",
+            stats.rewinds, stats.replayed, stats.shifted, stats.too_old, stats.time * 1e3, stats.max_time * 1e3);
+        this->kf->reset_rewind_stats();
+      }
       cnt++;
     }
   }
   return 0;
 }
-
-int main() {
-  util::set_realtime_priority(5);
-
-  Localizer localizer;
-  return localizer.locationd_thread();
-}
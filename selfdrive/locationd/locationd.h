@@ -5,6 +5,7 @@
 #include <memory>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "cereal/messaging/messaging.h"
 #include "common/transformations/coordinates.hpp"
@@ -12,6 +13,7 @@
 #include "common/params.h"
 #include "common/swaglog.h"
 #include "common/timing.h"
+#include "common/trace.h"
 #include "common/util.h"
 
 #include "system/sensord/sensors/constants.h"
@@ -20,6 +22,9 @@
 #include "selfdrive/locationd/models/live_kf.h"
 
 #define POSENET_STD_HIST_HALF 20
+// late observations that would replay more than this are applied at the filter time instead,
+// so a late gps fix costs one update instead of replaying every imu sample since
+#define MAX_FILTER_REPLAY 16
 
 class Localizer {
 public:
@@ -52,6 +57,10 @@ public:
   void handle_msg_bytes(const char *data, const size_t size);
   void handle_msg(const cereal::Event::Reader& log);
   void handle_sensor(double current_time, const cereal::SensorEventData::Reader& log);
+  bool queue_imu_samples(double sensor_time, int kind, double sanity_check,
+                         const capnp::List<float, capnp::Kind::PRIMITIVE>::Reader& v,
+                         const cereal::SensorEventData::Reader& log);
+  void apply_imu_samples();
   void handle_gps(double current_time, const cereal::GpsLocationData::Reader& log, const double sensor_time_offset);
   void handle_gnss(double current_time, const cereal::GnssMeasurements::Reader& log);
   void handle_car_state(double current_time, const cereal::CarState::Reader& log);
@@ -63,6 +72,15 @@ public:
 private:
   std::unique_ptr<LiveKalman> kf;
 
+  // accelerometer and gyroscope samples are applied in one go, before anything else that
+  // observes or reads the filter, which gives the same result as applying them on arrival
+  struct ImuSample {
+    double t;
+    int kind;
+    Eigen::Vector3d meas;
+  };
+  std::vector<ImuSample> imu_samples;
+
   Eigen::VectorXd calib;
   MatrixXdr device_from_calib;
   MatrixXdr calib_from_device;
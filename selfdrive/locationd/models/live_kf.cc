@@ -42,23 +42,22 @@ LiveKalman::LiveKalman() {
   }
 
   // init filter
-  this->filter = std::make_shared<EKFSym>(this->name, get_mapmat(this->Q), get_mapvec(this->initial_x),
-    get_mapmat(initial_P),  this->dim_state, this->dim_state_err, 0, 0, 0, std::vector<int>(),
-    std::vector<int>{3}, std::vector<std::string>(), 0.8);
+  this->filter = std::make_unique<live_fixed_ekf>(this->name, this->Q, this->initial_x, this->initial_P,
+    std::vector<int>{3}, 0.8);
 }
 
 void LiveKalman::init_state(VectorXd& state, VectorXd& covs_diag, double filter_time) {
   MatrixXdr covs = covs_diag.asDiagonal();
-  this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
+  this->filter->init_state(state, covs, filter_time);
 }
 
 void LiveKalman::init_state(VectorXd& state, MatrixXdr& covs, double filter_time) {
-  this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
+  this->filter->init_state(state, covs, filter_time);
 }
 
 void LiveKalman::init_state(VectorXd& state, double filter_time) {
   MatrixXdr covs = this->filter->covs();
-  this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
+  this->filter->init_state(state, covs, filter_time);
 }
 
 VectorXd LiveKalman::get_x() {
@@ -81,19 +80,37 @@ std::vector<MatrixXdr> LiveKalman::get_R(int kind, int n) {
   return R;
 }
 
-std::optional<Estimate> LiveKalman::predict_and_observe(double t, int kind, std::vector<VectorXd> meas, std::vector<MatrixXdr> R) {
-  std::optional<Estimate> r;
+bool LiveKalman::predict_and_observe(double t, int kind, std::vector<VectorXd> meas, std::vector<MatrixXdr> R) {
   if (R.size() == 0) {
     R = this->get_R(kind, meas.size());
   }
-  r = this->filter->predict_and_update_batch(t, kind, get_vec_mapvec(meas), get_vec_mapmat(R));
-  return r;
+  bool ret = true;
+  for (size_t i = 0; i < meas.size(); i++) {
+    ret &= this->filter->predict_and_update(t, kind, meas[i], R[i]);
+  }
+  return ret;
+}
+
+bool LiveKalman::predict_and_observe_single(double t, int kind, const Eigen::Ref<const Eigen::VectorXd> &meas) {
+  return this->filter->predict_and_update(t, kind, meas, this->obs_noise.at(kind));
 }
 
 void LiveKalman::predict(double t) {
   this->filter->predict(t);
 }
 
+void LiveKalman::set_max_replay(int max_replay) {
+  this->filter->set_max_replay(max_replay);
+}
+
+const EKFS::RewindStats &LiveKalman::get_rewind_stats() {
+  return this->filter->rewind_stats();
+}
+
+void LiveKalman::reset_rewind_stats() {
+  this->filter->reset_rewind_stats();
+}
+
 Eigen::VectorXd LiveKalman::get_initial_x() {
   return this->initial_x;
 }
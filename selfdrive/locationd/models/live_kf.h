@@ -7,6 +7,7 @@
 #include <eigen3/Eigen/Core>
 #include <eigen3/Eigen/Dense>
 
+#include "generated/live.h"
 #include "generated/live_kf_constants.h"
 #include "rednose/helpers/ekf_sym.h"
 
@@ -32,11 +33,18 @@ public:
   double get_filter_time();
   std::vector<MatrixXdr> get_R(int kind, int n);
 
-  std::optional<Estimate> predict_and_observe(double t, int kind, std::vector<Eigen::VectorXd> meas, std::vector<MatrixXdr> R = {});
+  // each measurement is a separate observation at t
+  bool predict_and_observe(double t, int kind, std::vector<Eigen::VectorXd> meas, std::vector<MatrixXdr> R = {});
+  // one measurement with the default noise, without the copies of predict_and_observe
+  bool predict_and_observe_single(double t, int kind, const Eigen::Ref<const Eigen::VectorXd> &meas);
   std::optional<Estimate> predict_and_update_odo_speed(std::vector<Eigen::VectorXd> speed, double t, int kind);
   std::optional<Estimate> predict_and_update_odo_trans(std::vector<Eigen::VectorXd> trans, double t, int kind);
   std::optional<Estimate> predict_and_update_odo_rot(std::vector<Eigen::VectorXd> rot, double t, int kind);
   void predict(double t);
+  // see EKFSymFixed::set_max_replay
+  void set_max_replay(int max_replay);
+  const EKFS::RewindStats &get_rewind_stats();
+  void reset_rewind_stats();
 
   Eigen::VectorXd get_initial_x();
   MatrixXdr get_initial_P();
@@ -49,7 +57,8 @@ public:
 private:
   std::string name = "live";
 
-  std::shared_ptr<EKFSym> filter;
+  // fixed-size filter generated with the live model, doesn't allocate while filtering
+  std::unique_ptr<live_fixed_ekf> filter;
 
   int dim_state;
   int dim_state_err;
@@ -0,0 +1,122 @@
+#include <cassert>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <iterator>
+#include <random>
+
+#include "selfdrive/locationd/locationd.h"
+
+// locationd bounds the replay of late observations with MAX_FILTER_REPLAY, a late gps fix is
+// applied at the filter time with the innovation of the state at its timestamp. Runs the live
+// filter on IMU samples, camera odometry and late gps fixes, with and without the bound, and
+// checks that the bounded filter stays within a fraction of the std of the exact one.
+// usage: ./test_bounded_replay
+
+const double GPS_DELAY = 0.15;  // s, later than the ublox offset in locationd
+
+struct Segment {
+  const char *name;
+  int start, err_start;
+};
+
+const Segment SEGMENTS[] = {
+  {"position", STATE_ECEF_POS_START, STATE_ECEF_POS_ERR_START},
+  {"velocity", STATE_ECEF_VELOCITY_START, STATE_ECEF_VELOCITY_ERR_START},
+  {"angular velocity", STATE_ANGULAR_VELOCITY_START, STATE_ANGULAR_VELOCITY_ERR_START},
+  {"acceleration", STATE_ACCELERATION_START, STATE_ACCELERATION_ERR_START},
+};
+
+int main() {
+  LiveKalman exact, bounded;
+  bounded.set_max_replay(MAX_FILTER_REPLAY);
+
+  const double t0 = 100.0;
+  Eigen::VectorXd x = exact.get_initial_x();
+  MatrixXdr P = exact.get_initial_P();
+  exact.init_state(x, P, t0);
+  bounded.init_state(x, P, t0);
+
+  std::mt19937 gen(42);
+  std::normal_distribution<double> noise(0.0, 1.0);
+  auto vec = [&](double a, double b, double c, double std) {
+    return Eigen::Vector3d(a + std * noise(gen), b + std * noise(gen), c + std * noise(gen));
+  };
+
+  // states of the exact filter, the late fixes are taken from them
+  std::deque<std::pair<double, Eigen::VectorXd>> history;
+  double worst[std::size(SEGMENTS)] = {};
+  double worst_std = 0.0;
+  int compared = 0;
+
+  for (int k = 1; k <= 3000; k++) {
+    const double t = t0 + k * 0.005;
+    auto observe = [&](int kind, const Eigen::Vector3d &meas, MatrixXdr R = MatrixXdr()) {
+      std::vector<MatrixXdr> Rs;
+      if (R.size() > 0) Rs.push_back(R);
+      exact.predict_and_observe(t, kind, {meas}, Rs);
+      bounded.predict_and_observe(t, kind, {meas}, Rs);
+    };
+
+    // 100 Hz gyro and accelerometer, alternating, 20 Hz camera odometry
+    if (k % 2) {
+      observe(OBSERVATION_PHONE_GYRO, vec(0.0, 0.0, 0.01 * std::sin(t), 0.001));
+    } else {
+      observe(OBSERVATION_PHONE_ACCEL, vec(-9.81, 0.0, 0.2 * std::cos(0.5 * t), 0.05));
+    }
+    if (k % 10 == 0) {
+      MatrixXdr R = Eigen::Vector3d::Constant(0.01).asDiagonal();
+      observe(OBSERVATION_CAMERA_ODO_TRANSLATION, vec(10.0, 0.0, 0.0, 0.1), R);
+      observe(OBSERVATION_CAMERA_ODO_ROTATION, vec(0.0, 0.0, 0.01 * std::sin(t), 0.001), R * 1e-4);
+    }
+    history.push_back({t, exact.get_x()});
+    while (history.front().first < t - 1.0) {
+      history.pop_front();
+    }
+
+    // 10 Hz gps, late by GPS_DELAY
+    if (k % 20 == 0 && t - GPS_DELAY > t0 + 1.0) {
+      const double t_gps = t - GPS_DELAY;
+      auto it = history.begin();
+      while (std::next(it) != history.end() && std::next(it)->first <= t_gps) it++;
+      const Eigen::VectorXd &x_gps = it->second;
+      Eigen::Vector3d pos = x_gps.segment<3>(STATE_ECEF_POS_START), vel = x_gps.segment<3>(STATE_ECEF_VELOCITY_START);
+      Eigen::Vector3d pos_meas = vec(pos[0], pos[1], pos[2], 1.0), vel_meas = vec(vel[0], vel[1], vel[2], 0.1);
+      MatrixXdr pos_R = Eigen::Vector3d::Constant(1.0).asDiagonal(), vel_R = Eigen::Vector3d::Constant(0.01).asDiagonal();
+      for (LiveKalman *kf : {&exact, &bounded}) {
+        kf->predict_and_observe(t_gps, OBSERVATION_ECEF_POS, {pos_meas}, {pos_R});
+        kf->predict_and_observe(t_gps, OBSERVATION_ECEF_VEL, {vel_meas}, {vel_R});
+      }
+
+      const Eigen::VectorXd x_exact = exact.get_x(), x_bounded = bounded.get_x();
+      const Eigen::VectorXd std_exact = exact.get_P().diagonal().array().sqrt();
+      const Eigen::VectorXd std_bounded = bounded.get_P().diagonal().array().sqrt();
+      for (size_t i = 0; i < std::size(SEGMENTS); i++) {
+        const Segment &s = SEGMENTS[i];
+        for (int j = 0; j < 3; j++) {
+          const double diff = std::abs(x_exact[s.start + j] - x_bounded[s.start + j]);
+          worst[i] = std::max(worst[i], diff / std_exact[s.err_start + j]);
+        }
+      }
+      worst_std = std::max(worst_std, (std_bounded.array() / std_exact.array() - 1.0).abs().maxCoeff());
+      compared++;
+    }
+  }
+
+  const EKFS::RewindStats &stats = bounded.get_rewind_stats();
+  printf("%d gps fixes, bounded: %" PRIu64 " rewinds, %" PRIu64 " shifted\n", compared, stats.rewinds, stats.shifted);
+  for (size_t i = 0; i < std::size(SEGMENTS); i++) {
+    printf("max %s difference: %.3f std\n", SEGMENTS[i].name, worst[i]);
+  }
+  printf("max std difference: %.1f%%\n", worst_std * 100);
+
+  // every fix is late by more than MAX_FILTER_REPLAY observations, so all of them are shifted
+  assert(exact.get_rewind_stats().shifted == 0);
+  assert(stats.shifted == exact.get_rewind_stats().rewinds && stats.shifted == uint64_t(2 * compared));
+  for (size_t i = 0; i < std::size(SEGMENTS); i++) {
+    assert(worst[i] < 0.25);
+  }
+  assert(worst_std < 0.1);
+  return 0;
+}
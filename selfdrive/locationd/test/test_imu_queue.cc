@@ -0,0 +1,145 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "selfdrive/locationd/locationd.h"
+
+// Localizer queues IMU samples and applies them in time order before anything else reads or
+// observes the filter. Checks that this gives the same filter, and the same observation timing
+// errors, as applying each sensor message on arrival, which rewinds for the late ones.
+// usage: ./test_imu_queue
+
+void send(Localizer &localizer, double log_time, std::function<void(cereal::Event::Builder)> init) {
+  MessageBuilder msg;
+  auto event = msg.initEvent();
+  event.setLogMonoTime(log_time * 1e9);
+  init(event);
+  auto bytes = msg.toBytes();
+  localizer.handle_msg_bytes((const char *)bytes.begin(), bytes.size());
+}
+
+void init_sensor(cereal::SensorEventData::Builder s, bool gyro, double t, std::vector<double> batch_times, double v) {
+  s.setSource(cereal::SensorEventData::SensorSource::LSM6DS3);
+  s.setSensor(gyro ? SENSOR_GYRO_UNCALIBRATED : SENSOR_ACCELEROMETER);
+  s.setType(gyro ? SENSOR_TYPE_GYROSCOPE_UNCALIBRATED : SENSOR_TYPE_ACCELEROMETER);
+  s.setTimestamp(t * 1e9);
+  auto value = [&](double ts) -> std::vector<float> {
+    if (gyro) return {float(0.01 * std::sin(ts)), float(0.02 * std::cos(3 * ts)), float(0.005 + v)};
+    return {float(9.81 + v), float(0.1 * std::sin(2 * ts)), float(0.2)};
+  };
+  std::vector<float> newest = value(t);
+  auto vec = gyro ? s.initGyroUncalibrated() : s.initAcceleration();
+  vec.setV({newest[0], newest[1], newest[2]});
+
+  if (!batch_times.empty()) {
+    auto batch = s.initBatch();
+    auto timestamps = batch.initTimestamps(batch_times.size());
+    auto values = batch.initValues(batch_times.size() * 3);
+    for (size_t i = 0; i < batch_times.size(); i++) {
+      timestamps.set(i, batch_times[i] * 1e9);
+      std::vector<float> sample = value(batch_times[i]);
+      for (int j = 0; j < 3; j++) values.set(i * 3 + j, sample[j]);
+    }
+  }
+}
+
+// the queued Localizer and one that applies each message right away
+struct Pair {
+  Localizer queued, per_sample;
+
+  void sensor(double log_time, bool gyro, double t, std::vector<double> batch_times = {}, double v = 0.0) {
+    for (Localizer *l : {&queued, &per_sample}) {
+      send(*l, log_time, [&](cereal::Event::Builder e) {
+        init_sensor(gyro ? e.initGyroscope() : e.initAccelerometer(), gyro, t, batch_times, v);
+      });
+    }
+    per_sample.apply_imu_samples();
+  }
+
+  void camera_odometry(double log_time, double k) {
+    for (Localizer *l : {&queued, &per_sample}) {
+      send(*l, log_time, [&](cereal::Event::Builder e) {
+        auto odo = e.initCameraOdometry();
+        odo.setTrans({float(20.0 + std::sin(k)), 0.1f, 0.0f});
+        odo.setRot({0.0f, 0.001f, float(0.01 * std::cos(k))});
+        odo.setTransStd({0.1f, 0.1f, 0.1f});
+        odo.setRotStd({0.01f, 0.01f, 0.01f});
+      });
+    }
+  }
+
+  void reset_timings() {
+    queued.observation_timings_invalid_reset();
+    per_sample.observation_timings_invalid_reset();
+  }
+};
+
+double max_diff(const Eigen::VectorXd &a, const Eigen::VectorXd &b) {
+  return (a - b).cwiseAbs().cwiseQuotient(b.cwiseAbs().array().max(1.0).matrix()).maxCoeff();
+}
+
+void test_equivalence() {
+  Pair pair;
+  const double t0 = 100.0;
+  double worst = 0.0;
+  int compared = 0;
+  for (int k = 0; k < 1000; k++) {
+    const double t = t0 + k * 0.01;
+    const double jitter = 0.001 * ((k * 7) % 5);
+
+    // accel arrives after the next gyro sample, so it's late for the per-sample filter
+    pair.sensor(t + 0.002, true, t + jitter);
+    if (k > 0) {
+      const double ta = t - 0.007 + jitter;
+      if (k % 50 == 0) {
+        // FIFO mode batch, oldest first
+        pair.sensor(ta + 0.002, false, ta, {ta - 0.004, ta - 0.002, ta}, 0.01);
+      } else {
+        pair.sensor(ta + 0.002, false, ta, {}, 0.001 * (k % 3));
+      }
+    }
+
+    if (k % 5 == 4) {
+      pair.camera_odometry(t + 0.005, k);
+      worst = std::max(worst, max_diff(pair.queued.get_state(), pair.per_sample.get_state()));
+      worst = std::max(worst, max_diff(pair.queued.get_stdev(), pair.per_sample.get_stdev()));
+      compared++;
+    }
+  }
+  printf("%d camera frames, max relative difference %g\n", compared, worst);
+  assert(compared == 200);
+  assert(worst < 1e-9);
+}
+
+void test_timings() {
+  Pair pair;
+  auto check = [&](bool ok) {
+    pair.queued.apply_imu_samples();
+    assert(pair.queued.are_inputs_ok() == ok);
+    assert(pair.per_sample.are_inputs_ok() == ok);
+    pair.reset_timings();
+  };
+
+  // more than the max rewind time behind the newest sample, which is still queued
+  pair.sensor(10.0, true, 10.0);
+  pair.sensor(10.9, true, 10.9);
+  pair.sensor(10.05, true, 10.05);
+  check(false);
+
+  // a batch with one such sample
+  pair.sensor(10.95, true, 10.95);
+  pair.sensor(10.95, false, 10.95, {10.1, 10.93, 10.95});
+  check(false);
+
+  pair.sensor(10.97, false, 10.97, {10.96, 10.97});
+  check(true);
+  printf("timings ok\n");
+}
+
+int main() {
+  test_equivalence();
+  test_timings();
+  return 0;
+}
@@ -0,0 +1,240 @@
+#include <fcntl.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json11.hpp"
+
+#include "cereal/messaging/messaging.h"
+#include "cereal/visionipc/visionipc_server.h"
+#include "cereal/visionipc/visionipc_sync_client.h"
+#include "common/clutil.h"
+#include "common/queue.h"
+#include "common/timing.h"
+#include "common/util.h"
+#include "selfdrive/modeld/models/driving.h"
+#include "tools/replay/framereader.h"
+
+// Runs the modeld loop on frames of a recorded segment, served by a local VisionIpcServer, and
+// reports the latency of each stage and the fps as JSON. No camera or device needed, on a PC the
+// default runner is ONNX.
+// usage (from selfdrive/modeld):
+//   ./benchmark_modeld fcamera.hevc [--wide ecamera.hevc] [--runner onnx] [--frames 200] [--fps 20] [--json out.json]
+// Without --fps, a frame is sent as soon as the previous one is published, which measures the
+// throughput. With it, frames are sent at that rate and the model drops the ones it can't keep up with.
+// modelV2 and cameraOdometry are published as in modeld, so don't run it next to openpilot.
+
+const char *VIPC_NAME = "benchmark_modeld";
+// decoded up front and cycled through, so decoding isn't part of any stage
+const int PRELOAD_FRAMES = 20;
+const std::vector<double> HISTOGRAM_BINS_MS = {0.5, 1, 2, 5, 10, 20, 50, 100, 200, 500};
+
+struct Stream {
+  VisionStreamType type;
+  int width, height;
+  std::vector<std::vector<uint8_t>> frames;
+};
+
+bool load_frames(const std::string &path, Stream &stream) {
+  FrameReader fr;
+  if (!fr.load(path, true)) {
+    printf("failed to load %s\n", path.c_str());
+    return false;
+  }
+  stream.width = fr.width;
+  stream.height = fr.height;
+  for (int i = 0; i < std::min<int>(fr.getFrameCount(), PRELOAD_FRAMES); i++) {
+    auto &frame = stream.frames.emplace_back(fr.getYUVSize());
+    if (!fr.get(i, frame.data())) {
+      printf("failed to decode frame %d of %s\n", i, path.c_str());
+      return false;
+    }
+  }
+  return !stream.frames.empty();
+}
+
+void serve_frames(VisionIpcServer &server, std::vector<Stream> &streams, int num_frames, double fps,
+                  SafeQueue<uint32_t> &published) {
+  const double start = millis_since_boot();
+  for (uint32_t frame_id = 1; frame_id <= (uint32_t)num_frames; frame_id++) {
+    // fill the next buffers while the model still works on the previous frame
+    std::vector<VisionBuf *> bufs;
+    for (auto &s : streams) {
+      VisionBuf *buf = server.get_buffer(s.type);
+      const auto &frame = s.frames[frame_id % s.frames.size()];
+      memcpy(buf->addr, frame.data(), frame.size());
+      buf->set_frame_id(frame_id);
+      bufs.push_back(buf);
+    }
+
+    if (fps > 0) {
+      util::sleep_for(std::max(0.0, start + frame_id * 1000.0 / fps - millis_since_boot()));
+    } else if (frame_id > 1) {
+      published.pop();
+    }
+
+    const uint64_t ts = nanos_since_boot();
+    VisionIpcBufExtra extra = {.frame_id = frame_id, .timestamp_sof = ts, .timestamp_eof = ts};
+    for (auto buf : bufs) {
+      server.send(buf, &extra);
+    }
+  }
+}
+
+json11::Json stage_stats(std::vector<double> times) {
+  if (times.empty()) return json11::Json::object{};
+
+  std::sort(times.begin(), times.end());
+  double mean = 0;
+  for (double t : times) mean += t / times.size();
+  auto percentile = [&](int p) { return times[std::min(times.size() - 1, times.size() * p / 100)]; };
+
+  std::vector<int> counts(HISTOGRAM_BINS_MS.size() + 1);
+  for (double t : times) {
+    counts[std::lower_bound(HISTOGRAM_BINS_MS.begin(), HISTOGRAM_BINS_MS.end(), t) - HISTOGRAM_BINS_MS.begin()]++;
+  }
+  return json11::Json::object{
+    {"mean_ms", mean},
+    {"p50_ms", percentile(50)},
+    {"p90_ms", percentile(90)},
+    {"p99_ms", percentile(99)},
+    {"max_ms", times.back()},
+    // counts[i] is the number of samples <= bins_ms[i], the last one the ones above all bins
+    {"histogram", json11::Json::object{{"bins_ms", HISTOGRAM_BINS_MS}, {"counts", counts}}},
+  };
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argv[1][0] == '-') {
+    printf("usage: %s fcamera.hevc [--wide ecamera.hevc] [--runner onnx] [--frames 200] [--fps 20] [--json out.json]\n", argv[0]);
+    return 1;
+  }
+  std::string road_path = argv[1], wide_path, runner, json_path;
+  int num_frames = 200;
+  double fps = 0;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    const std::string arg = argv[i];
+    if (arg == "--wide") wide_path = argv[i + 1];
+    else if (arg == "--runner") runner = argv[i + 1];
+    else if (arg == "--frames") num_frames = atoi(argv[i + 1]);
+    else if (arg == "--fps") fps = atof(argv[i + 1]);
+    else if (arg == "--json") json_path = argv[i + 1];
+    else {
+      printf("unknown argument %s\n", arg.c_str());
+      return 1;
+    }
+  }
+
+  // same as modeld without WideCameraOnly: road camera for the main frame, wide camera for the extra one
+  const bool use_extra = !wide_path.empty();
+  std::vector<Stream> streams = {{.type = VISION_STREAM_ROAD}};
+  if (use_extra) streams.push_back({.type = VISION_STREAM_WIDE_ROAD});
+  if (!load_frames(road_path, streams[0]) || (use_extra && !load_frames(wide_path, streams[1]))) {
+    return 1;
+  }
+
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
+
+  ModelState model;
+  model_init(&model, device_id, context, runner);
+
+  // buffers with the packed NV12 layout of FrameReader
+  VisionIpcServer server(VIPC_NAME, device_id, context);
+  std::vector<VisionStreamType> types;
+  for (auto &s : streams) {
+    const size_t y_size = s.width * s.height;
+    server.create_buffers_with_sizes(s.type, 4, false, s.width, s.height, y_size * 3 / 2, s.width, y_size);
+    types.push_back(s.type);
+  }
+  server.start_listener();
+
+  // both streams are sent with the same frame id, and at low --fps frames are far apart
+  VisionIpcSyncPolicy policy;
+  policy.match_frame_id = true;
+  policy.timeout_ms = 1000;
+  VisionIpcSyncClient vipc_client(VIPC_NAME, types, policy, device_id, context);
+  vipc_client.connect(true);
+
+  PubMaster pm({"modelV2", "cameraOdometry"});
+  const mat3 transform_main = update_calibration(Eigen::Vector3d::Zero(), false, false);
+  const mat3 transform_extra = update_calibration(Eigen::Vector3d::Zero(), true, true);
+  float vec_desire[DESIRE_LEN] = {};
+  float driving_style[DRIVING_STYLE_LEN] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0};
+  float nav_features[NAV_FEATURE_LEN] = {};
+
+  SafeQueue<uint32_t> published;
+  std::thread server_thread(serve_frames, std::ref(server), std::ref(streams), num_frames, fps, std::ref(published));
+
+  std::vector<double> vipc_wait, warp, inference, publish, total;
+  std::vector<VisionIpcSyncFrame> frames;
+  uint32_t last_frame_id = 0;
+  double start = 0;
+  while (last_frame_id < (uint32_t)num_frames) {
+    double t0 = millis_since_boot();
+    if (!vipc_client.recv(frames)) {
+      // no more frames
+      if (last_frame_id > 0) break;
+      continue;
+    }
+    double t1 = millis_since_boot();
+    if (start == 0) start = t1;
+
+    VisionBuf *buf_main = frames[0].buf;
+    VisionBuf *buf_extra = use_extra ? frames[1].buf : buf_main;
+    ModelInputs inputs;
+    model_prepare_frame(&model, &inputs, buf_main, buf_extra, transform_main, transform_extra, vec_desire, false, driving_style, nav_features);
+    double t2 = millis_since_boot();
+    ModelOutput *model_output = model_execute_frame(&model, inputs);
+    double t3 = millis_since_boot();
+
+    const VisionIpcBufExtra &meta = frames[0].extra;
+    model_publish(pm, meta.frame_id, use_extra ? frames[1].extra.frame_id : meta.frame_id, meta.frame_id, 0, *model_output, meta.timestamp_eof,
+                  (t3 - t2) / 1000.0, (t2 - t1) / 1000.0, 0, kj::ArrayPtr<const float>(model.output.data(), model.output.size()), true);
+    posenet_publish(pm, meta.frame_id, 0, *model_output, meta.timestamp_eof, true);
+    double t4 = millis_since_boot();
+
+    // the first frame waits for the server to start
+    if (last_frame_id > 0) vipc_wait.push_back(t1 - t0);
+    warp.push_back(t2 - t1);
+    inference.push_back(t3 - t2);
+    publish.push_back(t4 - t3);
+    total.push_back(t4 - t1);
+    last_frame_id = meta.frame_id;
+    published.push(last_frame_id);
+  }
+  const double elapsed = millis_since_boot() - start;
+  server_thread.join();
+
+  json11::Json result = json11::Json::object{
+    {"runner", runner.empty() ? "default" : runner},
+    {"cameras", (int)streams.size()},
+    {"frames_sent", num_frames},
+    {"frames_processed", (int)total.size()},
+    {"frames_dropped", (double)vipc_client.get_dropped()},
+    {"fps", total.size() * 1000.0 / elapsed},
+    {"stages", json11::Json::object{
+      {"vipc_wait", stage_stats(vipc_wait)},
+      {"warp", stage_stats(warp)},
+      {"inference", stage_stats(inference)},
+      {"publish", stage_stats(publish)},
+      {"total", stage_stats(total)},
+    }},
+  };
+  const std::string json = result.dump();
+  if (json_path.empty()) {
+    printf("%s\n", json.c_str());
+  } else {
+    util::write_file(json_path.c_str(), json.data(), json.size(), O_WRONLY | O_CREAT | O_TRUNC);
+  }
+
+  model_free(&model);
+  CL_CHECK(clReleaseContext(context));
+  return 0;
+}
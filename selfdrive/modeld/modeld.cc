@@ -1,17 +1,22 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <mutex>
 #include <cmath>
+#include <thread>
 
 #include <eigen3/Eigen/Dense>
 
 #include "cereal/messaging/messaging.h"
-#include "common/transformations/orientation.hpp"
 
-#include "cereal/visionipc/visionipc_client.h"
+#include "cereal/visionipc/visionipc_sync_client.h"
 #include "common/clutil.h"
 #include "common/params.h"
+#include "common/queue.h"
 #include "common/swaglog.h"
+#include "common/timing.h"
+#include "common/trace.h"
 #include "common/util.h"
 #include "system/hardware/hw.h"
 #include "selfdrive/modeld/models/driving.h"
@@ -20,47 +25,83 @@
 
 ExitHandler do_exit;
 
-mat3 update_calibration(Eigen::Vector3d device_from_calib_euler, bool wide_camera, bool bigmodel_frame) {
-  /*
-     import numpy as np
-     from common.transformations.model import medmodel_frame_from_calib_frame
-     medmodel_frame_from_calib_frame = medmodel_frame_from_calib_frame[:, :3]
-     calib_from_smedmodel_frame = np.linalg.inv(medmodel_frame_from_calib_frame)
-  */
-  static const auto calib_from_medmodel = (Eigen::Matrix<float, 3, 3>() <<
-     0.00000000e+00, 0.00000000e+00, 1.00000000e+00,
-     1.09890110e-03, 0.00000000e+00, -2.81318681e-01,
-    -2.25466395e-20, 1.09890110e-03,-5.23076923e-02).finished();
-
-  static const auto calib_from_sbigmodel = (Eigen::Matrix<float, 3, 3>() <<
-     0.00000000e+00,  7.31372216e-19,  1.00000000e+00,
-     2.19780220e-03,  4.11497335e-19, -5.62637363e-01,
-    -6.66298828e-20,  2.19780220e-03, -3.33626374e-01).finished();
-
-  static const auto view_from_device = (Eigen::Matrix<float, 3, 3>() <<
-     0.0,  1.0,  0.0,
-     0.0,  0.0,  1.0,
-     1.0,  0.0,  0.0).finished();
-
-
-  const auto cam_intrinsics = Eigen::Matrix<float, 3, 3, Eigen::RowMajor>(wide_camera ? ecam_intrinsic_matrix.v : fcam_intrinsic_matrix.v);
-  Eigen::Matrix<float, 3, 3, Eigen::RowMajor>  device_from_calib = euler2rot(device_from_calib_euler).cast <float> ();
-  auto calib_from_model = bigmodel_frame ? calib_from_sbigmodel : calib_from_medmodel;
-  auto camera_from_calib = cam_intrinsics * view_from_device * device_from_calib;
-  auto warp_matrix = camera_from_calib * calib_from_model;
-
-  mat3 transform = {};
-  for (int i=0; i<3*3; i++) {
-    transform.v[i] = warp_matrix(i / 3, i % 3);
+// the flow of the main camera frames in the trace
+const char *frame_flow = "road frame";
+
+// A prepared frame waiting for the model
+struct ModelJob {
+  ModelInputs inputs;
+  bool prepare_only;
+  uint32_t vipc_dropped_frames;
+  uint32_t frame_id;
+  float frame_drop_ratio;
+  VisionIpcBufExtra meta_main, meta_extra;
+  bool live_calib_seen;
+  double preprocess_start, prepared;
+};
+
+// An executed frame waiting to be published
+struct PublishJob {
+  ModelJob job;
+  std::array<float, NET_OUTPUT_SIZE> output;
+  float model_execution_time, model_preprocess_time, model_queue_time;
+};
+
+// Executes the prepared frames in order, so preprocessing of the next frame overlaps with inference of this one
+void inference_thread(ModelState &model, SafeQueue<ModelJob *> &ready, SafeQueue<ModelJob *> &free_jobs,
+                      SafeQueue<PublishJob *> &publish, SafeQueue<PublishJob *> &free_publish) {
+  ModelJob *job = nullptr;
+  while (!do_exit) {
+    if (!ready.try_pop(job, 100)) continue;
+
+    if (!job->prepare_only) {
+      TRACE_SCOPE_FRAME("model execute", job->meta_main.frame_id);
+      TRACE_FLOW_STEP(frame_flow, job->meta_main.frame_id);
+      double mt1 = millis_since_boot();
+      ModelOutput *model_output = model_execute_frame(&model, job->inputs);
+      double mt2 = millis_since_boot();
+
+      // never block inference on the publisher, drop the message instead
+      PublishJob *p = nullptr;
+      if (free_publish.try_pop(p)) {
+        p->job = *job;
+        std::memcpy(p->output.data(), model_output, sizeof(float) * NET_OUTPUT_SIZE);
+        p->model_execution_time = (mt2 - mt1) / 1000.0;
+        p->model_preprocess_time = (job->prepared - job->preprocess_start) / 1000.0;
+        p->model_queue_time = (mt1 - job->prepared) / 1000.0;
+        publish.push(p);
+      } else {
+        LOGE("publisher behind, dropping model output of frame %d", job->meta_main.frame_id);
+      }
+    }
+
+    // the inputs of this job can be overwritten from now on
+    free_jobs.push(job);
   }
-  static const mat3 yuv_transform = get_model_yuv_transform();
-  return matmul3(yuv_transform, transform);
 }
 
+// Serializes modelV2 and cameraOdometry off the inference thread
+void publish_thread(SafeQueue<PublishJob *> &publish, SafeQueue<PublishJob *> &free_publish) {
+  PubMaster pm({"modelV2", "cameraOdometry"});
+
+  PublishJob *p = nullptr;
+  while (!do_exit) {
+    if (!publish.try_pop(p, 100)) continue;
+
+    const ModelJob &job = p->job;
+    const ModelOutput &model_output = *(const ModelOutput *)p->output.data();
+    TRACE_SCOPE_FRAME("model publish", job.meta_main.frame_id);
+    TRACE_FLOW_STEP(frame_flow, job.meta_main.frame_id);
+    model_publish(pm, job.meta_main.frame_id, job.meta_extra.frame_id, job.frame_id, job.frame_drop_ratio, model_output, job.meta_main.timestamp_eof,
+                  p->model_execution_time, p->model_preprocess_time, p->model_queue_time,
+                  kj::ArrayPtr<const float>(p->output.data(), p->output.size()), job.live_calib_seen);
+    posenet_publish(pm, job.meta_main.frame_id, job.vipc_dropped_frames, model_output, job.meta_main.timestamp_eof, job.live_calib_seen);
+    free_publish.push(p);
+  }
+}
 
-void run_model(ModelState &model, VisionIpcClient &vipc_client_main, VisionIpcClient &vipc_client_extra, bool main_wide_camera, bool use_extra_client) {
+void run_model(ModelState &model, VisionIpcSyncClient &vipc_client, bool main_wide_camera, bool use_extra_client) {
   // messaging
-  PubMaster pm({"modelV2", "cameraOdometry"});
   SubMaster sm({"lateralPlan", "roadCameraState", "liveCalibration", "driverMonitoringState"});
 
   // setup filter to track dropped frames
@@ -81,35 +122,45 @@ void run_model(ModelState &model, VisionIpcClient &vipc_client_main, VisionIpcCl
 
   VisionIpcBufExtra meta_main = {0};
   VisionIpcBufExtra meta_extra = {0};
+  std::vector<VisionIpcSyncFrame> frames;
+
+  // The history buffers keep the inputs of one frame valid while the next one is prepared, so at most
+  // two frames are in flight. Runners that take the image as a cl_mem are prepared in place and
+  // can't overlap with inference.
+  const int pipeline_depth = model.m->getInputBuf() == nullptr ? 2 : 1;
+  std::vector<ModelJob> jobs(pipeline_depth);
+  std::vector<PublishJob> publish_jobs(2);
+  SafeQueue<ModelJob *> ready, free_jobs;
+  SafeQueue<PublishJob *> publish, free_publish;
+  for (auto &j : jobs) free_jobs.push(&j);
+  for (auto &p : publish_jobs) free_publish.push(&p);
+  LOGW("modeld pipeline depth %d", pipeline_depth);
+
+  frame_flow = main_wide_camera ? "wide road frame" : "road frame";
+  std::thread inference(inference_thread, std::ref(model), std::ref(ready), std::ref(free_jobs), std::ref(publish), std::ref(free_publish));
+  std::thread publisher(publish_thread, std::ref(publish), std::ref(free_publish));
 
   while (!do_exit) {
-    // Keep receiving frames until we are at least 1 frame ahead of previous extra frame
-    while (meta_main.timestamp_sof < meta_extra.timestamp_sof + 25000000ULL) {
-      buf_main = vipc_client_main.recv(&meta_main);
-      if (buf_main == nullptr)  break;
-    }
-
-    if (buf_main == nullptr) {
-      LOGE("vipc_client_main no frame");
+    // Wait for the main and extra frames of the same capture
+    if (!vipc_client.recv(frames)) {
+      if (!vipc_client.is_connected()) {
+        // camerad restarted. the frames are copied into the model inputs while preparing,
+        // so no job refers to the old buffers
+        LOGW("vipc_client disconnected, reconnecting");
+        while (!do_exit && !vipc_client.connect(false)) {
+          util::sleep_for(100);
+        }
+        continue;
+      }
+      LOGE_100("vipc_client no frame");
       continue;
     }
 
+    buf_main = frames[0].buf;
+    meta_main = frames[0].extra;
     if (use_extra_client) {
-      // Keep receiving extra frames until frame id matches main camera
-      do {
-        buf_extra = vipc_client_extra.recv(&meta_extra);
-      } while (buf_extra != nullptr && meta_main.timestamp_sof > meta_extra.timestamp_sof + 25000000ULL);
-
-      if (buf_extra == nullptr) {
-        LOGE("vipc_client_extra no frame");
-        continue;
-      }
-
-      if (std::abs((int64_t)meta_main.timestamp_sof - (int64_t)meta_extra.timestamp_sof) > 10000000ULL) {
-        LOGE("frames out of sync! main: %d (%.5f), extra: %d (%.5f)",
-          meta_main.frame_id, double(meta_main.timestamp_sof) / 1e9,
-          meta_extra.frame_id, double(meta_extra.timestamp_sof) / 1e9);
-      }
+      buf_extra = frames[1].buf;
+      meta_extra = frames[1].extra;
     } else {
       // Use single camera
       buf_extra = buf_main;
@@ -153,21 +204,37 @@ void run_model(ModelState &model, VisionIpcClient &vipc_client_main, VisionIpcCl
       LOGE("skipping model eval. Dropped %d frames", vipc_dropped_frames);
     }
 
-    double mt1 = millis_since_boot();
-    ModelOutput *model_output = model_eval_frame(&model, buf_main, buf_extra, model_transform_main, model_transform_extra, vec_desire, is_rhd, driving_style, nav_features, prepare_only);
-    double mt2 = millis_since_boot();
-    float model_execution_time = (mt2 - mt1) / 1000.0;
+    // wait until the frame before the previous one is done executing
+    ModelJob *job = nullptr;
+    while (!do_exit && !free_jobs.try_pop(job, 100)) {}
+    if (job == nullptr) break;
 
-    if (model_output != nullptr) {
-      model_publish(pm, meta_main.frame_id, meta_extra.frame_id, frame_id, frame_drop_ratio, *model_output, meta_main.timestamp_eof, model_execution_time,
-                    kj::ArrayPtr<const float>(model.output.data(), model.output.size()), live_calib_seen);
-      posenet_publish(pm, meta_main.frame_id, vipc_dropped_frames, *model_output, meta_main.timestamp_eof, live_calib_seen);
+    double mt1 = millis_since_boot();
+    {
+      TRACE_SCOPE_FRAME("model prepare", meta_main.frame_id);
+      TRACE_FLOW_STEP(frame_flow, meta_main.frame_id);
+      model_prepare_frame(&model, &job->inputs, buf_main, buf_extra, model_transform_main, model_transform_extra, vec_desire, is_rhd, driving_style, nav_features);
     }
+    double mt2 = millis_since_boot();
 
-    //printf("model process: %.2fms, from last %.2fms, vipc_frame_id %u, frame_id, %u, frame_drop %.3f\n", mt2 - mt1, mt1 - last, extra.frame_id, frame_id, frame_drop_ratio);
+    job->prepare_only = prepare_only;
+    job->vipc_dropped_frames = vipc_dropped_frames;
+    job->frame_id = frame_id;
+    job->frame_drop_ratio = frame_drop_ratio;
+    job->meta_main = meta_main;
+    job->meta_extra = meta_extra;
+    job->live_calib_seen = live_calib_seen;
+    job->preprocess_start = mt1;
+    job->prepared = mt2;
+    ready.push(job);
+
+    //printf("model prepare: %.2fms, from last %.2fms, vipc_frame_id %u, frame_id, %u, frame_drop %.3f\n", mt2 - mt1, mt1 - last, extra.frame_id, frame_id, frame_drop_ratio);
     last = mt1;
     last_vipc_frame_id = meta_main.frame_id;
   }
+
+  inference.join();
+  publisher.join();
 }
 
 int main(int argc, char **argv) {
@@ -191,29 +258,26 @@ int main(int argc, char **argv) {
   model_init(&model, device_id, context);
   LOGW("models loaded, modeld starting");
 
-  VisionIpcClient vipc_client_main = VisionIpcClient("camerad", main_wide_camera ? VISION_STREAM_WIDE_ROAD : VISION_STREAM_ROAD, true, device_id, context);
-  VisionIpcClient vipc_client_extra = VisionIpcClient("camerad", VISION_STREAM_WIDE_ROAD, false, device_id, context);
-
-  while (!do_exit && !vipc_client_main.connect(false)) {
-    util::sleep_for(100);
-  }
+  std::vector<VisionStreamType> streams = {main_wide_camera ? VISION_STREAM_WIDE_ROAD : VISION_STREAM_ROAD};
+  if (use_extra_client) streams.push_back(VISION_STREAM_WIDE_ROAD);
+  VisionIpcSyncClient vipc_client("camerad", streams, {}, device_id, context);
 
-  while (!do_exit && use_extra_client && !vipc_client_extra.connect(false)) {
+  while (!do_exit && !vipc_client.connect(false)) {
     util::sleep_for(100);
   }
 
   // run the models
   // vipc_client.connected is false only when do_exit is true
   if (!do_exit) {
-    const VisionBuf *b = &vipc_client_main.buffers[0];
+    const VisionBuf *b = &vipc_client.client(0).buffers[0];
     LOGW("connected main cam with buffer size: %d (%d x %d)", b->len, b->width, b->height);
 
     if (use_extra_client) {
-      const VisionBuf *wb = &vipc_client_extra.buffers[0];
+      const VisionBuf *wb = &vipc_client.client(1).buffers[0];
       LOGW("connected extra cam with buffer size: %d (%d x %d)", wb->len, wb->width, wb->height);
     }
 
-    run_model(model, vipc_client_main, vipc_client_extra, main_wide_camera, use_extra_client);
+    run_model(model, vipc_client, main_wide_camera, use_extra_client);
   }
 
   model_free(&model);
@@ -7,12 +7,32 @@
 
 #include "common/clutil.h"
 #include "common/mat.h"
+#include "common/swaglog.h"
 #include "common/timing.h"
+#include "selfdrive/modeld/transforms/transform_cpu.h"
 
-ModelFrame::ModelFrame(cl_device_id device_id, cl_context context) {
-  input_frames = std::make_unique<float[]>(buf_size);
+// MODEL_CPU_TRANSFORM=1 forces the CPU transform, 0 the OpenCL one.
+// by default the CPU transform is used when the OpenCL device is a CPU.
+static bool use_cpu_transform(cl_device_id device_id) {
+  if (const char *env = getenv("MODEL_CPU_TRANSFORM")) {
+    return atoi(env) != 0;
+  }
+  cl_device_type device_type = 0;
+  CL_CHECK(clGetDeviceInfo(device_id, CL_DEVICE_TYPE, sizeof(device_type), &device_type, NULL));
+  return device_type == CL_DEVICE_TYPE_CPU;
+}
 
+ModelFrame::ModelFrame(cl_device_id device_id, cl_context context) {
   q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+  use_cpu = use_cpu_transform(device_id);
+  if (use_cpu) {
+    LOGW("using CPU transform (%s)", transform_cpu_isa());
+    y_cpu = std::make_unique<uint8_t[]>(MODEL_WIDTH * MODEL_HEIGHT);
+    u_cpu = std::make_unique<uint8_t[]>((MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2));
+    v_cpu = std::make_unique<uint8_t[]>((MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2));
+    return;
+  }
+
   y_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_WIDTH * MODEL_HEIGHT, NULL, &err));
   u_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, (MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2), NULL, &err));
   v_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, (MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2), NULL, &err));
@@ -22,18 +42,32 @@ ModelFrame::ModelFrame(cl_device_id device_id, cl_context context) {
   loadyuv_init(&loadyuv, context, device_id, MODEL_WIDTH, MODEL_HEIGHT);
 }
 
-float* ModelFrame::prepare(cl_mem yuv_cl, int frame_width, int frame_height, int frame_stride, int frame_uv_offset, const mat3 &projection, cl_mem *output) {
+float* ModelFrame::prepare(VisionBuf *buf, const mat3 &projection, cl_mem *output) {
+  if (use_cpu) {
+    transform_cpu((const uint8_t *)buf->addr, buf->width, buf->height, buf->stride, buf->uv_offset,
+                  y_cpu.get(), u_cpu.get(), v_cpu.get(), MODEL_WIDTH, MODEL_HEIGHT, projection);
+
+    loadyuv_cpu(y_cpu.get(), u_cpu.get(), v_cpu.get(), input_frames.next(), MODEL_WIDTH, MODEL_HEIGHT);
+    input_frames.push();
+    if (output == NULL) {
+      return input_frames.data();
+    } else {
+      CL_CHECK(clEnqueueWriteBuffer(q, *output, CL_TRUE, 0, buf_size * sizeof(float), input_frames.data(), 0, nullptr, nullptr));
+      return NULL;
+    }
+  }
+
   transform_queue(&this->transform, q,
-                  yuv_cl, frame_width, frame_height, frame_stride, frame_uv_offset,
+                  buf->buf_cl, buf->width, buf->height, buf->stride, buf->uv_offset,
                   y_cl, u_cl, v_cl, MODEL_WIDTH, MODEL_HEIGHT, projection);
 
   if (output == NULL) {
     loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, net_input_cl);
 
-    std::memmove(&input_frames[0], &input_frames[MODEL_FRAME_SIZE], sizeof(float) * MODEL_FRAME_SIZE);
-    CL_CHECK(clEnqueueReadBuffer(q, net_input_cl, CL_TRUE, 0, MODEL_FRAME_SIZE * sizeof(float), &input_frames[MODEL_FRAME_SIZE], 0, nullptr, nullptr));
+    CL_CHECK(clEnqueueReadBuffer(q, net_input_cl, CL_TRUE, 0, MODEL_FRAME_SIZE * sizeof(float), input_frames.next(), 0, nullptr, nullptr));
     clFinish(q);
-    return &input_frames[0];
+    input_frames.push();
+    return input_frames.data();
   } else {
     loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, *output, true);
     // NOTE: Since thneed is using a different command queue, this clFinish is needed to ensure the image is ready.
@@ -43,12 +77,14 @@ float* ModelFrame::prepare(cl_mem yuv_cl, int frame_width, int frame_height, int
 }
 
 ModelFrame::~ModelFrame() {
-  transform_destroy(&transform);
-  loadyuv_destroy(&loadyuv);
-  CL_CHECK(clReleaseMemObject(net_input_cl));
-  CL_CHECK(clReleaseMemObject(v_cl));
-  CL_CHECK(clReleaseMemObject(u_cl));
-  CL_CHECK(clReleaseMemObject(y_cl));
+  if (!use_cpu) {
+    transform_destroy(&transform);
+    loadyuv_destroy(&loadyuv);
+    CL_CHECK(clReleaseMemObject(net_input_cl));
+    CL_CHECK(clReleaseMemObject(v_cl));
+    CL_CHECK(clReleaseMemObject(u_cl));
+    CL_CHECK(clReleaseMemObject(y_cl));
+  }
   CL_CHECK(clReleaseCommandQueue(q));
 }
 
@@ -70,3 +106,53 @@ void softmax(const float* input, float* output, size_t len) {
 float sigmoid(float input) {
   return 1 / (1 + expf(-input));
 }
+
+// Cephes expf: exp(x) = 2^n * exp(r) with |r| <= ln(2)/2
+static inline float exp_poly(float x) {
+  x = x < -87.3f ? -87.3f : (x > 88.3f ? 88.3f : x);
+  // round to nearest by adding and removing 1.5 * 2^23
+  const float fn = (x * 1.44269504088896341f + 12582912.0f) - 12582912.0f;
+  const int n = (int)fn;
+  const float r = x - fn * 0.693359375f + fn * 2.12194440e-4f;
+
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+
+  const int32_t bits = (n + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+void exp_block(const float* input, float* output, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    output[i] = exp_poly(input[i]);
+  }
+}
+
+void sigmoid_block(const float* input, float* output, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    output[i] = 1.0f / (1.0f + exp_poly(-input[i]));
+  }
+}
+
+void softmax_block(const float* input, float* output, size_t rows, size_t len) {
+  for (size_t r = 0; r < rows; r++, input += len, output += len) {
+    const float max_val = *std::max_element(input, input + len);
+    float denominator = 0;
+    for (size_t i = 0; i < len; i++) {
+      output[i] = exp_poly(input[i] - max_val);
+      denominator += output[i];
+    }
+
+    const float inv_denominator = 1.0f / denominator;
+    for (size_t i = 0; i < len; i++) {
+      output[i] *= inv_denominator;
+    }
+  }
+}
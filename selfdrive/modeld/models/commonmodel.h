@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cassert>
 #include <cfloat>
 #include <cstdlib>
+#include <cstring>
 
 #include <memory>
+#include <vector>
 
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
 #ifdef __APPLE__
@@ -14,6 +17,7 @@
 
 #include "common/mat.h"
 #include "cereal/messaging/messaging.h"
+#include "cereal/visionipc/visionbuf.h"
 #include "selfdrive/modeld/transforms/loadyuv.h"
 #include "selfdrive/modeld/transforms/transform.h"
 
@@ -22,16 +26,64 @@ const bool send_raw_pred = getenv("SEND_RAW_PRED") != NULL;
 void softmax(const float* input, float* output, size_t len);
 float sigmoid(float input);
 
+// exp, sigmoid and row wise softmax over whole blocks of model output. The exp is a branch free
+// polynomial (within 2 ulp of expf) so the loops vectorize, input and output may be the same.
+void exp_block(const float* input, float* output, size_t len);
+void sigmoid_block(const float* input, float* output, size_t len);
+void softmax_block(const float* input, float* output, size_t rows, size_t len);
+
 template<class T, size_t size>
 constexpr const kj::ArrayPtr<const T> to_kj_array_ptr(const std::array<T, size> &arr) {
   return kj::ArrayPtr(arr.data(), arr.size());
 }
 
+// The last len entries of entry_size elements, contiguous from oldest to newest so it can be
+// passed to the model runners as is. New entries are written in place after the window, which
+// moves forward through the storage and is copied back to the start once it reaches the end.
+// Compared to shifting the whole history on every push, that's capacity - len + 1 times less copying.
+// With capacity >= 2 * len, the window returned by data() stays valid through one more push,
+// which lets modeld prepare the next frame while the model still reads the current one.
+template <class T>
+class HistoryBuffer {
+public:
+  HistoryBuffer(size_t entry_size, size_t len, size_t capacity = 0)
+    : entry_size(entry_size), len(len), capacity(capacity ? capacity : 2 * len), end(len) {
+    assert(this->capacity > len);
+    buf.resize(this->capacity * entry_size);
+  }
+
+  // slot of the next entry, it's added to the history by push()
+  T *next() {
+    if (end == capacity) {
+      std::memmove(&buf[0], &buf[(end - len + 1) * entry_size], sizeof(T) * (len - 1) * entry_size);
+      end = len - 1;
+    }
+    return &buf[end * entry_size];
+  }
+  void push() {
+    next();
+    end++;
+  }
+  void push(const T *entry) {
+    std::memcpy(next(), entry, sizeof(T) * entry_size);
+    end++;
+  }
+
+  T *data() { return &buf[(end - len) * entry_size]; }
+  T *back() { return &buf[(end - 1) * entry_size]; }
+  size_t size() const { return len * entry_size; }
+
+private:
+  std::vector<T> buf;
+  const size_t entry_size, len, capacity;
+  size_t end;  // one past the newest entry
+};
+
 class ModelFrame {
 public:
   ModelFrame(cl_device_id device_id, cl_context context);
   ~ModelFrame();
-  float* prepare(cl_mem yuv_cl, int width, int height, int frame_stride, int frame_uv_offset, const mat3& transform, cl_mem *output);
+  float* prepare(VisionBuf *buf, const mat3& transform, cl_mem *output);
 
   const int MODEL_WIDTH = 512;
   const int MODEL_HEIGHT = 256;
@@ -43,5 +95,10 @@ private:
   LoadYUVState loadyuv;
   cl_command_queue q;
   cl_mem y_cl, u_cl, v_cl, net_input_cl;
-  std::unique_ptr<float[]> input_frames;
+  // the previous and the current frame
+  HistoryBuffer<float> input_frames{(size_t)MODEL_FRAME_SIZE, 2, 8};
+
+  // transform and loadyuv on the CPU, see transforms/transform_cpu.h
+  bool use_cpu;
+  std::unique_ptr<uint8_t[]> y_cpu, u_cpu, v_cpu;
 };
@@ -21,7 +21,9 @@ static inline T *get_buffer(std::vector<T> &buf, const size_t size) {
 
 void dmonitoring_init(DMonitoringModelState* s) {
 
-#ifdef USE_ONNX_MODEL
+#if defined(USE_ORT_MODEL)
+  s->m = new ORTModel("models/dmonitoring_model.onnx", &s->output[0], OUTPUT_SIZE, USE_DSP_RUNTIME, false, true);
+#elif defined(USE_ONNX_MODEL)
   s->m = new ONNXModel("models/dmonitoring_model.onnx", &s->output[0], OUTPUT_SIZE, USE_DSP_RUNTIME, false, true);
 #else
   s->m = new SNPEModel("models/dmonitoring_model_q.dlc", &s->output[0], OUTPUT_SIZE, USE_DSP_RUNTIME, false, true);
@@ -4,6 +4,7 @@
 #include <unistd.h>
 
 #include <cassert>
+#include <cstddef>
 #include <cstring>
 
 #include <eigen3/Eigen/Dense>
@@ -12,6 +13,7 @@
 #include "common/params.h"
 #include "common/timing.h"
 #include "common/swaglog.h"
+#include "common/transformations/orientation.hpp"
 
 constexpr float FCW_THRESHOLD_5MS2_HIGH = 0.15;
 constexpr float FCW_THRESHOLD_5MS2_LOW = 0.05;
@@ -22,25 +24,82 @@ std::array<float, 3> prev_brake_3ms2_probs = {0,0,0};
 
 // #define DUMP_YUV
 
-void model_init(ModelState* s, cl_device_id device_id, cl_context context) {
-  s->frame = new ModelFrame(device_id, context);
-  s->wide_frame = new ModelFrame(device_id, context);
+mat3 update_calibration(Eigen::Vector3d device_from_calib_euler, bool wide_camera, bool bigmodel_frame) {
+  /*
+     import numpy as np
+     from common.transformations.model import medmodel_frame_from_calib_frame
+     medmodel_frame_from_calib_frame = medmodel_frame_from_calib_frame[:, :3]
+     calib_from_smedmodel_frame = np.linalg.inv(medmodel_frame_from_calib_frame)
+  */
+  static const auto calib_from_medmodel = (Eigen::Matrix<float, 3, 3>() <<
+     0.00000000e+00, 0.00000000e+00, 1.00000000e+00,
+     1.09890110e-03, 0.00000000e+00, -2.81318681e-01,
+    -2.25466395e-20, 1.09890110e-03,-5.23076923e-02).finished();
+
+  static const auto calib_from_sbigmodel = (Eigen::Matrix<float, 3, 3>() <<
+     0.00000000e+00,  7.31372216e-19,  1.00000000e+00,
+     2.19780220e-03,  4.11497335e-19, -5.62637363e-01,
+    -6.66298828e-20,  2.19780220e-03, -3.33626374e-01).finished();
+
+  static const auto view_from_device = (Eigen::Matrix<float, 3, 3>() <<
+     0.0,  1.0,  0.0,
+     0.0,  0.0,  1.0,
+     1.0,  0.0,  0.0).finished();
+
+
+  const auto cam_intrinsics = Eigen::Matrix<float, 3, 3, Eigen::RowMajor>(wide_camera ? ecam_intrinsic_matrix.v : fcam_intrinsic_matrix.v);
+  Eigen::Matrix<float, 3, 3, Eigen::RowMajor>  device_from_calib = euler2rot(device_from_calib_euler).cast <float> ();
+  auto calib_from_model = bigmodel_frame ? calib_from_sbigmodel : calib_from_medmodel;
+  auto camera_from_calib = cam_intrinsics * view_from_device * device_from_calib;
+  auto warp_matrix = camera_from_calib * calib_from_model;
+
+  mat3 transform = {};
+  for (int i=0; i<3*3; i++) {
+    transform.v[i] = warp_matrix(i / 3, i % 3);
+  }
+  static const mat3 yuv_transform = get_model_yuv_transform();
+  return matmul3(yuv_transform, transform);
+}
 
+static std::unique_ptr<RunModel> model_runner(const std::string &runner, float *output, cl_context context) {
+  // in order of preference, same as the defaults of the build
 #ifdef USE_THNEED
-  s->m = std::make_unique<ThneedModel>("models/supercombo.thneed",
-#elif USE_ONNX_MODEL
-  s->m = std::make_unique<ONNXModel>("models/supercombo.onnx",
-#else
-  s->m = std::make_unique<SNPEModel>("models/supercombo.dlc",
+  if (runner.empty() || runner == "thneed") {
+    return std::make_unique<ThneedModel>("models/supercombo.thneed", output, NET_OUTPUT_SIZE, USE_GPU_RUNTIME, true, false, context);
+  }
+#endif
+#ifdef USE_ORT_MODEL
+  if (runner.empty() || runner == "ort") {
+    return std::make_unique<ORTModel>("models/supercombo.onnx", output, NET_OUTPUT_SIZE, USE_GPU_RUNTIME, true, false, context);
+  }
+#endif
+#ifdef USE_ONNX_MODEL
+  if (runner.empty() || runner == "onnx") {
+    return std::make_unique<ONNXModel>("models/supercombo.onnx", output, NET_OUTPUT_SIZE, USE_GPU_RUNTIME, true, false, context);
+  }
+#endif
+#ifndef __APPLE__
+  if (runner.empty() || runner == "snpe") {
+    return std::make_unique<SNPEModel>("models/supercombo.dlc", output, NET_OUTPUT_SIZE, USE_GPU_RUNTIME, true, false, context);
+  }
 #endif
-   &s->output[0], NET_OUTPUT_SIZE, USE_GPU_RUNTIME, true, false, context);
+  LOGE("model runner %s is not available in this build", runner.c_str());
+  return nullptr;
+}
+
+void model_init(ModelState* s, cl_device_id device_id, cl_context context, const std::string &runner) {
+  s->frame = new ModelFrame(device_id, context);
+  s->wide_frame = new ModelFrame(device_id, context);
+
+  s->m = model_runner(runner, &s->output[0], context);
+  assert(s->m != nullptr);
 
 #ifdef TEMPORAL
-  s->m->addRecurrent(&s->feature_buffer[0], TEMPORAL_SIZE);
+  s->m->addRecurrent(s->feature_buffer.data(), TEMPORAL_SIZE);
 #endif
 
 #ifdef DESIRE
-  s->m->addDesire(s->pulse_desire, DESIRE_LEN*(HISTORY_BUFFER_LEN+1));
+  s->m->addDesire(s->pulse_desire.data(), DESIRE_LEN*(HISTORY_BUFFER_LEN+1));
 #endif
 
 #ifdef TRAFFIC_CONVENTION
@@ -57,123 +116,196 @@ void model_init(ModelState* s, cl_device_id device_id, cl_context context) {
 
 }
 
-ModelOutput* model_eval_frame(ModelState* s, VisionBuf* buf, VisionBuf* wbuf,
-                              const mat3 &transform, const mat3 &transform_wide, float *desire_in, bool is_rhd, float *driving_style, float *nav_features, bool prepare_only) {
+void model_prepare_frame(ModelState* s, ModelInputs* inputs, VisionBuf* buf, VisionBuf* wbuf,
+                         const mat3 &transform, const mat3 &transform_wide, float *desire_in, bool is_rhd, float *driving_style, float *nav_features) {
 #ifdef DESIRE
-  std::memmove(&s->pulse_desire[0], &s->pulse_desire[DESIRE_LEN], sizeof(float) * DESIRE_LEN*HISTORY_BUFFER_LEN);
+  float *pulse_desire = s->pulse_desire.next();
+  std::memcpy(pulse_desire, s->pulse_desire.back(), sizeof(float) * DESIRE_LEN);
   if (desire_in != NULL) {
     for (int i = 1; i < DESIRE_LEN; i++) {
       // Model decides when action is completed
       // so desire input is just a pulse triggered on rising edge
       if (desire_in[i] - s->prev_desire[i] > .99) {
-        s->pulse_desire[DESIRE_LEN*HISTORY_BUFFER_LEN+i] = desire_in[i];
+        pulse_desire[i] = desire_in[i];
       } else {
-        s->pulse_desire[DESIRE_LEN*HISTORY_BUFFER_LEN+i] = 0.0;
+        pulse_desire[i] = 0.0;
       }
       s->prev_desire[i] = desire_in[i];
     }
   }
+  s->pulse_desire.push();
+  inputs->desire = s->pulse_desire.data();
 LOGT("Desire enqueued");
 #endif
 
 #ifdef NAV
-  std::memcpy(s->nav_features, nav_features, sizeof(float)*NAV_FEATURE_LEN);
+  std::memcpy(inputs->nav_features, nav_features, sizeof(float)*NAV_FEATURE_LEN);
 #endif
 
 #ifdef DRIVING_STYLE
-  std::memcpy(s->driving_style, driving_style, sizeof(float)*DRIVING_STYLE_LEN);
+  std::memcpy(inputs->driving_style, driving_style, sizeof(float)*DRIVING_STYLE_LEN);
 #endif
 
+#ifdef TRAFFIC_CONVENTION
   int rhd_idx = is_rhd;
-  s->traffic_convention[rhd_idx] = 1.0;
-  s->traffic_convention[1-rhd_idx] = 0.0;
+  inputs->traffic_convention[rhd_idx] = 1.0;
+  inputs->traffic_convention[1-rhd_idx] = 0.0;
+#endif
 
   // if getInputBuf is not NULL, net_input_buf will be
-  auto net_input_buf = s->frame->prepare(buf->buf_cl, buf->width, buf->height, buf->stride, buf->uv_offset, transform, static_cast<cl_mem*>(s->m->getInputBuf()));
-  s->m->addImage(net_input_buf, s->frame->buf_size);
+  inputs->image = s->frame->prepare(buf, transform, static_cast<cl_mem*>(s->m->getInputBuf()));
   LOGT("Image added");
 
+  inputs->extra = nullptr;
   if (wbuf != nullptr) {
-    auto net_extra_buf = s->wide_frame->prepare(wbuf->buf_cl, wbuf->width, wbuf->height, wbuf->stride, wbuf->uv_offset, transform_wide, static_cast<cl_mem*>(s->m->getExtraBuf()));
-    s->m->addExtra(net_extra_buf, s->wide_frame->buf_size);
+    inputs->extra = s->wide_frame->prepare(wbuf, transform_wide, static_cast<cl_mem*>(s->m->getExtraBuf()));
     LOGT("Extra image added");
   }
+}
 
-  if (prepare_only) {
-    return nullptr;
+ModelOutput* model_execute_frame(ModelState* s, const ModelInputs &inputs) {
+  // the small inputs are registered once in model_init, the history windows move every frame
+#ifdef DESIRE
+  s->m->addDesire(inputs.desire, DESIRE_LEN*(HISTORY_BUFFER_LEN+1));
+#endif
+#ifdef NAV
+  std::memcpy(s->nav_features, inputs.nav_features, sizeof(float)*NAV_FEATURE_LEN);
+#endif
+#ifdef DRIVING_STYLE
+  std::memcpy(s->driving_style, inputs.driving_style, sizeof(float)*DRIVING_STYLE_LEN);
+#endif
+#ifdef TRAFFIC_CONVENTION
+  std::memcpy(s->traffic_convention, inputs.traffic_convention, sizeof(float)*TRAFFIC_CONVENTION_LEN);
+#endif
+
+  s->m->addImage(inputs.image, s->frame->buf_size);
+  if (inputs.extra != nullptr) {
+    s->m->addExtra(inputs.extra, s->wide_frame->buf_size);
   }
 
+  #ifdef TEMPORAL
+    s->m->addRecurrent(s->feature_buffer.data(), TEMPORAL_SIZE);
+  #endif
+
   s->m->execute();
   LOGT("Execution finished");
 
   #ifdef TEMPORAL
-    std::memmove(&s->feature_buffer[0], &s->feature_buffer[FEATURE_LEN], sizeof(float) * FEATURE_LEN*(HISTORY_BUFFER_LEN-1));
-    std::memcpy(&s->feature_buffer[FEATURE_LEN*(HISTORY_BUFFER_LEN-1)], &s->output[OUTPUT_SIZE], sizeof(float) * FEATURE_LEN);
+    s->feature_buffer.push(&s->output[OUTPUT_SIZE]);
     LOGT("Features enqueued");
   #endif
 
   return (ModelOutput*)&s->output;
 }
 
+ModelOutput* model_eval_frame(ModelState* s, VisionBuf* buf, VisionBuf* wbuf,
+                              const mat3 &transform, const mat3 &transform_wide, float *desire_in, bool is_rhd, float *driving_style, float *nav_features, bool prepare_only) {
+  ModelInputs inputs;
+  model_prepare_frame(s, &inputs, buf, wbuf, transform, transform_wide, desire_in, is_rhd, driving_style, nav_features);
+  if (prepare_only) {
+    return nullptr;
+  }
+  return model_execute_frame(s, inputs);
+}
+
 void model_free(ModelState* s) {
   delete s->frame;
   delete s->wide_frame;
 }
 
+// Where a series of the output lives: every stride floats from offset floats into a block of
+// elements, e.g. the x of all plan positions. Lists are filled straight from the output with these,
+// without gathering into temporaries first.
+struct OutputSeries {
+  int offset;
+  int stride;
+};
+using XYZSeries = std::array<OutputSeries, 3>;
+
+template <class Element>
+constexpr OutputSeries output_series(size_t field_offset) {
+  static_assert(sizeof(Element) % sizeof(float) == 0);
+  return {int(field_offset / sizeof(float)), int(sizeof(Element) / sizeof(float))};
+}
+
+template <class Element>
+constexpr XYZSeries output_xyz_series(size_t xyz_offset) {
+  return {output_series<Element>(xyz_offset + offsetof(ModelOutputXYZ, x)),
+          output_series<Element>(xyz_offset + offsetof(ModelOutputXYZ, y)),
+          output_series<Element>(xyz_offset + offsetof(ModelOutputXYZ, z))};
+}
+
+constexpr XYZSeries PLAN_POSITION = output_xyz_series<ModelOutputPlanElement>(offsetof(ModelOutputPlanElement, position));
+constexpr XYZSeries PLAN_VELOCITY = output_xyz_series<ModelOutputPlanElement>(offsetof(ModelOutputPlanElement, velocity));
+constexpr XYZSeries PLAN_ACCELERATION = output_xyz_series<ModelOutputPlanElement>(offsetof(ModelOutputPlanElement, acceleration));
+constexpr XYZSeries PLAN_ROTATION = output_xyz_series<ModelOutputPlanElement>(offsetof(ModelOutputPlanElement, rotation));
+constexpr XYZSeries PLAN_ROTATION_RATE = output_xyz_series<ModelOutputPlanElement>(offsetof(ModelOutputPlanElement, rotation_rate));
+constexpr int PLAN_ELEMENT_LEN = sizeof(ModelOutputPlanElement) / sizeof(float);
+
+constexpr OutputSeries LINE_Y = output_series<ModelOutputYZ>(offsetof(ModelOutputYZ, y));
+constexpr OutputSeries LINE_Z = output_series<ModelOutputYZ>(offsetof(ModelOutputYZ, z));
+
+constexpr OutputSeries LEAD_X = output_series<ModelOutputLeadElement>(offsetof(ModelOutputLeadElement, x));
+constexpr OutputSeries LEAD_Y = output_series<ModelOutputLeadElement>(offsetof(ModelOutputLeadElement, y));
+constexpr OutputSeries LEAD_V = output_series<ModelOutputLeadElement>(offsetof(ModelOutputLeadElement, velocity));
+constexpr OutputSeries LEAD_A = output_series<ModelOutputLeadElement>(offsetof(ModelOutputLeadElement, acceleration));
+constexpr int LEAD_ELEMENT_LEN = sizeof(ModelOutputLeadElement) / sizeof(float);
+
+constexpr OutputSeries DISENGAGE_GAS = output_series<ModelOutputDisengageProb>(offsetof(ModelOutputDisengageProb, gas_disengage));
+constexpr OutputSeries DISENGAGE_BRAKE = output_series<ModelOutputDisengageProb>(offsetof(ModelOutputDisengageProb, brake_disengage));
+constexpr OutputSeries DISENGAGE_STEER = output_series<ModelOutputDisengageProb>(offsetof(ModelOutputDisengageProb, steer_override));
+constexpr OutputSeries DISENGAGE_BRAKE_3MS2 = output_series<ModelOutputDisengageProb>(offsetof(ModelOutputDisengageProb, brake_3ms2));
+constexpr OutputSeries DISENGAGE_BRAKE_4MS2 = output_series<ModelOutputDisengageProb>(offsetof(ModelOutputDisengageProb, brake_4ms2));
+constexpr OutputSeries DISENGAGE_BRAKE_5MS2 = output_series<ModelOutputDisengageProb>(offsetof(ModelOutputDisengageProb, brake_5ms2));
+constexpr int DISENGAGE_ELEMENT_LEN = sizeof(ModelOutputDisengageProb) / sizeof(float);
+
+template <class Element>
+const float *output_block(const Element *elements) {
+  return reinterpret_cast<const float *>(elements);
+}
+
+void fill_series(capnp::List<float>::Builder list, const float *block, const OutputSeries &series) {
+  for (uint i = 0; i < list.size(); i++) {
+    list.set(i, block[series.offset + i * series.stride]);
+  }
+}
+
 void fill_lead(cereal::ModelDataV2::LeadDataV3::Builder lead, const ModelOutputLeads &leads, int t_idx, float prob_t) {
   std::array<float, LEAD_TRAJ_LEN> lead_t = {0.0, 2.0, 4.0, 6.0, 8.0, 10.0};
   const auto &best_prediction = leads.get_best_prediction(t_idx);
   lead.setProb(sigmoid(leads.prob[t_idx]));
   lead.setProbTime(prob_t);
-  std::array<float, LEAD_TRAJ_LEN> lead_x, lead_y, lead_v, lead_a;
-  std::array<float, LEAD_TRAJ_LEN> lead_x_std, lead_y_std, lead_v_std, lead_a_std;
-  for (int i=0; i<LEAD_TRAJ_LEN; i++) {
-    lead_x[i] = best_prediction.mean[i].x;
-    lead_y[i] = best_prediction.mean[i].y;
-    lead_v[i] = best_prediction.mean[i].velocity;
-    lead_a[i] = best_prediction.mean[i].acceleration;
-    lead_x_std[i] = exp(best_prediction.std[i].x);
-    lead_y_std[i] = exp(best_prediction.std[i].y);
-    lead_v_std[i] = exp(best_prediction.std[i].velocity);
-    lead_a_std[i] = exp(best_prediction.std[i].acceleration);
-  }
+
+  const float *mean = output_block(best_prediction.mean.data());
+  std::array<float, LEAD_TRAJ_LEN * LEAD_ELEMENT_LEN> std_exp;
+  exp_block(output_block(best_prediction.std.data()), std_exp.data(), std_exp.size());
+
   lead.setT(to_kj_array_ptr(lead_t));
-  lead.setX(to_kj_array_ptr(lead_x));
-  lead.setY(to_kj_array_ptr(lead_y));
-  lead.setV(to_kj_array_ptr(lead_v));
-  lead.setA(to_kj_array_ptr(lead_a));
-  lead.setXStd(to_kj_array_ptr(lead_x_std));
-  lead.setYStd(to_kj_array_ptr(lead_y_std));
-  lead.setVStd(to_kj_array_ptr(lead_v_std));
-  lead.setAStd(to_kj_array_ptr(lead_a_std));
+  fill_series(lead.initX(LEAD_TRAJ_LEN), mean, LEAD_X);
+  fill_series(lead.initY(LEAD_TRAJ_LEN), mean, LEAD_Y);
+  fill_series(lead.initV(LEAD_TRAJ_LEN), mean, LEAD_V);
+  fill_series(lead.initA(LEAD_TRAJ_LEN), mean, LEAD_A);
+  fill_series(lead.initXStd(LEAD_TRAJ_LEN), std_exp.data(), LEAD_X);
+  fill_series(lead.initYStd(LEAD_TRAJ_LEN), std_exp.data(), LEAD_Y);
+  fill_series(lead.initVStd(LEAD_TRAJ_LEN), std_exp.data(), LEAD_V);
+  fill_series(lead.initAStd(LEAD_TRAJ_LEN), std_exp.data(), LEAD_A);
 }
 
 void fill_meta(cereal::ModelDataV2::MetaData::Builder meta, const ModelOutputMeta &meta_data) {
   std::array<float, DESIRE_LEN> desire_state_softmax;
-  softmax(meta_data.desire_state_prob.array.data(), desire_state_softmax.data(), DESIRE_LEN);
+  softmax_block(meta_data.desire_state_prob.array.data(), desire_state_softmax.data(), 1, DESIRE_LEN);
 
   std::array<float, DESIRE_PRED_LEN * DESIRE_LEN> desire_pred_softmax;
-  for (int i=0; i<DESIRE_PRED_LEN; i++) {
-    softmax(meta_data.desire_pred_prob[i].array.data(), desire_pred_softmax.data() + (i * DESIRE_LEN), DESIRE_LEN);
-  }
+  softmax_block(output_block(meta_data.desire_pred_prob.data()), desire_pred_softmax.data(), DESIRE_PRED_LEN, DESIRE_LEN);
 
   std::array<float, DISENGAGE_LEN> lat_long_t = {2,4,6,8,10};
-  std::array<float, DISENGAGE_LEN> gas_disengage_sigmoid, brake_disengage_sigmoid, steer_override_sigmoid,
-                                   brake_3ms2_sigmoid, brake_4ms2_sigmoid, brake_5ms2_sigmoid;
-  for (int i=0; i<DISENGAGE_LEN; i++) {
-    gas_disengage_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].gas_disengage);
-    brake_disengage_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_disengage);
-    steer_override_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].steer_override);
-    brake_3ms2_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_3ms2);
-    brake_4ms2_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_4ms2);
-    brake_5ms2_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_5ms2);
-    //gas_pressed_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].gas_pressed);
-  }
+  std::array<float, DISENGAGE_LEN * DISENGAGE_ELEMENT_LEN> disengage_sigmoid;
+  sigmoid_block(output_block(meta_data.disengage_prob.data()), disengage_sigmoid.data(), disengage_sigmoid.size());
 
   std::memmove(prev_brake_5ms2_probs.data(), &prev_brake_5ms2_probs[1], 4*sizeof(float));
   std::memmove(prev_brake_3ms2_probs.data(), &prev_brake_3ms2_probs[1], 2*sizeof(float));
-  prev_brake_5ms2_probs[4] = brake_5ms2_sigmoid[0];
-  prev_brake_3ms2_probs[2] = brake_3ms2_sigmoid[0];
+  prev_brake_5ms2_probs[4] = disengage_sigmoid[DISENGAGE_BRAKE_5MS2.offset];
+  prev_brake_3ms2_probs[2] = disengage_sigmoid[DISENGAGE_BRAKE_3MS2.offset];
 
   bool above_fcw_threshold = true;
   for (int i=0; i<prev_brake_5ms2_probs.size(); i++) {
@@ -186,12 +318,12 @@ void fill_meta(cereal::ModelDataV2::MetaData::Builder meta, const ModelOutputMet
 
   auto disengage = meta.initDisengagePredictions();
   disengage.setT(to_kj_array_ptr(lat_long_t));
-  disengage.setGasDisengageProbs(to_kj_array_ptr(gas_disengage_sigmoid));
-  disengage.setBrakeDisengageProbs(to_kj_array_ptr(brake_disengage_sigmoid));
-  disengage.setSteerOverrideProbs(to_kj_array_ptr(steer_override_sigmoid));
-  disengage.setBrake3MetersPerSecondSquaredProbs(to_kj_array_ptr(brake_3ms2_sigmoid));
-  disengage.setBrake4MetersPerSecondSquaredProbs(to_kj_array_ptr(brake_4ms2_sigmoid));
-  disengage.setBrake5MetersPerSecondSquaredProbs(to_kj_array_ptr(brake_5ms2_sigmoid));
+  fill_series(disengage.initGasDisengageProbs(DISENGAGE_LEN), disengage_sigmoid.data(), DISENGAGE_GAS);
+  fill_series(disengage.initBrakeDisengageProbs(DISENGAGE_LEN), disengage_sigmoid.data(), DISENGAGE_BRAKE);
+  fill_series(disengage.initSteerOverrideProbs(DISENGAGE_LEN), disengage_sigmoid.data(), DISENGAGE_STEER);
+  fill_series(disengage.initBrake3MetersPerSecondSquaredProbs(DISENGAGE_LEN), disengage_sigmoid.data(), DISENGAGE_BRAKE_3MS2);
+  fill_series(disengage.initBrake4MetersPerSecondSquaredProbs(DISENGAGE_LEN), disengage_sigmoid.data(), DISENGAGE_BRAKE_4MS2);
+  fill_series(disengage.initBrake5MetersPerSecondSquaredProbs(DISENGAGE_LEN), disengage_sigmoid.data(), DISENGAGE_BRAKE_5MS2);
 
   meta.setEngagedProb(sigmoid(meta_data.engaged_prob));
   meta.setDesirePrediction(to_kj_array_ptr(desire_pred_softmax));
@@ -199,83 +331,48 @@ void fill_meta(cereal::ModelDataV2::MetaData::Builder meta, const ModelOutputMet
   meta.setHardBrakePredicted(above_fcw_threshold);
 }
 
-template<size_t size>
-void fill_xyzt(cereal::XYZTData::Builder xyzt, const std::array<float, size> &t,
-               const std::array<float, size> &x, const std::array<float, size> &y, const std::array<float, size> &z) {
+void fill_xyzt(cereal::XYZTData::Builder xyzt, const std::array<float, TRAJECTORY_SIZE> &t,
+               const float *mean, const XYZSeries &xyz, const float *std_exp = nullptr) {
   xyzt.setT(to_kj_array_ptr(t));
-  xyzt.setX(to_kj_array_ptr(x));
-  xyzt.setY(to_kj_array_ptr(y));
-  xyzt.setZ(to_kj_array_ptr(z));
+  fill_series(xyzt.initX(TRAJECTORY_SIZE), mean, xyz[0]);
+  fill_series(xyzt.initY(TRAJECTORY_SIZE), mean, xyz[1]);
+  fill_series(xyzt.initZ(TRAJECTORY_SIZE), mean, xyz[2]);
+  if (std_exp != nullptr) {
+    fill_series(xyzt.initXStd(TRAJECTORY_SIZE), std_exp, xyz[0]);
+    fill_series(xyzt.initYStd(TRAJECTORY_SIZE), std_exp, xyz[1]);
+    fill_series(xyzt.initZStd(TRAJECTORY_SIZE), std_exp, xyz[2]);
+  }
 }
 
-template<size_t size>
-void fill_xyzt(cereal::XYZTData::Builder xyzt, const std::array<float, size> &t,
-               const std::array<float, size> &x, const std::array<float, size> &y, const std::array<float, size> &z,
-               const std::array<float, size> &x_std, const std::array<float, size> &y_std, const std::array<float, size> &z_std) {
-  fill_xyzt(xyzt, t, x, y, z);
-  xyzt.setXStd(to_kj_array_ptr(x_std));
-  xyzt.setYStd(to_kj_array_ptr(y_std));
-  xyzt.setZStd(to_kj_array_ptr(z_std));
+// lines and edges are y and z over X_IDXS
+void fill_xyzt(cereal::XYZTData::Builder xyzt, const std::array<float, TRAJECTORY_SIZE> &t,
+               const std::array<ModelOutputYZ, TRAJECTORY_SIZE> &line) {
+  xyzt.setT(to_kj_array_ptr(t));
+  xyzt.setX(to_kj_array_ptr(X_IDXS_FLOAT));
+  fill_series(xyzt.initY(TRAJECTORY_SIZE), output_block(line.data()), LINE_Y);
+  fill_series(xyzt.initZ(TRAJECTORY_SIZE), output_block(line.data()), LINE_Z);
 }
 
 void fill_plan(cereal::ModelDataV2::Builder &framed, const ModelOutputPlanPrediction &plan) {
-  std::array<float, TRAJECTORY_SIZE> pos_x, pos_y, pos_z;
-  std::array<float, TRAJECTORY_SIZE> pos_x_std, pos_y_std, pos_z_std;
-  std::array<float, TRAJECTORY_SIZE> vel_x, vel_y, vel_z;
-  std::array<float, TRAJECTORY_SIZE> rot_x, rot_y, rot_z;
-  std::array<float, TRAJECTORY_SIZE> acc_x, acc_y, acc_z;
-  std::array<float, TRAJECTORY_SIZE> rot_rate_x, rot_rate_y, rot_rate_z;
-
-  for(int i=0; i<TRAJECTORY_SIZE; i++) {
-    pos_x[i] = plan.mean[i].position.x;
-    pos_y[i] = plan.mean[i].position.y;
-    pos_z[i] = plan.mean[i].position.z;
-    pos_x_std[i] = exp(plan.std[i].position.x);
-    pos_y_std[i] = exp(plan.std[i].position.y);
-    pos_z_std[i] = exp(plan.std[i].position.z);
-    vel_x[i] = plan.mean[i].velocity.x;
-    vel_y[i] = plan.mean[i].velocity.y;
-    vel_z[i] = plan.mean[i].velocity.z;
-    acc_x[i] = plan.mean[i].acceleration.x;
-    acc_y[i] = plan.mean[i].acceleration.y;
-    acc_z[i] = plan.mean[i].acceleration.z;
-    rot_x[i] = plan.mean[i].rotation.x;
-    rot_y[i] = plan.mean[i].rotation.y;
-    rot_z[i] = plan.mean[i].rotation.z;
-    rot_rate_x[i] = plan.mean[i].rotation_rate.x;
-    rot_rate_y[i] = plan.mean[i].rotation_rate.y;
-    rot_rate_z[i] = plan.mean[i].rotation_rate.z;
-  }
-
-  fill_xyzt(framed.initPosition(), T_IDXS_FLOAT, pos_x, pos_y, pos_z, pos_x_std, pos_y_std, pos_z_std);
-  fill_xyzt(framed.initVelocity(), T_IDXS_FLOAT, vel_x, vel_y, vel_z);
-  fill_xyzt(framed.initAcceleration(), T_IDXS_FLOAT, acc_x, acc_y, acc_z);
-  fill_xyzt(framed.initOrientation(), T_IDXS_FLOAT, rot_x, rot_y, rot_z);
-  fill_xyzt(framed.initOrientationRate(), T_IDXS_FLOAT, rot_rate_x, rot_rate_y, rot_rate_z);
+  const float *mean = output_block(plan.mean.data());
+  // the whole block in one pass, only the position stds are sent
+  std::array<float, TRAJECTORY_SIZE * PLAN_ELEMENT_LEN> std_exp;
+  exp_block(output_block(plan.std.data()), std_exp.data(), std_exp.size());
+
+  fill_xyzt(framed.initPosition(), T_IDXS_FLOAT, mean, PLAN_POSITION, std_exp.data());
+  fill_xyzt(framed.initVelocity(), T_IDXS_FLOAT, mean, PLAN_VELOCITY);
+  fill_xyzt(framed.initAcceleration(), T_IDXS_FLOAT, mean, PLAN_ACCELERATION);
+  fill_xyzt(framed.initOrientation(), T_IDXS_FLOAT, mean, PLAN_ROTATION);
+  fill_xyzt(framed.initOrientationRate(), T_IDXS_FLOAT, mean, PLAN_ROTATION_RATE);
 }
 
 void fill_lane_lines(cereal::ModelDataV2::Builder &framed, const std::array<float, TRAJECTORY_SIZE> &plan_t,
                      const ModelOutputLaneLines &lanes) {
-  std::array<float, TRAJECTORY_SIZE> left_far_y, left_far_z;
-  std::array<float, TRAJECTORY_SIZE> left_near_y, left_near_z;
-  std::array<float, TRAJECTORY_SIZE> right_near_y, right_near_z;
-  std::array<float, TRAJECTORY_SIZE> right_far_y, right_far_z;
-  for (int j=0; j<TRAJECTORY_SIZE; j++) {
-    left_far_y[j] = lanes.mean.left_far[j].y;
-    left_far_z[j] = lanes.mean.left_far[j].z;
-    left_near_y[j] = lanes.mean.left_near[j].y;
-    left_near_z[j] = lanes.mean.left_near[j].z;
-    right_near_y[j] = lanes.mean.right_near[j].y;
-    right_near_z[j] = lanes.mean.right_near[j].z;
-    right_far_y[j] = lanes.mean.right_far[j].y;
-    right_far_z[j] = lanes.mean.right_far[j].z;
-  }
-
   auto lane_lines = framed.initLaneLines(4);
-  fill_xyzt(lane_lines[0], plan_t, X_IDXS_FLOAT, left_far_y, left_far_z);
-  fill_xyzt(lane_lines[1], plan_t, X_IDXS_FLOAT, left_near_y, left_near_z);
-  fill_xyzt(lane_lines[2], plan_t, X_IDXS_FLOAT, right_near_y, right_near_z);
-  fill_xyzt(lane_lines[3], plan_t, X_IDXS_FLOAT, right_far_y, right_far_z);
+  fill_xyzt(lane_lines[0], plan_t, lanes.mean.left_far);
+  fill_xyzt(lane_lines[1], plan_t, lanes.mean.left_near);
+  fill_xyzt(lane_lines[2], plan_t, lanes.mean.right_near);
+  fill_xyzt(lane_lines[3], plan_t, lanes.mean.right_far);
 
   framed.setLaneLineStds({
     exp(lanes.std.left_far[0].y),
@@ -294,18 +391,9 @@ void fill_lane_lines(cereal::ModelDataV2::Builder &framed, const std::array<floa
 
 void fill_road_edges(cereal::ModelDataV2::Builder &framed, const std::array<float, TRAJECTORY_SIZE> &plan_t,
                      const ModelOutputRoadEdges &edges) {
-  std::array<float, TRAJECTORY_SIZE> left_y, left_z;
-  std::array<float, TRAJECTORY_SIZE> right_y, right_z;
-  for (int j=0; j<TRAJECTORY_SIZE; j++) {
-    left_y[j] = edges.mean.left[j].y;
-    left_z[j] = edges.mean.left[j].z;
-    right_y[j] = edges.mean.right[j].y;
-    right_z[j] = edges.mean.right[j].z;
-  }
-
   auto road_edges = framed.initRoadEdges(2);
-  fill_xyzt(road_edges[0], plan_t, X_IDXS_FLOAT, left_y, left_z);
-  fill_xyzt(road_edges[1], plan_t, X_IDXS_FLOAT, right_y, right_z);
+  fill_xyzt(road_edges[0], plan_t, edges.mean.left);
+  fill_xyzt(road_edges[1], plan_t, edges.mean.right);
 
   framed.setRoadEdgeStds({
     exp(edges.std.left[0].y),
@@ -364,7 +452,8 @@ void fill_model(cereal::ModelDataV2::Builder &framed, const ModelOutput &net_out
 
 void model_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_frame_id_extra, uint32_t frame_id, float frame_drop,
                    const ModelOutput &net_outputs, uint64_t timestamp_eof,
-                   float model_execution_time, kj::ArrayPtr<const float> raw_pred, const bool valid) {
+                   float model_execution_time, float model_preprocess_time, float model_queue_time,
+                   kj::ArrayPtr<const float> raw_pred, const bool valid) {
   const uint32_t frame_age = (frame_id > vipc_frame_id) ? (frame_id - vipc_frame_id) : 0;
   MessageBuilder msg;
   auto framed = msg.initEvent(valid).initModelV2();
@@ -374,6 +463,8 @@ void model_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_frame_id
   framed.setFrameDropPerc(frame_drop * 100);
   framed.setTimestampEof(timestamp_eof);
   framed.setModelExecutionTime(model_execution_time);
+  framed.setModelPreprocessTime(model_preprocess_time);
+  framed.setModelQueueTime(model_queue_time);
   if (send_raw_pred) {
     framed.setRawPredictions(raw_pred.asBytes());
   }
@@ -7,6 +7,9 @@
 
 #include <array>
 #include <memory>
+#include <string>
+
+#include <eigen3/Eigen/Dense>
 
 #include "cereal/messaging/messaging.h"
 #include "cereal/visionipc/visionipc_client.h"
@@ -251,12 +254,12 @@ constexpr int NET_OUTPUT_SIZE = OUTPUT_SIZE + FEATURE_LEN + PAD_SIZE;
 struct ModelState {
   ModelFrame *frame = nullptr;
   ModelFrame *wide_frame = nullptr;
-  std::array<float, HISTORY_BUFFER_LEN * FEATURE_LEN> feature_buffer = {};
+  HistoryBuffer<float> feature_buffer{FEATURE_LEN, HISTORY_BUFFER_LEN};
   std::array<float, NET_OUTPUT_SIZE> output = {};
   std::unique_ptr<RunModel> m;
 #ifdef DESIRE
   float prev_desire[DESIRE_LEN] = {};
-  float pulse_desire[DESIRE_LEN*(HISTORY_BUFFER_LEN+1)] = {};
+  HistoryBuffer<float> pulse_desire{DESIRE_LEN, HISTORY_BUFFER_LEN+1};
 #endif
 #ifdef TRAFFIC_CONVENTION
   float traffic_convention[TRAFFIC_CONVENTION_LEN] = {};
@@ -269,12 +272,41 @@ struct ModelState {
 #endif
 };
 
-void model_init(ModelState* s, cl_device_id device_id, cl_context context);
+// Everything the model reads for one frame. Filled by model_prepare_frame and consumed by
+// model_execute_frame, so the next frame can be prepared while this one runs.
+// The image and desire pointers are windows into the history buffers of ModelState, they stay
+// valid until the frame after the next one is prepared.
+struct ModelInputs {
+  float *image = nullptr;
+  float *extra = nullptr;
+#ifdef DESIRE
+  float *desire = nullptr;
+#endif
+#ifdef TRAFFIC_CONVENTION
+  float traffic_convention[TRAFFIC_CONVENTION_LEN] = {};
+#endif
+#ifdef DRIVING_STYLE
+  float driving_style[DRIVING_STYLE_LEN] = {};
+#endif
+#ifdef NAV
+  float nav_features[NAV_FEATURE_LEN] = {};
+#endif
+};
+
+// warp from the camera frame to the model frame
+mat3 update_calibration(Eigen::Vector3d device_from_calib_euler, bool wide_camera, bool bigmodel_frame);
+
+// runner is "thneed", "ort", "onnx" or "snpe", the default runner of the build when empty
+void model_init(ModelState* s, cl_device_id device_id, cl_context context, const std::string &runner = "");
+void model_prepare_frame(ModelState* s, ModelInputs* inputs, VisionBuf* buf, VisionBuf* buf_wide,
+                         const mat3 &transform, const mat3 &transform_wide, float *desire_in, bool is_rhd, float *driving_style, float *nav_features);
+ModelOutput *model_execute_frame(ModelState* s, const ModelInputs &inputs);
 ModelOutput *model_eval_frame(ModelState* s, VisionBuf* buf, VisionBuf* buf_wide,
                               const mat3 &transform, const mat3 &transform_wide, float *desire_in, bool is_rhd, float *driving_style, float *nav_features, bool prepare_only);
 void model_free(ModelState* s);
 void model_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_frame_id_extra, uint32_t frame_id, float frame_drop,
                    const ModelOutput &net_outputs, uint64_t timestamp_eof,
-                   float model_execution_time, kj::ArrayPtr<const float> raw_pred, const bool valid);
+                   float model_execution_time, float model_preprocess_time, float model_queue_time,
+                   kj::ArrayPtr<const float> raw_pred, const bool valid);
 void posenet_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t vipc_dropped_frames,
                      const ModelOutput &net_outputs, uint64_t timestamp_eof, const bool valid);
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "common/timing.h"
+#include "selfdrive/modeld/runners/onnxmodel.h"
+#include "selfdrive/modeld/runners/ortmodel.h"
+
+// Compares the per-frame latency of the in process ORTModel with the onnx_runner.py ONNXModel
+// on random inputs, and checks that both produce the same outputs.
+// usage (from selfdrive/modeld): ./benchmark_runner models/supercombo.onnx [iterations] [--tf8]
+
+typedef void (RunModel::*AddInput)(float *buf, int size);
+
+// the order both runners match the model inputs with
+const AddInput ADD_INPUTS[] = {
+  &RunModel::addImage, &RunModel::addExtra, &RunModel::addDesire, &RunModel::addNavFeatures,
+  &RunModel::addDrivingStyle, &RunModel::addTrafficConvention, &RunModel::addCalib, &RunModel::addRecurrent,
+};
+
+void benchmark(const char *name, RunModel *model, std::vector<std::vector<float>> &inputs, int iterations) {
+  for (size_t i = 0; i < inputs.size(); i++) {
+    (model->*ADD_INPUTS[i])(inputs[i].data(), inputs[i].size());
+  }
+
+  // warmup
+  model->execute();
+
+  std::vector<double> times;
+  for (int i = 0; i < iterations; i++) {
+    double t1 = millis_since_boot();
+    model->execute();
+    times.push_back(millis_since_boot() - t1);
+  }
+  std::sort(times.begin(), times.end());
+  double mean = 0;
+  for (double t : times) mean += t / times.size();
+  printf("%s: mean %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", name, mean,
+         times[times.size() / 2], times[std::min(times.size() - 1, times.size() * 99 / 100)], times.back());
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    printf("usage: %s model.onnx [iterations] [--tf8]\n", argv[0]);
+    return 1;
+  }
+  const char *path = argv[1];
+  const int iterations = argc > 2 && argv[2][0] != '-' ? atoi(argv[2]) : 100;
+  const bool use_tf8 = strcmp(argv[argc - 1], "--tf8") == 0;
+
+  std::vector<size_t> input_sizes;
+  size_t output_size = 0;
+  {
+    ORTModel model(path, nullptr, 0, 0, false, use_tf8);
+    input_sizes = model.inputSizes();
+    output_size = model.outputSize();
+  }
+  if (input_sizes.size() > std::size(ADD_INPUTS)) {
+    printf("model has %zu inputs, at most %zu are supported\n", input_sizes.size(), std::size(ADD_INPUTS));
+    return 1;
+  }
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dist(0.0, 1.0);
+  std::vector<std::vector<float>> inputs;
+  for (size_t size : input_sizes) {
+    auto &input = inputs.emplace_back(size);
+    for (auto &v : input) v = dist(gen);
+  }
+
+  std::vector<float> ort_output(output_size), pipe_output(output_size);
+  {
+    ORTModel model(path, ort_output.data(), output_size, 0, false, use_tf8);
+    benchmark("ORTModel", &model, inputs, iterations);
+  }
+  {
+    ONNXModel model(path, pipe_output.data(), output_size, 0, false, use_tf8);
+    benchmark("ONNXModel", &model, inputs, iterations);
+  }
+
+  float max_diff = 0;
+  for (size_t i = 0; i < output_size; i++) {
+    max_diff = std::max(max_diff, std::abs(ort_output[i] - pipe_output[i]));
+  }
+  printf("outputs: %zu, max diff %g\n", output_size, max_diff);
+  return 0;
+}
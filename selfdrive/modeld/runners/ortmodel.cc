@@ -0,0 +1,297 @@
+#include "selfdrive/modeld/runners/ortmodel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+#include "common/swaglog.h"
+
+namespace {
+
+size_t element_size(ONNXTensorElementDataType type) {
+  switch (type) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT: return sizeof(float);
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16: return sizeof(uint16_t);
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8: return sizeof(uint8_t);
+    default:
+      LOGE("unsupported onnx element type %d", type);
+      assert(false);
+      return 0;
+  }
+}
+
+uint16_t float_to_half(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  const uint32_t sign = (x >> 16) & 0x8000;
+  const uint32_t mant = x & 0x7fffff;
+  const int32_t exp = (int32_t)((x >> 23) & 0xff) - 127 + 15;
+
+  if (((x >> 23) & 0xff) == 0xff) return sign | 0x7c00 | (mant ? 0x200 : 0);  // inf, nan
+  if (exp >= 31) return sign | 0x7c00;  // overflow
+  if (exp <= 0) {
+    // subnormal
+    if (exp < -10) return sign;
+    const uint32_t m = mant | 0x800000, shift = 14 - exp;
+    uint32_t h = m >> shift;
+    const uint32_t rem = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+    if (rem > half || (rem == half && (h & 1))) h++;
+    return sign | h;
+  }
+
+  // round to nearest even, a carry into the exponent is still correct
+  uint32_t h = (exp << 10) | (mant >> 13);
+  const uint32_t rem = mant & 0x1fff;
+  if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++;
+  return sign | h;
+}
+
+float half_to_float(uint16_t h) {
+  const uint32_t sign = (h & 0x8000) << 16, exp = (h >> 10) & 0x1f, mant = h & 0x3ff;
+  uint32_t x;
+  if (exp == 0) {
+    const float f = mant * (1.0f / (1 << 24));
+    return sign ? -f : f;
+  } else if (exp == 31) {
+    x = sign | 0x7f800000 | (mant << 13);
+  } else {
+    x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+  }
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+template <class F>
+void fill(std::vector<uint8_t> &dst, ONNXTensorElementDataType type, size_t n, F value) {
+  switch (type) {
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT: {
+      float *d = (float *)dst.data();
+      for (size_t i = 0; i < n; i++) d[i] = value(i);
+      break;
+    }
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16: {
+      uint16_t *d = (uint16_t *)dst.data();
+      for (size_t i = 0; i < n; i++) d[i] = float_to_half(value(i));
+      break;
+    }
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8: {
+      uint8_t *d = dst.data();
+      for (size_t i = 0; i < n; i++) d[i] = value(i);
+      break;
+    }
+    default:
+      assert(false);
+  }
+}
+
+int env_int(const char *name, int default_value) {
+  const char *v = getenv(name);
+  return v ? atoi(v) : default_value;
+}
+
+}  // namespace
+
+ORTModel::ORTModel(const char *path, float *_output, size_t _output_size, int runtime, bool _use_extra, bool _use_tf8, cl_context context)
+    : env(ORT_LOGGING_LEVEL_WARNING, "modeld") {
+  LOGD("loading model %s", path);
+
+  output = _output;
+  output_size = _output_size;
+  use_extra = _use_extra;
+  use_tf8 = _use_tf8;
+
+  // same settings as onnx_runner.py. ORT_INTRA_OP_THREADS and ORT_INTER_OP_THREADS override its thread counts
+  const int intra_op_threads = env_int("ORT_INTRA_OP_THREADS", 2);
+  const int inter_op_threads = env_int("ORT_INTER_OP_THREADS", 8);
+  Ort::SessionOptions options;
+  options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+  auto providers = Ort::GetAvailableProviders();
+  auto available = [&](const char *provider) {
+    return getenv("ONNXCPU") == nullptr && std::find(providers.begin(), providers.end(), provider) != providers.end();
+  };
+  if (available("OpenVINOExecutionProvider")) {
+    OrtOpenVINOProviderOptions openvino_options;
+    options.AppendExecutionProvider_OpenVINO(openvino_options);
+    LOGW("onnxruntime using OpenVINOExecutionProvider");
+  } else if (available("CUDAExecutionProvider")) {
+    OrtCUDAProviderOptions cuda_options;
+    options.AppendExecutionProvider_CUDA(cuda_options);
+    options.SetIntraOpNumThreads(intra_op_threads);
+    LOGW("onnxruntime using CUDAExecutionProvider");
+  } else {
+    options.SetIntraOpNumThreads(intra_op_threads);
+    options.SetInterOpNumThreads(inter_op_threads);
+    options.SetExecutionMode(ORT_SEQUENTIAL);
+    options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+    LOGW("onnxruntime using CPUExecutionProvider");
+  }
+
+  session = Ort::Session(env, path, options);
+  memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+
+  Ort::AllocatorWithDefaultOptions allocator;
+  auto tensor = [&](const std::string &name, Ort::TypeInfo type_info) {
+    auto info = type_info.GetTensorTypeAndShapeInfo();
+    Tensor t = {.name = name, .shape = info.GetShape(), .type = info.GetElementType()};
+    // run with a batch size of 1
+    t.shape[0] = 1;
+    t.size = 1;
+    for (auto d : t.shape) t.size *= d;
+    // only the image input is normalized, same as onnx_runner.py
+    t.tf8 = use_tf8 && name == "input_img";
+    return t;
+  };
+
+  for (size_t i = 0; i < session.GetInputCount(); i++) {
+    Tensor t = tensor(session.GetInputNameAllocated(i, allocator).get(), session.GetInputTypeInfo(i));
+    if (t.tf8 || t.type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+      t.scratch.resize(t.size * element_size(t.type));
+    }
+    inputs.push_back(std::move(t));
+  }
+
+  size_t total_output_size = 0;
+  for (size_t i = 0; i < session.GetOutputCount(); i++) {
+    Tensor t = tensor(session.GetOutputNameAllocated(i, allocator).get(), session.GetOutputTypeInfo(i));
+    if (t.type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+      t.scratch.resize(t.size * element_size(t.type));
+    }
+    total_output_size += t.size;
+    outputs.push_back(std::move(t));
+  }
+  // the outputs are concatenated into output
+  assert(output == nullptr || total_output_size == output_size);
+
+  binding = Ort::IoBinding(session);
+  input_bufs.reserve(inputs.size());
+
+  // output is fixed, so the outputs are bound once. without an output the model is only queried for its sizes
+  if (output != nullptr) {
+    float *out = output;
+    for (auto &t : outputs) {
+      bind(t, t.scratch.empty() ? (void *)out : t.scratch.data(), false);
+      out += t.size;
+    }
+  }
+}
+
+std::vector<size_t> ORTModel::inputSizes() const {
+  std::vector<size_t> sizes;
+  for (auto &t : inputs) {
+    // tf8 images are passed as bytes in a float buffer
+    sizes.push_back(t.tf8 ? t.size / sizeof(float) : t.size);
+  }
+  return sizes;
+}
+
+size_t ORTModel::outputSize() const {
+  size_t size = 0;
+  for (auto &t : outputs) size += t.size;
+  return size;
+}
+
+void ORTModel::addRecurrent(float *state, int state_size) {
+  rnn_input_buf = state;
+  rnn_state_size = state_size;
+}
+
+void ORTModel::addDesire(float *state, int state_size) {
+  desire_input_buf = state;
+  desire_state_size = state_size;
+}
+
+void ORTModel::addNavFeatures(float *state, int state_size) {
+  nav_features_input_buf = state;
+  nav_features_size = state_size;
+}
+
+void ORTModel::addDrivingStyle(float *state, int state_size) {
+  driving_style_input_buf = state;
+  driving_style_size = state_size;
+}
+
+void ORTModel::addTrafficConvention(float *state, int state_size) {
+  traffic_convention_input_buf = state;
+  traffic_convention_size = state_size;
+}
+
+void ORTModel::addCalib(float *state, int state_size) {
+  calib_input_buf = state;
+  calib_size = state_size;
+}
+
+void ORTModel::addImage(float *image_buf, int buf_size) {
+  image_input_buf = image_buf;
+  image_buf_size = buf_size;
+}
+
+void ORTModel::addExtra(float *image_buf, int buf_size) {
+  extra_input_buf = image_buf;
+  extra_buf_size = buf_size;
+}
+
+void ORTModel::bind(Tensor &t, void *data, bool input) {
+  if (data == t.bound) return;
+
+  auto it = std::find_if(t.values.begin(), t.values.end(), [=](auto &v) { return v.first == data; });
+  if (it == t.values.end()) {
+    t.values.emplace_back(data, Ort::Value::CreateTensor(memory_info, data, t.size * element_size(t.type), t.shape.data(), t.shape.size(), t.type));
+    it = std::prev(t.values.end());
+  }
+  if (input) {
+    binding.BindInput(t.name.c_str(), it->second);
+  } else {
+    binding.BindOutput(t.name.c_str(), it->second);
+  }
+  t.bound = data;
+}
+
+void ORTModel::bindInput(Tensor &t, float *buf, int size) {
+  if (t.tf8) {
+    assert(size * sizeof(float) == t.size);
+    const uint8_t *src = (const uint8_t *)buf;
+    fill(t.scratch, t.type, t.size, [=](size_t i) { return src[i] / 255.0f; });
+  } else if (t.type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+    assert(size == t.size);
+    fill(t.scratch, t.type, t.size, [=](size_t i) { return buf[i]; });
+  } else {
+    // no copy
+    assert(size == t.size);
+  }
+  bind(t, t.scratch.empty() ? (void *)buf : t.scratch.data(), true);
+}
+
+void ORTModel::execute() {
+  // order must be the same as ONNXModel
+  auto &bufs = input_bufs;
+  bufs.clear();
+  if (image_input_buf != NULL) bufs.push_back({image_input_buf, image_buf_size});
+  if (extra_input_buf != NULL) bufs.push_back({extra_input_buf, extra_buf_size});
+  if (desire_input_buf != NULL) bufs.push_back({desire_input_buf, desire_state_size});
+  if (nav_features_input_buf != NULL) bufs.push_back({nav_features_input_buf, nav_features_size});
+  if (driving_style_input_buf != NULL) bufs.push_back({driving_style_input_buf, driving_style_size});
+  if (traffic_convention_input_buf != NULL) bufs.push_back({traffic_convention_input_buf, traffic_convention_size});
+  if (calib_input_buf != NULL) bufs.push_back({calib_input_buf, calib_size});
+  if (rnn_input_buf != NULL) bufs.push_back({rnn_input_buf, rnn_state_size});
+  assert(bufs.size() == inputs.size() && output != nullptr);
+
+  for (size_t i = 0; i < inputs.size(); i++) {
+    bindInput(inputs[i], bufs[i].first, bufs[i].second);
+  }
+
+  session.Run(Ort::RunOptions{nullptr}, binding);
+
+  float *out = output;
+  for (auto &t : outputs) {
+    if (t.type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16) {
+      const uint16_t *src = (const uint16_t *)t.scratch.data();
+      for (size_t i = 0; i < t.size; i++) out[i] = half_to_float(src[i]);
+    } else if (t.type == ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8) {
+      std::copy(t.scratch.begin(), t.scratch.end(), out);
+    }
+    out += t.size;
+  }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+#include "selfdrive/modeld/runners/runmodel.h"
+
+// Runs ONNX models in process with the ONNX Runtime C++ API. Float32 inputs and outputs are
+// bound directly to the buffers passed to the add* functions and to output, other element
+// types are converted through scratch buffers. The tensors over these buffers are created
+// once and only rebound when the add* functions pass a different buffer.
+//
+// The inputs are matched to the model inputs by position, in the same order as ONNXModel.
+class ORTModel : public RunModel {
+public:
+  ORTModel(const char *path, float *output, size_t output_size, int runtime, bool use_extra = false, bool use_tf8 = false, cl_context context = NULL);
+  void addRecurrent(float *state, int state_size);
+  void addDesire(float *state, int state_size);
+  void addNavFeatures(float *state, int state_size);
+  void addDrivingStyle(float *state, int state_size);
+  void addTrafficConvention(float *state, int state_size);
+  void addCalib(float *state, int state_size);
+  void addImage(float *image_buf, int buf_size);
+  void addExtra(float *image_buf, int buf_size);
+  void execute();
+
+  // number of elements of each model input, for feeding a model without knowing its layout
+  std::vector<size_t> inputSizes() const;
+  size_t outputSize() const;
+
+private:
+  struct Tensor {
+    std::string name;
+    std::vector<int64_t> shape;
+    ONNXTensorElementDataType type;
+    size_t size;
+    bool tf8;                           // uint8 image normalized to [0, 1] like onnx_runner.py
+    std::vector<uint8_t> scratch;       // for the element types that can't be bound directly
+    // tensors over the buffers bound so far. the pipelined frames of modeld alternate between buffers
+    std::vector<std::pair<void *, Ort::Value>> values;
+    void *bound = nullptr;
+  };
+
+  Ort::Env env;
+  Ort::Session session{nullptr};
+  Ort::MemoryInfo memory_info{nullptr};
+  Ort::IoBinding binding{nullptr};
+  std::vector<Tensor> inputs, outputs;
+  std::vector<std::pair<float *, int>> input_bufs;
+
+  float *output;
+  size_t output_size;
+
+  float *rnn_input_buf = NULL;
+  int rnn_state_size;
+  float *desire_input_buf = NULL;
+  int desire_state_size;
+  float *nav_features_input_buf = NULL;
+  int nav_features_size;
+  float *driving_style_input_buf = NULL;
+  int driving_style_size;
+  float *traffic_convention_input_buf = NULL;
+  int traffic_convention_size;
+  float *calib_input_buf = NULL;
+  int calib_size;
+  float *image_input_buf = NULL;
+  int image_buf_size;
+  bool use_tf8;
+  float *extra_input_buf = NULL;
+  int extra_buf_size;
+  bool use_extra;
+
+  void bind(Tensor &t, void *data, bool input);
+  void bindInput(Tensor &t, float *buf, int size);
+};
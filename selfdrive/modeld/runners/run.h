@@ -3,8 +3,12 @@
 #include "runmodel.h"
 #include "snpemodel.h"
 
-#if defined(USE_THNEED)
+#ifdef USE_THNEED
 #include "thneedmodel.h"
-#elif defined(USE_ONNX_MODEL)
+#endif
+#ifdef USE_ONNX_MODEL
 #include "onnxmodel.h"
 #endif
+#ifdef USE_ORT_MODEL
+#include "ortmodel.h"
+#endif
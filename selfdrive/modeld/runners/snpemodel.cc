@@ -140,6 +140,12 @@ SNPEModel::SNPEModel(const char *path, float *loutput, size_t loutput_size, int
 void SNPEModel::addRecurrent(float *state, int state_size) {
   recurrent = state;
   recurrent_size = state_size;
+  if (recurrentBuffer) {
+    // the history buffer moved, point the existing user buffer at it
+    bool ret = recurrentBuffer->setBufferAddress(state);
+    assert(ret == true);
+    return;
+  }
   recurrentBuffer = this->addExtra(state, state_size, 3);
 }
 
@@ -150,6 +156,11 @@ void SNPEModel::addTrafficConvention(float *state, int state_size) {
 
 void SNPEModel::addDesire(float *state, int state_size) {
   desire = state;
+  if (desireBuffer) {
+    bool ret = desireBuffer->setBufferAddress(state);
+    assert(ret == true);
+    return;
+  }
   desireBuffer = this->addExtra(state, state_size, 1);
 }
 
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "common/clutil.h"
+#include "common/timing.h"
+#include "selfdrive/modeld/transforms/loadyuv.h"
+#include "selfdrive/modeld/transforms/transform.h"
+#include "selfdrive/modeld/transforms/transform_cpu.h"
+
+// Benchmarks the CPU transform and loadyuv against the OpenCL kernels on a wide camera sized
+// frame, and checks that both produce the same model input.
+// usage (from selfdrive/modeld): transforms/benchmark_transform [iterations]
+
+const int IN_WIDTH = 1928, IN_HEIGHT = 1208, IN_STRIDE = 2048;
+const int IN_UV_OFFSET = IN_STRIDE * IN_HEIGHT;
+const int OUT_WIDTH = 512, OUT_HEIGHT = 256;
+const int OUT_Y_SIZE = OUT_WIDTH * OUT_HEIGHT, OUT_UV_SIZE = OUT_Y_SIZE / 4;
+const int MODEL_FRAME_SIZE = OUT_Y_SIZE * 3 / 2;
+
+// roughly the calibrated wide camera to bigmodel transform
+const mat3 PROJECTION = {{
+  1.06f, 0.02f, 700.0f,
+  -0.01f, 1.04f, 420.0f,
+  0.00001f, 0.00002f, 1.0f,
+}};
+
+int main(int argc, char *argv[]) {
+  const int iterations = argc > 1 ? atoi(argv[1]) : 200;
+
+  std::vector<uint8_t> frame(IN_STRIDE * IN_HEIGHT * 3 / 2);
+  std::mt19937 gen(0);
+  for (auto &b : frame) b = gen();
+
+  // CPU
+  std::vector<uint8_t> y(OUT_Y_SIZE), u(OUT_UV_SIZE), v(OUT_UV_SIZE);
+  std::vector<float> cpu_out(MODEL_FRAME_SIZE);
+  double transform_ms = 0, loadyuv_ms = 0;
+  for (int i = 0; i < iterations; i++) {
+    double t1 = millis_since_boot();
+    transform_cpu(frame.data(), IN_WIDTH, IN_HEIGHT, IN_STRIDE, IN_UV_OFFSET,
+                  y.data(), u.data(), v.data(), OUT_WIDTH, OUT_HEIGHT, PROJECTION);
+    double t2 = millis_since_boot();
+    loadyuv_cpu(y.data(), u.data(), v.data(), cpu_out.data(), OUT_WIDTH, OUT_HEIGHT);
+    double t3 = millis_since_boot();
+    transform_ms += t2 - t1;
+    loadyuv_ms += t3 - t2;
+  }
+  printf("cpu (%s): transform %.3f ms, loadyuv %.3f ms\n", transform_cpu_isa(), transform_ms / iterations, loadyuv_ms / iterations);
+
+  cl_uint num_platforms = 0;
+  if (clGetPlatformIDs(0, NULL, &num_platforms) != CL_SUCCESS || num_platforms == 0) {
+    printf("no OpenCL platform, skipping the comparison\n");
+    return 0;
+  }
+
+  // OpenCL
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
+  cl_command_queue q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+
+  Transform transform;
+  LoadYUVState loadyuv;
+  transform_init(&transform, context, device_id);
+  loadyuv_init(&loadyuv, context, device_id, OUT_WIDTH, OUT_HEIGHT);
+
+  cl_mem frame_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, frame.size(), frame.data(), &err));
+  cl_mem y_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, OUT_Y_SIZE, NULL, &err));
+  cl_mem u_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, OUT_UV_SIZE, NULL, &err));
+  cl_mem v_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, OUT_UV_SIZE, NULL, &err));
+  cl_mem out_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_FRAME_SIZE * sizeof(float), NULL, &err));
+
+  std::vector<float> cl_out(MODEL_FRAME_SIZE);
+  double cl_ms = 0;
+  for (int i = 0; i < iterations; i++) {
+    double t1 = millis_since_boot();
+    transform_queue(&transform, q, frame_cl, IN_WIDTH, IN_HEIGHT, IN_STRIDE, IN_UV_OFFSET,
+                    y_cl, u_cl, v_cl, OUT_WIDTH, OUT_HEIGHT, PROJECTION);
+    loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, out_cl);
+    CL_CHECK(clEnqueueReadBuffer(q, out_cl, CL_TRUE, 0, MODEL_FRAME_SIZE * sizeof(float), cl_out.data(), 0, nullptr, nullptr));
+    cl_ms += millis_since_boot() - t1;
+  }
+  printf("opencl: transform + loadyuv %.3f ms\n", cl_ms / iterations);
+
+  int mismatches = 0;
+  float max_diff = 0;
+  for (int i = 0; i < MODEL_FRAME_SIZE; i++) {
+    float diff = std::abs(cpu_out[i] - cl_out[i]);
+    max_diff = std::max(max_diff, diff);
+    mismatches += diff > 0;
+  }
+  printf("mismatched pixels: %d / %d, max diff: %.0f\n", mismatches, MODEL_FRAME_SIZE, max_diff);
+
+  CL_CHECK(clReleaseMemObject(out_cl));
+  CL_CHECK(clReleaseMemObject(v_cl));
+  CL_CHECK(clReleaseMemObject(u_cl));
+  CL_CHECK(clReleaseMemObject(y_cl));
+  CL_CHECK(clReleaseMemObject(frame_cl));
+  loadyuv_destroy(&loadyuv);
+  transform_destroy(&transform);
+  CL_CHECK(clReleaseCommandQueue(q));
+  CL_CHECK(clReleaseContext(context));
+
+  // off by one from rounding differences of the float math is expected
+  return max_diff <= 1 ? 0 : 1;
+}
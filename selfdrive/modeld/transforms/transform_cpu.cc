@@ -0,0 +1,315 @@
+#include "selfdrive/modeld/transforms/transform_cpu.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define INTER_BITS 5
+#define INTER_TAB_SIZE (1 << INTER_BITS)
+
+#define INTER_REMAP_COEF_BITS 15
+#define INTER_REMAP_COEF_SCALE (1 << INTER_REMAP_COEF_BITS)
+
+namespace {
+
+// source pixel and bilinear weight table index of a row of destination pixels
+struct WarpRow {
+  std::vector<int32_t> sx, sy, tab;
+};
+
+typedef void (*warp_coords_fn)(const float *M, int dy, int cols, WarpRow &row);
+typedef void (*deinterleave_fn)(const uint8_t *src, float *even, float *odd, int pairs);
+typedef void (*convert_fn)(const uint8_t *src, float *dst, int len);
+
+inline int32_t saturate_short(int32_t v) {
+  return std::clamp(v, -32768, 32767);
+}
+
+// bilinear weights for each (ay, ax), computed the same way as in transform.cl
+const std::array<std::array<int32_t, 4>, INTER_TAB_SIZE * INTER_TAB_SIZE> &weight_table() {
+  static const auto table = []() {
+    std::array<std::array<int32_t, 4>, INTER_TAB_SIZE * INTER_TAB_SIZE> t = {};
+    for (int ay = 0; ay < INTER_TAB_SIZE; ay++) {
+      for (int ax = 0; ax < INTER_TAB_SIZE; ax++) {
+        float taby = 1.f / INTER_TAB_SIZE * ay;
+        float tabx = 1.f / INTER_TAB_SIZE * ax;
+        t[ay * INTER_TAB_SIZE + ax] = {
+          saturate_short(lrintf((1.0f - taby) * (1.0f - tabx) * INTER_REMAP_COEF_SCALE)),
+          saturate_short(lrintf((1.0f - taby) * tabx * INTER_REMAP_COEF_SCALE)),
+          saturate_short(lrintf(taby * (1.0f - tabx) * INTER_REMAP_COEF_SCALE)),
+          saturate_short(lrintf(taby * tabx * INTER_REMAP_COEF_SCALE)),
+        };
+      }
+    }
+    return t;
+  }();
+  return table;
+}
+
+inline void warp_coord(const float *M, int dx, float x_dy, float y_dy, float w_dy, WarpRow &row) {
+  float X0 = M[0] * dx + x_dy + M[2];
+  float Y0 = M[3] * dx + y_dy + M[5];
+  float W = M[6] * dx + w_dy + M[8];
+  W = W != 0.0f ? INTER_TAB_SIZE / W : 0.0f;
+  int32_t X = lrintf(X0 * W), Y = lrintf(Y0 * W);
+
+  row.sx[dx] = saturate_short(X >> INTER_BITS);
+  row.sy[dx] = saturate_short(Y >> INTER_BITS);
+  row.tab[dx] = (Y & (INTER_TAB_SIZE - 1)) * INTER_TAB_SIZE + (X & (INTER_TAB_SIZE - 1));
+}
+
+void warp_coords_scalar(const float *M, int dy, int cols, WarpRow &row) {
+  const float x_dy = M[1] * dy, y_dy = M[4] * dy, w_dy = M[7] * dy;
+  for (int dx = 0; dx < cols; dx++) {
+    warp_coord(M, dx, x_dy, y_dy, w_dy, row);
+  }
+}
+
+void deinterleave_scalar(const uint8_t *src, float *even, float *odd, int pairs) {
+  for (int i = 0; i < pairs; i++) {
+    even[i] = src[2 * i];
+    odd[i] = src[2 * i + 1];
+  }
+}
+
+void convert_scalar(const uint8_t *src, float *dst, int len) {
+  for (int i = 0; i < len; i++) {
+    dst[i] = src[i];
+  }
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2")))
+void warp_coords_avx2(const float *M, int dy, int cols, WarpRow &row) {
+  const float x_dy = M[1] * dy, y_dy = M[4] * dy, w_dy = M[7] * dy;
+  const __m256 m0 = _mm256_set1_ps(M[0]), m2 = _mm256_set1_ps(M[2]), xdy = _mm256_set1_ps(x_dy);
+  const __m256 m3 = _mm256_set1_ps(M[3]), m5 = _mm256_set1_ps(M[5]), ydy = _mm256_set1_ps(y_dy);
+  const __m256 m6 = _mm256_set1_ps(M[6]), m8 = _mm256_set1_ps(M[8]), wdy = _mm256_set1_ps(w_dy);
+  const __m256 tab_size = _mm256_set1_ps(INTER_TAB_SIZE), zero = _mm256_setzero_ps();
+  const __m256i short_min = _mm256_set1_epi32(-32768), short_max = _mm256_set1_epi32(32767);
+  const __m256i tab_mask = _mm256_set1_epi32(INTER_TAB_SIZE - 1);
+
+  int dx = 0;
+  __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  for (; dx + 8 <= cols; dx += 8) {
+    const __m256 fdx = _mm256_cvtepi32_ps(idx);
+    __m256 X0 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, fdx), xdy), m2);
+    __m256 Y0 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m3, fdx), ydy), m5);
+    __m256 W = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m6, fdx), wdy), m8);
+    W = _mm256_blendv_ps(_mm256_div_ps(tab_size, W), zero, _mm256_cmp_ps(W, zero, _CMP_EQ_OQ));
+
+    // rounds to nearest even, same as rint
+    const __m256i X = _mm256_cvtps_epi32(_mm256_mul_ps(X0, W));
+    const __m256i Y = _mm256_cvtps_epi32(_mm256_mul_ps(Y0, W));
+
+    const __m256i sx = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(X, INTER_BITS), short_min), short_max);
+    const __m256i sy = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(Y, INTER_BITS), short_min), short_max);
+    const __m256i tab = _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(Y, tab_mask), INTER_BITS), _mm256_and_si256(X, tab_mask));
+    _mm256_storeu_si256((__m256i *)&row.sx[dx], sx);
+    _mm256_storeu_si256((__m256i *)&row.sy[dx], sy);
+    _mm256_storeu_si256((__m256i *)&row.tab[dx], tab);
+
+    idx = _mm256_add_epi32(idx, _mm256_set1_epi32(8));
+  }
+  for (; dx < cols; dx++) {
+    warp_coord(M, dx, x_dy, y_dy, w_dy, row);
+  }
+}
+
+__attribute__((target("avx2")))
+void deinterleave_avx2(const uint8_t *src, float *even, float *odd, int pairs) {
+  const __m128i shuffle = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+  int i = 0;
+  for (; i + 8 <= pairs; i += 8) {
+    const __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 2 * i)), shuffle);
+    _mm256_storeu_ps(even + i, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)));
+    _mm256_storeu_ps(odd + i, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8))));
+  }
+  deinterleave_scalar(src + 2 * i, even + i, odd + i, pairs - i);
+}
+
+__attribute__((target("avx2")))
+void convert_avx2(const uint8_t *src, float *dst, int len) {
+  int i = 0;
+  for (; i + 8 <= len; i += 8) {
+    const __m128i v = _mm_loadl_epi64((const __m128i *)(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)));
+  }
+  convert_scalar(src + i, dst + i, len - i);
+}
+
+#elif defined(__aarch64__)
+
+void warp_coords_neon(const float *M, int dy, int cols, WarpRow &row) {
+  const float x_dy = M[1] * dy, y_dy = M[4] * dy, w_dy = M[7] * dy;
+  const float32x4_t tab_size = vdupq_n_f32(INTER_TAB_SIZE), zero = vdupq_n_f32(0.0f);
+  const int32x4_t short_min = vdupq_n_s32(-32768), short_max = vdupq_n_s32(32767);
+  const int32x4_t tab_mask = vdupq_n_s32(INTER_TAB_SIZE - 1);
+
+  int dx = 0;
+  const int32_t start[4] = {0, 1, 2, 3};
+  int32x4_t idx = vld1q_s32(start);
+  for (; dx + 4 <= cols; dx += 4) {
+    const float32x4_t fdx = vcvtq_f32_s32(idx);
+    // vmulq + vaddq instead of vmlaq, which may be fused
+    float32x4_t X0 = vaddq_f32(vaddq_f32(vmulq_n_f32(fdx, M[0]), vdupq_n_f32(x_dy)), vdupq_n_f32(M[2]));
+    float32x4_t Y0 = vaddq_f32(vaddq_f32(vmulq_n_f32(fdx, M[3]), vdupq_n_f32(y_dy)), vdupq_n_f32(M[5]));
+    float32x4_t W = vaddq_f32(vaddq_f32(vmulq_n_f32(fdx, M[6]), vdupq_n_f32(w_dy)), vdupq_n_f32(M[8]));
+    W = vbslq_f32(vceqq_f32(W, zero), zero, vdivq_f32(tab_size, W));
+
+    // rounds to nearest even, same as rint
+    const int32x4_t X = vcvtnq_s32_f32(vmulq_f32(X0, W));
+    const int32x4_t Y = vcvtnq_s32_f32(vmulq_f32(Y0, W));
+
+    vst1q_s32(&row.sx[dx], vminq_s32(vmaxq_s32(vshrq_n_s32(X, INTER_BITS), short_min), short_max));
+    vst1q_s32(&row.sy[dx], vminq_s32(vmaxq_s32(vshrq_n_s32(Y, INTER_BITS), short_min), short_max));
+    vst1q_s32(&row.tab[dx], vaddq_s32(vshlq_n_s32(vandq_s32(Y, tab_mask), INTER_BITS), vandq_s32(X, tab_mask)));
+
+    idx = vaddq_s32(idx, vdupq_n_s32(4));
+  }
+  for (; dx < cols; dx++) {
+    warp_coord(M, dx, x_dy, y_dy, w_dy, row);
+  }
+}
+
+inline void store_u8x8(uint8x8_t v, float *dst) {
+  const uint16x8_t v16 = vmovl_u8(v);
+  vst1q_f32(dst, vcvtq_f32_u32(vmovl_u16(vget_low_u16(v16))));
+  vst1q_f32(dst + 4, vcvtq_f32_u32(vmovl_u16(vget_high_u16(v16))));
+}
+
+void deinterleave_neon(const uint8_t *src, float *even, float *odd, int pairs) {
+  int i = 0;
+  for (; i + 8 <= pairs; i += 8) {
+    const uint8x8x2_t v = vld2_u8(src + 2 * i);
+    store_u8x8(v.val[0], even + i);
+    store_u8x8(v.val[1], odd + i);
+  }
+  deinterleave_scalar(src + 2 * i, even + i, odd + i, pairs - i);
+}
+
+void convert_neon(const uint8_t *src, float *dst, int len) {
+  int i = 0;
+  for (; i + 8 <= len; i += 8) {
+    store_u8x8(vld1_u8(src + i), dst + i);
+  }
+  convert_scalar(src + i, dst + i, len - i);
+}
+
+#endif
+
+struct Kernels {
+  const char *isa;
+  warp_coords_fn warp_coords;
+  deinterleave_fn deinterleave;
+  convert_fn convert;
+};
+
+const Kernels &kernels() {
+  static const Kernels k = []() -> Kernels {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+      return {"avx2", warp_coords_avx2, deinterleave_avx2, convert_avx2};
+    }
+#elif defined(__aarch64__)
+    return {"neon", warp_coords_neon, deinterleave_neon, convert_neon};
+#endif
+    return {"scalar", warp_coords_scalar, deinterleave_scalar, convert_scalar};
+  }();
+  return k;
+}
+
+inline int fetch(const uint8_t *src, int row_stride, int px_stride, int rows, int cols, int x, int y) {
+  return (x >= 0 && x < cols && y >= 0 && y < rows) ? src[y * row_stride + x * px_stride] : 0;
+}
+
+// warps the planes at src + offsets[i] to dst[i]. the planes share the same geometry, so the
+// source coordinates are only computed once.
+void warp_perspective(const uint8_t *src, int row_stride, int px_stride, int rows, int cols,
+                      const int *offsets, uint8_t *const *dst, int planes,
+                      int dst_rows, int dst_cols, const mat3 &M) {
+  const auto &table = weight_table();
+  const auto &k = kernels();
+
+  thread_local WarpRow row;
+  row.sx.resize(dst_cols);
+  row.sy.resize(dst_cols);
+  row.tab.resize(dst_cols);
+
+  for (int dy = 0; dy < dst_rows; dy++) {
+    k.warp_coords(M.v, dy, dst_cols, row);
+
+    for (int p = 0; p < planes; p++) {
+      const uint8_t *s = src + offsets[p];
+      uint8_t *d = dst[p] + dy * dst_cols;
+      for (int dx = 0; dx < dst_cols; dx++) {
+        const int sx = row.sx[dx], sy = row.sy[dx];
+        int v0, v1, v2, v3;
+        if (sx >= 0 && sx + 1 < cols && sy >= 0 && sy + 1 < rows) {
+          const uint8_t *p0 = s + sy * row_stride + sx * px_stride;
+          v0 = p0[0];
+          v1 = p0[px_stride];
+          v2 = p0[row_stride];
+          v3 = p0[row_stride + px_stride];
+        } else {
+          v0 = fetch(s, row_stride, px_stride, rows, cols, sx, sy);
+          v1 = fetch(s, row_stride, px_stride, rows, cols, sx + 1, sy);
+          v2 = fetch(s, row_stride, px_stride, rows, cols, sx, sy + 1);
+          v3 = fetch(s, row_stride, px_stride, rows, cols, sx + 1, sy + 1);
+        }
+
+        const auto &w = table[row.tab[dx]];
+        const int val = v0 * w[0] + v1 * w[1] + v2 * w[2] + v3 * w[3];
+        d[dx] = std::clamp((val + (1 << (INTER_REMAP_COEF_BITS - 1))) >> INTER_REMAP_COEF_BITS, 0, 255);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+void transform_cpu(const uint8_t *in_yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                   uint8_t *out_y, uint8_t *out_u, uint8_t *out_v,
+                   int out_width, int out_height,
+                   const mat3 &projection) {
+  // in and out uv is half the size of y.
+  const mat3 projection_uv = transform_scale_buffer(projection, 0.5);
+
+  const int y_offset = 0;
+  warp_perspective(in_yuv, in_stride, 1, in_height, in_width, &y_offset, &out_y, 1,
+                   out_height, out_width, projection);
+
+  const int uv_offsets[2] = {in_uv_offset, in_uv_offset + 1};
+  uint8_t *const out_uv[2] = {out_u, out_v};
+  warp_perspective(in_yuv, in_stride, 2, in_height / 2, in_width / 2, uv_offsets, out_uv, 2,
+                   out_height / 2, out_width / 2, projection_uv);
+}
+
+void loadyuv_cpu(const uint8_t *y, const uint8_t *u, const uint8_t *v, float *out, int width, int height) {
+  const auto &k = kernels();
+  const int uv_size = (width / 2) * (height / 2);
+
+  // the y plane is split into 4 planes by row and column parity:
+  // 02
+  // 13
+  for (int oy = 0; oy < height; oy++) {
+    float *out_even = out + ((oy & 1) ? uv_size : 0) + (oy / 2) * (width / 2);
+    float *out_odd = out + ((oy & 1) ? uv_size * 3 : uv_size * 2) + (oy / 2) * (width / 2);
+    k.deinterleave(y + oy * width, out_even, out_odd, width / 2);
+  }
+
+  k.convert(u, out + uv_size * 4, uv_size);
+  k.convert(v, out + uv_size * 5, uv_size);
+}
+
+const char *transform_cpu_isa() {
+  return kernels().isa;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/mat.h"
+
+// CPU versions of the warpPerspective and loadyuv kernels, for hosts without a GPU where
+// a CPU OpenCL runtime adds a lot of overhead. The vectorized path (AVX2 or NEON) is selected
+// at runtime. Results match the OpenCL kernels within rounding of the float math.
+
+// same as transform_queue. out_y, out_u and out_v are planar
+void transform_cpu(const uint8_t *in_yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                   uint8_t *out_y, uint8_t *out_u, uint8_t *out_v,
+                   int out_width, int out_height,
+                   const mat3 &projection);
+
+// same as loadyuv_queue without the shift
+void loadyuv_cpu(const uint8_t *y, const uint8_t *u, const uint8_t *v, float *out, int width, int height);
+
+// name of the instruction set in use: "avx2", "neon" or "scalar"
+const char *transform_cpu_isa();
@@ -199,23 +199,33 @@ class TestOnroad(unittest.TestCase):
     result += "------------------ CPU Usage -------------------\n"
     result += "------------------------------------------------\n"
 
-    plogs_by_proc = defaultdict(list)
-    for pl in self.service_msgs['procLog']:
+    # a procLog only has the processes that changed since the last one, unless it's a full one.
+    # Start at the first full one and keep the latest of each process after it.
+    plogs = self.service_msgs['procLog']
+    first = next(i for i, pl in enumerate(plogs) if pl.procLog.full)
+    start_procs = {x.pid: x for x in plogs[first].procLog.procs}
+    end_procs = {}
+    for pl in plogs[first:]:
       for x in pl.procLog.procs:
-        if len(x.cmdline) > 0:
-          n = list(x.cmdline)[0]
-          plogs_by_proc[n].append(x)
-    print(plogs_by_proc.keys())
+        end_procs[x.pid] = x
+
+    # cpu time of each process, by name
+    cpu_times_by_proc = defaultdict(list)
+    for pid, x in end_procs.items():
+      if len(x.cmdline) > 0 and pid in start_procs and start_procs[pid].startTime == x.startTime:
+        n = list(x.cmdline)[0]
+        cpu_times_by_proc[n].append(cputime_total(x) - cputime_total(start_procs[pid]))
+    print(cpu_times_by_proc.keys())
 
     cpu_ok = True
-    dt = (self.service_msgs['procLog'][-1].logMonoTime - self.service_msgs['procLog'][0].logMonoTime) / 1e9
+    dt = (plogs[-1].logMonoTime - plogs[first].logMonoTime) / 1e9
     for proc_name, expected_cpu in PROCS.items():
 
       err = ""
       cpu_usage = 0.
-      x = plogs_by_proc[proc_name]
-      if len(x) > 2:
-        cpu_time = cputime_total(x[-1]) - cputime_total(x[0])
+      x = cpu_times_by_proc[proc_name]
+      if len(x) > 0:
+        cpu_time = sum(x)
         cpu_usage = cpu_time / dt * 100.
 
         if expected_cpu is None:
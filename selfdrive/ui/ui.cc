@@ -84,21 +84,21 @@ void update_model(UIState *s,
                   const cereal::UiPlan::Reader &plan) {
   UIScene &scene = s->scene;
 
-  // FrogPilot variables for Custom Road UI
-  static auto params = Params();
-  const bool isCustomRoadUI = params.getBool("CustomRoadUI");
-  const bool isUnlimitedLength = isCustomRoadUI && params.getBool("UnlimitedLength");
+  // FrogPilot variables for Custom Road UI, read every frame so from the cache
+  static auto params = Params({}, true);
+  const bool isCustomRoadUI = params.get<ParamKey::CustomRoadUI>();
+  const bool isUnlimitedLength = isCustomRoadUI && params.get<ParamKey::UnlimitedLength>();
   static float lane_line_width = 0.025;
   static float path_edge_width = 0;
   static float path_width = 0.9;
   static float road_edge_width = 0.025;
   // If CustomRoadUI has been updated, update the road UI
-  if (params.getBool("FrogPilotTogglesUpdated")) {
-    lane_line_width = params.getFloat("LaneLinesWidth") / 12 * 0.1524; // Convert from inches to meters
-    path_edge_width = params.getInt("PathEdgeWidth");
-    path_width = params.getFloat("PathWidth") / 10 * 0.1524;           // Convert from feet to meters
-    road_edge_width = params.getFloat("RoadEdgesWidth") / 12 * 0.1524; // Convert from inches to meters
-    params.putBool("FrogPilotTogglesUpdated", false);
+  if (params.get<ParamKey::FrogPilotTogglesUpdated>()) {
+    lane_line_width = params.get<ParamKey::LaneLinesWidth>() / 12 * 0.1524; // Convert from inches to meters
+    path_edge_width = params.get<ParamKey::PathEdgeWidth>();
+    path_width = params.get<ParamKey::PathWidth>() / 10 * 0.1524;           // Convert from feet to meters
+    road_edge_width = params.get<ParamKey::RoadEdgesWidth>() / 12 * 0.1524; // Convert from inches to meters
+    params.put<ParamKey::FrogPilotTogglesUpdated>(false);
   }
 
   auto plan_position = plan.getPosition();
@@ -266,38 +266,39 @@ static void update_state(UIState *s) {
 void ui_update_params(UIState *s) {
   auto params = Params();
   UIScene &scene = s->scene;
-  s->scene.is_metric = params.getBool("IsMetric");
-  s->scene.map_on_left = params.getBool("NavSettingLeftSide");
+  s->scene.is_metric = params.get<ParamKey::IsMetric>();
+  s->scene.map_on_left = params.get<ParamKey::NavSettingLeftSide>();
 
   // FrogPilot variables
-  const bool frog_theme = params.getBool("FrogTheme");
-  scene.compass = params.getBool("Compass");
-  scene.frog_colors = frog_theme && params.getBool("FrogColors");
-  scene.frog_signals = frog_theme && params.getBool("FrogSignals");
-  scene.mute_dm = params.getBool("FireTheBabysitter") && params.getBool("MuteDM");
-  scene.rotating_wheel = params.getBool("RotatingWheel");
-  scene.wide_camera_disabled = params.getBool("WideCameraDisable");
+  const bool frog_theme = params.get<ParamKey::FrogTheme>();
+  scene.compass = params.get<ParamKey::Compass>();
+  scene.frog_colors = frog_theme && params.get<ParamKey::FrogColors>();
+  scene.frog_signals = frog_theme && params.get<ParamKey::FrogSignals>();
+  scene.mute_dm = params.get<ParamKey::FireTheBabysitter>() && params.get<ParamKey::MuteDM>();
+  scene.rotating_wheel = params.get<ParamKey::RotatingWheel>();
+  scene.wide_camera_disabled = params.get<ParamKey::WideCameraDisable>();
 }
 
 void ui_live_update_params(UIState *s) {
-  static auto params = Params();
+  // read every frame, so from the cache
+  static auto params = Params({}, true);
   UIScene &scene = s->scene;
   // FrogPilot variables that need to be updated live
-  scene.adjustable_follow_distance_profile = params.getInt("AdjustableFollowDistanceProfile");
+  scene.adjustable_follow_distance_profile = params.get<ParamKey::AdjustableFollowDistanceProfile>();
   if (scene.conditional_experimental) {
-    scene.conditional_status = params.getInt("ConditionalStatus");
+    scene.conditional_status = params.get<ParamKey::ConditionalStatus>();
     if (scene.experimental_mode_via_wheel && !scene.steering_wheel_car) {
-      scene.experimental_mode_override = params.getInt("ExperimentalModeOverride");
+      scene.experimental_mode_override = params.get<ParamKey::ExperimentalModeOverride>();
     }
   }
   // FrogPilot variables that need to be updated whenever the user changes its toggle value
-  if (params.getBool("FrogPilotTogglesUpdated")) {
+  if (params.get<ParamKey::FrogPilotTogglesUpdated>()) {
     if (scene.conditional_experimental) {
-      scene.conditional_speed = params.getInt("ConditionalExperimentalModeSpeed");
-      scene.conditional_speed_lead = params.getInt("ConditionalExperimentalModeSpeedLead");
+      scene.conditional_speed = params.get<ParamKey::ConditionalExperimentalModeSpeed>();
+      scene.conditional_speed_lead = params.get<ParamKey::ConditionalExperimentalModeSpeedLead>();
     }
-    scene.screen_brightness = params.getInt("ScreenBrightness");
-    scene.steering_wheel = params.getInt("SteeringWheel");
+    scene.screen_brightness = params.get<ParamKey::ScreenBrightness>();
+    scene.steering_wheel = params.get<ParamKey::SteeringWheel>();
   }
 }
 
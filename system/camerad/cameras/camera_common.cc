@@ -2,11 +2,18 @@
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <chrono>
 #include <thread>
 
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include "libyuv.h"
 #include <jpeglib.h>
 
@@ -14,6 +21,7 @@
 #include "common/clutil.h"
 #include "common/modeldata.h"
 #include "common/swaglog.h"
+#include "common/trace.h"
 #include "common/util.h"
 #include "system/hardware/hw.h"
 #include "msm_media_info.h"
@@ -122,6 +130,7 @@ bool CameraBuf::acquire() {
   cur_frame_data = camera_bufs_metadata[cur_buf_idx];
   cur_yuv_buf = vipc_server->get_buffer(yuv_type);
   cur_camera_buf = &camera_bufs[cur_buf_idx];
+  TRACE_SCOPE_FRAME("debayer", cur_frame_data.frame_id);
 
   double start_time = millis_since_boot();
   cl_event event;
@@ -136,6 +145,8 @@ bool CameraBuf::acquire() {
     cur_frame_data.timestamp_eof,
   };
   cur_yuv_buf->set_frame_id(cur_frame_data.frame_id);
+  TRACE_FLOW_BEGIN(yuv_type == VISION_STREAM_ROAD ? "road frame" : yuv_type == VISION_STREAM_WIDE_ROAD ? "wide road frame" : "driver frame",
+                   cur_frame_data.frame_id);
   vipc_server->send(cur_yuv_buf, &extra);
 
   return true;
@@ -181,32 +192,103 @@ kj::Array<uint8_t> get_raw_frame_image(const CameraBuf *b) {
   return kj::mv(frame_image);
 }
 
-static kj::Array<capnp::byte> yuv420_to_jpeg(const CameraBuf *b, int thumbnail_width, int thumbnail_height) {
-  int downscale = b->cur_yuv_buf->width / thumbnail_width;
-  assert(downscale * thumbnail_height == b->cur_yuv_buf->height);
-  int in_stride = b->cur_yuv_buf->stride;
+namespace {
 
-  // make the buffer big enough. jpeg_write_raw_data requires 16-pixels aligned height to be used.
-  std::unique_ptr<uint8[]> buf(new uint8_t[(thumbnail_width * ((thumbnail_height + 15) & ~15) * 3) / 2]);
-  uint8_t *y_plane = buf.get();
-  uint8_t *u_plane = y_plane + thumbnail_width * thumbnail_height;
-  uint8_t *v_plane = u_plane + (thumbnail_width * thumbnail_height) / 4;
-  {
-    // subsampled conversion from nv12 to yuv
-    for (int hy = 0; hy < thumbnail_height/2; hy++) {
-      for (int hx = 0; hx < thumbnail_width/2; hx++) {
-        int ix = hx * downscale + (downscale-1)/2;
-        int iy = hy * downscale + (downscale-1)/2;
-        y_plane[(hy*2 + 0)*thumbnail_width + (hx*2 + 0)] = b->cur_yuv_buf->y[(iy*2 + 0) * in_stride + ix*2 + 0];
-        y_plane[(hy*2 + 0)*thumbnail_width + (hx*2 + 1)] = b->cur_yuv_buf->y[(iy*2 + 0) * in_stride + ix*2 + 1];
-        y_plane[(hy*2 + 1)*thumbnail_width + (hx*2 + 0)] = b->cur_yuv_buf->y[(iy*2 + 1) * in_stride + ix*2 + 0];
-        y_plane[(hy*2 + 1)*thumbnail_width + (hx*2 + 1)] = b->cur_yuv_buf->y[(iy*2 + 1) * in_stride + ix*2 + 1];
-        u_plane[hy*thumbnail_width/2 + hx] = b->cur_yuv_buf->uv[iy*in_stride + ix*2 + 0];
-        v_plane[hy*thumbnail_width/2 + hx] = b->cur_yuv_buf->uv[iy*in_stride + ix*2 + 1];
-      }
+// Row kernels of the thumbnail, with SSE2 or NEON for the downscale camerad uses and a scalar loop
+// for the rest of a row and any other downscale.
+
+#if defined(__x86_64__)
+
+// the first uint16 of every 8 bytes, of 64 bytes
+inline __m128i gather_pairs4(const uint8_t *src) {
+  const __m128i mask = _mm_set_epi32(0, 0xffff, 0, 0xffff);
+  __m128i v[4];
+  for (int i = 0; i < 4; i++) {
+    v[i] = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + 16 * i)), mask);
+    v[i] = _mm_shuffle_epi32(v[i], _MM_SHUFFLE(3, 1, 2, 0));
+  }
+  __m128i lo = _mm_unpacklo_epi64(v[0], v[1]);
+  __m128i hi = _mm_unpacklo_epi64(v[2], v[3]);
+  // sign extended, so the saturating pack keeps all 16 bits
+  lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+  hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+  return _mm_packs_epi32(lo, hi);
+}
+
+inline void store_pairs4(const uint8_t *src, uint8_t *dst) {
+  _mm_storeu_si128((__m128i *)dst, gather_pairs4(src));
+}
+
+inline void store_pairs4_uv(const uint8_t *src, uint8_t *u, uint8_t *v) {
+  const __m128i uv = gather_pairs4(src);
+  const __m128i zero = _mm_setzero_si128();
+  _mm_storel_epi64((__m128i *)u, _mm_packus_epi16(_mm_and_si128(uv, _mm_set1_epi16(0xff)), zero));
+  _mm_storel_epi64((__m128i *)v, _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+}
+
+#elif defined(__aarch64__)
+
+inline void store_pairs4(const uint8_t *src, uint8_t *dst) {
+  vst1q_u16((uint16_t *)dst, vld4q_u16((const uint16_t *)src).val[0]);
+}
+
+inline void store_pairs4_uv(const uint8_t *src, uint8_t *u, uint8_t *v) {
+  const uint16x8_t uv = vld4q_u16((const uint16_t *)src).val[0];
+  vst1_u8(u, vmovn_u16(uv));
+  vst1_u8(v, vshrn_n_u16(uv, 8));
+}
+
+#endif
+
+// every step-th pair of bytes. The vector loops stop a pair early, so they don't read past the
+// last pair of a row
+void downscale_row(const uint8_t *src, int step, uint8_t *dst, int pairs) {
+  int i = 0;
+#if defined(__x86_64__) || defined(__aarch64__)
+  if (step == 4) {
+    for (; i + 9 <= pairs; i += 8) {
+      store_pairs4(src + 8 * i, dst + 2 * i);
     }
   }
+#endif
+  for (; i < pairs; i++) {
+    dst[2 * i] = src[2 * i * step];
+    dst[2 * i + 1] = src[2 * i * step + 1];
+  }
+}
 
+void downscale_row_uv(const uint8_t *src, int step, uint8_t *u, uint8_t *v, int pairs) {
+  int i = 0;
+#if defined(__x86_64__) || defined(__aarch64__)
+  if (step == 4) {
+    for (; i + 9 <= pairs; i += 8) {
+      store_pairs4_uv(src + 8 * i, u + i, v + i);
+    }
+  }
+#endif
+  for (; i < pairs; i++) {
+    u[i] = src[2 * i * step];
+    v[i] = src[2 * i * step + 1];
+  }
+}
+
+// counts every skip-th pixel. Neighbouring pixels often have the same value, they go to different
+// histograms so that an increment doesn't wait for the one before. This is what bounds the loop,
+// vector loads of the pixels don't make it faster
+void histogram_row(const uint8_t *src, int count, int skip, uint32_t (*hist)[256]) {
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    hist[0][src[i * skip]]++;
+    hist[1][src[(i + 1) * skip]]++;
+    hist[2][src[(i + 2) * skip]]++;
+    hist[3][src[(i + 3) * skip]]++;
+  }
+  for (; i < count; i++) {
+    hist[0][src[i * skip]]++;
+  }
+}
+
+kj::Array<capnp::byte> yuv420_to_jpeg(const uint8_t *y_plane, const uint8_t *u_plane, const uint8_t *v_plane, int width, int height) {
   struct jpeg_compress_struct cinfo;
   struct jpeg_error_mgr jerr;
   cinfo.err = jpeg_std_error(&jerr);
@@ -216,8 +298,8 @@ static kj::Array<capnp::byte> yuv420_to_jpeg(const CameraBuf *b, int thumbnail_w
   size_t thumbnail_len = 0;
   jpeg_mem_dest(&cinfo, &thumbnail_buffer, &thumbnail_len);
 
-  cinfo.image_width = thumbnail_width;
-  cinfo.image_height = thumbnail_height;
+  cinfo.image_width = width;
+  cinfo.image_height = height;
   cinfo.input_components = 3;
 
   jpeg_set_defaults(&cinfo);
@@ -239,11 +321,11 @@ static kj::Array<capnp::byte> yuv420_to_jpeg(const CameraBuf *b, int thumbnail_w
 
   for (int line = 0; line < cinfo.image_height; line += 16) {
     for (int i = 0; i < 16; ++i) {
-      y[i] = y_plane + (line + i) * cinfo.image_width;
+      y[i] = (JSAMPROW)y_plane + (line + i) * cinfo.image_width;
       if (i % 2 == 0) {
         int offset = (cinfo.image_width / 2) * ((i + line) / 2);
-        u[i / 2] = u_plane + offset;
-        v[i / 2] = v_plane + offset;
+        u[i / 2] = (JSAMPROW)u_plane + offset;
+        v[i / 2] = (JSAMPROW)v_plane + offset;
       }
     }
     jpeg_write_raw_data(&cinfo, planes, 16);
@@ -257,38 +339,107 @@ static kj::Array<capnp::byte> yuv420_to_jpeg(const CameraBuf *b, int thumbnail_w
   return dat;
 }
 
-static void publish_thumbnail(PubMaster *pm, const CameraBuf *b) {
-  auto thumbnail = yuv420_to_jpeg(b, b->rgb_width / 4, b->rgb_height / 4);
-  if (thumbnail.size() == 0) return;
+}  // namespace
+
+// NV12 to planar YUV420, keeping one 2x2 block of pixels of every downscale x downscale blocks
+void downscale_nv12(const VisionBuf *buf, int width, int height, uint8_t *y_plane, uint8_t *u_plane, uint8_t *v_plane) {
+  const int downscale = buf->width / width;
+  assert(downscale * height == buf->height);
+  const int offset = (downscale - 1) / 2;
+  for (int hy = 0; hy < height / 2; hy++) {
+    const int iy = hy * downscale + offset;
+    const uint8_t *y_row = buf->y + iy * 2 * buf->stride + offset * 2;
+    downscale_row(y_row, downscale, y_plane + (hy * 2 + 0) * width, width / 2);
+    downscale_row(y_row + buf->stride, downscale, y_plane + (hy * 2 + 1) * width, width / 2);
+    downscale_row_uv(buf->uv + iy * buf->stride + offset * 2, downscale, u_plane + hy * width / 2, v_plane + hy * width / 2, width / 2);
+  }
+}
 
-  MessageBuilder msg;
-  auto thumbnaild = msg.initEvent().initThumbnail();
-  thumbnaild.setFrameId(b->cur_frame_data.frame_id);
-  thumbnaild.setTimestampEof(b->cur_frame_data.timestamp_eof);
-  thumbnaild.setThumbnail(thumbnail);
+// The thumbnail is downscaled on the processing thread, and encoded and sent on a thread of its
+// own, so libjpeg doesn't hold up a frame.
+class ThumbnailPublisher {
+public:
+  ThumbnailPublisher(PubMaster *publisher, int thumbnail_width, int thumbnail_height)
+      : pm(publisher), width(thumbnail_width), height(thumbnail_height) {
+    for (auto &t : thumbnails) {
+      // make the buffer big enough. jpeg_write_raw_data requires 16-pixels aligned height to be used.
+      t.yuv = std::make_unique<uint8_t[]>((width * ((height + 15) & ~15) * 3) / 2);
+      free_thumbnails.push(&t);
+    }
+    thread = std::thread(&ThumbnailPublisher::run, this);
+  }
 
-  pm->send("thumbnail", msg);
-}
+  ~ThumbnailPublisher() {
+    thread.join();
+  }
+
+  void queue(const CameraBuf *b) {
+    Thumbnail *t = nullptr;
+    if (!free_thumbnails.try_pop(t)) {
+      LOGW("skipping thumbnail of frame %d, the last ones weren't sent yet", b->cur_frame_data.frame_id);
+      return;
+    }
+    t->frame_id = b->cur_frame_data.frame_id;
+    t->timestamp_eof = b->cur_frame_data.timestamp_eof;
+    downscale_nv12(b->cur_yuv_buf, width, height, y_plane(t), u_plane(t), v_plane(t));
+    pending.push(t);
+  }
+
+private:
+  struct Thumbnail {
+    uint32_t frame_id;
+    uint64_t timestamp_eof;
+    std::unique_ptr<uint8_t[]> yuv;
+  };
+
+  uint8_t *y_plane(Thumbnail *t) { return t->yuv.get(); }
+  uint8_t *u_plane(Thumbnail *t) { return y_plane(t) + width * height; }
+  uint8_t *v_plane(Thumbnail *t) { return u_plane(t) + (width * height) / 4; }
+
+  void run() {
+    util::set_thread_name("thumbnail");
+    while (!do_exit) {
+      Thumbnail *t = nullptr;
+      if (!pending.try_pop(t, 50)) continue;
+
+      TRACE_SCOPE_FRAME("thumbnail", t->frame_id);
+      auto thumbnail = yuv420_to_jpeg(y_plane(t), u_plane(t), v_plane(t), width, height);
+      if (thumbnail.size() > 0) {
+        MessageBuilder msg;
+        auto thumbnaild = msg.initEvent().initThumbnail();
+        thumbnaild.setFrameId(t->frame_id);
+        thumbnaild.setTimestampEof(t->timestamp_eof);
+        thumbnaild.setThumbnail(thumbnail);
+        pm->send("thumbnail", msg);
+      }
+      free_thumbnails.push(t);
+    }
+  }
+
+  PubMaster *pm;
+  const int width, height;
+  Thumbnail thumbnails[2];
+  SafeQueue<Thumbnail *> pending, free_thumbnails;
+  std::thread thread;
+};
 
 float set_exposure_target(const CameraBuf *b, int x_start, int x_end, int x_skip, int y_start, int y_end, int y_skip) {
   int lum_med;
-  uint32_t lum_binning[256] = {0};
+  uint32_t lum_binning[4][256] = {};
   const uint8_t *pix_ptr = b->cur_yuv_buf->y;
+  const int x_count = std::max(0, (x_end - x_start + x_skip - 1) / x_skip);
 
   unsigned int lum_total = 0;
   for (int y = y_start; y < y_end; y += y_skip) {
-    for (int x = x_start; x < x_end; x += x_skip) {
-      uint8_t lum = pix_ptr[(y * b->rgb_width) + x];
-      lum_binning[lum]++;
-      lum_total += 1;
-    }
+    histogram_row(&pix_ptr[(y * b->rgb_width) + x_start], x_count, x_skip, lum_binning);
+    lum_total += x_count;
   }
 
 
   // Find mean lumimance value
   unsigned int lum_cur = 0;
   for (lum_med = 255; lum_med >= 0; lum_med--) {
-    lum_cur += lum_binning[lum_med];
+    lum_cur += lum_binning[0][lum_med] + lum_binning[1][lum_med] + lum_binning[2][lum_med] + lum_binning[3][lum_med];
 
     if (lum_cur >= lum_total / 2) {
       break;
@@ -309,15 +460,20 @@ void *processing_thread(MultiCameraState *cameras, CameraState *cs, process_thre
   }
   util::set_thread_name(thread_name);
 
+  std::unique_ptr<ThumbnailPublisher> thumbnails;
+  if (cs == &cameras->road_cam && cameras->pm) {
+    thumbnails = std::make_unique<ThumbnailPublisher>(cameras->pm, cs->buf.rgb_width / 4, cs->buf.rgb_height / 4);
+  }
+
   uint32_t cnt = 0;
   while (!do_exit) {
     if (!cs->buf.acquire()) continue;
 
+    TRACE_SCOPE_FRAME(thread_name, cs->buf.cur_frame_data.frame_id);
     callback(cameras, cs, cnt);
 
-    if (cs == &(cameras->road_cam) && cameras->pm && cnt % 100 == 3) {
-      // this takes 10ms???
-      publish_thumbnail(cameras->pm, &(cs->buf));
+    if (thumbnails && cnt % 100 == 3) {
+      thumbnails->queue(&cs->buf);
     }
     ++cnt;
   }
@@ -0,0 +1,70 @@
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+#include "system/camerad/cameras/camera_common.h"
+
+// Checks downscale_nv12, with the vector loop for a downscale of 4, against a plain copy of one
+// 2x2 block of every downscale x downscale blocks. Covers rows of less than 9 pairs, which only
+// go through the scalar loop, every tail length after the vector loop, and other downscales. The
+// planes end right before a page that can't be read, so a read past the last row crashes.
+// usage: ./test_downscale_nv12
+
+// len bytes that end right before a PROT_NONE page
+uint8_t *guarded(size_t len) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t pages = (len + page_size - 1) / page_size;
+  uint8_t *mem = (uint8_t *)mmap(nullptr, (pages + 1) * page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert(mem != MAP_FAILED);
+  assert(mprotect(mem + pages * page_size, page_size, PROT_NONE) == 0);
+  return mem + pages * page_size - len;
+}
+
+void test(int downscale, int width, int height) {
+  VisionBuf buf;
+  buf.width = width * downscale;
+  buf.height = height * downscale;
+  buf.stride = buf.width + 2 * (width % 7);  // padded, or not
+  const int offset = (downscale - 1) / 2;
+
+  // only the rows up to the last one that is read, so that the guard page comes right after it
+  const int last_block = (height / 2 - 1) * downscale + offset;
+  const size_t y_len = (last_block * 2 + 1) * buf.stride + buf.width;
+  const size_t uv_len = last_block * buf.stride + buf.width;
+  buf.y = guarded(y_len);
+  buf.uv = guarded(uv_len);
+  for (size_t i = 0; i < y_len; i++) buf.y[i] = i * 7 + (i >> 8);
+  for (size_t i = 0; i < uv_len; i++) buf.uv[i] = i * 13 + (i >> 8) + 1;
+
+  std::vector<uint8_t> y(width * height), u(width * height / 4), v(width * height / 4);
+  downscale_nv12(&buf, width, height, y.data(), u.data(), v.data());
+
+  for (int by = 0; by < height / 2; by++) {
+    for (int bx = 0; bx < width / 2; bx++) {
+      const int sy = by * downscale + offset, sx = bx * downscale + offset;
+      for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < 2; i++) {
+          assert(y[(by * 2 + j) * width + bx * 2 + i] == buf.y[(sy * 2 + j) * buf.stride + sx * 2 + i]);
+        }
+      }
+      assert(u[by * width / 2 + bx] == buf.uv[sy * buf.stride + sx * 2]);
+      assert(v[by * width / 2 + bx] == buf.uv[sy * buf.stride + sx * 2 + 1]);
+    }
+  }
+}
+
+int main() {
+  for (int downscale : {4, 1, 2, 3, 5}) {
+    // 1 to 40 pairs per row
+    for (int width = 2; width <= 80; width += 2) {
+      test(downscale, width, 6);
+    }
+  }
+  // the thumbnails of the road cameras
+  test(4, 482, 302);
+  printf("passed\n");
+  return 0;
+}
@@ -72,6 +72,10 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
     ((name == "qRoadEncodeData") ? event.getQRoadEncodeData() : event.getRoadEncodeData()));
   auto idx = edata.getIdx();
   auto flags = idx.getFlags();
+  TRACE_SCOPE_FRAME("handle_encoder_msg", idx.getFrameId());
+  if (name != "qRoadEncodeData") {
+    TRACE_FLOW_STEP(name == "driverEncodeData" ? "driver frame" : name == "wideRoadEncodeData" ? "wide road frame" : "road frame", idx.getFrameId());
+  }
 
   // encoderd can have started long before loggerd
   if (!re.seen_first_packet) {
@@ -20,6 +20,7 @@
 #include "common/params.h"
 #include "common/swaglog.h"
 #include "common/timing.h"
+#include "common/trace.h"
 #include "common/util.h"
 #include "system/hardware/hw.h"
 
@@ -6,13 +6,16 @@
 
 ExitHandler do_exit;
 
+const int FULL_INTERVAL = 15;  // messages, every 30 secs
+
 int main(int argc, char **argv) {
   setpriority(PRIO_PROCESS, 0, -15);
 
   PubMaster publisher({"procLog"});
-  while (!do_exit) {
+  ProcLog proc_log;
+  for (int i = 0; !do_exit; i++) {
     MessageBuilder msg;
-    buildProcLogMessage(msg);
+    proc_log.buildMessage(msg, i % FULL_INTERVAL == 0);
     publisher.send("procLog", msg);
 
     util::sleep_for(2000);  // 2 secs
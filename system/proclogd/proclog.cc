@@ -1,43 +1,106 @@
 #include "system/proclogd/proclog.h"
 
-#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
-#include <fstream>
-#include <iterator>
-#include <sstream>
+#include <cctype>
+#include <climits>
+#include <cstring>
 
 #include "common/swaglog.h"
 #include "common/util.h"
 
+namespace {
+
+const size_t READ_BUF_SIZE = 64 * 1024;  // /proc/stat and /proc/meminfo are a few kB
+const int RESERVED_FDS = 64;
+const int MAX_OPEN_STATS = 1024;  // more than the processes and kernel threads of a device
+
+// numbers of the /proc files are separated by spaces, p is moved past the number
+template <class T>
+bool parse_num(const char *&p, const char *end, T &value) {
+  while (p < end && *p == ' ') p++;
+  const bool negative = p < end && *p == '-';
+  if (negative) p++;
+  if (p == end || !isdigit(*p)) return false;
+
+  unsigned long long v = 0;
+  for (; p < end && isdigit(*p); p++) {
+    v = v * 10 + (*p - '0');
+  }
+  value = negative ? (T)-(long long)v : (T)v;
+  return true;
+}
+
+const char *next_line(const char *p, const char *end) {
+  p = (const char *)memchr(p, '\n', end - p);
+  return p ? p + 1 : end;
+}
+
+// reads a file of /proc again from the start, to the end of buf
+ssize_t read_proc_file(int fd, std::vector<char> &buf) {
+  return HANDLE_EINTR(pread(fd, buf.data(), buf.size(), 0));
+}
+
+bool same_stat(const ProcStat &a, const ProcStat &b) {
+  return a.state == b.state && a.utime == b.utime && a.stime == b.stime && a.cutime == b.cutime &&
+         a.cstime == b.cstime && a.priority == b.priority && a.nice == b.nice && a.num_threads == b.num_threads &&
+         a.vms == b.vms && a.rss == b.rss && a.processor == b.processor && a.ppid == b.ppid &&
+         a.starttime == b.starttime && a.name == b.name;
+}
+
+}  // namespace
+
 namespace Parser {
 
 // parse /proc/stat
-std::vector<CPUTime> cpuTimes(std::istream &stream) {
-  std::vector<CPUTime> cpu_times;
-  std::string line;
+void cpuTimes(const char *stat, size_t len, std::vector<CPUTime> &cpu_times) {
+  cpu_times.clear();
+  const char *end = stat + len;
   // skip the first line for cpu total
-  std::getline(stream, line);
-  while (std::getline(stream, line)) {
-    if (line.compare(0, 3, "cpu") != 0) break;
+  for (const char *p = next_line(stat, end); p < end; p = next_line(p, end)) {
+    if (end - p < 3 || strncmp(p, "cpu", 3) != 0) break;
 
     CPUTime t = {};
-    std::istringstream iss(line);
-    if (iss.ignore(3) >> t.id >> t.utime >> t.ntime >> t.stime >> t.itime >> t.iowtime >> t.irqtime >> t.sirqtime)
+    const char *q = p + 3;
+    if (parse_num(q, end, t.id) && parse_num(q, end, t.utime) && parse_num(q, end, t.ntime) &&
+        parse_num(q, end, t.stime) && parse_num(q, end, t.itime) && parse_num(q, end, t.iowtime) &&
+        parse_num(q, end, t.irqtime) && parse_num(q, end, t.sirqtime)) {
       cpu_times.push_back(t);
+    }
   }
-  return cpu_times;
 }
 
 // parse /proc/meminfo
-std::unordered_map<std::string, uint64_t> memInfo(std::istream &stream) {
-  std::unordered_map<std::string, uint64_t> mem_info;
-  std::string line, key;
-  while (std::getline(stream, line)) {
-    uint64_t val = 0;
-    std::istringstream iss(line);
-    if (iss >> key >> val) {
-      mem_info[key] = val * 1024;
+MemInfo memInfo(const char *meminfo, size_t len) {
+  static const struct {
+    const char *key;
+    uint64_t MemInfo::*field;
+  } keys[] = {
+    {"MemTotal:", &MemInfo::total},
+    {"MemFree:", &MemInfo::free},
+    {"MemAvailable:", &MemInfo::available},
+    {"Buffers:", &MemInfo::buffers},
+    {"Cached:", &MemInfo::cached},
+    {"Active:", &MemInfo::active},
+    {"Inactive:", &MemInfo::inactive},
+    {"Shmem:", &MemInfo::shared},
+  };
+
+  MemInfo mem_info = {};
+  const char *end = meminfo + len;
+  for (const char *p = meminfo; p < end; p = next_line(p, end)) {
+    for (const auto &k : keys) {
+      const size_t key_len = strlen(k.key);
+      const char *q = p + key_len;
+      uint64_t val = 0;
+      if (end - p > (ptrdiff_t)key_len && strncmp(p, k.key, key_len) == 0 && parse_num(q, end, val)) {
+        mem_info.*k.field = val * 1024;
+        break;
+      }
     }
   }
   return mem_info;
@@ -59,112 +122,163 @@ enum StatPos {
   vsize = 23,
   rss = 24,
   processor = 39,
-  MAX_FIELD = 52,
 };
 
 // parse /proc/pid/stat
-std::optional<ProcStat> procStat(std::string stat) {
+bool procStat(const char *stat, size_t len, ProcStat &p) {
   // To avoid being fooled by names containing a closing paren, scan backwards.
-  auto open_paren = stat.find('(');
-  auto close_paren = stat.rfind(')');
-  if (open_paren == std::string::npos || close_paren == std::string::npos || open_paren > close_paren) {
-    return std::nullopt;
+  const char *end = stat + len;
+  const char *open_paren = (const char *)memchr(stat, '(', len);
+  const char *close_paren = (const char *)memrchr(stat, ')', len);
+  if (!open_paren || !close_paren || open_paren > close_paren || end - close_paren < 4) {
+    return false;
   }
 
-  std::string name = stat.substr(open_paren + 1, close_paren - open_paren - 1);
-  // replace space in name with _
-  std::replace(&stat[open_paren], &stat[close_paren], ' ', '_');
-  std::istringstream iss(stat);
-  std::vector<std::string> v{std::istream_iterator<std::string>(iss),
-                             std::istream_iterator<std::string>()};
-  try {
-    if (v.size() != StatPos::MAX_FIELD) {
-      throw std::invalid_argument("stat");
-    }
-    ProcStat p = {
-      .name = name,
-      .pid = stoi(v[StatPos::pid - 1]),
-      .state = v[StatPos::state - 1][0],
-      .ppid = stoi(v[StatPos::ppid - 1]),
-      .utime = stoul(v[StatPos::utime - 1]),
-      .stime = stoul(v[StatPos::stime - 1]),
-      .cutime = stol(v[StatPos::cutime - 1]),
-      .cstime = stol(v[StatPos::cstime - 1]),
-      .priority = stol(v[StatPos::priority - 1]),
-      .nice = stol(v[StatPos::nice - 1]),
-      .num_threads = stol(v[StatPos::num_threads - 1]),
-      .starttime = stoull(v[StatPos::starttime - 1]),
-      .vms = stoul(v[StatPos::vsize - 1]),
-      .rss = stol(v[StatPos::rss - 1]),
-      .processor = stoi(v[StatPos::processor - 1]),
-    };
-    return p;
-  } catch (const std::invalid_argument &e) {
-    LOGE("failed to parse procStat (%s) :%s", e.what(), stat.c_str());
-  } catch (const std::out_of_range &e) {
-    LOGE("failed to parse procStat (%s) :%s", e.what(), stat.c_str());
-  }
-  return std::nullopt;
-}
+  const char *s = stat;
+  if (!parse_num(s, open_paren, p.pid)) return false;
+  p.name.assign(open_paren + 1, close_paren - open_paren - 1);
+  p.state = close_paren[2];
 
-// return list of PIDs from /proc
-std::vector<int> pids() {
-  std::vector<int> ids;
-  DIR *d = opendir("/proc");
-  assert(d);
-  char *p_end;
-  struct dirent *de = NULL;
-  while ((de = readdir(d))) {
-    if (de->d_type == DT_DIR) {
-      int pid = strtol(de->d_name, &p_end, 10);
-      if (p_end == (de->d_name + strlen(de->d_name))) {
-        ids.push_back(pid);
-      }
+  // the numbers after the state, until the last one used
+  s = close_paren + 3;
+  for (int pos = StatPos::state + 1; pos <= StatPos::processor; pos++) {
+    long long v = 0;
+    if (!parse_num(s, end, v)) {
+      LOGE("failed to parse procStat: %.*s", (int)len, stat);
+      return false;
+    }
+    switch (pos) {
+      case StatPos::ppid: p.ppid = v; break;
+      case StatPos::utime: p.utime = v; break;
+      case StatPos::stime: p.stime = v; break;
+      case StatPos::cutime: p.cutime = v; break;
+      case StatPos::cstime: p.cstime = v; break;
+      case StatPos::priority: p.priority = v; break;
+      case StatPos::nice: p.nice = v; break;
+      case StatPos::num_threads: p.num_threads = v; break;
+      case StatPos::starttime: p.starttime = v; break;
+      case StatPos::vsize: p.vms = v; break;
+      case StatPos::rss: p.rss = v; break;
+      case StatPos::processor: p.processor = v; break;
+      default: break;
     }
   }
-  closedir(d);
-  return ids;
+  return true;
 }
 
 // null-delimited cmdline arguments to vector
-std::vector<std::string> cmdline(std::istream &stream) {
+std::vector<std::string> cmdline(const std::string &cmdline) {
   std::vector<std::string> ret;
-  std::string line;
-  while (std::getline(stream, line, '\0')) {
-    if (!line.empty()) {
-      ret.push_back(line);
+  for (size_t start = 0; start < cmdline.size();) {
+    size_t end = cmdline.find('\0', start);
+    if (end == std::string::npos) end = cmdline.size();
+    if (end > start) {
+      ret.emplace_back(cmdline, start, end - start);
     }
+    start = end + 1;
   }
   return ret;
 }
 
-const ProcCache &getProcExtraInfo(int pid, const std::string &name) {
-  static std::unordered_map<pid_t, ProcCache> proc_cache;
-  ProcCache &cache = proc_cache[pid];
-  if (cache.pid != pid || cache.name != name) {
-    cache.pid = pid;
-    cache.name = name;
-    std::string proc_path = "/proc/" + std::to_string(pid);
-    cache.exe = util::readlink(proc_path + "/exe");
-    std::ifstream stream(proc_path + "/cmdline");
-    cache.cmdline = cmdline(stream);
-  }
-  return cache;
-}
-
 }  // namespace Parser
 
 const double jiffy = sysconf(_SC_CLK_TCK);
 const size_t page_size = sysconf(_SC_PAGE_SIZE);
 
-void buildCPUTimes(cereal::ProcLog::Builder &builder) {
-  std::ifstream stream("/proc/stat");
-  std::vector<CPUTime> stats = Parser::cpuTimes(stream);
+ProcLog::ProcLog() : buf(READ_BUF_SIZE) {
+  proc_dir = opendir("/proc");
+  assert(proc_dir);
+  stat_fd = HANDLE_EINTR(open("/proc/stat", O_RDONLY | O_CLOEXEC));
+  meminfo_fd = HANDLE_EINTR(open("/proc/meminfo", O_RDONLY | O_CLOEXEC));
+  assert(stat_fd >= 0 && meminfo_fd >= 0);
 
-  auto log_cpu_times = builder.initCpuTimes(stats.size());
-  for (int i = 0; i < stats.size(); ++i) {
+  // a stat of each process stays open, up to MAX_OPEN_STATS. The soft limit is only raised as far
+  // as they need, the others are opened for each read.
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    const rlim_t needed = MAX_OPEN_STATS + RESERVED_FDS;
+    if (limit.rlim_cur < needed) {
+      limit.rlim_cur = std::min(needed, limit.rlim_max);
+      setrlimit(RLIMIT_NOFILE, &limit);
+      getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    max_open_fds = std::clamp<long>((long)std::min<rlim_t>(limit.rlim_cur, INT_MAX) - RESERVED_FDS, 0, MAX_OPEN_STATS);
+  }
+}
+
+ProcLog::~ProcLog() {
+  for (auto &[pid, proc] : procs) {
+    if (proc.fd >= 0) close(proc.fd);
+  }
+  close(stat_fd);
+  close(meminfo_fd);
+  closedir(proc_dir);
+}
+
+void ProcLog::readProcs(bool full) {
+  sample++;
+  changed.clear();
+  rewinddir(proc_dir);
+  while (struct dirent *de = readdir(proc_dir)) {
+    char *p_end;
+    const int pid = strtol(de->d_name, &p_end, 10);
+    if (de->d_type != DT_DIR || p_end == de->d_name || *p_end != '\0') continue;
+
+    Proc &proc = procs[pid];
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = proc.fd;
+    if (fd < 0) {
+      fd = HANDLE_EINTR(open(path, O_RDONLY | O_CLOEXEC));
+      if (fd >= 0 && open_fds < max_open_fds) {
+        proc.fd = fd;
+        open_fds++;
+      }
+    }
+    // a stat that stays open is of the same process, even when its pid is used again
+    const ssize_t len = fd >= 0 ? read_proc_file(fd, buf) : -1;
+    if (fd >= 0 && fd != proc.fd) close(fd);
+    if (len <= 0 || !Parser::procStat(buf.data(), len, stat)) continue;
+    proc.sample = sample;
+
+    const bool same_process = proc.sent && stat.pid == proc.stat.pid && stat.starttime == proc.stat.starttime;
+    if (!same_process || stat.name != proc.extra.name) {
+      const std::string proc_path = "/proc/" + std::to_string(pid);
+      proc.extra.pid = pid;
+      proc.extra.name = stat.name;
+      proc.extra.exe = util::readlink(proc_path + "/exe");
+      proc.extra.cmdline = Parser::cmdline(util::read_file(proc_path + "/cmdline"));
+    }
+    if (full || !same_process || !same_stat(stat, proc.stat)) {
+      std::swap(proc.stat, stat);
+      proc.sent = true;
+      changed.push_back(&proc);
+    }
+  }
+
+  // the processes that exited
+  exited.clear();
+  for (auto &[pid, proc] : procs) {
+    if (proc.sample != sample) exited.push_back(pid);
+  }
+  for (int pid : exited) {
+    auto it = procs.find(pid);
+    if (it->second.fd >= 0) {
+      close(it->second.fd);
+      open_fds--;
+    }
+    procs.erase(it);
+  }
+}
+
+void ProcLog::buildCPUTimes(cereal::ProcLog::Builder &builder) {
+  const ssize_t len = read_proc_file(stat_fd, buf);
+  Parser::cpuTimes(buf.data(), std::max<ssize_t>(len, 0), cpu_times);
+
+  auto log_cpu_times = builder.initCpuTimes(cpu_times.size());
+  for (int i = 0; i < cpu_times.size(); ++i) {
     auto l = log_cpu_times[i];
-    const CPUTime &r = stats[i];
+    const CPUTime &r = cpu_times[i];
     l.setCpuNum(r.id);
     l.setUser(r.utime / jiffy);
     l.setNice(r.ntime / jiffy);
@@ -176,36 +290,26 @@ void buildCPUTimes(cereal::ProcLog::Builder &builder) {
   }
 }
 
-void buildMemInfo(cereal::ProcLog::Builder &builder) {
-  std::ifstream stream("/proc/meminfo");
-  auto mem_info = Parser::memInfo(stream);
+void ProcLog::buildMemInfo(cereal::ProcLog::Builder &builder) {
+  const ssize_t len = read_proc_file(meminfo_fd, buf);
+  const MemInfo mem_info = Parser::memInfo(buf.data(), std::max<ssize_t>(len, 0));
 
   auto mem = builder.initMem();
-  mem.setTotal(mem_info["MemTotal:"]);
-  mem.setFree(mem_info["MemFree:"]);
-  mem.setAvailable(mem_info["MemAvailable:"]);
-  mem.setBuffers(mem_info["Buffers:"]);
-  mem.setCached(mem_info["Cached:"]);
-  mem.setActive(mem_info["Active:"]);
-  mem.setInactive(mem_info["Inactive:"]);
-  mem.setShared(mem_info["Shmem:"]);
+  mem.setTotal(mem_info.total);
+  mem.setFree(mem_info.free);
+  mem.setAvailable(mem_info.available);
+  mem.setBuffers(mem_info.buffers);
+  mem.setCached(mem_info.cached);
+  mem.setActive(mem_info.active);
+  mem.setInactive(mem_info.inactive);
+  mem.setShared(mem_info.shared);
 }
 
-void buildProcs(cereal::ProcLog::Builder &builder) {
-  auto pids = Parser::pids();
-  std::vector<ProcStat> proc_stats;
-  proc_stats.reserve(pids.size());
-  for (int pid : pids) {
-    std::string path = "/proc/" + std::to_string(pid) + "/stat";
-    if (auto stat = Parser::procStat(util::read_file(path))) {
-      proc_stats.push_back(*stat);
-    }
-  }
-
-  auto procs = builder.initProcs(proc_stats.size());
-  for (size_t i = 0; i < proc_stats.size(); i++) {
-    auto l = procs[i];
-    const ProcStat &r = proc_stats[i];
+void ProcLog::buildProcs(cereal::ProcLog::Builder &builder) {
+  auto log_procs = builder.initProcs(changed.size());
+  for (size_t i = 0; i < changed.size(); i++) {
+    auto l = log_procs[i];
+    const ProcStat &r = changed[i]->stat;
     l.setPid(r.pid);
     l.setState(r.state);
     l.setPpid(r.ppid);
@@ -222,7 +326,7 @@ void buildProcs(cereal::ProcLog::Builder &builder) {
     l.setProcessor(r.processor);
     l.setName(r.name);
 
-    const ProcCache &extra_info = Parser::getProcExtraInfo(r.pid, r.name);
+    const ProcCache &extra_info = changed[i]->extra;
     l.setExe(extra_info.exe);
     auto lcmdline = l.initCmdline(extra_info.cmdline.size());
     for (size_t j = 0; j < lcmdline.size(); j++) {
@@ -231,8 +335,10 @@ void buildProcs(cereal::ProcLog::Builder &builder) {
   }
 }
 
-void buildProcLogMessage(MessageBuilder &msg) {
+void ProcLog::buildMessage(MessageBuilder &msg, bool full) {
+  readProcs(full);
   auto procLog = msg.initEvent().initProcLog();
+  procLog.setFull(full);
   buildProcs(procLog);
   buildCPUTimes(procLog);
   buildMemInfo(procLog);
@@ -1,4 +1,8 @@
-#include <optional>
+#pragma once
+
+#include <dirent.h>
+
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -11,6 +15,10 @@ struct CPUTime {
   unsigned long iowtime, irqtime, sirqtime;
 };
 
+struct MemInfo {
+  uint64_t total, free, available, buffers, cached, active, inactive, shared;
+};
+
 struct ProcCache {
   int pid;
   std::string name, exe;
@@ -26,15 +34,50 @@ struct ProcStat {
   std::string name;
 };
 
+// Parsers of the /proc files, for the contents of a whole file. They don't allocate, but for
+// process names longer than the inline buffer of a string and the cmdline.
 namespace Parser {
 
-std::vector<int> pids();
-std::optional<ProcStat> procStat(std::string stat);
-std::vector<std::string> cmdline(std::istream &stream);
-std::vector<CPUTime> cpuTimes(std::istream &stream);
-std::unordered_map<std::string, uint64_t> memInfo(std::istream &stream);
-const ProcCache &getProcExtraInfo(int pid, const std::string &name);
+bool procStat(const char *stat, size_t len, ProcStat &p);
+std::vector<std::string> cmdline(const std::string &cmdline);
+void cpuTimes(const char *stat, size_t len, std::vector<CPUTime> &cpu_times);
+MemInfo memInfo(const char *meminfo, size_t len);
 
 };  // namespace Parser
 
-void buildProcLogMessage(MessageBuilder &msg);
+// Samples /proc for procLog. The files are kept open between samples and read again with pread,
+// and a message has only the processes whose stat changed since they were last sent, unless it's
+// a full one. Idle processes and kernel threads are then only in the full messages.
+class ProcLog {
+public:
+  ProcLog();
+  ~ProcLog();
+  void buildMessage(MessageBuilder &msg, bool full);
+
+private:
+  struct Proc {
+    int fd = -1;  // of its stat, -1 if it's opened for each read
+    uint64_t sample = 0;  // the last one it was in
+    bool sent = false;
+    ProcStat stat;  // as last sent
+    ProcCache extra;
+  };
+
+  void readProcs(bool full);
+  void buildProcs(cereal::ProcLog::Builder &builder);
+  void buildCPUTimes(cereal::ProcLog::Builder &builder);
+  void buildMemInfo(cereal::ProcLog::Builder &builder);
+
+  DIR *proc_dir = nullptr;
+  int stat_fd = -1, meminfo_fd = -1;
+  int open_fds = 0, max_open_fds = 0;
+  uint64_t sample = 0;
+  std::unordered_map<int, Proc> procs;
+
+  // reused between samples
+  std::vector<char> buf;
+  ProcStat stat;
+  std::vector<const Proc *> changed;
+  std::vector<int> exited;
+  std::vector<CPUTime> cpu_times;
+};
@@ -0,0 +1,72 @@
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "common/util.h"
+#include "system/proclogd/proclog.h"
+
+// Checks the parsers on known contents and the messages of this machine: a full one has all
+// processes, a following one only the ones that changed, and this one keeps running.
+
+void test_parsers() {
+  ProcStat p;
+  const char stat[] = "12 (a b) c) S 1 12 12 0 -1 4194560 100 0 0 0 7 8 -9 11 10 -20 5 0 123456 4096 77 "
+                      "18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 2 0 0 0 0 0 0 0 0 0 0 0 0 0\n";
+  assert(Parser::procStat(stat, strlen(stat), p));
+  assert(p.pid == 12 && p.name == "a b) c" && p.state == 'S' && p.ppid == 1);
+  assert(p.utime == 7 && p.stime == 8 && p.cutime == -9 && p.cstime == 11);
+  assert(p.priority == 10 && p.nice == -20 && p.num_threads == 5 && p.starttime == 123456);
+  assert(p.vms == 4096 && p.rss == 77 && p.processor == 2);
+
+  const char truncated[] = "12 (x) S 1 12";
+  assert(!Parser::procStat(truncated, strlen(truncated), p));
+
+  auto cmdline = Parser::cmdline(std::string("a\0bb\0\0c\0", 8));
+  assert(cmdline.size() == 3 && cmdline[0] == "a" && cmdline[1] == "bb" && cmdline[2] == "c");
+
+  const char meminfo[] = "MemTotal:     100 kB\nMemFree:   5 kB\nShmem:  2 kB\n";
+  MemInfo mem = Parser::memInfo(meminfo, strlen(meminfo));
+  assert(mem.total == 100 * 1024 && mem.free == 5 * 1024 && mem.shared == 2 * 1024 && mem.cached == 0);
+
+  const char cpu_stat[] = "cpu  1 2 3 4 5 6 7 0 0 0\ncpu0 1 2 3 4 5 6 7 0 0 0\ncpu1 8 9 10 11 12 13 14 0 0 0\nintr 1 2\n";
+  std::vector<CPUTime> cpu_times;
+  Parser::cpuTimes(cpu_stat, strlen(cpu_stat), cpu_times);
+  assert(cpu_times.size() == 2 && cpu_times[1].id == 1 && cpu_times[1].utime == 8 && cpu_times[1].sirqtime == 14);
+}
+
+bool has_self(const cereal::ProcLog::Reader &proc_log) {
+  for (auto p : proc_log.getProcs()) {
+    if (p.getPid() == getpid()) {
+      assert(std::string(p.getName()) + "\n" == util::read_file("/proc/self/comm"));
+      assert(p.getCmdline().size() > 0);
+      return true;
+    }
+  }
+  return false;
+}
+
+int main() {
+  test_parsers();
+
+  ProcLog proc_log;
+  MessageBuilder full_msg;
+  proc_log.buildMessage(full_msg, true);
+  auto full = full_msg.getRoot<cereal::Event>().getProcLog().asReader();
+  assert(full.getFull() && has_self(full));
+  assert(full.getCpuTimes().size() > 0 && full.getMem().getTotal() > 0);
+
+  // use some cpu, so this one changes
+  for (volatile int i = 0; i < 100000000; i++) {}
+
+  MessageBuilder diff_msg;
+  proc_log.buildMessage(diff_msg, false);
+  auto diff = diff_msg.getRoot<cereal::Event>().getProcLog().asReader();
+  assert(!diff.getFull() && has_self(diff));
+  assert(diff.getProcs().size() < full.getProcs().size());
+
+  printf("full %u, diff %u procs\npassed\n", full.getProcs().size(), diff.getProcs().size());
+  return 0;
+}
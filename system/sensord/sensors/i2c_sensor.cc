@@ -28,6 +28,10 @@ int I2CSensor::read_register(uint register_address, uint8_t *buffer, uint8_t len
   return bus->read_register(get_device_address(), register_address, buffer, len);
 }
 
+int I2CSensor::read_burst(uint register_address, uint8_t *buffer, uint16_t len) {
+  return bus->read_burst(get_device_address(), register_address, buffer, len);
+}
+
 int I2CSensor::set_register(uint register_address, uint8_t data) {
   return bus->set_register(get_device_address(), register_address, data);
 }
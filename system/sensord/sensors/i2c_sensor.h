@@ -27,6 +27,7 @@ public:
   I2CSensor(I2CBus *bus, int gpio_nr = 0, bool shared_gpio = false);
   ~I2CSensor();
   int read_register(uint register_address, uint8_t *buffer, uint8_t len);
+  int read_burst(uint register_address, uint8_t *buffer, uint16_t len);
   int set_register(uint register_address, uint8_t data);
   int init_gpio();
   bool has_interrupt_enabled();
@@ -8,8 +8,8 @@
 #include "common/timing.h"
 #include "common/util.h"
 
-LSM6DS3_Accel::LSM6DS3_Accel(I2CBus *bus, int gpio_nr, bool shared_gpio) :
-  I2CSensor(bus, gpio_nr, shared_gpio) {}
+LSM6DS3_Accel::LSM6DS3_Accel(I2CBus *bus, int gpio_nr, bool shared_gpio, LSM6DS3_Fifo *fifo) :
+  I2CSensor(bus, gpio_nr, shared_gpio), fifo(fifo) {}
 
 void LSM6DS3_Accel::wait_for_data_ready() {
   uint8_t drdy = 0;
@@ -157,11 +157,17 @@ int LSM6DS3_Accel::init() {
   }
 
   // TODO: set scale and bandwidth. Default is +- 2G, 50 Hz
-  ret = set_register(LSM6DS3_ACCEL_I2C_REG_CTRL1_XL, LSM6DS3_ACCEL_ODR_104HZ);
+  ret = set_register(LSM6DS3_ACCEL_I2C_REG_CTRL1_XL, fifo ? LSM6DS3_ACCEL_ODR_208HZ : LSM6DS3_ACCEL_ODR_104HZ);
   if (ret < 0) {
     goto fail;
   }
 
+  if (fifo) {
+    // the FIFO threshold interrupt replaces the data ready one
+    ret = fifo->init();
+    goto fail;
+  }
+
   ret = set_register(LSM6DS3_ACCEL_I2C_REG_DRDY_CFG, LSM6DS3_ACCEL_DRDY_PULSE_MODE);
   if (ret < 0) {
     goto fail;
@@ -184,6 +190,10 @@ fail:
 int LSM6DS3_Accel::shutdown() {
   int ret = 0;
 
+  if (fifo) {
+    fifo->shutdown();
+  }
+
   // disable data ready interrupt for accel on INT1
   uint8_t value = 0;
   ret = read_register(LSM6DS3_ACCEL_I2C_REG_INT1_CTRL, &value, 1);
@@ -217,6 +227,9 @@ fail:
 }
 
 bool LSM6DS3_Accel::get_event(MessageBuilder &msg, uint64_t ts) {
+  if (fifo) {
+    return get_fifo_event(msg, ts);
+  }
 
   // INT1 shared with gyro, check STATUS_REG who triggered
   uint8_t status_reg = 0;
@@ -248,3 +261,25 @@ bool LSM6DS3_Accel::get_event(MessageBuilder &msg, uint64_t ts) {
 
   return true;
 }
+
+bool LSM6DS3_Accel::get_fifo_event(MessageBuilder &msg, uint64_t ts) {
+  // INT1 shared with gyro, the first one to handle the interrupt drains the FIFO
+  if (!fifo->read(ts) || fifo->accel().empty()) {
+    return false;
+  }
+
+  auto event = msg.initEvent().initAccelerometer();
+  event.setSource(source);
+  event.setVersion(1);
+  event.setSensor(SENSOR_ACCELEROMETER);
+  event.setType(SENSOR_TYPE_ACCELEROMETER);
+  event.setTimestamp(fifo->accel().back().timestamp);
+
+  float xyz[3];
+  lsm6ds3_fill_batch(event, fifo->accel(), 9.81 * 2.0f / (1 << 15), xyz);
+  auto svec = event.initAcceleration();
+  svec.setV(xyz);
+  svec.setStatus(true);
+
+  return true;
+}
@@ -0,0 +1,185 @@
+#include "lsm6ds3_fifo.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "common/swaglog.h"
+
+// gyro x, y, z then accel x, y, z, see FIFO_PATTERN
+const int WORDS_PER_SAMPLE = 6;
+const int BYTES_PER_SAMPLE = WORDS_PER_SAMPLE * 2;
+const int MAX_SAMPLES_PER_READ = 64;
+// the FIFO holds 4 kB, about 340 samples
+const int MAX_READS_PER_INTERRUPT = 8;
+
+LSM6DS3_Fifo::LSM6DS3_Fifo(I2CBus *bus, int watermark) : bus(bus), watermark(watermark) {
+  buffer.resize(MAX_SAMPLES_PER_READ * BYTES_PER_SAMPLE);
+}
+
+int LSM6DS3_Fifo::init() {
+  const int watermark_words = watermark * WORDS_PER_SAMPLE;
+  uint8_t value = 0;
+
+  // bypass mode empties the FIFO
+  int ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5, LSM6DS3_FIFO_MODE_BYPASS);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_FIFO_CTRL1, watermark_words & 0xFF);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_FIFO_CTRL2, (watermark_words >> 8) & 0x07);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_FIFO_CTRL3, LSM6DS3_FIFO_NO_DECIMATION);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5, LSM6DS3_FIFO_ODR_208HZ | LSM6DS3_FIFO_MODE_CONTINUOUS);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  // enable FIFO threshold interrupt on INT1
+  // (without resetting existing interrupts)
+  ret = bus->read_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_INT1_CTRL, &value, 1);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  value |= LSM6DS3_FIFO_INT1_FTH;
+  ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_INT1_CTRL, value);
+
+  samples_read = 0;
+  last_anchor_ts = 0;
+
+fail:
+  return ret;
+}
+
+int LSM6DS3_Fifo::shutdown() {
+  // disable FIFO threshold interrupt on INT1
+  uint8_t value = 0;
+  int ret = bus->read_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_INT1_CTRL, &value, 1);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  value &= ~(LSM6DS3_FIFO_INT1_FTH);
+  ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_INT1_CTRL, value);
+  if (ret < 0) {
+    LOGE("Could not disable lsm6ds3 fifo interrupt!");
+    goto fail;
+  }
+
+  ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5, LSM6DS3_FIFO_MODE_BYPASS);
+
+fail:
+  return ret;
+}
+
+bool LSM6DS3_Fifo::read(uint64_t ts) {
+  // accel and gyro share the interrupt, only the first one reads
+  if (ts == last_read_ts) {
+    return !gyro_samples.empty();
+  }
+  last_read_ts = ts;
+  gyro_samples.clear();
+  accel_samples.clear();
+
+  // The interrupt fires when the watermark-th sample is stored, more may have come in since.
+  // The period is measured between interrupts, since the ODR of the chip is only accurate to a few percent.
+  const uint64_t anchor_idx = samples_read + watermark - 1;
+  if (last_anchor_ts != 0 && anchor_idx > last_anchor_idx) {
+    const double period = double(ts - last_anchor_ts) / (anchor_idx - last_anchor_idx);
+    const double nominal = 1e9 / LSM6DS3_FIFO_ODR_HZ;
+    if (std::abs(period - nominal) < 0.1 * nominal) {
+      period_ns += 0.05 * (period - period_ns);
+    }
+  }
+  last_anchor_ts = ts;
+  last_anchor_idx = anchor_idx;
+
+  // The threshold interrupt is an edge on the GPIO, it only fires again after the level
+  // drops below the watermark. Keep reading until it does, samples come in during a burst.
+  for (int i = 0; i < MAX_READS_PER_INTERRUPT; i++) {
+    const int n = read_samples(ts);
+    if (n < 0) {
+      break;
+    }
+    samples_read += n;
+    if (n < watermark) {
+      break;
+    }
+  }
+  return !gyro_samples.empty();
+}
+
+int LSM6DS3_Fifo::read_samples(uint64_t ts) {
+  // FIFO_STATUS1-4: number of unread words, flags and the pattern of the next word
+  uint8_t status[4];
+  int ret = bus->read_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_STATUS1, status, sizeof(status));
+  if (ret < 0) {
+    return ret;
+  }
+  int words = status[0] | ((status[1] & 0x07) << 8);
+  const int pattern = status[2] | ((status[3] & 0x03) << 8);
+  if (status[1] & LSM6DS3_FIFO_STATUS2_OVER_RUN) {
+    LOGE("lsm6ds3 fifo overrun");
+  }
+
+  // realign to the start of a sample, only after an overrun
+  const int skip = (WORDS_PER_SAMPLE - pattern % WORDS_PER_SAMPLE) % WORDS_PER_SAMPLE;
+  if (skip > 0 && words >= skip) {
+    ret = bus->read_burst(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, buffer.data(), skip * 2);
+    if (ret < 0) {
+      return ret;
+    }
+    words -= skip;
+  }
+
+  // below the watermark there's nothing to read yet, the rest comes with the next interrupt
+  const int n = std::min(words / WORDS_PER_SAMPLE, MAX_SAMPLES_PER_READ);
+  if (n < watermark) {
+    return 0;
+  }
+
+  // the address rolls back from FIFO_DATA_OUT_H to FIFO_DATA_OUT_L, so it's a single read
+  ret = bus->read_burst(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, buffer.data(), n * BYTES_PER_SAMPLE);
+  if (ret < 0) {
+    return ret;
+  }
+
+  // samples are numbered from the first one after the last interrupt
+  const int first = gyro_samples.size();
+  for (int i = 0; i < n; i++) {
+    const uint8_t *b = &buffer[i * BYTES_PER_SAMPLE];
+    const uint64_t t = ts + (int64_t)std::llround((first + i - (watermark - 1)) * period_ns);
+    gyro_samples.push_back({t, {read_16_bit(b[0], b[1]), read_16_bit(b[2], b[3]), read_16_bit(b[4], b[5])}});
+    accel_samples.push_back({t, {read_16_bit(b[6], b[7]), read_16_bit(b[8], b[9]), read_16_bit(b[10], b[11])}});
+  }
+  return n;
+}
+
+void lsm6ds3_fill_batch(cereal::SensorEventData::Builder event, const std::vector<LSM6DS3_Sample> &samples,
+                        float scale, float xyz[3]) {
+  auto batch = event.initBatch();
+  auto timestamps = batch.initTimestamps(samples.size());
+  auto values = batch.initValues(samples.size() * 3);
+  for (size_t i = 0; i < samples.size(); i++) {
+    const LSM6DS3_Sample &s = samples[i];
+    xyz[0] = s.v[1] * scale;
+    xyz[1] = -s.v[0] * scale;
+    xyz[2] = s.v[2] * scale;
+    timestamps.set(i, s.timestamp);
+    for (int j = 0; j < 3; j++) {
+      values.set(i * 3 + j, xyz[j]);
+    }
+  }
+}
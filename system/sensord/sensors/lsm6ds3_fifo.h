@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "system/sensord/sensors/i2c_sensor.h"
+
+// Address of the chip on the bus
+#define LSM6DS3_FIFO_I2C_ADDR            0x6A
+
+// Registers of the chip
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL1  0x06
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL2  0x07
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL3  0x08
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5  0x0A
+#define LSM6DS3_FIFO_I2C_REG_INT1_CTRL   0x0D
+#define LSM6DS3_FIFO_I2C_REG_STATUS1     0x3A
+#define LSM6DS3_FIFO_I2C_REG_DATA_OUT_L  0x3E
+
+// Constants
+#define LSM6DS3_FIFO_ODR_208HZ           (0b0101 << 3)
+#define LSM6DS3_FIFO_MODE_BYPASS         0b000
+#define LSM6DS3_FIFO_MODE_CONTINUOUS     0b110
+#define LSM6DS3_FIFO_NO_DECIMATION       ((0b001 << 3) | 0b001)  // gyro and accel
+#define LSM6DS3_FIFO_INT1_FTH            (1 << 3)
+#define LSM6DS3_FIFO_STATUS2_OVER_RUN    (1 << 6)
+#define LSM6DS3_FIFO_ODR_HZ              208
+
+struct LSM6DS3_Sample {
+  uint64_t timestamp;
+  int16_t v[3];
+};
+
+// The FIFO of the LSM6DS3, shared by LSM6DS3_Accel and LSM6DS3_Gyro. Both are stored at the FIFO ODR
+// and drained in one burst read on the watermark interrupt, instead of an interrupt and two reads
+// per sample. Sample timestamps are reconstructed from the interrupt timestamp and the measured
+// sample period.
+class LSM6DS3_Fifo {
+  I2CBus *bus;
+  int watermark;  // samples of each sensor
+
+  uint64_t last_read_ts = 0;
+  std::vector<uint8_t> buffer;
+  std::vector<LSM6DS3_Sample> gyro_samples, accel_samples;
+
+  // sample timing
+  double period_ns = 1e9 / LSM6DS3_FIFO_ODR_HZ;
+  uint64_t samples_read = 0;
+  uint64_t last_anchor_ts = 0, last_anchor_idx = 0;
+
+  // one status read and burst, returns the number of samples read or < 0 on error
+  int read_samples(uint64_t ts);
+
+public:
+  LSM6DS3_Fifo(I2CBus *bus, int watermark = 4);
+  // resets and starts the FIFO, each sensor calls it after configuring itself
+  int init();
+  int shutdown();
+  // drains the FIFO below the watermark once per interrupt, ts is the time of the interrupt
+  bool read(uint64_t ts);
+  const std::vector<LSM6DS3_Sample> &gyro() const { return gyro_samples; }
+  const std::vector<LSM6DS3_Sample> &accel() const { return accel_samples; }
+};
+
+// fills the batch of the event with the samples scaled to the sensor unit, in the same axes
+// as the single sample events, and returns the newest one in xyz
+void lsm6ds3_fill_batch(cereal::SensorEventData::Builder event, const std::vector<LSM6DS3_Sample> &samples,
+                        float scale, float xyz[3]);
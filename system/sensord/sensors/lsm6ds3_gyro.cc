@@ -10,8 +10,8 @@
 
 #define DEG2RAD(x) ((x) * M_PI / 180.0)
 
-LSM6DS3_Gyro::LSM6DS3_Gyro(I2CBus *bus, int gpio_nr, bool shared_gpio) :
-  I2CSensor(bus, gpio_nr, shared_gpio) {}
+LSM6DS3_Gyro::LSM6DS3_Gyro(I2CBus *bus, int gpio_nr, bool shared_gpio, LSM6DS3_Fifo *fifo) :
+  I2CSensor(bus, gpio_nr, shared_gpio), fifo(fifo) {}
 
 void LSM6DS3_Gyro::wait_for_data_ready() {
   uint8_t drdy = 0;
@@ -140,11 +140,17 @@ int LSM6DS3_Gyro::init() {
   }
 
   // TODO: set scale. Default is +- 250 deg/s
-  ret = set_register(LSM6DS3_GYRO_I2C_REG_CTRL2_G, LSM6DS3_GYRO_ODR_104HZ);
+  ret = set_register(LSM6DS3_GYRO_I2C_REG_CTRL2_G, fifo ? LSM6DS3_GYRO_ODR_208HZ : LSM6DS3_GYRO_ODR_104HZ);
   if (ret < 0) {
     goto fail;
   }
 
+  if (fifo) {
+    // the FIFO threshold interrupt replaces the data ready one
+    ret = fifo->init();
+    goto fail;
+  }
+
   ret = set_register(LSM6DS3_GYRO_I2C_REG_DRDY_CFG, LSM6DS3_GYRO_DRDY_PULSE_MODE);
   if (ret < 0) {
     goto fail;
@@ -167,6 +173,10 @@ fail:
 int LSM6DS3_Gyro::shutdown() {
   int ret = 0;
 
+  if (fifo) {
+    fifo->shutdown();
+  }
+
   // disable data ready interrupt for gyro on INT1
   uint8_t value = 0;
   ret = read_register(LSM6DS3_GYRO_I2C_REG_INT1_CTRL, &value, 1);
@@ -200,6 +210,9 @@ fail:
 }
 
 bool LSM6DS3_Gyro::get_event(MessageBuilder &msg, uint64_t ts) {
+  if (fifo) {
+    return get_fifo_event(msg, ts);
+  }
 
   // INT1 shared with accel, check STATUS_REG who triggered
   uint8_t status_reg = 0;
@@ -231,3 +244,25 @@ bool LSM6DS3_Gyro::get_event(MessageBuilder &msg, uint64_t ts) {
 
   return true;
 }
+
+bool LSM6DS3_Gyro::get_fifo_event(MessageBuilder &msg, uint64_t ts) {
+  // INT1 shared with accel, the first one to handle the interrupt drains the FIFO
+  if (!fifo->read(ts) || fifo->gyro().empty()) {
+    return false;
+  }
+
+  auto event = msg.initEvent().initGyroscope();
+  event.setSource(source);
+  event.setVersion(2);
+  event.setSensor(SENSOR_GYRO_UNCALIBRATED);
+  event.setType(SENSOR_TYPE_GYROSCOPE_UNCALIBRATED);
+  event.setTimestamp(fifo->gyro().back().timestamp);
+
+  float xyz[3];
+  lsm6ds3_fill_batch(event, fifo->gyro(), DEG2RAD(8.75 / 1000.0), xyz);
+  auto svec = event.initGyroUncalibrated();
+  svec.setV(xyz);
+  svec.setStatus(true);
+
+  return true;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "system/sensord/sensors/i2c_sensor.h"
+#include "system/sensord/sensors/lsm6ds3_fifo.h"
 
 // Address of the chip on the bus
 #define LSM6DS3_GYRO_I2C_ADDR       0x6A
@@ -32,13 +33,16 @@
 class LSM6DS3_Gyro : public I2CSensor {
   uint8_t get_device_address() {return LSM6DS3_GYRO_I2C_ADDR;}
   cereal::SensorEventData::SensorSource source = cereal::SensorEventData::SensorSource::LSM6DS3;
+  LSM6DS3_Fifo *fifo;  // read in batches from the FIFO when set
 
   // self test functions
   int self_test(int test_type);
   void wait_for_data_ready();
   void read_and_avg_data(float* val_st_off);
+
+  bool get_fifo_event(MessageBuilder &msg, uint64_t ts);
 public:
-  LSM6DS3_Gyro(I2CBus *bus, int gpio_nr = 0, bool shared_gpio = false);
+  LSM6DS3_Gyro(I2CBus *bus, int gpio_nr = 0, bool shared_gpio = false, LSM6DS3_Fifo *fifo = nullptr);
   int init();
   bool get_event(MessageBuilder &msg, uint64_t ts = 0);
   int shutdown();
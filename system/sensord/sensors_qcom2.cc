@@ -1,6 +1,7 @@
 #include <sys/resource.h>
 
 #include <chrono>
+#include <cstring>
 #include <thread>
 #include <vector>
 #include <map>
@@ -19,6 +20,7 @@
 #include "system/sensord/sensors/constants.h"
 #include "system/sensord/sensors/light_sensor.h"
 #include "system/sensord/sensors/lsm6ds3_accel.h"
+#include "system/sensord/sensors/lsm6ds3_fifo.h"
 #include "system/sensord/sensors/lsm6ds3_gyro.h"
 #include "system/sensord/sensors/lsm6ds3_temp.h"
 #include "system/sensord/sensors/mmc5603nj_magn.h"
@@ -30,7 +32,8 @@ ExitHandler do_exit;
 uint64_t init_ts = 0;
 
 void interrupt_loop(std::vector<Sensor *>& sensors,
-                    std::map<Sensor*, std::string>& sensor_service)
+                    std::map<Sensor*, std::string>& sensor_service,
+                    LSM6DS3_Fifo *fifo)
 {
   PubMaster pm_int({"gyroscope", "accelerometer"});
 
@@ -48,6 +51,10 @@ void interrupt_loop(std::vector<Sensor *>& sensors,
       return;
     } else if (err == 0) {
       LOGE("poll timed out");
+      // a FIFO left above the watermark never raises the interrupt again, start it over
+      if (fifo != nullptr && fifo->init() < 0) {
+        LOGE("lsm6ds3 fifo reset failed");
+      }
       continue;
     }
 
@@ -94,8 +101,13 @@ int sensor_loop(I2CBus *i2c_bus_imu) {
   BMX055_Magn bmx055_magn(i2c_bus_imu);
   BMX055_Temp bmx055_temp(i2c_bus_imu);
 
-  LSM6DS3_Accel lsm6ds3_accel(i2c_bus_imu, GPIO_LSM_INT);
-  LSM6DS3_Gyro lsm6ds3_gyro(i2c_bus_imu, GPIO_LSM_INT, true); // GPIO shared with accel
+  // LSM_FIFO=1 reads accel and gyro in batches from the FIFO, at twice the rate
+  LSM6DS3_Fifo lsm6ds3_fifo(i2c_bus_imu);
+  const char *env_lsm_fifo = std::getenv("LSM_FIFO");
+  LSM6DS3_Fifo *fifo = (env_lsm_fifo != nullptr && strncmp(env_lsm_fifo, "1", 1) == 0) ? &lsm6ds3_fifo : nullptr;
+
+  LSM6DS3_Accel lsm6ds3_accel(i2c_bus_imu, GPIO_LSM_INT, false, fifo);
+  LSM6DS3_Gyro lsm6ds3_gyro(i2c_bus_imu, GPIO_LSM_INT, true, fifo); // GPIO shared with accel
   LSM6DS3_Temp lsm6ds3_temp(i2c_bus_imu);
 
   MMC5603NJ_Magn mmc5603nj_magn(i2c_bus_imu);
@@ -171,7 +183,7 @@ int sensor_loop(I2CBus *i2c_bus_imu) {
   // thread for reading events via interrupts
   std::vector<Sensor *> lsm_interrupt_sensors = {&lsm6ds3_accel, &lsm6ds3_gyro};
   std::thread lsm_interrupt_thread(&interrupt_loop, std::ref(lsm_interrupt_sensors),
-                                   std::ref(sensor_service));
+                                   std::ref(sensor_service), fifo);
 
   // polling loop for non interrupt handled sensors
   while (!do_exit) {
@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+
+#include "common/i2c.h"
+#include "system/sensord/sensors/lsm6ds3_fifo.h"
+
+// Checks the FIFO word parsing and the timestamp reconstruction of LSM6DS3_Fifo against a
+// simulated chip, linked in place of the I2C bus.
+// usage: ./test_lsm6ds3_fifo
+
+const double PERIOD_NS = 1e9 / LSM6DS3_FIFO_ODR_HZ;
+
+// the FIFO of the chip, words in pattern order: gyro x, y, z then accel x, y, z
+struct FakeFifo {
+  std::deque<int16_t> words;
+  int pattern = 0;  // position of the next word in the pattern
+  bool overrun = false;
+  int status_reads = 0, burst_reads = 0;
+  std::function<void()> on_burst;  // samples that come in during a burst
+
+  void push_sample(int16_t gyro[3], int16_t accel[3]) {
+    for (int i = 0; i < 3; i++) words.push_back(gyro[i]);
+    for (int i = 0; i < 3; i++) words.push_back(accel[i]);
+  }
+} chip;
+
+I2CBus::I2CBus(uint8_t bus_id) {}
+I2CBus::~I2CBus() {}
+
+int I2CBus::read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) {
+  if (register_address == LSM6DS3_FIFO_I2C_REG_STATUS1) {
+    assert(len == 4);
+    chip.status_reads++;
+    buffer[0] = chip.words.size() & 0xFF;
+    buffer[1] = ((chip.words.size() >> 8) & 0x07) | (chip.overrun ? LSM6DS3_FIFO_STATUS2_OVER_RUN : 0);
+    buffer[2] = chip.pattern & 0xFF;
+    buffer[3] = (chip.pattern >> 8) & 0x03;
+    return 0;
+  }
+  memset(buffer, 0, len);
+  return 0;
+}
+
+int I2CBus::read_burst(uint8_t device_address, uint register_address, uint8_t *buffer, uint16_t len) {
+  assert(register_address == LSM6DS3_FIFO_I2C_REG_DATA_OUT_L && len % 2 == 0);
+  assert(len / 2 <= chip.words.size());
+  chip.burst_reads++;
+  for (int i = 0; i < len / 2; i++) {
+    uint16_t w = chip.words.front();
+    chip.words.pop_front();
+    buffer[i * 2] = w & 0xFF;
+    buffer[i * 2 + 1] = w >> 8;
+    chip.pattern = (chip.pattern + 1) % 6;
+  }
+  if (chip.on_burst) chip.on_burst();
+  return len;
+}
+
+int I2CBus::set_register(uint8_t device_address, uint register_address, uint8_t data) {
+  if (register_address == LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5 && (data & 0x07) == LSM6DS3_FIFO_MODE_BYPASS) {
+    chip.words.clear();
+    chip.pattern = 0;
+  }
+  return 0;
+}
+
+// sample i has gyro (i, -i, 1000 + i) and accel (-2i, 2i, -1000 - i), so each field is identifiable
+void push_samples(uint64_t &next, int n) {
+  for (int i = 0; i < n; i++, next++) {
+    int16_t v = next;
+    int16_t gyro[3] = {v, int16_t(-v), int16_t(1000 + v)};
+    int16_t accel[3] = {int16_t(-2 * v), int16_t(2 * v), int16_t(-1000 - v)};
+    chip.push_sample(gyro, accel);
+  }
+}
+
+void check_samples(const LSM6DS3_Fifo &fifo, uint64_t first, size_t n) {
+  assert(fifo.gyro().size() == n && fifo.accel().size() == n);
+  for (size_t i = 0; i < n; i++) {
+    int16_t v = first + i;
+    const LSM6DS3_Sample &g = fifo.gyro()[i], &a = fifo.accel()[i];
+    assert(g.v[0] == v && g.v[1] == -v && g.v[2] == 1000 + v);
+    assert(a.v[0] == -2 * v && a.v[1] == 2 * v && a.v[2] == -1000 - v);
+    assert(g.timestamp == a.timestamp);
+    assert(i == 0 || g.timestamp > fifo.gyro()[i - 1].timestamp);
+  }
+}
+
+void test_parsing() {
+  I2CBus bus(0);
+  LSM6DS3_Fifo fifo(&bus, 4);
+  assert(fifo.init() == 0);
+
+  // more than one burst, and negative values
+  uint64_t next = 0;
+  push_samples(next, 150);
+  assert(fifo.read(1000000000));
+  check_samples(fifo, 0, 150);
+  assert(chip.words.empty());
+
+  // accel and gyro share the interrupt, the second read doesn't touch the bus
+  int status_reads = chip.status_reads;
+  assert(fifo.read(1000000000));
+  assert(chip.status_reads == status_reads);
+
+  // samples that come in during the first burst are read as well, until the level is below the watermark
+  int bursts = 2;
+  chip.on_burst = [&]() {
+    if (bursts-- > 0) push_samples(next, 5);
+  };
+  push_samples(next, 4);
+  assert(fifo.read(2000000000));
+  chip.on_burst = nullptr;
+  check_samples(fifo, 150, 14);
+  assert(chip.words.empty());
+
+  // less than the watermark is left for the next interrupt
+  chip.on_burst = [&]() { push_samples(next, 2); };
+  push_samples(next, 6);
+  assert(fifo.read(3000000000));
+  chip.on_burst = nullptr;
+  check_samples(fifo, 164, 6);
+  assert(chip.words.size() == 2 * 6);
+  push_samples(next, 2);
+  assert(fifo.read(4000000000));
+  check_samples(fifo, 170, 4);
+
+  // after an overrun the FIFO can start in the middle of a sample
+  assert(fifo.init() == 0);
+  next = 500;
+  for (int i = 0; i < 4; i++) chip.words.push_back(0x7FFF);
+  chip.pattern = 2;
+  chip.overrun = true;
+  push_samples(next, 8);
+  assert(fifo.read(5000000000));
+  chip.overrun = false;
+  check_samples(fifo, 500, 8);
+  printf("parsing ok\n");
+}
+
+void test_timestamps() {
+  I2CBus bus(0);
+  const int watermark = 4;
+  LSM6DS3_Fifo fifo(&bus, watermark);
+  assert(fifo.init() == 0);
+
+  // the chip runs 3% slow, and the interrupt is handled up to 2 samples late
+  const double true_period = PERIOD_NS * 1.03;
+  const uint64_t t0 = 10e9;
+  uint64_t next = 0;
+  double max_err = 0;
+  uint64_t prev_ts = 0;
+  for (int k = 0; k < 1000; k++) {
+    push_samples(next, watermark);
+    // time of the watermark-th sample in the FIFO, the interrupt, with up to 50 us of jitter
+    const int64_t jitter = (k * 7919 % 101 - 50) * 1000;
+    const uint64_t ts = t0 + std::llround((next - 1) * true_period) + jitter;
+
+    // late handling, the samples stored since come with this read
+    const int late = k % 3;
+    push_samples(next, late);
+    assert(fifo.read(ts));
+    assert(chip.words.empty());
+
+    const uint64_t first = next - fifo.gyro().size();
+    check_samples(fifo, first, fifo.gyro().size());
+    for (size_t i = 0; i < fifo.gyro().size(); i++) {
+      const double expected = t0 + (first + i) * true_period;
+      const double err = std::abs(double(fifo.gyro()[i].timestamp) - expected);
+      if (k >= 200) max_err = std::max(max_err, err);
+    }
+    // no gap or overlap with the previous interrupt
+    if (k >= 200) {
+      const double dt = double(fifo.gyro()[0].timestamp) - prev_ts;
+      assert(std::abs(dt - true_period) < 0.1 * true_period);
+    }
+    prev_ts = fifo.gyro().back().timestamp;
+  }
+  printf("max timestamp error after converging: %.1f us\n", max_err / 1e3);
+  assert(max_err < 0.1 * true_period);
+
+  // interrupts far outside the nominal rate don't change the period
+  const double period_before = double(fifo.gyro().back().timestamp - fifo.gyro().front().timestamp) / (fifo.gyro().size() - 1);
+  push_samples(next, watermark);
+  const uint64_t ts = t0 + std::llround((next - 1) * true_period) + 200e6;
+  assert(fifo.read(ts));
+  const double period_after = double(fifo.gyro().back().timestamp - fifo.gyro().front().timestamp) / (fifo.gyro().size() - 1);
+  assert(std::abs(period_after - period_before) < 0.01 * period_before);
+  printf("timestamps ok\n");
+}
+
+int main() {
+  test_parsing();
+  test_timestamps();
+  return 0;
+}
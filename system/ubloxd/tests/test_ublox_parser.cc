@@ -0,0 +1,551 @@
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/util.h"
+#include "system/ubloxd/generated/glonass.h"
+#include "system/ubloxd/generated/gps.h"
+#include "system/ubloxd/ublox_msg.h"
+
+// Checks UbloxMsgParser, fuzzes it and measures its throughput. Without arguments it checks the
+// fields of PVT and RAWX on known values, and the ephemerides of random GPS subframes and GLONASS
+// strings against the Kaitai parsers of gps.ksy and glonass.ksy. Then it runs on a synthetic
+// stream: 10 Hz PVT and RAWX with RAWX_MEAS measurements, MON-HW at 1 Hz and GPS subframes and
+// GLONASS strings, which are fed as-is, with garbage between the messages and with flipped bits.
+// A captured stream of raw UBX bytes can be replayed with
+//   ./test_ublox_parser ubx.bin
+// e.g. the concatenated ubloxRaw of a route, written with tools.lib.logreader.LogReader.
+
+const int RAWX_MEAS = 64;  // a full sky of GPS, GLONASS, Galileo and BeiDou
+const int SECONDS = 600;
+const int EPHEMERIDES = 1000;
+
+// user range accuracy in meters, of F_T
+const float GLONASS_URA[16] = {1, 2, 2.5, 4, 5, 7, 10, 12, 14, 16, 32, 64, 128, 256, 512, 1024};
+
+std::mt19937 rng(42);
+
+struct Counts {
+  int pvt = 0, gnss = 0, ephemeris = 0, glonass_ephemeris = 0, measurements = 0;
+  double seconds = 0;
+};
+
+void add_msg(std::vector<uint8_t> &stream, uint16_t type, const std::vector<uint8_t> &payload) {
+  const size_t start = stream.size();
+  stream.insert(stream.end(), {ublox::PREAMBLE1, ublox::PREAMBLE2, (uint8_t)(type >> 8), (uint8_t)type,
+                               (uint8_t)payload.size(), (uint8_t)(payload.size() >> 8)});
+  stream.insert(stream.end(), payload.begin(), payload.end());
+  uint8_t ck_a = 0, ck_b = 0;
+  for (size_t i = start + 2; i < stream.size(); i++) {
+    ck_a += stream[i];
+    ck_b += ck_a;
+  }
+  stream.insert(stream.end(), {ck_a, ck_b});
+}
+
+template <class T>
+void append(std::vector<uint8_t> &payload, const T &v) {
+  const uint8_t *p = (const uint8_t *)&v;
+  payload.insert(payload.end(), p, p + sizeof(v));
+}
+
+void put_bits(uint8_t *data, int pos, int len, uint32_t value) {
+  for (int i = 0; i < len; i++) {
+    const int bit = pos + i;
+    data[bit / 8] &= ~(1 << (7 - bit % 8));
+    data[bit / 8] |= ((value >> (len - 1 - i)) & 1) << (7 - bit % 8);
+  }
+}
+
+ublox::ubx_rxm_sfrbx_t sfrbx(int gnss_id, int sv_id, int freq_id, int num_words) {
+  ublox::ubx_rxm_sfrbx_t msg = {};
+  msg.gnssId = gnss_id;
+  msg.svId = sv_id;
+  msg.freqId = freq_id;
+  msg.numWords = num_words;
+  msg.version = 2;
+  return msg;
+}
+
+// a subframe with random data, the preamble, its id and the IODE or IODC
+std::string gps_subframe(int subframe_id, int iode) {
+  std::string subframe(ublox::GPS_SUBFRAME_SIZE, 0);
+  uint8_t *data = (uint8_t *)subframe.data();
+  for (size_t i = 0; i < subframe.size(); i++) data[i] = rng();
+  data[0] = 0x8b;
+  put_bits(data, 43, 3, subframe_id);
+  if (subframe_id == 1) put_bits(data, 168, 8, iode);
+  if (subframe_id == 2) put_bits(data, 48, 8, iode);
+  if (subframe_id == 3) put_bits(data, 216, 8, iode);
+  return subframe;
+}
+
+void add_gps_subframe(std::vector<uint8_t> &stream, int sv_id, const std::string &subframe) {
+  const uint8_t *data = (const uint8_t *)subframe.data();
+  std::vector<uint8_t> payload;
+  append(payload, sfrbx(ublox::GNSS_TYPE_GPS, sv_id, 0, 10));
+  for (int i = 0; i < 10; i++) {
+    // 24 bits of data and 6 of parity in each word
+    const uint32_t word = (data[i * 3] << 22) | (data[i * 3 + 1] << 14) | (data[i * 3 + 2] << 6) | (rng() & 0x3f);
+    append(payload, word);
+  }
+  add_msg(stream, 0x0213, payload);
+}
+
+// a string of immediate data with random contents
+std::string glonass_string(int string_number, int superframe) {
+  std::string string(ublox::GLONASS_STRING_SIZE, 0);
+  uint8_t *data = (uint8_t *)string.data();
+  for (size_t i = 0; i < string.size(); i++) data[i] = rng();
+  put_bits(data, 0, 1, 0);
+  put_bits(data, 1, 4, string_number);
+  put_bits(data, 96, 16, superframe);
+  return string;
+}
+
+void add_glonass_string(std::vector<uint8_t> &stream, int sv_id, int freq_id, const std::string &string) {
+  const uint8_t *data = (const uint8_t *)string.data();
+  std::vector<uint8_t> payload;
+  append(payload, sfrbx(ublox::GNSS_TYPE_GLONASS, sv_id, freq_id, 4));
+  for (int i = 0; i < 4; i++) {
+    const uint32_t word = (data[i * 4] << 24) | (data[i * 4 + 1] << 16) | (data[i * 4 + 2] << 8) | data[i * 4 + 3];
+    append(payload, word);
+  }
+  add_msg(stream, 0x0213, payload);
+}
+
+// the stream and how many messages of it are sent
+std::vector<uint8_t> synthetic_stream(int seconds, Counts &expected) {
+  std::vector<uint8_t> stream;
+  for (int epoch = 0; epoch < seconds * 10; epoch++) {
+    ublox::ubx_nav_pvt_t pvt = {};
+    pvt.iTOW = epoch * 100;
+    pvt.year = 2024;
+    pvt.fixType = 3;
+    pvt.lat = 377749000 + epoch;
+    pvt.lon = -1224194000;
+    std::vector<uint8_t> payload;
+    append(payload, pvt);
+    add_msg(stream, 0x0107, payload);
+    expected.pvt++;
+
+    payload.clear();
+    ublox::ubx_rxm_rawx_t rawx = {};
+    rawx.rcvTow = epoch / 10.0;
+    rawx.week = 2300;
+    rawx.numMeas = RAWX_MEAS;
+    rawx.version = 1;
+    append(payload, rawx);
+    for (int i = 0; i < RAWX_MEAS; i++) {
+      ublox::ubx_rxm_rawx_meas_t meas = {};
+      meas.prMes = 2e7 + rng() % 100000;
+      meas.cpMes = 1e8 + rng() % 100000;
+      meas.doMes = (int)(rng() % 8000) - 4000;
+      meas.gnssId = i % 4;
+      meas.svId = 1 + i / 4;
+      meas.cno = 20 + rng() % 30;
+      meas.trkStat = 0x0f;
+      append(payload, meas);
+    }
+    add_msg(stream, 0x0215, payload);
+    expected.gnss++;
+    expected.measurements += RAWX_MEAS;
+
+    if (epoch % 10 == 0) {
+      payload.assign(sizeof(ublox::ubx_mon_hw_t), 0);
+      add_msg(stream, 0x0a09, payload);
+      expected.gnss++;
+
+      // a subframe every 6 s, and a string every 2 s, of each satellite. An ephemeris is sent with
+      // the last of subframes 1-3 and strings 1-5, the almanac isn't parsed
+      const int second = epoch / 10;
+      if (second % 6 == 0) {
+        for (int sv_id = 1; sv_id <= 12; sv_id++) {
+          const int subframe_id = second / 6 % 5 + 1;
+          add_gps_subframe(stream, sv_id, gps_subframe(subframe_id, second / 30));
+          if (subframe_id == 3) {
+            expected.gnss++;
+            expected.ephemeris++;
+          }
+        }
+      }
+      if (second % 2 == 0) {
+        for (int freq_id = 0; freq_id < 8; freq_id++) {
+          const int string_number = second / 2 % 15 + 1;
+          if (string_number <= 5) {
+            add_glonass_string(stream, 1, freq_id, glonass_string(string_number, 1 + second / 30));
+            if (string_number == 5) {
+              expected.gnss++;
+              expected.glonass_ephemeris++;
+            }
+          }
+        }
+      }
+    }
+  }
+  return stream;
+}
+
+// feeds the stream in chunks of up to max_chunk bytes, like ubloxd gets them from pigeond, and
+// calls f with the name and the event of each message that is sent
+template <class F>
+void parse(const std::vector<uint8_t> &stream, size_t max_chunk, float log_time_per_byte, F f) {
+  UbloxMsgParser parser;
+  AlignedBuffer aligned_buf;
+  std::uniform_int_distribution<size_t> chunk_size(1, max_chunk);
+
+  size_t pos = 0;
+  while (pos < stream.size()) {
+    const size_t len = std::min(chunk_size(rng), stream.size() - pos);
+    const float log_time = pos * log_time_per_byte;
+    size_t consumed = 0;
+    while (consumed < len) {
+      size_t bytes_consumed = 0;
+      if (parser.add_data(log_time, stream.data() + pos + consumed, len - consumed, bytes_consumed)) {
+        auto [name, bytes] = parser.gen_msg();
+        if (bytes.size() > 0) {
+          capnp::FlatArrayMessageReader reader(aligned_buf.align((const char *)bytes.begin(), bytes.size()));
+          f(name, reader.getRoot<cereal::Event>());
+        }
+        parser.reset();
+      }
+      consumed += bytes_consumed;
+    }
+    pos += len;
+  }
+}
+
+Counts parse(const std::vector<uint8_t> &stream, size_t max_chunk, float log_time_per_byte) {
+  Counts counts;
+  const auto start = std::chrono::steady_clock::now();
+  parse(stream, max_chunk, log_time_per_byte, [&](const char *name, cereal::Event::Reader event) {
+    if (strcmp(name, "gpsLocationExternal") == 0) {
+      assert(event.isGpsLocationExternal());
+      counts.pvt++;
+    } else {
+      assert(event.isUbloxGnss());
+      counts.gnss++;
+      auto gnss = event.getUbloxGnss();
+      if (gnss.isEphemeris()) counts.ephemeris++;
+      if (gnss.isGlonassEphemeris()) counts.glonass_ephemeris++;
+      if (gnss.isMeasurementReport()) counts.measurements += gnss.getMeasurementReport().getMeasurements().size();
+    }
+  });
+  counts.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return counts;
+}
+
+bool close(double value, double expected) {
+  return std::abs(value - expected) <= 1e-6 * std::max(1.0, std::abs(expected));
+}
+
+void test_pvt_rawx() {
+  std::vector<uint8_t> stream;
+  ublox::ubx_nav_pvt_t pvt = {};
+  pvt.year = 2024;
+  pvt.month = 3;
+  pvt.day = 15;
+  pvt.hour = 12;
+  pvt.min = 30;
+  pvt.sec = 45;
+  pvt.nano = 500000000;
+  pvt.fixType = 3;
+  pvt.flags = 0x01;
+  pvt.lat = 377749000;
+  pvt.lon = -1224194000;
+  pvt.height = 12345;
+  pvt.hAcc = 1500;
+  pvt.vAcc = 2500;
+  pvt.velN = 1000;
+  pvt.velE = -2000;
+  pvt.velD = 300;
+  pvt.gSpeed = 25000;
+  pvt.headMot = 9000000;
+  pvt.sAcc = 300;
+  pvt.headAcc = 120000;
+  std::vector<uint8_t> payload;
+  append(payload, pvt);
+  add_msg(stream, 0x0107, payload);
+
+  payload.clear();
+  ublox::ubx_rxm_rawx_t rawx = {};
+  rawx.rcvTow = 345600.5;
+  rawx.week = 2305;
+  rawx.leapS = 18;
+  rawx.numMeas = 2;
+  rawx.recStat = 0b101;
+  rawx.version = 1;
+  append(payload, rawx);
+  ublox::ubx_rxm_rawx_meas_t meas = {};
+  meas.prMes = 21000000.25;
+  meas.cpMes = 110000000.5;
+  meas.doMes = -1234.5;
+  meas.gnssId = 0;
+  meas.svId = 5;
+  meas.locktime = 64500;
+  meas.cno = 42;
+  meas.prStdev = 3;
+  meas.cpStdev = 5;
+  meas.doStdev = 4;
+  meas.trkStat = 0b0111;
+  append(payload, meas);
+  meas = {};
+  meas.prMes = 22000000;
+  meas.doMes = 250;
+  meas.gnssId = 6;
+  meas.svId = 12;
+  meas.freqId = 9;
+  meas.cno = 30;
+  meas.prStdev = 0x15;  // only the low 4 bits are used
+  meas.cpStdev = 0x12;
+  meas.trkStat = 0b1001;
+  append(payload, meas);
+  add_msg(stream, 0x0215, payload);
+
+  int msgs = 0;
+  parse(stream, 1024, 0, [&](const char *name, cereal::Event::Reader event) {
+    msgs++;
+    if (strcmp(name, "gpsLocationExternal") == 0) {
+      auto loc = event.getGpsLocationExternal();
+      assert(loc.getSource() == cereal::GpsLocationData::SensorSource::UBLOX);
+      assert(loc.getFlags() == 1);
+      assert(close(loc.getLatitude(), 37.7749) && close(loc.getLongitude(), -122.4194));
+      assert(close(loc.getAltitude(), 12.345));
+      assert(close(loc.getSpeed(), 25) && close(loc.getBearingDeg(), 90));
+      assert(close(loc.getAccuracy(), 1.5) && close(loc.getVerticalAccuracy(), 2.5));
+      assert(close(loc.getSpeedAccuracy(), 0.3) && close(loc.getBearingAccuracyDeg(), 1.2));
+      assert(loc.getUnixTimestampMillis() == 1710505845500);
+      auto vned = loc.getVNED();
+      assert(vned.size() == 3 && close(vned[0], 1) && close(vned[1], -2) && close(vned[2], 0.3));
+    } else {
+      assert(event.getUbloxGnss().isMeasurementReport());
+      auto mr = event.getUbloxGnss().getMeasurementReport();
+      assert(mr.getRcvTow() == 345600.5 && mr.getGpsWeek() == 2305 && mr.getLeapSeconds() == 18);
+      assert(mr.getReceiverStatus().getLeapSecValid() && mr.getReceiverStatus().getClkReset());
+      assert(mr.getNumMeas() == 2 && mr.getMeasurements().size() == 2);
+
+      auto m = mr.getMeasurements()[0];
+      assert(m.getSvId() == 5 && m.getGnssId() == 0 && m.getGlonassFrequencyIndex() == 0);
+      assert(m.getPseudorange() == 21000000.25 && m.getCarrierCycles() == 110000000.5 && m.getDoppler() == -1234.5f);
+      assert(m.getLocktime() == 64500 && m.getCno() == 42);
+      assert(close(m.getPseudorangeStdev(), 0.08) && close(m.getCarrierPhaseStdev(), 0.02) && close(m.getDopplerStdev(), 0.032));
+      auto ts = m.getTrackingStatus();
+      assert(ts.getPseudorangeValid() && ts.getCarrierPhaseValid() && ts.getHalfCycleValid() && !ts.getHalfCycleSubtracted());
+
+      m = mr.getMeasurements()[1];
+      assert(m.getSvId() == 12 && m.getGnssId() == 6 && m.getGlonassFrequencyIndex() == 9);
+      assert(m.getPseudorange() == 22000000 && m.getCarrierCycles() == 0 && m.getDoppler() == 250);
+      assert(m.getLocktime() == 0 && m.getCno() == 30);
+      assert(close(m.getPseudorangeStdev(), 0.32) && close(m.getCarrierPhaseStdev(), 0.008) && close(m.getDopplerStdev(), 0.002));
+      ts = m.getTrackingStatus();
+      assert(ts.getPseudorangeValid() && !ts.getCarrierPhaseValid() && !ts.getHalfCycleValid() && ts.getHalfCycleSubtracted());
+    }
+  });
+  assert(msgs == 2);
+}
+
+void check_gps_ephemeris(cereal::UbloxGnss::Ephemeris::Reader eph, int sv_id, std::string subframes[3]) {
+  kaitai::kstream stream_1(subframes[0]), stream_2(subframes[1]), stream_3(subframes[2]);
+  gps_t gps_1(&stream_1), gps_2(&stream_2), gps_3(&stream_3);
+  auto subframe_1 = static_cast<gps_t::subframe_1_t *>(gps_1.body());
+  auto subframe_2 = static_cast<gps_t::subframe_2_t *>(gps_2.body());
+  auto subframe_3 = static_cast<gps_t::subframe_3_t *>(gps_3.body());
+
+  int week = subframe_1->week_no() + 1024;
+  if (week < 1877) week += 1024;
+  if (subframe_2->t_oe() == 0 && gps_2.how()->tow_count() * 6 >= SECS_IN_WEEK - 2 * SECS_IN_HR) week++;
+
+  assert(eph.getSvId() == sv_id);
+  assert(eph.getToeWeek() == week && eph.getTocWeek() == week);
+  assert(eph.getTgd() == subframe_1->t_gd() * pow(2, -31));
+  assert(eph.getToc() == subframe_1->t_oc() * pow(2, 4));
+  assert(eph.getAf2() == subframe_1->af_2() * pow(2, -55));
+  assert(eph.getAf1() == subframe_1->af_1() * pow(2, -43));
+  assert(eph.getAf0() == subframe_1->af_0() * pow(2, -31));
+  assert(eph.getSvHealth() == subframe_1->sv_health());
+  assert(eph.getTowCount() == gps_1.how()->tow_count());
+
+  const double gps_pi = 3.1415926535898;
+  assert(eph.getCrs() == subframe_2->c_rs() * pow(2, -5));
+  assert(eph.getDeltaN() == subframe_2->delta_n() * pow(2, -43) * gps_pi);
+  assert(eph.getM0() == subframe_2->m_0() * pow(2, -31) * gps_pi);
+  assert(eph.getCuc() == subframe_2->c_uc() * pow(2, -29));
+  assert(eph.getEcc() == subframe_2->e() * pow(2, -33));
+  assert(eph.getCus() == subframe_2->c_us() * pow(2, -29));
+  assert(eph.getA() == pow(subframe_2->sqrt_a() * pow(2, -19), 2.0));
+  assert(eph.getToe() == subframe_2->t_oe() * pow(2, 4));
+
+  assert(eph.getCic() == subframe_3->c_ic() * pow(2, -29));
+  assert(eph.getOmega0() == subframe_3->omega_0() * pow(2, -31) * gps_pi);
+  assert(eph.getCis() == subframe_3->c_is() * pow(2, -29));
+  assert(eph.getI0() == subframe_3->i_0() * pow(2, -31) * gps_pi);
+  assert(eph.getCrc() == subframe_3->c_rc() * pow(2, -5));
+  assert(eph.getOmega() == subframe_3->omega() * pow(2, -31) * gps_pi);
+  assert(eph.getOmegaDot() == subframe_3->omega_dot() * pow(2, -43) * gps_pi);
+  assert(eph.getIode() == subframe_3->iode());
+  assert(eph.getIDot() == subframe_3->idot() * pow(2, -43) * gps_pi);
+}
+
+void check_glonass_ephemeris(cereal::UbloxGnss::GlonassEphemeris::Reader eph, int sv_id, int freq_id, std::string strings[5]) {
+  kaitai::kstream stream_1(strings[0]), stream_2(strings[1]), stream_3(strings[2]), stream_4(strings[3]), stream_5(strings[4]);
+  glonass_t glonass_1(&stream_1), glonass_2(&stream_2), glonass_3(&stream_3), glonass_4(&stream_4), glonass_5(&stream_5);
+  auto string_1 = static_cast<glonass_t::string_1_t *>(glonass_1.data());
+  auto string_2 = static_cast<glonass_t::string_2_t *>(glonass_2.data());
+  auto string_3 = static_cast<glonass_t::string_3_t *>(glonass_3.data());
+  auto string_4 = static_cast<glonass_t::string_4_t *>(glonass_4.data());
+  auto string_5 = static_cast<glonass_t::string_5_t *>(glonass_5.data());
+
+  assert(eph.getSvId() == sv_id && eph.getFreqNum() == freq_id - 7);
+  assert(eph.getSvHealth() == ((string_2->b_n() >> 2) | string_3->l_n()));
+
+  const int tk = string_1->t_k();
+  assert(eph.getP1() == string_1->p1() && eph.getTkDEPRECATED() == tk);
+  assert(eph.getTkSeconds() == SECS_IN_HR * ((tk >> 7) & 0x1f) + SECS_IN_MIN * ((tk >> 1) & 0x3f) + (tk & 0x1) * 30);
+  assert(eph.getXVel() == string_1->x_vel() * pow(2, -20));
+  assert(eph.getXAccel() == string_1->x_accel() * pow(2, -30));
+  assert(eph.getX() == string_1->x() * pow(2, -11));
+
+  assert(eph.getP2() == string_2->p2() && eph.getTb() == string_2->t_b());
+  assert(eph.getYVel() == string_2->y_vel() * pow(2, -20));
+  assert(eph.getYAccel() == string_2->y_accel() * pow(2, -30));
+  assert(eph.getY() == string_2->y() * pow(2, -11));
+
+  assert(eph.getP3() == string_3->p3());
+  assert(eph.getGammaN() == string_3->gamma_n() * pow(2, -40));
+  assert(eph.getZVel() == string_3->z_vel() * pow(2, -20));
+  assert(eph.getZAccel() == string_3->z_accel() * pow(2, -30));
+  assert(eph.getZ() == string_3->z() * pow(2, -11));
+
+  assert(eph.getNt() == string_4->n_t());
+  assert(eph.getTauN() == string_4->tau_n() * pow(2, -30));
+  assert(eph.getDeltaTauN() == string_4->delta_tau_n() * pow(2, -30));
+  assert(eph.getAge() == string_4->e_n() && eph.getP4() == string_4->p4());
+  assert(eph.getSvURA() == GLONASS_URA[string_4->f_t()]);
+  assert(eph.getSvType() == string_4->m());
+
+  assert(eph.getN4() == string_5->n_4());
+}
+
+// the ephemerides of random subframes and strings are the ones of the Kaitai parsers
+void test_ephemeris() {
+  for (int i = 0; i < EPHEMERIDES; i++) {
+    std::vector<uint8_t> stream;
+    const int sv_id = 1 + rng() % ublox::GPS_MAX_SV_ID;
+    const int iode = rng() % 256;
+    std::string subframes[3];
+    for (int id = 1; id <= 3; id++) {
+      subframes[id - 1] = gps_subframe(id, iode);
+    }
+    if (i % 4 == 0) {
+      // toe at the start of the next week, from the last hours of this one
+      put_bits((uint8_t *)subframes[1].data(), 216, 16, 0);
+      put_bits((uint8_t *)subframes[1].data(), 24, 17, (SECS_IN_WEEK - SECS_IN_HR) / 6);
+    }
+    for (auto &subframe : subframes) {
+      add_gps_subframe(stream, sv_id, subframe);
+    }
+
+    const int freq_id = rng() % ublox::GLONASS_FREQ_IDS;
+    const int slot = 1 + rng() % 24;
+    const int superframe = 1 + rng() % 0xffff;
+    std::string strings[5];
+    for (int n = 1; n <= 5; n++) {
+      strings[n - 1] = glonass_string(n, superframe);
+      // the slot number of string 4 is the sv id
+      if (n == 4) put_bits((uint8_t *)strings[3].data(), 70, 5, slot);
+      add_glonass_string(stream, slot, freq_id, strings[n - 1]);
+    }
+
+    int ephemeris = 0, glonass_ephemeris = 0;
+    parse(stream, 1024, 0, [&](const char *name, cereal::Event::Reader event) {
+      auto gnss = event.getUbloxGnss();
+      if (gnss.isEphemeris()) {
+        check_gps_ephemeris(gnss.getEphemeris(), sv_id, subframes);
+        ephemeris++;
+      } else {
+        assert(gnss.isGlonassEphemeris());
+        check_glonass_ephemeris(gnss.getGlonassEphemeris(), slot, freq_id, strings);
+        glonass_ephemeris++;
+      }
+    });
+    assert(ephemeris == 1 && glonass_ephemeris == 1);
+  }
+}
+
+void print(const char *name, const Counts &c, size_t bytes) {
+  printf("%-8s %6d pvt %7d gnss %5d eph %5d glonass eph, %.1f MB/s\n", name, c.pvt, c.gnss, c.ephemeris,
+         c.glonass_ephemeris, bytes / c.seconds / 1e6);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    std::string data = util::read_file(argv[1]);
+    assert(!data.empty());
+    std::vector<uint8_t> stream(data.begin(), data.end());
+    Counts counts = parse(stream, 1024, 0);
+    print("replay", counts, stream.size());
+    return 0;
+  }
+
+  test_pvt_rawx();
+  test_ephemeris();
+
+  Counts expected;
+  const std::vector<uint8_t> clean = synthetic_stream(SECONDS, expected);
+  const float log_time_per_byte = (float)SECONDS / clean.size();
+
+  // everything is sent, however the stream is split
+  for (size_t max_chunk : {1, 7, 1024, 65536}) {
+    Counts counts = parse(clean, max_chunk, log_time_per_byte);
+    assert(counts.pvt == expected.pvt && counts.gnss == expected.gnss && counts.measurements == expected.measurements);
+    assert(counts.ephemeris == expected.ephemeris && counts.glonass_ephemeris == expected.glonass_ephemeris);
+  }
+
+  // it keeps up with the receiver with a lot of room to spare
+  Counts counts = parse(clean, 1024, log_time_per_byte);
+  print("clean", counts, clean.size());
+  assert(counts.seconds < SECONDS / 100.0);
+
+  // garbage between the messages, with a lot of false preambles, loses nothing
+  std::vector<uint8_t> garbage;
+  std::vector<uint8_t> noise;
+  for (size_t pos = 0; pos < clean.size();) {
+    const size_t size = ublox::UBLOX_HEADER_SIZE + (clean[pos + 4] | (clean[pos + 5] << 8)) + ublox::UBLOX_CHECKSUM_SIZE;
+    garbage.insert(garbage.end(), clean.begin() + pos, clean.begin() + pos + size);
+    pos += size;
+    if (rng() % 4 == 0) {
+      for (int n = rng() % 64; n > 0; n--) {
+        const uint8_t b = rng() % 4 == 0 ? ublox::PREAMBLE1 : rng() % 3 == 0 ? ublox::PREAMBLE2 : rng();
+        garbage.push_back(b);
+        noise.push_back(b);
+      }
+    }
+  }
+  // a false header at the end still waits for its length, the receiver keeps sending
+  garbage.insert(garbage.end(), ublox::UBLOX_MAX_MSG_SIZE + ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE, 0);
+  counts = parse(garbage, 1024, (float)SECONDS / garbage.size());
+  print("garbage", counts, garbage.size());
+  assert(counts.pvt == expected.pvt && counts.gnss == expected.gnss && counts.measurements == expected.measurements);
+  assert(counts.ephemeris == expected.ephemeris && counts.glonass_ephemeris == expected.glonass_ephemeris);
+
+  // flipped bits lose only the messages they are in
+  std::vector<uint8_t> flipped = clean;
+  for (int i = 0; i < 1000; i++) {
+    flipped[rng() % flipped.size()] ^= 1 << (rng() % 8);
+  }
+  counts = parse(flipped, 1024, log_time_per_byte);
+  print("flipped", counts, flipped.size());
+  assert(counts.pvt > expected.pvt / 2 && counts.gnss > expected.gnss / 2);
+
+  // and noise is only noise
+  counts = parse(noise, 1024, 0);
+  assert(counts.pvt == 0 && counts.gnss == 0);
+
+  printf("passed\n");
+  return 0;
+}
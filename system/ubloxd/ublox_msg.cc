@@ -2,514 +2,568 @@
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
-#include <unordered_map>
+#include <iterator>
 
 #include "common/swaglog.h"
 
 const double gpsPi = 3.1415926535898;
-#define UBLOX_MSG_SIZE(hdr) (*(uint16_t *)&hdr[4])
+#define UBLOX_MSG_SIZE(hdr) ((hdr)[4] | ((hdr)[5] << 8))
+
+// user range accuracy in meters
+const float glonass_URA_lookup[16] = {1, 2, 2.5, 4, 5, 7, 10, 12, 14, 16, 32, 64, 128, 256, 512, 1024};
 
 inline static bool bit_to_bool(uint8_t val, int shifts) {
   return (bool)(val & (1 << shifts));
 }
 
-inline int UbloxMsgParser::needed_bytes() {
-  // Msg header incomplete?
-  if(bytes_in_parse_buf < ublox::UBLOX_HEADER_SIZE)
-    return ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE - bytes_in_parse_buf;
-  uint16_t needed = UBLOX_MSG_SIZE(msg_parse_buf) + ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE;
-  // too much data
-  if(needed < (uint16_t)bytes_in_parse_buf)
-    return -1;
-  return needed - (uint16_t)bytes_in_parse_buf;
+// len bits of big endian data at pos, counted from the most significant bit of the first byte
+inline static uint32_t get_bits(const uint8_t *data, int pos, int len) {
+  uint64_t val = 0;
+  for (int i = pos / 8; i <= (pos + len - 1) / 8; i++) {
+    val = (val << 8) | data[i];
+  }
+  return (val >> (7 - (pos + len - 1) % 8)) & ((1ULL << len) - 1);
+}
+
+inline static int32_t get_bits_signed(const uint8_t *data, int pos, int len) {
+  return (int32_t)(get_bits(data, pos, len) << (32 - len)) >> (32 - len);
+}
+
+// a sign bit at pos followed by len bits of magnitude
+inline static int32_t get_bits_sign_magnitude(const uint8_t *data, int pos, int len) {
+  const int32_t val = get_bits(data, pos + 1, len);
+  return get_bits(data, pos, 1) ? -val : val;
+}
+
+inline static uint32_t read_u32(const uint8_t *data) {
+  uint32_t val;
+  memcpy(&val, data, sizeof(val));
+  return val;
 }
 
-inline bool UbloxMsgParser::valid_cheksum() {
+inline static size_t msg_size(const uint8_t *hdr) {
+  return ublox::UBLOX_HEADER_SIZE + UBLOX_MSG_SIZE(hdr) + ublox::UBLOX_CHECKSUM_SIZE;
+}
+
+inline static bool valid_checksum(const uint8_t *msg, size_t len) {
   uint8_t ck_a = 0, ck_b = 0;
-  for(int i = 2; i < bytes_in_parse_buf - ublox::UBLOX_CHECKSUM_SIZE;i++) {
-    ck_a = (ck_a + msg_parse_buf[i]) & 0xFF;
+  for (size_t i = 2; i < len - ublox::UBLOX_CHECKSUM_SIZE; i++) {
+    ck_a = (ck_a + msg[i]) & 0xFF;
     ck_b = (ck_b + ck_a) & 0xFF;
   }
-  if(ck_a != msg_parse_buf[bytes_in_parse_buf - 2]) {
-    LOGD("Checksum a mismatch: %02X, %02X", ck_a, msg_parse_buf[6]);
+  if (ck_a != msg[len - 2]) {
+    LOGD("Checksum a mismatch: %02X, %02X", ck_a, msg[len - 2]);
     return false;
   }
-  if(ck_b != msg_parse_buf[bytes_in_parse_buf - 1]) {
-    LOGD("Checksum b mismatch: %02X, %02X", ck_b, msg_parse_buf[7]);
+  if (ck_b != msg[len - 1]) {
+    LOGD("Checksum b mismatch: %02X, %02X", ck_b, msg[len - 1]);
     return false;
   }
   return true;
 }
 
-inline bool UbloxMsgParser::valid() {
-  return bytes_in_parse_buf >= ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE &&
-         needed_bytes() == 0 && valid_cheksum();
+// the next possible start of a message, or end
+inline static const uint8_t *find_preamble(const uint8_t *data, const uint8_t *end) {
+  while ((data = (const uint8_t *)memchr(data, ublox::PREAMBLE1, end - data))) {
+    if (data + 1 == end || data[1] == ublox::PREAMBLE2) {
+      return data;
+    }
+    data++;
+  }
+  return end;
 }
 
-inline bool UbloxMsgParser::valid_so_far() {
-  if(bytes_in_parse_buf > 0 && msg_parse_buf[0] != ublox::PREAMBLE1) {
-    return false;
-  }
-  if(bytes_in_parse_buf > 1 && msg_parse_buf[1] != ublox::PREAMBLE2) {
-    return false;
-  }
-  if(needed_bytes() == 0 && !valid()) {
-    return false;
-  }
-  return true;
+// drops the bytes of buf before the next possible start of a message from pos, returns what's left
+inline static size_t skip_to_preamble(uint8_t *buf, size_t len, size_t pos) {
+  const uint8_t *start = find_preamble(buf + std::min(pos, len), buf + len);
+  len -= start - buf;
+  memmove(buf, start, len);
+  return len;
 }
 
 bool UbloxMsgParser::add_data(float log_time, const uint8_t *incoming_data, uint32_t incoming_data_len, size_t &bytes_consumed) {
   last_log_time = log_time;
-  int needed = needed_bytes();
-  if(needed > 0) {
-    bytes_consumed = std::min((uint32_t)needed, incoming_data_len );
-    // Add data to buffer
-    memcpy(msg_parse_buf + bytes_in_parse_buf, incoming_data, bytes_consumed);
-    bytes_in_parse_buf += bytes_consumed;
-  } else {
+  if (bytes_in_parse_buf == 0) {
+    // skip to the start of a message, it's parsed in place if it's all there
+    const uint8_t *start = find_preamble(incoming_data, incoming_data + incoming_data_len);
+    const size_t len = incoming_data + incoming_data_len - start;
+    if (len >= ublox::UBLOX_HEADER_SIZE && len >= msg_size(start)) {
+      const size_t skipped = start - incoming_data;
+      if (valid_checksum(start, msg_size(start))) {
+        frame = start;
+        frame_len = msg_size(start);
+        bytes_consumed = skipped + frame_len;
+        return true;
+      }
+      // not a message, look again from the next byte
+      bytes_consumed = skipped + 1;
+      return false;
+    }
+
+    memcpy(msg_parse_buf, start, len);
+    bytes_in_parse_buf = len;
     bytes_consumed = incoming_data_len;
+    return false;
   }
 
-  // Validate msg format, detect invalid header and invalid checksum.
-  while(!valid_so_far() && bytes_in_parse_buf != 0) {
-    // Corrupted msg, drop a byte.
-    bytes_in_parse_buf -= 1;
-    if(bytes_in_parse_buf > 0)
-      memmove(&msg_parse_buf[0], &msg_parse_buf[1], bytes_in_parse_buf);
+  // the rest of a message that started in earlier data
+  bytes_consumed = 0;
+  while (bytes_in_parse_buf > 0) {
+    if (msg_parse_buf[0] != ublox::PREAMBLE1 || (bytes_in_parse_buf > 1 && msg_parse_buf[1] != ublox::PREAMBLE2)) {
+      bytes_in_parse_buf = skip_to_preamble(msg_parse_buf, bytes_in_parse_buf, 0);
+      continue;
+    }
+
+    const size_t size = bytes_in_parse_buf < ublox::UBLOX_HEADER_SIZE ? ublox::UBLOX_HEADER_SIZE : msg_size(msg_parse_buf);
+    if (bytes_in_parse_buf < size) {
+      const size_t n = std::min(size - bytes_in_parse_buf, incoming_data_len - bytes_consumed);
+      memcpy(msg_parse_buf + bytes_in_parse_buf, incoming_data + bytes_consumed, n);
+      bytes_in_parse_buf += n;
+      bytes_consumed += n;
+      if (bytes_in_parse_buf < size) {
+        return false;
+      }
+      if (size == ublox::UBLOX_HEADER_SIZE) {
+        continue;
+      }
+    }
+
+    if (valid_checksum(msg_parse_buf, size)) {
+      frame = msg_parse_buf;
+      frame_len = size;
+      return true;
+    }
+    // Corrupted msg, look for another in the buffered bytes
+    bytes_in_parse_buf = skip_to_preamble(msg_parse_buf, bytes_in_parse_buf, 1);
   }
+  return false;
+}
 
-  // There is redundant data at the end of buffer, reset the buffer.
-  if(needed_bytes() == -1) {
-    bytes_in_parse_buf = 0;
+void UbloxMsgParser::reset() {
+  // bytes buffered after the message are the start of the next
+  if (frame == msg_parse_buf) {
+    bytes_in_parse_buf -= frame_len;
+    memmove(msg_parse_buf, msg_parse_buf + frame_len, bytes_in_parse_buf);
   }
-  return valid();
+  frame = nullptr;
+  frame_len = 0;
 }
 
+MessageBuilder &UbloxMsgParser::init_msg() {
+  // the previous message zeroes the segment again
+  msg_builder.reset();
+  return msg_builder.emplace(kj::arrayPtr(segment + 1, std::size(segment) - 1));
+}
 
-std::pair<std::string, kj::Array<capnp::word>> UbloxMsgParser::gen_msg() {
-  std::string dat = data();
-  kaitai::kstream stream(dat);
+kj::ArrayPtr<capnp::byte> UbloxMsgParser::msg_bytes() {
+  auto segments = msg_builder->getSegmentsForOutput();
+  if (segments.size() == 1 && segments[0].begin() == segment + 1) {
+    // the segment table of a message of one segment, the count minus one and the size
+    const uint32_t table[2] = {0, (uint32_t)segments[0].size()};
+    memcpy(&segment[0], table, sizeof(table));
+    return kj::arrayPtr((capnp::byte *)segment, (1 + segments[0].size()) * sizeof(capnp::word));
+  }
+  heap_msg = capnp::messageToFlatArray(segments);
+  return heap_msg.asBytes();
+}
 
-  ubx_t ubx_message(&stream);
-  auto body = ubx_message.body();
+std::pair<const char *, kj::ArrayPtr<capnp::byte>> UbloxMsgParser::gen_msg() {
+  const uint16_t msg_type = (frame[2] << 8) | frame[3];
+  const size_t len = UBLOX_MSG_SIZE(frame);
+  const uint8_t *payload = frame + ublox::UBLOX_HEADER_SIZE;
 
-  switch (ubx_message.msg_type()) {
+  switch (msg_type) {
   case 0x0107:
-    return {"gpsLocationExternal", gen_nav_pvt(static_cast<ubx_t::nav_pvt_t*>(body))};
-  case 0x0213: // UBX-RXM-SFRB (Broadcast Navigation Data Subframe)
-    return {"ubloxGnss", gen_rxm_sfrbx(static_cast<ubx_t::rxm_sfrbx_t*>(body))};
-  case 0x0215: // UBX-RXM-RAW (Multi-GNSS Raw Measurement Data)
-    return {"ubloxGnss", gen_rxm_rawx(static_cast<ubx_t::rxm_rawx_t*>(body))};
+    if (len < sizeof(ublox::ubx_nav_pvt_t)) break;
+    return {"gpsLocationExternal", gen_nav_pvt((const ublox::ubx_nav_pvt_t *)payload)};
+  case 0x0213: { // UBX-RXM-SFRB (Broadcast Navigation Data Subframe)
+    auto sfrbx = (const ublox::ubx_rxm_sfrbx_t *)payload;
+    if (len < sizeof(*sfrbx) || len < sizeof(*sfrbx) + sfrbx->numWords * sizeof(uint32_t)) break;
+    return {"ubloxGnss", gen_rxm_sfrbx(sfrbx)};
+  }
+  case 0x0215: { // UBX-RXM-RAW (Multi-GNSS Raw Measurement Data)
+    auto rawx = (const ublox::ubx_rxm_rawx_t *)payload;
+    if (len < sizeof(*rawx) || len < sizeof(*rawx) + rawx->numMeas * sizeof(ublox::ubx_rxm_rawx_meas_t)) break;
+    return {"ubloxGnss", gen_rxm_rawx(rawx)};
+  }
   case 0x0a09:
-    return {"ubloxGnss", gen_mon_hw(static_cast<ubx_t::mon_hw_t*>(body))};
+    if (len < sizeof(ublox::ubx_mon_hw_t)) break;
+    return {"ubloxGnss", gen_mon_hw((const ublox::ubx_mon_hw_t *)payload)};
   case 0x0a0b:
-    return {"ubloxGnss", gen_mon_hw2(static_cast<ubx_t::mon_hw2_t*>(body))};
+    if (len < sizeof(ublox::ubx_mon_hw2_t)) break;
+    return {"ubloxGnss", gen_mon_hw2((const ublox::ubx_mon_hw2_t *)payload)};
   case 0x0135:
-    // TODO return {"ubloxGnss", gen_nav_sat(static_cast<ubx_t::nav_sat_t*>(body))};
-    return {"ubloxGnss", kj::Array<capnp::word>()};
+    // TODO return {"ubloxGnss", gen_nav_sat((const ublox::ubx_nav_sat_t *)payload)};
+    return {"ubloxGnss", {}};
   default:
-    LOGE("Unknown message type %x", ubx_message.msg_type());
-    return {"ubloxGnss", kj::Array<capnp::word>()};
+    LOGE("Unknown message type %x", msg_type);
+    return {"ubloxGnss", {}};
   }
+
+  LOGE("Error parsing ublox message %x of %zu bytes", msg_type, len);
+  return {"ubloxGnss", {}};
 }
 
 
-kj::Array<capnp::word> UbloxMsgParser::gen_nav_pvt(ubx_t::nav_pvt_t *msg) {
-  MessageBuilder msg_builder;
-  auto gpsLoc = msg_builder.initEvent().initGpsLocationExternal();
+kj::ArrayPtr<capnp::byte> UbloxMsgParser::gen_nav_pvt(const ublox::ubx_nav_pvt_t *msg) {
+  auto gpsLoc = init_msg().initEvent().initGpsLocationExternal();
   gpsLoc.setSource(cereal::GpsLocationData::SensorSource::UBLOX);
-  gpsLoc.setFlags(msg->flags());
-  gpsLoc.setLatitude(msg->lat() * 1e-07);
-  gpsLoc.setLongitude(msg->lon() * 1e-07);
-  gpsLoc.setAltitude(msg->height() * 1e-03);
-  gpsLoc.setSpeed(msg->g_speed() * 1e-03);
-  gpsLoc.setBearingDeg(msg->head_mot() * 1e-5);
-  gpsLoc.setAccuracy(msg->h_acc() * 1e-03);
+  gpsLoc.setFlags(msg->flags);
+  gpsLoc.setLatitude(msg->lat * 1e-07);
+  gpsLoc.setLongitude(msg->lon * 1e-07);
+  gpsLoc.setAltitude(msg->height * 1e-03);
+  gpsLoc.setSpeed(msg->gSpeed * 1e-03);
+  gpsLoc.setBearingDeg(msg->headMot * 1e-5);
+  gpsLoc.setAccuracy(msg->hAcc * 1e-03);
   std::tm timeinfo = std::tm();
-  timeinfo.tm_year = msg->year() - 1900;
-  timeinfo.tm_mon = msg->month() - 1;
-  timeinfo.tm_mday = msg->day();
-  timeinfo.tm_hour = msg->hour();
-  timeinfo.tm_min = msg->min();
-  timeinfo.tm_sec = msg->sec();
+  timeinfo.tm_year = msg->year - 1900;
+  timeinfo.tm_mon = msg->month - 1;
+  timeinfo.tm_mday = msg->day;
+  timeinfo.tm_hour = msg->hour;
+  timeinfo.tm_min = msg->min;
+  timeinfo.tm_sec = msg->sec;
 
   std::time_t utc_tt = timegm(&timeinfo);
-  gpsLoc.setUnixTimestampMillis(utc_tt * 1e+03 + msg->nano() * 1e-06);
-  float f[] = { msg->vel_n() * 1e-03f, msg->vel_e() * 1e-03f, msg->vel_d() * 1e-03f };
+  gpsLoc.setUnixTimestampMillis(utc_tt * 1e+03 + msg->nano * 1e-06);
+  float f[] = { msg->velN * 1e-03f, msg->velE * 1e-03f, msg->velD * 1e-03f };
   gpsLoc.setVNED(f);
-  gpsLoc.setVerticalAccuracy(msg->v_acc() * 1e-03);
-  gpsLoc.setSpeedAccuracy(msg->s_acc() * 1e-03);
-  gpsLoc.setBearingAccuracyDeg(msg->head_acc() * 1e-05);
-  return capnp::messageToFlatArray(msg_builder);
+  gpsLoc.setVerticalAccuracy(msg->vAcc * 1e-03);
+  gpsLoc.setSpeedAccuracy(msg->sAcc * 1e-03);
+  gpsLoc.setBearingAccuracyDeg(msg->headAcc * 1e-05);
+  return msg_bytes();
 }
 
-kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *msg) {
+kj::ArrayPtr<capnp::byte> UbloxMsgParser::parse_gps_ephemeris(const ublox::ubx_rxm_sfrbx_t *msg) {
+  if (msg->numWords != 10 || msg->svId < 1 || msg->svId > ublox::GPS_MAX_SV_ID) {
+    return {};
+  }
+
   // GPS subframes are packed into 10x 4 bytes, each containing 3 actual bytes
   // We will first need to separate the data from the padding and parity
-  auto body = *msg->body();
-  assert(body.size() == 10);
-
-  std::string subframe_data;
-  subframe_data.reserve(30);
-  for (uint32_t word : body) {
-    word = word >> 6; // TODO: Verify parity
-    subframe_data.push_back(word >> 16);
-    subframe_data.push_back(word >> 8);
-    subframe_data.push_back(word >> 0);
+  const uint8_t *words = (const uint8_t *)(msg + 1);
+  uint8_t subframe_data[ublox::GPS_SUBFRAME_SIZE];
+  for (int i = 0; i < 10; i++) {
+    uint32_t word = read_u32(words + i * 4) >> 6; // TODO: Verify parity
+    subframe_data[i * 3] = word >> 16;
+    subframe_data[i * 3 + 1] = word >> 8;
+    subframe_data[i * 3 + 2] = word >> 0;
+  }
+  if (subframe_data[0] != 0x8b) {
+    LOGE("Invalid GPS subframe preamble %02X", subframe_data[0]);
+    return {};
   }
 
-  // Collect subframes in map and parse when we have all the parts
-  {
-    kaitai::kstream stream(subframe_data);
-    gps_t subframe(&stream);
-
-    int subframe_id = subframe.how()->subframe_id();
-    if (subframe_id > 3 || subframe_id < 1) {
-      // dont parse almanac subframes
-      return kj::Array<capnp::word>();
-    }
-    gps_subframes[msg->sv_id()][subframe_id] = subframe_data;
+  // Collect subframes and parse when we have all the parts
+  int subframe_id = get_bits(subframe_data, 43, 3);
+  if (subframe_id > 3 || subframe_id < 1) {
+    // dont parse almanac subframes
+    return {};
   }
+  GpsSubframes &subframes = gps_subframes[msg->svId];
+  memcpy(subframes.data[subframe_id - 1], subframe_data, sizeof(subframe_data));
+  subframes.received |= 1 << (subframe_id - 1);
 
   // publish if subframes 1-3 have been collected
-  if (gps_subframes[msg->sv_id()].size() == 3) {
-    MessageBuilder msg_builder;
-    auto eph = msg_builder.initEvent().initUbloxGnss().initEphemeris();
-    eph.setSvId(msg->sv_id());
-
-    int iode_s2 = 0;
-    int iode_s3 = 0;
-    int iodc_lsb = 0;
-    int week;
-
-    // Subframe 1
-    {
-      kaitai::kstream stream(gps_subframes[msg->sv_id()][1]);
-      gps_t subframe(&stream);
-      gps_t::subframe_1_t* subframe_1 = static_cast<gps_t::subframe_1_t*>(subframe.body());
-
-      // Each message is incremented to be greater or equal than week 1877 (2015-12-27).
-      //  To skip this use the current_time argument
-      week = subframe_1->week_no();
-      week += 1024;
-      if (week < 1877) {
-        week += 1024;
-      }
-      //eph.setGpsWeek(subframe_1->week_no());
-      eph.setTgd(subframe_1->t_gd() * pow(2, -31));
-      eph.setToc(subframe_1->t_oc() * pow(2, 4));
-      eph.setAf2(subframe_1->af_2() * pow(2, -55));
-      eph.setAf1(subframe_1->af_1() * pow(2, -43));
-      eph.setAf0(subframe_1->af_0() * pow(2, -31));
-      eph.setSvHealth(subframe_1->sv_health());
-      eph.setTowCount(subframe.how()->tow_count());
-      iodc_lsb = subframe_1->iodc_lsb();
-    }
-
-    // Subframe 2
-    {
-      kaitai::kstream stream(gps_subframes[msg->sv_id()][2]);
-      gps_t subframe(&stream);
-      gps_t::subframe_2_t* subframe_2 = static_cast<gps_t::subframe_2_t*>(subframe.body());
-
-      // GPS week refers to current week, the ephemeris can be valid for the next
-      // if toe equals 0, this can be verified by the TOW count if it is within the
-      // last 2 hours of the week (gps ephemeris valid for 4hours)
-      if (subframe_2->t_oe() == 0 and subframe.how()->tow_count()*6 >= (SECS_IN_WEEK - 2*SECS_IN_HR)){
-        week += 1;
-      }
-      eph.setCrs(subframe_2->c_rs() * pow(2, -5));
-      eph.setDeltaN(subframe_2->delta_n() * pow(2, -43) * gpsPi);
-      eph.setM0(subframe_2->m_0() * pow(2, -31) * gpsPi);
-      eph.setCuc(subframe_2->c_uc() * pow(2, -29));
-      eph.setEcc(subframe_2->e() * pow(2, -33));
-      eph.setCus(subframe_2->c_us() * pow(2, -29));
-      eph.setA(pow(subframe_2->sqrt_a() * pow(2, -19), 2.0));
-      eph.setToe(subframe_2->t_oe() * pow(2, 4));
-      iode_s2 = subframe_2->iode();
-    }
-
-    // Subframe 3
-    {
-      kaitai::kstream stream(gps_subframes[msg->sv_id()][3]);
-      gps_t subframe(&stream);
-      gps_t::subframe_3_t* subframe_3 = static_cast<gps_t::subframe_3_t*>(subframe.body());
-
-      eph.setCic(subframe_3->c_ic() * pow(2, -29));
-      eph.setOmega0(subframe_3->omega_0() * pow(2, -31) * gpsPi);
-      eph.setCis(subframe_3->c_is() * pow(2, -29));
-      eph.setI0(subframe_3->i_0() * pow(2, -31) * gpsPi);
-      eph.setCrc(subframe_3->c_rc() * pow(2, -5));
-      eph.setOmega(subframe_3->omega() * pow(2, -31) * gpsPi);
-      eph.setOmegaDot(subframe_3->omega_dot() * pow(2, -43) * gpsPi);
-      eph.setIode(subframe_3->iode());
-      eph.setIDot(subframe_3->idot() * pow(2, -43) * gpsPi);
-      iode_s3 = subframe_3->iode();
-    }
-
-    eph.setToeWeek(week);
-    eph.setTocWeek(week);
-
-    gps_subframes[msg->sv_id()].clear();
-    if (iodc_lsb != iode_s2 || iodc_lsb != iode_s3) {
-      // data set cutover, reject ephemeris
-      return kj::Array<capnp::word>();
-    }
-    return capnp::messageToFlatArray(msg_builder);
+  if (subframes.received != 0b111) {
+    return {};
+  }
+  subframes.received = 0;
+
+  auto eph = init_msg().initEvent().initUbloxGnss().initEphemeris();
+  eph.setSvId(msg->svId);
+
+  // Subframe 1
+  const uint8_t *subframe_1 = subframes.data[0];
+  // Each message is incremented to be greater or equal than week 1877 (2015-12-27).
+  //  To skip this use the current_time argument
+  int week = get_bits(subframe_1, 48, 10);
+  week += 1024;
+  if (week < 1877) {
+    week += 1024;
   }
-  return kj::Array<capnp::word>();
+  eph.setTgd(get_bits_signed(subframe_1, 160, 8) * pow(2, -31));
+  eph.setToc(get_bits(subframe_1, 176, 16) * pow(2, 4));
+  eph.setAf2(get_bits_signed(subframe_1, 192, 8) * pow(2, -55));
+  eph.setAf1(get_bits_signed(subframe_1, 200, 16) * pow(2, -43));
+  eph.setAf0(get_bits_signed(subframe_1, 216, 22) * pow(2, -31));
+  eph.setSvHealth(get_bits(subframe_1, 64, 6));
+  eph.setTowCount(get_bits(subframe_1, 24, 17));
+  int iodc_lsb = get_bits(subframe_1, 168, 8);
+
+  // Subframe 2
+  const uint8_t *subframe_2 = subframes.data[1];
+  // GPS week refers to current week, the ephemeris can be valid for the next
+  // if toe equals 0, this can be verified by the TOW count if it is within the
+  // last 2 hours of the week (gps ephemeris valid for 4hours)
+  const uint32_t t_oe = get_bits(subframe_2, 216, 16);
+  if (t_oe == 0 and get_bits(subframe_2, 24, 17)*6 >= (SECS_IN_WEEK - 2*SECS_IN_HR)){
+    week += 1;
+  }
+  eph.setCrs(get_bits_signed(subframe_2, 56, 16) * pow(2, -5));
+  eph.setDeltaN(get_bits_signed(subframe_2, 72, 16) * pow(2, -43) * gpsPi);
+  eph.setM0(get_bits_signed(subframe_2, 88, 32) * pow(2, -31) * gpsPi);
+  eph.setCuc(get_bits_signed(subframe_2, 120, 16) * pow(2, -29));
+  eph.setEcc(get_bits_signed(subframe_2, 136, 32) * pow(2, -33));
+  eph.setCus(get_bits_signed(subframe_2, 168, 16) * pow(2, -29));
+  eph.setA(pow(get_bits(subframe_2, 184, 32) * pow(2, -19), 2.0));
+  eph.setToe(t_oe * pow(2, 4));
+  int iode_s2 = get_bits(subframe_2, 48, 8);
+
+  // Subframe 3
+  const uint8_t *subframe_3 = subframes.data[2];
+  eph.setCic(get_bits_signed(subframe_3, 48, 16) * pow(2, -29));
+  eph.setOmega0(get_bits_signed(subframe_3, 64, 32) * pow(2, -31) * gpsPi);
+  eph.setCis(get_bits_signed(subframe_3, 96, 16) * pow(2, -29));
+  eph.setI0(get_bits_signed(subframe_3, 112, 32) * pow(2, -31) * gpsPi);
+  eph.setCrc(get_bits_signed(subframe_3, 144, 16) * pow(2, -5));
+  eph.setOmega(get_bits_signed(subframe_3, 160, 32) * pow(2, -31) * gpsPi);
+  eph.setOmegaDot(get_bits_signed(subframe_3, 192, 24) * pow(2, -43) * gpsPi);
+  int iode_s3 = get_bits(subframe_3, 216, 8);
+  eph.setIode(iode_s3);
+  eph.setIDot(get_bits_signed(subframe_3, 224, 14) * pow(2, -43) * gpsPi);
+
+  eph.setToeWeek(week);
+  eph.setTocWeek(week);
+
+  if (iodc_lsb != iode_s2 || iodc_lsb != iode_s3) {
+    // data set cutover, reject ephemeris
+    return {};
+  }
+  return msg_bytes();
 }
 
-kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_t *msg) {
+kj::ArrayPtr<capnp::byte> UbloxMsgParser::parse_glonass_ephemeris(const ublox::ubx_rxm_sfrbx_t *msg) {
   // This parser assumes that no 2 satellites of the same frequency
   // can be in view at the same time
-  auto body = *msg->body();
-  assert(body.size() == 4);
+  if (msg->numWords != 4 || msg->freqId >= ublox::GLONASS_FREQ_IDS) {
+    return {};
+  }
+  GlonassStrings &strings = glonass_strings[msg->freqId];
   {
-    std::string string_data;
-    string_data.reserve(16);
-    for (uint32_t word : body) {
+    const uint8_t *words = (const uint8_t *)(msg + 1);
+    uint8_t string_data[ublox::GLONASS_STRING_SIZE];
+    for (int w = 0; w < 4; w++) {
+      uint32_t word = read_u32(words + w * 4);
       for (int i = 3; i >= 0; i--)
-        string_data.push_back(word >> 8*i);
+        string_data[w * 4 + 3 - i] = word >> 8*i;
     }
 
-    kaitai::kstream stream(string_data);
-    glonass_t gl_string(&stream);
-    int string_number = gl_string.string_number();
-    if (string_number < 1 || string_number > 5 || gl_string.idle_chip()) {
+    int string_number = get_bits(string_data, 1, 4);
+    if (string_number < 1 || string_number > 5 || get_bits(string_data, 0, 1)) {
       // dont parse non immediate data, idle_chip == 0
-      return kj::Array<capnp::word>();
+      return {};
     }
+    int superframe_number = get_bits(string_data, 96, 16);
 
     // Check if new string either has same superframe_id or log transmission times make sense
     bool superframe_unknown = false;
     bool needs_clear = false;
     for (int i = 1; i <= 5; i++) {
-      if (glonass_strings[msg->freq_id()].find(i) == glonass_strings[msg->freq_id()].end())
+      if (!(strings.received & (1 << (i - 1))))
         continue;
-      if (glonass_string_superframes[msg->freq_id()][i] == 0 || gl_string.superframe_number() == 0) {
+      if (strings.superframes[i - 1] == 0 || superframe_number == 0) {
         superframe_unknown = true;
       }
-      else if (glonass_string_superframes[msg->freq_id()][i] != gl_string.superframe_number()) {
+      else if (strings.superframes[i - 1] != superframe_number) {
         needs_clear = true;
       }
       // Check if string times add up to being from the same frame
       // If superframe is known this is redundant
       // Strings are sent 2s apart and frames are 30s apart
       if (superframe_unknown &&
-          std::abs((glonass_string_times[msg->freq_id()][i] - 2.0 * i) - (last_log_time - 2.0 * string_number)) > 10)
+          std::abs((strings.times[i - 1] - 2.0 * i) - (last_log_time - 2.0 * string_number)) > 10)
         needs_clear = true;
     }
     if (needs_clear) {
-      glonass_strings[msg->freq_id()].clear();
-      glonass_string_superframes[msg->freq_id()].clear();
-      glonass_string_times[msg->freq_id()].clear();
+      strings.received = 0;
     }
-    glonass_strings[msg->freq_id()][string_number] = string_data;
-    glonass_string_superframes[msg->freq_id()][string_number] = gl_string.superframe_number();
-    glonass_string_times[msg->freq_id()][string_number] = last_log_time;
+    memcpy(strings.data[string_number - 1], string_data, sizeof(string_data));
+    strings.superframes[string_number - 1] = superframe_number;
+    strings.times[string_number - 1] = last_log_time;
+    strings.received |= 1 << (string_number - 1);
   }
-  if (msg->sv_id() == 255) {
+  if (msg->svId == 255) {
     // data can be decoded before identifying the SV number, in this case 255
     // is returned, which means "unknown"  (ublox p32)
-    return kj::Array<capnp::word>();
+    return {};
   }
 
   // publish if strings 1-5 have been collected
-  if (glonass_strings[msg->freq_id()].size() != 5) {
-    return kj::Array<capnp::word>();
+  if (strings.received != 0b11111) {
+    return {};
   }
 
-  MessageBuilder msg_builder;
-  auto eph = msg_builder.initEvent().initUbloxGnss().initGlonassEphemeris();
-  eph.setSvId(msg->sv_id());
-  eph.setFreqNum(msg->freq_id() - 7);
+  auto eph = init_msg().initEvent().initUbloxGnss().initGlonassEphemeris();
+  eph.setSvId(msg->svId);
+  eph.setFreqNum(msg->freqId - 7);
 
   uint16_t current_day = 0;
   uint16_t tk = 0;
 
   // string number 1
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][1]);
-    glonass_t gl_stream(&stream);
-    glonass_t::string_1_t* data = static_cast<glonass_t::string_1_t*>(gl_stream.data());
-
-    eph.setP1(data->p1());
-    tk = data->t_k();
+    const uint8_t *data = strings.data[0];
+    eph.setP1(get_bits(data, 7, 2));
+    tk = get_bits(data, 9, 12);
     eph.setTkDEPRECATED(tk);
-    eph.setXVel(data->x_vel() * pow(2, -20));
-    eph.setXAccel(data->x_accel() * pow(2, -30));
-    eph.setX(data->x() * pow(2, -11));
+    eph.setXVel(get_bits_sign_magnitude(data, 21, 23) * pow(2, -20));
+    eph.setXAccel(get_bits_sign_magnitude(data, 45, 4) * pow(2, -30));
+    eph.setX(get_bits_sign_magnitude(data, 50, 26) * pow(2, -11));
   }
 
   // string number 2
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][2]);
-    glonass_t gl_stream(&stream);
-    glonass_t::string_2_t* data = static_cast<glonass_t::string_2_t*>(gl_stream.data());
-
-    eph.setSvHealth(data->b_n()>>2); // MSB indicates health
-    eph.setP2(data->p2());
-    eph.setTb(data->t_b());
-    eph.setYVel(data->y_vel() * pow(2, -20));
-    eph.setYAccel(data->y_accel() * pow(2, -30));
-    eph.setY(data->y() * pow(2, -11));
+    const uint8_t *data = strings.data[1];
+    eph.setSvHealth(get_bits(data, 5, 3)>>2); // MSB indicates health
+    eph.setP2(get_bits(data, 8, 1));
+    eph.setTb(get_bits(data, 9, 7));
+    eph.setYVel(get_bits_sign_magnitude(data, 21, 23) * pow(2, -20));
+    eph.setYAccel(get_bits_sign_magnitude(data, 45, 4) * pow(2, -30));
+    eph.setY(get_bits_sign_magnitude(data, 50, 26) * pow(2, -11));
   }
 
   // string number 3
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][3]);
-    glonass_t gl_stream(&stream);
-    glonass_t::string_3_t* data = static_cast<glonass_t::string_3_t*>(gl_stream.data());
-
-    eph.setP3(data->p3());
-    eph.setGammaN(data->gamma_n() * pow(2, -40));
-    eph.setSvHealth(eph.getSvHealth() | data->l_n());
-    eph.setZVel(data->z_vel() * pow(2, -20));
-    eph.setZAccel(data->z_accel() * pow(2, -30));
-    eph.setZ(data->z() * pow(2, -11));
+    const uint8_t *data = strings.data[2];
+    eph.setP3(get_bits(data, 5, 1));
+    eph.setGammaN(get_bits_sign_magnitude(data, 6, 10) * pow(2, -40));
+    eph.setSvHealth(eph.getSvHealth() | get_bits(data, 20, 1));
+    eph.setZVel(get_bits_sign_magnitude(data, 21, 23) * pow(2, -20));
+    eph.setZAccel(get_bits_sign_magnitude(data, 45, 4) * pow(2, -30));
+    eph.setZ(get_bits_sign_magnitude(data, 50, 26) * pow(2, -11));
   }
 
   // string number 4
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][4]);
-    glonass_t gl_stream(&stream);
-    glonass_t::string_4_t* data = static_cast<glonass_t::string_4_t*>(gl_stream.data());
-
-    current_day = data->n_t();
+    const uint8_t *data = strings.data[3];
+    current_day = get_bits(data, 59, 11);
     eph.setNt(current_day);
-    eph.setTauN(data->tau_n() * pow(2, -30));
-    eph.setDeltaTauN(data->delta_tau_n() * pow(2, -30));
-    eph.setAge(data->e_n());
-    eph.setP4(data->p4());
-    eph.setSvURA(glonass_URA_lookup.at(data->f_t()));
-    if (msg->sv_id() != data->n()) {
-      LOGE("SV_ID != SLOT_NUMBER: %d %d", msg->sv_id(), data->n())
+    eph.setTauN(get_bits_sign_magnitude(data, 5, 21) * pow(2, -30));
+    eph.setDeltaTauN(get_bits_sign_magnitude(data, 27, 4) * pow(2, -30));
+    eph.setAge(get_bits(data, 32, 5));
+    eph.setP4(get_bits(data, 51, 1));
+    eph.setSvURA(glonass_URA_lookup[get_bits(data, 52, 4)]);
+    const int slot_number = get_bits(data, 70, 5);
+    if (msg->svId != slot_number) {
+      LOGE("SV_ID != SLOT_NUMBER: %d %d", msg->svId, slot_number);
     }
-    eph.setSvType(data->m());
+    eph.setSvType(get_bits(data, 75, 2));
   }
 
   // string number 5
   {
-    kaitai::kstream stream(glonass_strings[msg->freq_id()][5]);
-    glonass_t gl_stream(&stream);
-    glonass_t::string_5_t* data = static_cast<glonass_t::string_5_t*>(gl_stream.data());
-
+    const uint8_t *data = strings.data[4];
     // string5 parsing is only needed to get the year, this can be removed and
     // the year can be fetched later in laika (note rollovers and leap year)
-    eph.setN4(data->n_4());
+    eph.setN4(get_bits(data, 49, 5));
     int tk_seconds = SECS_IN_HR * ((tk>>7) & 0x1F) + SECS_IN_MIN * ((tk>>1) & 0x3F) + (tk & 0x1) * 30;
     eph.setTkSeconds(tk_seconds);
   }
 
-  glonass_strings[msg->freq_id()].clear();
-  return capnp::messageToFlatArray(msg_builder);
+  strings.received = 0;
+  return msg_bytes();
 }
 
 
-kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg) {
-  switch (msg->gnss_id()) {
-    case ubx_t::gnss_type_t::GNSS_TYPE_GPS:
+kj::ArrayPtr<capnp::byte> UbloxMsgParser::gen_rxm_sfrbx(const ublox::ubx_rxm_sfrbx_t *msg) {
+  switch (msg->gnssId) {
+    case ublox::GNSS_TYPE_GPS:
       return parse_gps_ephemeris(msg);
-    case ubx_t::gnss_type_t::GNSS_TYPE_GLONASS:
+    case ublox::GNSS_TYPE_GLONASS:
       return parse_glonass_ephemeris(msg);
     default:
-      return kj::Array<capnp::word>();
+      return {};
   }
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_rxm_rawx(ubx_t::rxm_rawx_t *msg) {
-  MessageBuilder msg_builder;
-  auto mr = msg_builder.initEvent().initUbloxGnss().initMeasurementReport();
-  mr.setRcvTow(msg->rcv_tow());
-  mr.setGpsWeek(msg->week());
-  mr.setLeapSeconds(msg->leap_s());
-  mr.setGpsWeek(msg->week());
-
-  auto mb = mr.initMeasurements(msg->num_meas());
-  auto measurements = *msg->meas();
-  for(int8_t i = 0; i < msg->num_meas(); i++) {
-    mb[i].setSvId(measurements[i]->sv_id());
-    mb[i].setPseudorange(measurements[i]->pr_mes());
-    mb[i].setCarrierCycles(measurements[i]->cp_mes());
-    mb[i].setDoppler(measurements[i]->do_mes());
-    mb[i].setGnssId(measurements[i]->gnss_id());
-    mb[i].setGlonassFrequencyIndex(measurements[i]->freq_id());
-    mb[i].setLocktime(measurements[i]->lock_time());
-    mb[i].setCno(measurements[i]->cno());
-    mb[i].setPseudorangeStdev(0.01 * (pow(2, (measurements[i]->pr_stdev() & 15)))); // weird scaling, might be wrong
-    mb[i].setCarrierPhaseStdev(0.004 * (measurements[i]->cp_stdev() & 15));
-    mb[i].setDopplerStdev(0.002 * (pow(2, (measurements[i]->do_stdev() & 15)))); // weird scaling, might be wrong
+kj::ArrayPtr<capnp::byte> UbloxMsgParser::gen_rxm_rawx(const ublox::ubx_rxm_rawx_t *msg) {
+  auto mr = init_msg().initEvent().initUbloxGnss().initMeasurementReport();
+  mr.setRcvTow(msg->rcvTow);
+  mr.setGpsWeek(msg->week);
+  mr.setLeapSeconds(msg->leapS);
+
+  auto mb = mr.initMeasurements(msg->numMeas);
+  auto measurements = (const ublox::ubx_rxm_rawx_meas_t *)(msg + 1);
+  for(int i = 0; i < msg->numMeas; i++) {
+    mb[i].setSvId(measurements[i].svId);
+    mb[i].setPseudorange(measurements[i].prMes);
+    mb[i].setCarrierCycles(measurements[i].cpMes);
+    mb[i].setDoppler(measurements[i].doMes);
+    mb[i].setGnssId(measurements[i].gnssId);
+    mb[i].setGlonassFrequencyIndex(measurements[i].freqId);
+    mb[i].setLocktime(measurements[i].locktime);
+    mb[i].setCno(measurements[i].cno);
+    mb[i].setPseudorangeStdev(0.01 * (pow(2, (measurements[i].prStdev & 15)))); // weird scaling, might be wrong
+    mb[i].setCarrierPhaseStdev(0.004 * (measurements[i].cpStdev & 15));
+    mb[i].setDopplerStdev(0.002 * (pow(2, (measurements[i].doStdev & 15)))); // weird scaling, might be wrong
 
     auto ts = mb[i].initTrackingStatus();
-    auto trk_stat = measurements[i]->trk_stat();
+    auto trk_stat = measurements[i].trkStat;
     ts.setPseudorangeValid(bit_to_bool(trk_stat, 0));
     ts.setCarrierPhaseValid(bit_to_bool(trk_stat, 1));
     ts.setHalfCycleValid(bit_to_bool(trk_stat, 2));
     ts.setHalfCycleSubtracted(bit_to_bool(trk_stat, 3));
   }
 
-  mr.setNumMeas(msg->num_meas());
+  mr.setNumMeas(msg->numMeas);
   auto rs = mr.initReceiverStatus();
-  rs.setLeapSecValid(bit_to_bool(msg->rec_stat(), 0));
-  rs.setClkReset(bit_to_bool(msg->rec_stat(), 2));
-  return capnp::messageToFlatArray(msg_builder);
+  rs.setLeapSecValid(bit_to_bool(msg->recStat, 0));
+  rs.setClkReset(bit_to_bool(msg->recStat, 2));
+  return msg_bytes();
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_nav_sat(ubx_t::nav_sat_t *msg) {
-  MessageBuilder msg_builder;
-  auto sr = msg_builder.initEvent().initUbloxGnss().initSatReport();
-  sr.setITow(msg->itow());
+kj::ArrayPtr<capnp::byte> UbloxMsgParser::gen_nav_sat(const ublox::ubx_nav_sat_t *msg) {
+  auto sr = init_msg().initEvent().initUbloxGnss().initSatReport();
+  sr.setITow(msg->iTOW);
 
-  auto svs = sr.initSvs(msg->num_svs());
-  auto svs_data = *msg->svs();
-  for(int8_t i = 0; i < msg->num_svs(); i++) {
-    svs[i].setSvId(svs_data[i]->sv_id());
-    svs[i].setGnssId(svs_data[i]->gnss_id());
-    svs[i].setFlagsBitfield(svs_data[i]->flags());
+  auto svs = sr.initSvs(msg->numSvs);
+  auto svs_data = (const ublox::ubx_nav_sat_sv_t *)(msg + 1);
+  for(int i = 0; i < msg->numSvs; i++) {
+    svs[i].setSvId(svs_data[i].svId);
+    svs[i].setGnssId(svs_data[i].gnssId);
+    svs[i].setFlagsBitfield(svs_data[i].flags);
   }
 
-  return capnp::messageToFlatArray(msg_builder);
+  return msg_bytes();
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw(ubx_t::mon_hw_t *msg) {
-  MessageBuilder msg_builder;
-  auto hwStatus = msg_builder.initEvent().initUbloxGnss().initHwStatus();
-  hwStatus.setNoisePerMS(msg->noise_per_ms());
-  hwStatus.setFlags(msg->flags());
-  hwStatus.setAgcCnt(msg->agc_cnt());
-  hwStatus.setAStatus((cereal::UbloxGnss::HwStatus::AntennaSupervisorState) msg->a_status());
-  hwStatus.setAPower((cereal::UbloxGnss::HwStatus::AntennaPowerStatus) msg->a_power());
-  hwStatus.setJamInd(msg->jam_ind());
-  return capnp::messageToFlatArray(msg_builder);
+kj::ArrayPtr<capnp::byte> UbloxMsgParser::gen_mon_hw(const ublox::ubx_mon_hw_t *msg) {
+  auto hwStatus = init_msg().initEvent().initUbloxGnss().initHwStatus();
+  hwStatus.setNoisePerMS(msg->noisePerMS);
+  hwStatus.setFlags(msg->flags);
+  hwStatus.setAgcCnt(msg->agcCnt);
+  hwStatus.setAStatus((cereal::UbloxGnss::HwStatus::AntennaSupervisorState) msg->aStatus);
+  hwStatus.setAPower((cereal::UbloxGnss::HwStatus::AntennaPowerStatus) msg->aPower);
+  hwStatus.setJamInd(msg->jamInd);
+  return msg_bytes();
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw2(ubx_t::mon_hw2_t *msg) {
-  MessageBuilder msg_builder;
-  auto hwStatus = msg_builder.initEvent().initUbloxGnss().initHwStatus2();
-  hwStatus.setOfsI(msg->ofs_i());
-  hwStatus.setMagI(msg->mag_i());
-  hwStatus.setOfsQ(msg->ofs_q());
-  hwStatus.setMagQ(msg->mag_q());
+kj::ArrayPtr<capnp::byte> UbloxMsgParser::gen_mon_hw2(const ublox::ubx_mon_hw2_t *msg) {
+  auto hwStatus = init_msg().initEvent().initUbloxGnss().initHwStatus2();
+  hwStatus.setOfsI(msg->ofsI);
+  hwStatus.setMagI(msg->magI);
+  hwStatus.setOfsQ(msg->ofsQ);
+  hwStatus.setMagQ(msg->magQ);
 
-  switch (msg->cfg_source()) {
-    case ubx_t::mon_hw2_t::config_source_t::CONFIG_SOURCE_ROM:
+  switch (msg->cfgSource) {
+    case ublox::CONFIG_SOURCE_ROM:
       hwStatus.setCfgSource(cereal::UbloxGnss::HwStatus2::ConfigSource::ROM);
       break;
-    case ubx_t::mon_hw2_t::config_source_t::CONFIG_SOURCE_OTP:
+    case ublox::CONFIG_SOURCE_OTP:
       hwStatus.setCfgSource(cereal::UbloxGnss::HwStatus2::ConfigSource::OTP);
       break;
-    case ubx_t::mon_hw2_t::config_source_t::CONFIG_SOURCE_CONFIG_PINS:
+    case ublox::CONFIG_SOURCE_CONFIG_PINS:
       hwStatus.setCfgSource(cereal::UbloxGnss::HwStatus2::ConfigSource::CONFIGPINS);
       break;
-    case ubx_t::mon_hw2_t::config_source_t::CONFIG_SOURCE_FLASH:
+    case ublox::CONFIG_SOURCE_FLASH:
       hwStatus.setCfgSource(cereal::UbloxGnss::HwStatus2::ConfigSource::FLASH);
       break;
     default:
@@ -517,8 +571,8 @@ kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw2(ubx_t::mon_hw2_t *msg) {
       break;
   }
 
-  hwStatus.setLowLevCfg(msg->low_lev_cfg());
-  hwStatus.setPostStatus(msg->post_status());
+  hwStatus.setLowLevCfg(msg->lowLevCfg);
+  hwStatus.setPostStatus(msg->postStatus);
 
-  return capnp::messageToFlatArray(msg_builder);
+  return msg_bytes();
 }
@@ -2,16 +2,13 @@
 
 #include <cassert>
 #include <cstdint>
-#include <memory>
+#include <optional>
 #include <string>
-#include <unordered_map>
+#include <utility>
 #include <ctime>
 
 #include "cereal/messaging/messaging.h"
 #include "common/util.h"
-#include "system/ubloxd/generated/gps.h"
-#include "system/ubloxd/generated/glonass.h"
-#include "system/ubloxd/generated/ubx.h"
 
 using namespace std::string_literals;
 
@@ -29,6 +26,151 @@ namespace ublox {
   const int UBLOX_CHECKSUM_SIZE = 2;
   const int UBLOX_MAX_MSG_SIZE = 65536;
 
+  const int GPS_SUBFRAME_SIZE = 30;  // 10 words of 24 bits, without the parity
+  const int GLONASS_STRING_SIZE = 16;
+  const int GPS_MAX_SV_ID = 32;
+  const int GLONASS_FREQ_IDS = 14;
+
+  // payloads, read in place from the received data
+  struct ubx_nav_pvt_t {
+    uint32_t iTOW;
+    uint16_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t min;
+    uint8_t sec;
+    uint8_t valid;
+    uint32_t tAcc;
+    int32_t nano;
+    uint8_t fixType;
+    uint8_t flags;
+    uint8_t flags2;
+    uint8_t numSV;
+    int32_t lon;
+    int32_t lat;
+    int32_t height;
+    int32_t hMSL;
+    uint32_t hAcc;
+    uint32_t vAcc;
+    int32_t velN;
+    int32_t velE;
+    int32_t velD;
+    int32_t gSpeed;
+    int32_t headMot;
+    int32_t sAcc;
+    uint32_t headAcc;
+    uint16_t pDOP;
+    uint8_t flags3;
+    uint8_t reserved1[5];
+    int32_t headVeh;
+    int16_t magDec;
+    uint16_t magAcc;
+  } __attribute__((packed));
+
+  // followed by numMeas ubx_rxm_rawx_meas_t
+  struct ubx_rxm_rawx_t {
+    double rcvTow;
+    uint16_t week;
+    int8_t leapS;
+    uint8_t numMeas;
+    uint8_t recStat;
+    uint8_t version;
+    uint8_t reserved1[2];
+  } __attribute__((packed));
+
+  struct ubx_rxm_rawx_meas_t {
+    double prMes;
+    double cpMes;
+    float doMes;
+    uint8_t gnssId;
+    uint8_t svId;
+    uint8_t sigId;
+    uint8_t freqId;
+    uint16_t locktime;
+    uint8_t cno;
+    uint8_t prStdev;
+    uint8_t cpStdev;
+    uint8_t doStdev;
+    uint8_t trkStat;
+    uint8_t reserved2;
+  } __attribute__((packed));
+
+  // followed by numWords uint32_t
+  struct ubx_rxm_sfrbx_t {
+    uint8_t gnssId;
+    uint8_t svId;
+    uint8_t sigId;
+    uint8_t freqId;
+    uint8_t numWords;
+    uint8_t chn;
+    uint8_t version;
+    uint8_t reserved1;
+  } __attribute__((packed));
+
+  // followed by numSvs ubx_nav_sat_sv_t
+  struct ubx_nav_sat_t {
+    uint32_t iTOW;
+    uint8_t version;
+    uint8_t numSvs;
+    uint8_t reserved1[2];
+  } __attribute__((packed));
+
+  struct ubx_nav_sat_sv_t {
+    uint8_t gnssId;
+    uint8_t svId;
+    uint8_t cno;
+    int8_t elev;
+    int16_t azim;
+    int16_t prRes;
+    uint32_t flags;
+  } __attribute__((packed));
+
+  struct ubx_mon_hw_t {
+    uint32_t pinSel;
+    uint32_t pinBank;
+    uint32_t pinDir;
+    uint32_t pinVal;
+    uint16_t noisePerMS;
+    uint16_t agcCnt;
+    uint8_t aStatus;
+    uint8_t aPower;
+    uint8_t flags;
+    uint8_t reserved1;
+    uint32_t usedMask;
+    uint8_t VP[17];
+    uint8_t jamInd;
+    uint8_t reserved2[2];
+    uint32_t pinIrq;
+    uint32_t pullH;
+    uint32_t pullL;
+  } __attribute__((packed));
+
+  struct ubx_mon_hw2_t {
+    int8_t ofsI;
+    uint8_t magI;
+    int8_t ofsQ;
+    uint8_t magQ;
+    uint8_t cfgSource;
+    uint8_t reserved1[3];
+    uint32_t lowLevCfg;
+    uint8_t reserved2[8];
+    uint32_t postStatus;
+    uint8_t reserved3[4];
+  } __attribute__((packed));
+
+  enum gnss_type {
+    GNSS_TYPE_GPS = 0,
+    GNSS_TYPE_GLONASS = 6,
+  };
+
+  enum config_source {
+    CONFIG_SOURCE_FLASH = 102,
+    CONFIG_SOURCE_OTP = 111,
+    CONFIG_SOURCE_CONFIG_PINS = 112,
+    CONFIG_SOURCE_ROM = 113,
+  };
+
   struct ubx_mga_ini_time_utc_t {
     uint8_t type;
     uint8_t version;
@@ -89,42 +231,56 @@ namespace ublox {
   }
 }
 
+// Frames UBX messages and decodes them in place, without allocating. A message that is complete
+// in the received data isn't copied, only one that continues in the next data is, to a fixed
+// buffer. The GPS subframes and GLONASS strings of the ephemerides are collected in fixed slots.
 class UbloxMsgParser {
   public:
     bool add_data(float log_time, const uint8_t *incoming_data, uint32_t incoming_data_len, size_t &bytes_consumed);
-    inline void reset() {bytes_in_parse_buf = 0;}
-    inline int needed_bytes();
-    inline std::string data() {return std::string((const char*)msg_parse_buf, bytes_in_parse_buf);}
-
-    std::pair<std::string, kj::Array<capnp::word>> gen_msg();
-    kj::Array<capnp::word> gen_nav_pvt(ubx_t::nav_pvt_t *msg);
-    kj::Array<capnp::word> gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg);
-    kj::Array<capnp::word> gen_rxm_rawx(ubx_t::rxm_rawx_t *msg);
-    kj::Array<capnp::word> gen_mon_hw(ubx_t::mon_hw_t *msg);
-    kj::Array<capnp::word> gen_mon_hw2(ubx_t::mon_hw2_t *msg);
-    kj::Array<capnp::word> gen_nav_sat(ubx_t::nav_sat_t *msg);
+    void reset();
+    inline std::string data() {return std::string((const char*)frame, frame_len);}
+
+    // the service and the serialized event, valid until the next call. Empty if there's nothing to send.
+    std::pair<const char *, kj::ArrayPtr<capnp::byte>> gen_msg();
+    kj::ArrayPtr<capnp::byte> gen_nav_pvt(const ublox::ubx_nav_pvt_t *msg);
+    kj::ArrayPtr<capnp::byte> gen_rxm_sfrbx(const ublox::ubx_rxm_sfrbx_t *msg);
+    kj::ArrayPtr<capnp::byte> gen_rxm_rawx(const ublox::ubx_rxm_rawx_t *msg);
+    kj::ArrayPtr<capnp::byte> gen_mon_hw(const ublox::ubx_mon_hw_t *msg);
+    kj::ArrayPtr<capnp::byte> gen_mon_hw2(const ublox::ubx_mon_hw2_t *msg);
+    kj::ArrayPtr<capnp::byte> gen_nav_sat(const ublox::ubx_nav_sat_t *msg);
 
   private:
-    inline bool valid_cheksum();
-    inline bool valid();
-    inline bool valid_so_far();
+    struct GpsSubframes {
+      uint8_t data[3][ublox::GPS_SUBFRAME_SIZE];
+      uint8_t received = 0;  // bit of each subframe
+    };
+
+    // of the satellite of a frequency
+    struct GlonassStrings {
+      uint8_t data[5][ublox::GLONASS_STRING_SIZE];
+      int superframes[5];
+      long times[5];
+      uint8_t received = 0;  // bit of each string
+    };
 
-    kj::Array<capnp::word> parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *msg);
-    kj::Array<capnp::word> parse_glonass_ephemeris(ubx_t::rxm_sfrbx_t *msg);
+    MessageBuilder &init_msg();
+    kj::ArrayPtr<capnp::byte> msg_bytes();
+    kj::ArrayPtr<capnp::byte> parse_gps_ephemeris(const ublox::ubx_rxm_sfrbx_t *msg);
+    kj::ArrayPtr<capnp::byte> parse_glonass_ephemeris(const ublox::ubx_rxm_sfrbx_t *msg);
 
-    std::unordered_map<int, std::unordered_map<int, std::string>> gps_subframes;
+    GpsSubframes gps_subframes[ublox::GPS_MAX_SV_ID + 1];
+    GlonassStrings glonass_strings[ublox::GLONASS_FREQ_IDS];
 
     float last_log_time = 0.0;
+    // the message, in the incoming data or in msg_parse_buf
+    const uint8_t *frame = nullptr;
+    size_t frame_len = 0;
     size_t bytes_in_parse_buf = 0;
-    uint8_t msg_parse_buf[ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_MAX_MSG_SIZE];
-
-    // user range accuracy in meters
-    const std::unordered_map<uint8_t, float> glonass_URA_lookup =
-      {{ 0,  1}, { 1,   2}, { 2, 2.5}, { 3,   4}, { 4,  5}, {5, 7},
-       { 6, 10}, { 7,  12}, { 8,  14}, { 9,  16}, {10, 32},
-       {11, 64}, {12, 128}, {13, 256}, {14, 512}, {15, 1024}};
+    uint8_t msg_parse_buf[ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_MAX_MSG_SIZE + ublox::UBLOX_CHECKSUM_SIZE];
 
-    std::unordered_map<int, std::unordered_map<int, std::string>> glonass_strings;
-    std::unordered_map<int, std::unordered_map<int, long>> glonass_string_times;
-    std::unordered_map<int, std::unordered_map<int, int>> glonass_string_superframes;
+    // the event is built in segment, after a word for the segment table, so a message of one
+    // segment is sent from there. A larger one is copied to heap_msg.
+    capnp::word segment[1 + 4096] = {};
+    std::optional<MessageBuilder> msg_builder;
+    kj::Array<capnp::word> heap_msg;
 };
@@ -1,7 +1,5 @@
 #include <cassert>
 
-#include <kaitai/kaitaistream.h>
-
 #include "cereal/messaging/messaging.h"
 #include "common/swaglog.h"
 #include "common/util.h"
@@ -48,8 +46,7 @@ int main() {
         try {
           auto ublox_msg = parser.gen_msg();
           if (ublox_msg.second.size() > 0) {
-            auto bytes = ublox_msg.second.asBytes();
-            pm.send(ublox_msg.first.c_str(), bytes.begin(), bytes.size());
+            pm.send(ublox_msg.first, ublox_msg.second.begin(), ublox_msg.second.size());
           }
         } catch (const std::exception& e) {
           LOGE("Error parsing ublox message %s", e.what());
@@ -0,0 +1,36 @@
+#!/usr/bin/env python3
+import argparse
+import glob
+import json
+import os
+
+
+def load_events(path):
+  # one event per line, so the trace of a process that didn't exit cleanly can be read as well
+  events = []
+  with open(path) as f:
+    for line in f:
+      line = line.strip().rstrip(',')
+      if not line.startswith('{"name"'):
+        continue
+      try:
+        events.append(json.loads(line))
+      except json.JSONDecodeError:
+        pass  # cut off at the end
+  return events
+
+
+if __name__ == "__main__":
+  parser = argparse.ArgumentParser(description="Merges the traces written by the processes with TRACE_DIR set into a single trace, "
+                                               "to open in ui.perfetto.dev or chrome://tracing")
+  parser.add_argument("trace_dir", help="TRACE_DIR of the processes")
+  parser.add_argument("-o", "--output", default="trace.json")
+  args = parser.parse_args()
+
+  events = []
+  for path in sorted(glob.glob(os.path.join(args.trace_dir, "*.json"))):
+    events += load_events(path)
+
+  with open(args.output, "w") as f:
+    json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+  print(f"{len(events)} events written to {args.output}")
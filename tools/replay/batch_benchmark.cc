@@ -0,0 +1,73 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include <capnp/schema.h>
+#include <iostream>
+#include <map>
+
+#include "tools/replay/batchprocessor.h"
+#include "tools/replay/route.h"
+#include "tools/replay/util.h"
+
+// measures the event throughput of BatchProcessor over all segments of a route
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Benchmark offline log processing.");
+  parser.addHelpOption();
+  parser.addPositionalArgument("route", "the route to process");
+  parser.addOption({{"a", "allow"}, "whitelist of services to process", "allow"});
+  parser.addOption({{"j", "threads"}, "number of worker threads. default is the number of cores", "n"});
+  parser.addOption({"data_dir", "local directory with routes", "data_dir"});
+  parser.addOption({"qlog", "process qlogs instead of rlogs"});
+  parser.addOption({"no-cache", "turn off local cache"});
+  parser.process(app);
+
+  const QStringList args = parser.positionalArguments();
+  if (args.empty()) {
+    parser.showHelp();
+  }
+
+  Route route(args.first(), parser.value("data_dir"));
+  if (!route.load()) {
+    rError("failed to load route %s", qPrintable(args.first()));
+    return 1;
+  }
+
+  std::vector<std::string> logs;
+  for (auto &[n, f] : route.segments()) {
+    const QString &log = parser.isSet("qlog") || f.rlog.isEmpty() ? f.qlog : f.rlog;
+    if (!log.isEmpty()) logs.push_back(log.toStdString());
+  }
+
+  std::set<cereal::Event::Which> allow;
+  auto event_struct = capnp::Schema::from<cereal::Event>().asStruct();
+  for (const QString &name : parser.value("allow").split(",", QString::SkipEmptyParts)) {
+    KJ_IF_MAYBE(field, event_struct.findFieldByName(name.toStdString())) {
+      allow.insert((cereal::Event::Which)field->getProto().getDiscriminantValue());
+    } else {
+      rWarning("unknown service %s", qPrintable(name));
+    }
+  }
+
+  BatchProcessor processor(parser.value("threads").toInt(), !parser.isSet("no-cache"));
+  typedef std::map<cereal::Event::Which, uint64_t> Counts;
+  Counts counts = processor.process<Counts>(
+      logs, allow,
+      [](Counts &c, const Event *e) { ++c[e->which]; },
+      [](Counts &result, const Counts &other) {
+        for (auto &[which, n] : other) result[which] += n;
+      });
+
+  for (auto &[which, n] : counts) {
+    KJ_IF_MAYBE(field, event_struct.getFieldByDiscriminant(which)) {
+      std::cout << field->getProto().getName().cStr() << ": " << n << std::endl;
+    }
+  }
+  const auto &stats = processor.stats();
+  std::cout << "logs: " << stats.logs << " (" << stats.failed << " failed), threads: " << processor.threads() << std::endl
+            << "events: " << stats.events << " in " << stats.elapsed_ms << " ms, "
+            << (uint64_t)stats.eventsPerSecond() << " events/s" << std::endl;
+  return 0;
+}
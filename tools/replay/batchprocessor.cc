@@ -0,0 +1,49 @@
+#include "tools/replay/batchprocessor.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "common/timing.h"
+#include "tools/replay/util.h"
+
+BatchProcessor::BatchProcessor(int threads, bool local_cache) : local_cache_(local_cache) {
+  threads_ = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+BatchProcessor::Stats BatchProcessor::run(const std::vector<std::string> &logs, const std::set<cereal::Event::Which> &allow,
+                                          const std::function<void(int worker, const LogReader &log)> &fn,
+                                          std::atomic<bool> *abort) {
+  std::atomic<size_t> next_log = 0;
+  std::atomic<uint64_t> failed = 0, events = 0;
+  const double start_ts = millis_since_boot();
+
+  auto worker = [&](int id) {
+    for (size_t i = next_log++; i < logs.size() && !(abort && *abort); i = next_log++) {
+      LogReader log;
+      if (!log.load(logs[i], abort, allow, local_cache_, 0, 3)) {
+        rWarning("failed to load %s", logs[i].c_str());
+        ++failed;
+        continue;
+      }
+      // encodeIdx events are duplicated as frame events by LogReader, don't count them twice
+      events += std::count_if(log.events.begin(), log.events.end(), [](const Event *e) { return !e->frame; });
+      fn(id, log);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  const int n = std::min<int>(threads_, logs.size());
+  for (int i = 0; i < n; ++i) {
+    workers.emplace_back(worker, i);
+  }
+  for (auto &t : workers) {
+    t.join();
+  }
+
+  Stats stats;
+  stats.logs = logs.size();
+  stats.failed = failed;
+  stats.events = events;
+  stats.elapsed_ms = millis_since_boot() - start_ts;
+  return stats;
+}
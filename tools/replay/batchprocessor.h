@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "tools/replay/logreader.h"
+
+// Runs offline analysis over many logs. The logs are sharded over a pool of worker threads,
+// each worker holds a single log in memory at a time, and the events are filtered with
+// the allow list while parsing.
+class BatchProcessor {
+public:
+  struct Stats {
+    uint64_t logs = 0;
+    uint64_t failed = 0;
+    uint64_t events = 0;
+    double elapsed_ms = 0;
+    inline double eventsPerSecond() const { return elapsed_ms > 0 ? events / (elapsed_ms / 1000.0) : 0; }
+  };
+
+  BatchProcessor(int threads = 0, bool local_cache = true);
+  // fn is called from the worker threads with each loaded log
+  Stats run(const std::vector<std::string> &logs, const std::set<cereal::Event::Which> &allow,
+            const std::function<void(int worker, const LogReader &log)> &fn, std::atomic<bool> *abort = nullptr);
+
+  // streams the events of all logs to on_event. every worker accumulates into its own result,
+  // the results are merged once all logs are processed.
+  template <class T>
+  T process(const std::vector<std::string> &logs, const std::set<cereal::Event::Which> &allow,
+            const std::function<void(T &result, const Event *e)> &on_event,
+            const std::function<void(T &result, const T &other)> &merge, std::atomic<bool> *abort = nullptr) {
+    std::vector<T> results(threads_);
+    stats_ = run(logs, allow, [&](int worker, const LogReader &log) {
+      for (const Event *e : log.events) {
+        if (!e->frame) on_event(results[worker], e);
+      }
+    }, abort);
+
+    T result = {};
+    for (const T &r : results) {
+      merge(result, r);
+    }
+    return result;
+  }
+
+  inline int threads() const { return threads_; }
+  inline const Stats &stats() const { return stats_; }
+
+private:
+  int threads_;
+  bool local_cache_;
+  Stats stats_;
+};
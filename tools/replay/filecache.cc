@@ -0,0 +1,181 @@
+#include "tools/replay/filecache.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <tuple>
+#include <vector>
+
+#include "common/util.h"
+#include "tools/replay/util.h"
+
+const int DEFAULT_CACHE_MAX_SIZE_MB = 10 * 1024;
+
+FileCache &FileCache::instance() {
+  static FileCache cache;
+  return cache;
+}
+
+FileCache::FileCache() {
+  dir_ = util::getenv("COMMA_CACHE", "/tmp/comma_download_cache/");
+  if (dir_.back() != '/') dir_ += "/";
+  capacity_ = (size_t)util::getenv("COMMA_CACHE_MAX_SIZE", DEFAULT_CACHE_MAX_SIZE_MB) * 1024 * 1024;
+  util::create_directories(dir_ + "blobs", 0755);
+  util::create_directories(dir_ + "keys", 0755);
+  removeLegacyFiles();
+}
+
+void FileCache::removeLegacyFiles() const {
+  // older versions stored each download as <COMMA_CACHE>/sha256(url), which is never read now
+  if (DIR *d = opendir(dir_.c_str())) {
+    struct dirent *de = nullptr;
+    while ((de = readdir(d))) {
+      const std::string name = de->d_name;
+      if (name.size() != 64 || !std::all_of(name.begin(), name.end(), [](unsigned char c) { return std::isxdigit(c); })) continue;
+
+      std::string path = dir_ + name;
+      struct stat st = {};
+      if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        unlink(path.c_str());
+      }
+    }
+    closedir(d);
+  }
+}
+
+std::string FileCache::keyPath(const std::string &file, const std::string &tag) const {
+  return dir_ + "keys/" + sha256(getUrlWithoutQuery(file) + "#" + tag);
+}
+
+bool FileCache::writeAtomic(const std::string &path, const std::string &data) const {
+  // readers in other processes only ever see complete files. hidden temp files are skipped by evict()
+  std::string tmp_path = util::dir_name(path) + "/.tmp_" + util::random_string(8);
+  if (util::write_file(tmp_path.c_str(), data.data(), data.size(), O_WRONLY | O_CREAT | O_TRUNC) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::string FileCache::get(const std::string &file, const std::string &tag) {
+  const std::string key_path = keyPath(file, tag);
+  const std::string hash = util::read_file(key_path);
+  if (hash.empty()) return {};
+
+  const std::string blob_path = dir_ + "blobs/" + hash;
+  std::string result = util::read_file(blob_path);
+  if (result.empty()) {
+    // the blob has been evicted
+    unlink(key_path.c_str());
+    return {};
+  }
+  // mark as recently used
+  utimensat(AT_FDCWD, blob_path.c_str(), nullptr, 0);
+  return result;
+}
+
+bool FileCache::put(const std::string &file, const std::string &data, const std::string &tag) {
+  if (data.empty()) return false;
+
+  const std::string hash = sha256(data);
+  const std::string blob_path = dir_ + "blobs/" + hash;
+  if (util::file_exists(blob_path)) {
+    utimensat(AT_FDCWD, blob_path.c_str(), nullptr, 0);
+  } else {
+    evict(data.size());
+    if (!writeAtomic(blob_path, data)) {
+      rWarning("failed to write %s to cache", file.c_str());
+      return false;
+    }
+    std::lock_guard lk(mutex_);
+    if (size_) *size_ += data.size();
+  }
+  return writeAtomic(keyPath(file, tag), hash);
+}
+
+void FileCache::remove(const std::string &file, const std::string &tag) {
+  const std::string key_path = keyPath(file, tag);
+  const std::string hash = util::read_file(key_path);
+  unlink(key_path.c_str());
+  if (hash.empty()) return;
+
+  // identical files share a blob, it's only dropped once no other key references it
+  if (isReferenced(hash)) return;
+
+  const std::string blob_path = dir_ + "blobs/" + hash;
+  struct stat st = {};
+  if (stat(blob_path.c_str(), &st) == 0 && unlink(blob_path.c_str()) == 0) {
+    std::lock_guard lk(mutex_);
+    if (size_) *size_ -= std::min(*size_, (size_t)st.st_size);
+  }
+}
+
+bool FileCache::isReferenced(const std::string &hash) const {
+  bool referenced = false;
+  if (DIR *d = opendir((dir_ + "keys").c_str())) {
+    struct dirent *de = nullptr;
+    while (!referenced && (de = readdir(d))) {
+      if (de->d_name[0] == '.') continue;
+      referenced = util::read_file(dir_ + "keys/" + de->d_name) == hash;
+    }
+    closedir(d);
+  }
+  return referenced;
+}
+
+void FileCache::evict(size_t reserve) {
+  std::lock_guard lk(mutex_);
+  if (size_ && *size_ + reserve <= capacity_) return;
+
+  // serialize eviction between replay processes
+  const std::string lock_path = dir_ + ".lock";
+  int lock_fd = HANDLE_EINTR(open(lock_path.c_str(), O_CREAT | O_RDONLY, 0644));
+  if (lock_fd < 0 || HANDLE_EINTR(flock(lock_fd, LOCK_EX)) < 0) {
+    if (lock_fd >= 0) close(lock_fd);
+    return;
+  }
+
+  const std::string blobs_dir = dir_ + "blobs/";
+  std::vector<std::tuple<struct timespec, size_t, std::string>> blobs;
+  size_t total_size = 0;
+  if (DIR *d = opendir(blobs_dir.c_str())) {
+    struct dirent *de = nullptr;
+    while ((de = readdir(d))) {
+      if (de->d_name[0] == '.') continue;
+
+      std::string path = blobs_dir + de->d_name;
+      struct stat st = {};
+      if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        blobs.emplace_back(st.st_mtim, st.st_size, path);
+        total_size += st.st_size;
+      }
+    }
+    closedir(d);
+  }
+
+  if (total_size + reserve > capacity_) {
+    std::sort(blobs.begin(), blobs.end(), [](auto &a, auto &b) {
+      auto &l = std::get<0>(a), &r = std::get<0>(b);
+      return l.tv_sec < r.tv_sec || (l.tv_sec == r.tv_sec && l.tv_nsec < r.tv_nsec);
+    });
+    for (auto it = blobs.begin(); it != blobs.end() && total_size + reserve > capacity_; ++it) {
+      if (unlink(std::get<2>(*it).c_str()) == 0) {
+        total_size -= std::get<1>(*it);
+      }
+    }
+    rDebug("cache evicted to %s", formattedDataSize(total_size).c_str());
+  }
+  // other processes write to the same cache, so resync with what is actually on disk
+  size_ = total_size;
+
+  close(lock_fd);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <mutex>
+#include <optional>
+#include <string>
+
+// Local cache shared by all replay processes. Data is stored once per content hash
+// under <COMMA_CACHE>/blobs and referenced from <COMMA_CACHE>/keys, so identical
+// files are deduplicated. Blobs are evicted least recently used first when the
+// cache grows beyond COMMA_CACHE_MAX_SIZE (MB).
+class FileCache {
+public:
+  static FileCache &instance();
+  // the tag distinguishes data derived from the same file, e.g. a decompressed log or a frame index.
+  std::string get(const std::string &file, const std::string &tag = {});
+  bool put(const std::string &file, const std::string &data, const std::string &tag = {});
+  // removes the key, and its blob unless another key references it
+  void remove(const std::string &file, const std::string &tag = {});
+  // evict blobs until the cache has room for reserve bytes. the directory is only scanned
+  // when the running size says the cache is over budget
+  void evict(size_t reserve = 0);
+
+  inline const std::string &dir() const { return dir_; }
+  inline size_t capacity() const { return capacity_; }
+
+private:
+  FileCache();
+  std::string keyPath(const std::string &file, const std::string &tag) const;
+  bool writeAtomic(const std::string &path, const std::string &data) const;
+  void removeLegacyFiles() const;
+  bool isReferenced(const std::string &hash) const;
+
+  std::string dir_;
+  size_t capacity_ = 0;
+  std::mutex mutex_;
+  // size of the blobs as of the last scan plus what this process has written since
+  std::optional<size_t> size_;
+};
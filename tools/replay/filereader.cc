@@ -1,32 +1,20 @@
 #include "tools/replay/filereader.h"
 
-#include <fstream>
-
 #include "common/util.h"
+#include "tools/replay/filecache.h"
 #include "tools/replay/util.h"
 
-std::string cacheFilePath(const std::string &url) {
-  static std::string cache_path = [] {
-    const std::string comma_cache = util::getenv("COMMA_CACHE", "/tmp/comma_download_cache/");
-    util::create_directories(comma_cache, 0755);
-    return comma_cache.back() == '/' ? comma_cache : comma_cache + "/";
-  }();
-
-  return cache_path + sha256(getUrlWithoutQuery(url));
-}
-
 std::string FileReader::read(const std::string &file, std::atomic<bool> *abort) {
   const bool is_remote = file.find("https://") == 0;
-  const std::string local_file = is_remote ? cacheFilePath(file) : file;
-  std::string result;
+  if (!is_remote) {
+    return util::file_exists(file) ? util::read_file(file) : "";
+  }
 
-  if ((!is_remote || cache_to_local_) && util::file_exists(local_file)) {
-    result = util::read_file(local_file);
-  } else if (is_remote) {
+  std::string result = cache_to_local_ ? FileCache::instance().get(file) : "";
+  if (result.empty()) {
     result = download(file, abort);
     if (cache_to_local_ && !result.empty()) {
-      std::ofstream fs(local_file, std::ios::binary | std::ios::out);
-      fs.write(result.data(), result.size());
+      FileCache::instance().put(file, result);
     }
   }
   return result;
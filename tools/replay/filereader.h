@@ -16,5 +16,3 @@ private:
   int max_retries_;
   bool cache_to_local_;
 };
-
-std::string cacheFilePath(const std::string &url);
@@ -1,10 +1,13 @@
 #include "tools/replay/framereader.h"
 #include "tools/replay/util.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include "libyuv.h"
 
 #include "cereal/visionipc/visionbuf.h"
+#include "tools/replay/filecache.h"
 
 #ifdef __APPLE__
 #define HW_DEVICE_TYPE AV_HWDEVICE_TYPE_VIDEOTOOLBOX
@@ -33,6 +36,104 @@ int readPacket(void *opaque, uint8_t *buf, int buf_size) {
   return buf_size;
 }
 
+const uint32_t HEVC_SLICE_I = 2;
+const std::string HEVC_INDEX_TAG = "hevc_index";
+
+struct BitReader {
+  const uint8_t *data;
+  size_t size;
+  size_t pos = 0;
+
+  uint32_t get(int bits) {
+    uint32_t v = 0;
+    for (int i = 0; i < bits; ++i, ++pos) {
+      v = (v << 1) | ((pos / 8 < size) ? (data[pos / 8] >> (7 - pos % 8)) & 1 : 0);
+    }
+    return v;
+  }
+  // Exp-Golomb
+  uint32_t ue() {
+    int zeros = 0;
+    while (get(1) == 0 && zeros < 31) ++zeros;
+    return (1u << zeros) - 1 + get(zeros);
+  }
+};
+
+const uint8_t *nextStartCode(const uint8_t *ptr, const uint8_t *end) {
+  for (; ptr + 3 <= end; ++ptr) {
+    if (ptr[0] == 0 && ptr[1] == 0 && ptr[2] == 1) return ptr;
+  }
+  return end;
+}
+
+// NAL units that follow the slices of their access unit: EOS, EOB, filler data, suffix SEI
+// and the reserved suffix types. they belong to the preceding frame instead of starting the next one.
+inline bool isSuffixNal(uint32_t nal_unit_type) {
+  return (nal_unit_type >= 36 && nal_unit_type <= 38) || nal_unit_type == 40 ||
+         (nal_unit_type >= 45 && nal_unit_type <= 47);
+}
+
+// same layout as tools/lib/vidindex: [slice_type, offset] of each frame. the offset points to
+// the first NAL unit of the access unit, so key frames include their VPS/SPS/PPS.
+std::vector<std::pair<uint32_t, uint32_t>> buildHevcIndex(const uint8_t *data, size_t size) {
+  std::vector<std::pair<uint32_t, uint32_t>> index;
+  index.reserve(60 * 20);  // 20fps, one minute
+
+  const uint8_t *end = data + size;
+  int64_t au_start = -1;
+  for (const uint8_t *ptr = nextStartCode(data, end); ptr < end;) {
+    const uint8_t *next = nextStartCode(ptr + 3, end);
+    const uint8_t *nal = ptr + 3;
+    if (next - nal >= 3) {
+      const uint32_t nal_unit_type = (nal[0] >> 1) & 0x3f;
+      if (nal_unit_type < 32) {
+        // slice_segment_header, skipping the 2 bytes nal_unit_header
+        BitReader bs = {.data = nal + 2, .size = (size_t)(next - nal - 2)};
+        if (bs.get(1)) {  // first_slice_segment_in_pic_flag
+          if (nal_unit_type >= 16 && nal_unit_type <= 23) {
+            bs.get(1);  // no_output_of_prior_pics_flag
+          }
+          bs.ue();  // slice_pic_parameter_set_id
+          // num_extra_slice_header_bits is 0 in openpilot streams
+          uint32_t slice_type = bs.ue();
+          index.push_back({slice_type, au_start >= 0 ? au_start : ptr - data});
+        }
+        au_start = -1;
+      } else if (au_start < 0 && !isSuffixNal(nal_unit_type)) {
+        au_start = ptr - data;
+      }
+    }
+    ptr = next;
+  }
+  return index;
+}
+
+std::string serializeIndex(const std::vector<std::pair<uint32_t, uint32_t>> &index, size_t file_size) {
+  std::vector<uint32_t> buf;
+  buf.reserve(index.size() * 2 + 2);
+  for (auto &[slice_type, offset] : index) {
+    buf.push_back(slice_type);
+    buf.push_back(offset);
+  }
+  buf.push_back(0xFFFFFFFF);
+  buf.push_back(file_size);
+  return std::string((const char *)buf.data(), buf.size() * sizeof(uint32_t));
+}
+
+bool parseIndex(const std::string &str, size_t file_size, std::vector<std::pair<uint32_t, uint32_t>> &index) {
+  const size_t count = str.size() / sizeof(uint32_t);
+  if (count < 4 || count % 2 != 0) return false;
+
+  const uint32_t *buf = (const uint32_t *)str.data();
+  if (buf[count - 2] != 0xFFFFFFFF || buf[count - 1] != file_size) return false;
+
+  index.resize(count / 2 - 1);
+  for (size_t i = 0; i < index.size(); ++i) {
+    index[i] = {buf[i * 2], buf[i * 2 + 1]};
+  }
+  return true;
+}
+
 enum AVPixelFormat get_hw_format(AVCodecContext *ctx, const enum AVPixelFormat *pix_fmts) {
   enum AVPixelFormat *hw_pix_fmt = reinterpret_cast<enum AVPixelFormat *>(ctx->opaque);
   for (const enum AVPixelFormat *p = pix_fmts; *p != -1; p++) {
@@ -54,6 +155,7 @@ FrameReader::~FrameReader() {
   for (AVPacket *pkt : packets) {
     av_packet_free(&pkt);
   }
+  if (index_packet_) av_packet_free(&index_packet_);
 
   if (decoder_ctx) avcodec_free_context(&decoder_ctx);
   if (input_ctx) avformat_close_input(&input_ctx);
@@ -73,10 +175,15 @@ bool FrameReader::load(const std::string &url, bool no_hw_decoder, std::atomic<b
     return false;
   }
 
-  return load((std::byte *)data.data(), data.size(), no_hw_decoder, abort);
+  return load(std::move(data), no_hw_decoder, abort, local_cache ? url : "");
 }
 
 bool FrameReader::load(const std::byte *data, size_t size, bool no_hw_decoder, std::atomic<bool> *abort) {
+  return load(std::string((const char *)data, size), no_hw_decoder, abort);
+}
+
+bool FrameReader::load(std::string &&data, bool no_hw_decoder, std::atomic<bool> *abort, const std::string &cache_key) {
+  data_ = std::move(data);
   input_ctx = avformat_alloc_context();
   if (!input_ctx) {
     rError("Error calling avformat_alloc_context");
@@ -84,9 +191,9 @@ bool FrameReader::load(const std::byte *data, size_t size, bool no_hw_decoder, s
   }
 
   struct buffer_data bd = {
-    .data = (const uint8_t*)data,
+    .data = (const uint8_t*)data_.data(),
     .offset = 0,
-    .size = size,
+    .size = data_.size(),
   };
   const int avio_ctx_buffer_size = 64 * 1024;
   unsigned char *avio_ctx_buffer = (unsigned char *)av_malloc(avio_ctx_buffer_size);
@@ -132,6 +239,12 @@ bool FrameReader::load(const std::byte *data, size_t size, bool no_hw_decoder, s
     return false;
   }
 
+  // raw HEVC streams are indexed instead of demuxing every packet
+  if (strcmp(input_ctx->iformat->name, "hevc") == 0 && loadPacketIndex(cache_key)) {
+    valid_ = !(abort && *abort);
+    return valid_;
+  }
+
   packets.reserve(60 * 20);  // 20fps, one minute
   while (!(abort && *abort)) {
     AVPacket *pkt = av_packet_alloc();
@@ -145,10 +258,50 @@ bool FrameReader::load(const std::byte *data, size_t size, bool no_hw_decoder, s
     // some stream seems to contain no keyframes
     key_frames_count_ += pkt->flags & AV_PKT_FLAG_KEY;
   }
+  std::string().swap(data_);  // the packets hold their own copy of the data
   valid_ = valid_ && !packets.empty();
   return valid_;
 }
 
+bool FrameReader::loadPacketIndex(const std::string &cache_key) {
+  const std::string cached = cache_key.empty() ? "" : FileCache::instance().get(cache_key, HEVC_INDEX_TAG);
+  if (!parseIndex(cached, data_.size(), packet_index_)) {
+    packet_index_ = buildHevcIndex((const uint8_t *)data_.data(), data_.size());
+    if (!packet_index_.empty() && !cache_key.empty()) {
+      FileCache::instance().put(cache_key, serializeIndex(packet_index_, data_.size()), HEVC_INDEX_TAG);
+    }
+  }
+
+  // the stream must start with a key frame to be decodable from the index
+  if (packet_index_.empty() || packet_index_[0].first != HEVC_SLICE_I) {
+    packet_index_.clear();
+    return false;
+  }
+
+  key_frames_count_ = std::count_if(packet_index_.begin(), packet_index_.end(),
+                                    [](auto &p) { return p.first == HEVC_SLICE_I; });
+  index_packet_ = av_packet_alloc();
+  return true;
+}
+
+AVPacket *FrameReader::getPacket(int idx) {
+  if (packet_index_.empty()) {
+    return packets[idx];
+  }
+
+  // the packet references data_ without copying
+  const uint32_t begin = packet_index_[idx].second;
+  const uint32_t end = idx + 1 < packet_index_.size() ? packet_index_[idx + 1].second : data_.size();
+  index_packet_->data = (uint8_t *)data_.data() + begin;
+  index_packet_->size = end - begin;
+  index_packet_->flags = isKeyFrame(idx) ? AV_PKT_FLAG_KEY : 0;
+  return index_packet_;
+}
+
+bool FrameReader::isKeyFrame(int idx) const {
+  return packet_index_.empty() ? packets[idx]->flags & AV_PKT_FLAG_KEY : packet_index_[idx].first == HEVC_SLICE_I;
+}
+
 bool FrameReader::initHardwareDecoder(AVHWDeviceType hw_device_type) {
   for (int i = 0;; i++) {
     const AVCodecHWConfig *config = avcodec_get_hw_config(decoder_ctx->codec, i);
@@ -179,7 +332,7 @@ bool FrameReader::initHardwareDecoder(AVHWDeviceType hw_device_type) {
 
 bool FrameReader::get(int idx, uint8_t *yuv) {
   assert(yuv != nullptr);
-  if (!valid_ || idx < 0 || idx >= packets.size()) {
+  if (!valid_ || idx < 0 || idx >= getFrameCount()) {
     return false;
   }
   return decode(idx, yuv);
@@ -190,7 +343,7 @@ bool FrameReader::decode(int idx, uint8_t *yuv) {
   if (idx != prev_idx + 1 && key_frames_count_ > 1) {
     // seeking to the nearest key frame
     for (int i = idx; i >= 0; --i) {
-      if (packets[i]->flags & AV_PKT_FLAG_KEY) {
+      if (isKeyFrame(i)) {
         from_idx = i;
         break;
       }
@@ -199,7 +352,7 @@ bool FrameReader::decode(int idx, uint8_t *yuv) {
   prev_idx = idx;
 
   for (int i = from_idx; i <= idx; ++i) {
-    AVFrame *f = decodeFrame(packets[i]);
+    AVFrame *f = decodeFrame(getPacket(i));
     if (f && i == idx) {
       return copyBuffers(f, yuv);
     }
@@ -22,9 +22,11 @@ public:
   bool load(const std::string &url, bool no_hw_decoder = false, std::atomic<bool> *abort = nullptr, bool local_cache = false,
             int chunk_size = -1, int retries = 0);
   bool load(const std::byte *data, size_t size, bool no_hw_decoder = false, std::atomic<bool> *abort = nullptr);
+  // takes ownership of the file data. the packet index of raw HEVC streams is cached as cache_key if it's not empty.
+  bool load(std::string &&data, bool no_hw_decoder = false, std::atomic<bool> *abort = nullptr, const std::string &cache_key = {});
   bool get(int idx, uint8_t *yuv);
   int getYUVSize() const { return width * height * 3 / 2; }
-  size_t getFrameCount() const { return packets.size(); }
+  size_t getFrameCount() const { return packet_index_.empty() ? packets.size() : packet_index_.size(); }
   bool valid() const { return valid_; }
 
   int width = 0, height = 0;
@@ -32,10 +34,18 @@ public:
 
 private:
   bool initHardwareDecoder(AVHWDeviceType hw_device_type);
+  bool loadPacketIndex(const std::string &cache_key);
+  AVPacket *getPacket(int idx);
+  bool isKeyFrame(int idx) const;
   bool decode(int idx, uint8_t *yuv);
   AVFrame * decodeFrame(AVPacket *pkt);
   bool copyBuffers(AVFrame *f, uint8_t *yuv);
 
+  // raw HEVC streams are decoded from [slice_type, offset] of each frame in data_,
+  // other streams are demuxed into packets on load.
+  std::string data_;
+  std::vector<std::pair<uint32_t, uint32_t>> packet_index_;
+  AVPacket *index_packet_ = nullptr;
   std::vector<AVPacket*> packets;
   std::unique_ptr<AVFrame, AVFrameDeleter>av_frame_, hw_frame;
   AVFormatContext *input_ctx = nullptr;
@@ -1,6 +1,7 @@
 #include "tools/replay/logreader.h"
 
 #include <algorithm>
+#include "tools/replay/filecache.h"
 #include "tools/replay/util.h"
 
 Event::Event(const kj::ArrayPtr<const capnp::word> &amsg, bool frame) : reader(amsg), frame(frame) {
@@ -49,22 +50,30 @@ LogReader::~LogReader() {
 bool LogReader::load(const std::string &url, std::atomic<bool> *abort,
                      const std::set<cereal::Event::Which> &allow,
                      bool local_cache, int chunk_size, int retries) {
-  raw_ = FileReader(local_cache, chunk_size, retries).read(url, abort);
-  if (raw_.empty()) return false;
-
-  if (url.find(".bz2") != std::string::npos) {
-    raw_ = decompressBZ2(raw_, abort);
-    if (raw_.empty()) return false;
+  const bool is_bz2 = url.find(".bz2") != std::string::npos;
+  std::string raw = local_cache && is_bz2 ? FileCache::instance().get(url, DECOMPRESSED_LOG_TAG) : "";
+  if (raw.empty()) {
+    raw = FileReader(local_cache, chunk_size, retries).read(url, abort);
+    if (raw.empty()) return false;
+
+    if (is_bz2) {
+      raw = decompressBZ2(raw, abort);
+      if (raw.empty()) return false;
+      // the compressed copy is only needed until the decompressed one is cached
+      if (local_cache && FileCache::instance().put(url, raw, DECOMPRESSED_LOG_TAG)) {
+        FileCache::instance().remove(url);
+      }
+    }
   }
-  return parse(allow, abort);
+  return parse(std::move(raw), allow, abort) && sort(abort);
 }
 
 bool LogReader::load(const std::byte *data, size_t size, std::atomic<bool> *abort) {
-  raw_.assign((const char *)data, size);
-  return parse({}, abort);
+  return parse(std::string((const char *)data, size), {}, abort) && sort(abort);
 }
 
-bool LogReader::parse(const std::set<cereal::Event::Which> &allow, std::atomic<bool> *abort) {
+bool LogReader::parse(std::string &&raw, const std::set<cereal::Event::Which> &allow, std::atomic<bool> *abort) {
+  raw_ = std::move(raw);
   try {
     kj::ArrayPtr<const capnp::word> words((const capnp::word *)raw_.data(), raw_.size() / sizeof(capnp::word));
     while (words.size() > 0 && !(abort && *abort)) {
@@ -107,6 +116,10 @@ bool LogReader::parse(const std::set<cereal::Event::Which> &allow, std::atomic<b
     }
   }
 
+  return !events.empty() && !(abort && *abort);
+}
+
+bool LogReader::sort(std::atomic<bool> *abort) {
   if (!events.empty() && !(abort && *abort)) {
     std::sort(events.begin(), events.end(), Event::lessThan());
     return true;
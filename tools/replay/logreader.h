@@ -14,6 +14,8 @@
 const CameraType ALL_CAMERAS[] = {RoadCam, DriverCam, WideRoadCam};
 const int MAX_CAMERAS = std::size(ALL_CAMERAS);
 const int DEFAULT_EVENT_MEMORY_POOL_BLOCK_SIZE = 65000;
+// FileCache tag of decompressed logs
+constexpr const char *DECOMPRESSED_LOG_TAG = "decompressed";
 
 class Event {
 public:
@@ -55,10 +57,12 @@ public:
   bool load(const std::string &url, std::atomic<bool> *abort = nullptr, const std::set<cereal::Event::Which> &allow = {},
             bool local_cache = false, int chunk_size = -1, int retries = 0);
   bool load(const std::byte *data, size_t size, std::atomic<bool> *abort = nullptr);
+  // the load steps, run separately by SegmentLoader. parse takes ownership of the decompressed log.
+  bool parse(std::string &&raw, const std::set<cereal::Event::Which> &allow = {}, std::atomic<bool> *abort = nullptr);
+  bool sort(std::atomic<bool> *abort = nullptr);
   std::vector<Event*> events;
 
 private:
-  bool parse(const std::set<cereal::Event::Which> &allow, std::atomic<bool> *abort);
   std::string raw_;
 #ifdef HAS_MEMORY_RESOURCE
   std::pmr::monotonic_buffer_resource *mbr_ = nullptr;
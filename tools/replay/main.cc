@@ -29,6 +29,8 @@ int main(int argc, char *argv[]) {
   parser.addOption({"demo", "use a demo route instead of providing your own"});
   parser.addOption({"data_dir", "local directory with routes", "data_dir"});
   parser.addOption({"prefix", "set OPENPILOT_PREFIX", "prefix"});
+  parser.addOption({"loader-workers", "number of fetch,decompress,parse,index workers. default is 4,2,2,1", "workers"});
+  parser.addOption({"loader-memory", "memory budget of the segment loader in MB. default is 1024", "mb"});
   for (auto &[name, _, desc] : flags) {
     parser.addOption({name, desc});
   }
@@ -56,6 +58,18 @@ int main(int argc, char *argv[]) {
     op_prefix.reset(new OpenpilotPrefix(prefix.toStdString()));
   }
 
+  SegmentLoader::Config loader_config;
+  if (!parser.value("loader-workers").isEmpty()) {
+    const QStringList workers = parser.value("loader-workers").split(",");
+    for (int i = 0; i < std::min<int>(workers.size(), SegmentLoader::STAGE_COUNT); ++i) {
+      loader_config.workers[i] = std::max(1, workers[i].toInt());
+    }
+  }
+  if (!parser.value("loader-memory").isEmpty()) {
+    loader_config.memory_budget = parser.value("loader-memory").toULongLong() * 1024 * 1024;
+  }
+  SegmentLoader::instance().setConfig(loader_config);
+
   Replay *replay = new Replay(route, allow, block, nullptr, replay_flags, parser.value("data_dir"), &app);
   if (!parser.value("c").isEmpty()) {
     replay->setSegmentCacheLimit(parser.value("c").toInt());
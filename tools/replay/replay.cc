@@ -2,11 +2,13 @@
 
 #include <QDebug>
 #include <QtConcurrent>
+#include <cinttypes>
 
 #include <capnp/dynamic.h>
 #include "cereal/services.h"
 #include "common/params.h"
 #include "common/timing.h"
+#include "common/util.h"
 #include "system/hardware/hw.h"
 #include "tools/replay/util.h"
 
@@ -127,68 +129,40 @@ void Replay::seekToFlag(FindFlag flag) {
 }
 
 void Replay::buildTimeline() {
-  uint64_t engaged_begin = 0;
-  uint64_t alert_begin = 0;
-  TimelineType alert_type = TimelineType::None;
-
-  for (auto it = segments_.cbegin(); it != segments_.cend() && !exit_; ++it) {
-    LogReader log;
-    if (!log.load(route_->at(it->first).qlog.toStdString(), &exit_,
-                  {cereal::Event::Which::CONTROLS_STATE, cereal::Event::Which::USER_FLAG},
-                  !hasFlag(REPLAY_FLAG_NO_FILE_CACHE), 0, 3)) continue;
-
-    for (const Event *e : log.events) {
-      if (e->which == cereal::Event::Which::CONTROLS_STATE) {
-        auto cs = e->event.getControlsState();
-
-        if (!engaged_begin && cs.getEnabled()) {
-          engaged_begin = e->mono_time;
-        } else if (engaged_begin && !cs.getEnabled()) {
-          std::lock_guard lk(timeline_lock);
-          timeline.push_back({toSeconds(engaged_begin), toSeconds(e->mono_time), TimelineType::Engaged});
-          engaged_begin = 0;
-        }
-
-        if (!alert_begin && cs.getAlertType().size() > 0) {
-          alert_begin = e->mono_time;
-          alert_type = TimelineType::AlertInfo;
-          if (cs.getAlertStatus() != cereal::ControlsState::AlertStatus::NORMAL) {
-            alert_type = cs.getAlertStatus() == cereal::ControlsState::AlertStatus::USER_PROMPT
-                             ? TimelineType::AlertWarning
-                             : TimelineType::AlertCritical;
-          }
-        } else if (alert_begin && cs.getAlertType().size() == 0) {
-          std::lock_guard lk(timeline_lock);
-          timeline.push_back({toSeconds(alert_begin), toSeconds(e->mono_time), alert_type});
-          alert_begin = 0;
-        }
-      } else if (e->which == cereal::Event::Which::USER_FLAG) {
-        std::lock_guard lk(timeline_lock);
-        timeline.push_back({toSeconds(e->mono_time), toSeconds(e->mono_time), TimelineType::UserFlag});
-      }
-    }
+  // summarize all segments in parallel. the summaries are cached, so reopening a route is instant.
+  std::vector<int> seg_nums;
+  std::map<int, SegmentTimeline> segments;
+  for (auto &[n, _] : segments_) {
+    seg_nums.push_back(n);
+    segments[n] = {};
   }
+  QtConcurrent::blockingMap(seg_nums, [&](int n) {
+    if (exit_) return;
+    segments.at(n) = SegmentTimeline::load(route_->at(n).qlog.toStdString(), !hasFlag(REPLAY_FLAG_NO_FILE_CACHE), &exit_);
+  });
+  if (exit_) return;
+
+  Timeline t;
+  t.build(segments, route_start_ts_);
+  std::lock_guard lk(timeline_lock);
+  timeline = std::move(t);
 }
 
 std::optional<uint64_t> Replay::find(FindFlag flag) {
-  int cur_ts = currentSeconds();
-  for (auto [start_ts, end_ts, type] : getTimeline()) {
-    if (type == TimelineType::Engaged) {
-      if (flag == FindFlag::nextEngagement && start_ts > cur_ts) {
-        return start_ts;
-      } else if (flag == FindFlag::nextDisEngagement && end_ts > cur_ts) {
-        return end_ts;
-      }
-    } else if (start_ts > cur_ts) {
-      if ((flag == FindFlag::nextUserFlag && type == TimelineType::UserFlag) ||
-          (flag == FindFlag::nextInfo && type == TimelineType::AlertInfo) ||
-          (flag == FindFlag::nextWarning && type == TimelineType::AlertWarning) ||
-          (flag == FindFlag::nextCritical && type == TimelineType::AlertCritical)) {
-        return start_ts;
-      }
+  const double cur_ts = currentSeconds();
+  std::optional<double> next;
+  {
+    std::lock_guard lk(timeline_lock);
+    switch (flag) {
+      case FindFlag::nextEngagement: next = timeline.nextStart(TimelineType::Engaged, cur_ts); break;
+      case FindFlag::nextDisEngagement: next = timeline.nextEnd(TimelineType::Engaged, cur_ts); break;
+      case FindFlag::nextUserFlag: next = timeline.nextStart(TimelineType::UserFlag, cur_ts); break;
+      case FindFlag::nextInfo: next = timeline.nextStart(TimelineType::AlertInfo, cur_ts); break;
+      case FindFlag::nextWarning: next = timeline.nextStart(TimelineType::AlertWarning, cur_ts); break;
+      case FindFlag::nextCritical: next = timeline.nextStart(TimelineType::AlertCritical, cur_ts); break;
     }
   }
-  return std::nullopt;
+  return next ? std::optional<uint64_t>(*next) : std::nullopt;
 }
 
 void Replay::pause(bool pause) {
@@ -206,6 +180,16 @@ void Replay::setCurrentSegment(int n) {
 }
 
 void Replay::segmentLoadFinished(bool success) {
+  auto stats = SegmentLoader::instance().stats();
+  std::string s;
+  for (int i = 0; i < SegmentLoader::STAGE_COUNT; ++i) {
+    const auto &st = stats.stages[i];
+    s += util::string_format("%s: %d/%d/%" PRIu64 " %.0fms ", SegmentLoader::stageName((SegmentLoader::Stage)i),
+                             st.queued, st.active, st.completed, st.busy_ms);
+  }
+  rDebug("loader (queued/active/done) %smemory %s/%s", s.c_str(), formattedDataSize(stats.memory_used).c_str(),
+         formattedDataSize(stats.memory_budget).c_str());
+
   if (!success) {
     Segment *seg = qobject_cast<Segment *>(sender());
     rWarning("failed to load segment %d, removing it from current replay list", seg->seg_num);
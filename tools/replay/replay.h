@@ -2,10 +2,12 @@
 
 #include <optional>
 
+#include <QFuture>
 #include <QThread>
 
 #include "tools/replay/camera.h"
 #include "tools/replay/route.h"
+#include "tools/replay/timeline.h"
 
 const QString DEMO_ROUTE = "4cf7a6ad03080c90|2021-09-29--13-46-36";
 
@@ -33,7 +35,6 @@ enum class FindFlag {
   nextCritical
 };
 
-enum class TimelineType { None, Engaged, AlertInfo, AlertWarning, AlertCritical, UserFlag };
 typedef bool (*replayEventFilter)(const Event *, void *);
 
 class Replay : public QObject {
@@ -75,7 +76,11 @@ public:
   inline const std::string &carFingerprint() const { return car_fingerprint_; }
   inline const std::vector<std::tuple<int, int, TimelineType>> getTimeline() {
     std::lock_guard lk(timeline_lock);
-    return timeline;
+    return timeline.entries();
+  }
+  inline std::optional<Timeline::Signal> getSignal(double sec) {
+    std::lock_guard lk(timeline_lock);
+    return timeline.signalAt(sec);
   }
 
 signals:
@@ -130,7 +135,7 @@ protected:
 
   std::mutex timeline_lock;
   QFuture<void> timeline_future;
-  std::vector<std::tuple<int, int, TimelineType>> timeline;
+  Timeline timeline;
   std::set<cereal::Event::Which> allow_list;
   std::string car_fingerprint_;
   float speed_ = 1.0;
@@ -5,12 +5,12 @@
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QRegExp>
-#include <QtConcurrent>
 
 #include <array>
 
 #include "system/hardware/hw.h"
 #include "selfdrive/ui/qt/api.h"
+#include "tools/replay/filecache.h"
 #include "tools/replay/replay.h"
 #include "tools/replay/util.h"
 
@@ -113,7 +113,7 @@ Segment::Segment(int n, const SegmentFile &files, uint32_t flags,
   for (int i = 0; i < file_list.size(); ++i) {
     if (!file_list[i].isEmpty() && (!(flags & REPLAY_FLAG_NO_VIPC) || i >= MAX_CAMERAS)) {
       ++loading_;
-      synchronizer_.addFuture(QtConcurrent::run(this, &Segment::loadFile, i, file_list[i].toStdString()));
+      SegmentLoader::instance().submit(createJob(i, file_list[i].toStdString()));
     }
   }
 }
@@ -121,21 +121,62 @@ Segment::Segment(int n, const SegmentFile &files, uint32_t flags,
 Segment::~Segment() {
   disconnect();
   abort_ = true;
-  synchronizer_.setCancelOnWait(true);
-  synchronizer_.waitForFinished();
+  SegmentLoader::instance().cancel(&abort_);
+  std::unique_lock lk(lock_);
+  cv_.wait(lk, [this]() { return loading_ == 0; });
 }
 
-void Segment::loadFile(int id, const std::string file) {
+std::unique_ptr<SegmentLoader::Job> Segment::createJob(int id, const std::string &file) {
   const bool local_cache = !(flags & REPLAY_FLAG_NO_FILE_CACHE);
-  bool success = false;
+  auto job = std::make_unique<SegmentLoader::Job>();
+  job->abort = &abort_;
+  job->done = [this](bool success) { fileLoaded(success); };
+
+  const size_t chunk_size = id < MAX_CAMERAS ? 20 * 1024 * 1024 : 0;
+  const bool is_bz2 = file.find(".bz2") != std::string::npos;
+  // set by the fetch stage if the decompressed log is found in the local cache
+  auto decompressed = std::make_shared<bool>(false);
+  job->stages[SegmentLoader::Fetch] = [=](std::string &data) {
+    if (local_cache && is_bz2) {
+      data = FileCache::instance().get(file, DECOMPRESSED_LOG_TAG);
+      *decompressed = !data.empty();
+      if (*decompressed) return true;
+    }
+    data = FileReader(local_cache, chunk_size, 3).read(file, &abort_);
+    return !data.empty();
+  };
+
   if (id < MAX_CAMERAS) {
-    frames[id] = std::make_unique<FrameReader>();
-    success = frames[id]->load(file, flags & REPLAY_FLAG_NO_HW_DECODER, &abort_, local_cache, 20 * 1024 * 1024, 3);
+    job->stages[SegmentLoader::Parse] = [=](std::string &data) {
+      frames[id] = std::make_unique<FrameReader>();
+      return frames[id]->load(std::move(data), flags & REPLAY_FLAG_NO_HW_DECODER, &abort_, local_cache ? file : "");
+    };
   } else {
-    log = std::make_unique<LogReader>();
-    success = log->load(file, &abort_, allow, local_cache, 0, 3);
+    if (is_bz2) {
+      job->stages[SegmentLoader::Decompress] = [=](std::string &data) {
+        if (*decompressed) return true;
+
+        data = decompressBZ2(data, &abort_);
+        // the compressed copy is only needed until the decompressed one is cached
+        if (local_cache && FileCache::instance().put(file, data, DECOMPRESSED_LOG_TAG)) {
+          FileCache::instance().remove(file);
+        }
+        return !data.empty();
+      };
+    }
+    job->stages[SegmentLoader::Parse] = [=](std::string &data) {
+      log = std::make_unique<LogReader>();
+      return log->parse(std::move(data), allow, &abort_);
+    };
+    job->stages[SegmentLoader::Index] = [=](std::string &data) {
+      return log->sort(&abort_);
+    };
   }
+  return job;
+}
 
+void Segment::fileLoaded(bool success) {
+  std::lock_guard lk(lock_);
   if (!success) {
     // abort all loading jobs.
     abort_ = true;
@@ -143,5 +184,6 @@ void Segment::loadFile(int id, const std::string file) {
 
   if (--loading_ == 0) {
     emit loadFinished(!abort_);
+    cv_.notify_all();
   }
 }
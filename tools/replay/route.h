@@ -1,10 +1,13 @@
 #pragma once
 
 #include <QDateTime>
-#include <QFutureSynchronizer>
+
+#include <condition_variable>
+#include <mutex>
 
 #include "tools/replay/framereader.h"
 #include "tools/replay/logreader.h"
+#include "tools/replay/segmentloader.h"
 #include "tools/replay/util.h"
 
 struct RouteIdentifier {
@@ -62,11 +65,13 @@ signals:
   void loadFinished(bool success);
 
 protected:
-  void loadFile(int id, const std::string file);
+  std::unique_ptr<SegmentLoader::Job> createJob(int id, const std::string &file);
+  void fileLoaded(bool success);
 
   std::atomic<bool> abort_ = false;
   std::atomic<int> loading_ = 0;
-  QFutureSynchronizer<void> synchronizer_;
+  std::mutex lock_;
+  std::condition_variable cv_;
   uint32_t flags;
   std::set<cereal::Event::Which> allow;
 };
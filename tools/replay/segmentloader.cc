@@ -0,0 +1,157 @@
+#include "tools/replay/segmentloader.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "common/timing.h"
+
+SegmentLoader &SegmentLoader::instance() {
+  static SegmentLoader loader;
+  return loader;
+}
+
+SegmentLoader::~SegmentLoader() {
+  {
+    std::lock_guard lk(lock_);
+    exit_ = true;
+  }
+  for (auto &cv : cv_) cv.notify_all();
+  for (auto &t : threads_) t.join();
+}
+
+const char *SegmentLoader::stageName(Stage stage) {
+  static const char *names[STAGE_COUNT] = {"fetch", "decompress", "parse", "index"};
+  return names[stage];
+}
+
+void SegmentLoader::setConfig(const Config &config) {
+  std::lock_guard lk(lock_);
+  assert(!started_);
+  config_ = config;
+}
+
+void SegmentLoader::start() {
+  for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+    for (int i = 0; i < std::max(1, config_.workers[stage]); ++i) {
+      threads_.emplace_back(&SegmentLoader::workerThread, this, (Stage)stage);
+    }
+  }
+  started_ = true;
+}
+
+void SegmentLoader::submit(std::unique_ptr<Job> job) {
+  {
+    std::lock_guard lk(lock_);
+    if (!started_) start();
+  }
+  dispatch(std::move(job), Fetch);
+}
+
+void SegmentLoader::cancel(std::atomic<bool> *abort) {
+  std::vector<std::unique_ptr<Job>> canceled;
+  {
+    std::lock_guard lk(lock_);
+    for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+      auto &q = queue_[stage];
+      for (auto it = q.begin(); it != q.end();) {
+        if ((*it)->abort == abort) {
+          canceled.push_back(std::move(*it));
+          it = q.erase(it);
+          --stats_[stage].queued;
+        } else {
+          ++it;
+        }
+      }
+    }
+  }
+  for (auto &job : canceled) {
+    finish(std::move(job), false);
+  }
+}
+
+SegmentLoader::Stats SegmentLoader::stats() {
+  std::lock_guard lk(lock_);
+  Stats s;
+  std::copy(std::begin(stats_), std::end(stats_), s.stages);
+  s.memory_used = memory_used_;
+  s.memory_budget = config_.memory_budget;
+  return s;
+}
+
+void SegmentLoader::dispatch(std::unique_ptr<Job> job, int from_stage) {
+  if (job->abort && *job->abort) {
+    finish(std::move(job), false);
+    return;
+  }
+
+  int stage = from_stage;
+  while (stage < STAGE_COUNT && !job->stages[stage]) ++stage;
+  if (stage == STAGE_COUNT) {
+    finish(std::move(job), true);
+    return;
+  }
+
+  {
+    std::lock_guard lk(lock_);
+    queue_[stage].push_back(std::move(job));
+    ++stats_[stage].queued;
+  }
+  cv_[stage].notify_one();
+}
+
+void SegmentLoader::finish(std::unique_ptr<Job> job, bool success) {
+  {
+    std::lock_guard lk(lock_);
+    memory_used_ -= job->accounted_bytes;
+    job->accounted_bytes = 0;
+  }
+  cv_[Fetch].notify_all();
+
+  std::string().swap(job->data);
+  if (job->done) {
+    job->done(success);
+  }
+}
+
+void SegmentLoader::workerThread(Stage stage) {
+  while (true) {
+    std::unique_ptr<Job> job;
+    {
+      std::unique_lock lk(lock_);
+      // the fetch stage only starts new jobs while the pipeline is within the memory budget
+      cv_[stage].wait(lk, [&]() { return exit_ || (!queue_[stage].empty() && (stage != Fetch || hasMemory())); });
+      if (exit_) break;
+
+      job = std::move(queue_[stage].front());
+      queue_[stage].pop_front();
+      --stats_[stage].queued;
+      ++stats_[stage].active;
+    }
+
+    double start_ts = millis_since_boot();
+    bool success = !(job->abort && *job->abort) && job->stages[stage](job->data);
+    double elapsed = millis_since_boot() - start_ts;
+
+    {
+      std::lock_guard lk(lock_);
+      auto &s = stats_[stage];
+      --s.active;
+      s.busy_ms += elapsed;
+      s.bytes += job->data.size();
+      success ? ++s.completed : ++s.failed;
+
+      memory_used_ = memory_used_ - job->accounted_bytes + job->data.size();
+      job->accounted_bytes = job->data.size();
+    }
+    if (stage != Fetch) {
+      // a later stage may have released memory, wake up the fetch workers
+      cv_[Fetch].notify_all();
+    }
+
+    if (success) {
+      dispatch(std::move(job), stage + 1);
+    } else {
+      finish(std::move(job), false);
+    }
+  }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Pipelined loader shared by all segments. Each file is pushed through the
+// fetch -> decompress -> parse -> index stages, every stage has its own pool of
+// workers, and the fetch stage stalls while the buffers held by in-flight jobs
+// exceed the memory budget.
+class SegmentLoader {
+public:
+  enum Stage { Fetch, Decompress, Parse, Index, STAGE_COUNT };
+
+  struct Config {
+    int workers[STAGE_COUNT] = {4, 2, 2, 1};
+    size_t memory_budget = 1024 * 1024 * 1024;  // 1GB
+  };
+
+  struct StageStats {
+    int queued = 0;
+    int active = 0;
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    uint64_t bytes = 0;  // size of the buffers produced by this stage
+    double busy_ms = 0;
+  };
+
+  struct Stats {
+    StageStats stages[STAGE_COUNT];
+    size_t memory_used = 0;
+    size_t memory_budget = 0;
+  };
+
+  // a stage transforms the job's buffer in place and returns false on failure.
+  // stages left empty are skipped.
+  typedef std::function<bool(std::string &data)> StageFunc;
+
+  struct Job {
+    StageFunc stages[STAGE_COUNT];
+    std::function<void(bool success)> done;
+    std::atomic<bool> *abort = nullptr;
+    std::string data;
+    size_t accounted_bytes = 0;
+  };
+
+  static SegmentLoader &instance();
+  ~SegmentLoader();
+  // must be called before the first job is submitted.
+  void setConfig(const Config &config);
+  void submit(std::unique_ptr<Job> job);
+  // drop all queued jobs sharing this abort flag. their done callbacks are called with false.
+  void cancel(std::atomic<bool> *abort);
+  Stats stats();
+
+  static const char *stageName(Stage stage);
+
+private:
+  SegmentLoader() = default;
+  void start();
+  void workerThread(Stage stage);
+  void dispatch(std::unique_ptr<Job> job, int from_stage);
+  void finish(std::unique_ptr<Job> job, bool success);
+  inline bool hasMemory() const {
+    return memory_used_ < config_.memory_budget || memory_used_ == 0;
+  }
+
+  std::mutex lock_;
+  std::condition_variable cv_[STAGE_COUNT];
+  std::deque<std::unique_ptr<Job>> queue_[STAGE_COUNT];
+  std::vector<std::thread> threads_;
+  Config config_;
+  StageStats stats_[STAGE_COUNT];
+  size_t memory_used_ = 0;
+  bool started_ = false;
+  bool exit_ = false;
+};
@@ -0,0 +1,196 @@
+#include "tools/replay/timeline.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "tools/replay/filecache.h"
+#include "tools/replay/logreader.h"
+
+namespace {
+
+const std::string TIMELINE_TAG = "timeline";
+const uint32_t TIMELINE_VERSION = 1;
+const uint64_t SIGNAL_SAMPLE_INTERVAL = 0.5 * 1e9;
+
+template <class T>
+void write(std::string &out, T v) {
+  out.append((const char *)&v, sizeof(v));
+}
+
+template <class T>
+bool read(const std::string &in, size_t &pos, T &v) {
+  if (pos + sizeof(v) > in.size()) return false;
+  memcpy(&v, in.data() + pos, sizeof(v));
+  pos += sizeof(v);
+  return true;
+}
+
+TimelineType alertType(const cereal::ControlsState::Reader &cs) {
+  if (cs.getAlertType().size() == 0) return TimelineType::None;
+
+  switch (cs.getAlertStatus()) {
+    case cereal::ControlsState::AlertStatus::NORMAL: return TimelineType::AlertInfo;
+    case cereal::ControlsState::AlertStatus::USER_PROMPT: return TimelineType::AlertWarning;
+    default: return TimelineType::AlertCritical;
+  }
+}
+
+}  // namespace
+
+// class SegmentTimeline
+
+SegmentTimeline SegmentTimeline::load(const std::string &qlog, bool local_cache, std::atomic<bool> *abort) {
+  SegmentTimeline seg;
+  if (local_cache && seg.deserialize(FileCache::instance().get(qlog, TIMELINE_TAG))) {
+    return seg;
+  }
+
+  LogReader log;
+  if (!log.load(qlog, abort, {cereal::Event::Which::CONTROLS_STATE, cereal::Event::Which::USER_FLAG, cereal::Event::Which::CAR_STATE},
+                local_cache, 0, 3)) {
+    return seg;
+  }
+
+  for (const Event *e : log.events) {
+    if (e->which == cereal::Event::Which::CONTROLS_STATE) {
+      auto cs = e->event.getControlsState();
+      State state = {.mono_time = e->mono_time, .engaged = cs.getEnabled(), .alert = alertType(cs)};
+      // only keep the changes
+      if (seg.states.empty() || seg.states.back().engaged != state.engaged || seg.states.back().alert != state.alert) {
+        seg.states.push_back(state);
+      }
+    } else if (e->which == cereal::Event::Which::USER_FLAG) {
+      seg.user_flags.push_back(e->mono_time);
+    } else if (e->which == cereal::Event::Which::CAR_STATE) {
+      if (seg.signals.empty() || e->mono_time - seg.signals.back().mono_time >= SIGNAL_SAMPLE_INTERVAL) {
+        auto cs = e->event.getCarState();
+        seg.signals.push_back({.mono_time = e->mono_time, .v_ego = cs.getVEgo(), .steering_angle_deg = cs.getSteeringAngleDeg()});
+      }
+    }
+  }
+
+  if (local_cache && !(abort && *abort)) {
+    FileCache::instance().put(qlog, seg.serialize(), TIMELINE_TAG);
+  }
+  return seg;
+}
+
+std::string SegmentTimeline::serialize() const {
+  std::string out;
+  write(out, TIMELINE_VERSION);
+  write(out, (uint32_t)states.size());
+  for (auto &s : states) {
+    write(out, s.mono_time);
+    write(out, (uint8_t)s.engaged);
+    write(out, (uint8_t)s.alert);
+  }
+  write(out, (uint32_t)user_flags.size());
+  for (auto t : user_flags) {
+    write(out, t);
+  }
+  write(out, (uint32_t)signals.size());
+  for (auto &s : signals) {
+    write(out, s.mono_time);
+    write(out, s.v_ego);
+    write(out, s.steering_angle_deg);
+  }
+  return out;
+}
+
+bool SegmentTimeline::deserialize(const std::string &data) {
+  size_t pos = 0;
+  uint32_t version = 0, count = 0;
+  if (!read(data, pos, version) || version != TIMELINE_VERSION) return false;
+
+  if (!read(data, pos, count)) return false;
+  states.resize(count);
+  for (auto &s : states) {
+    uint8_t engaged = 0, alert = 0;
+    if (!read(data, pos, s.mono_time) || !read(data, pos, engaged) || !read(data, pos, alert)) return false;
+    s.engaged = engaged;
+    s.alert = (TimelineType)alert;
+  }
+
+  if (!read(data, pos, count)) return false;
+  user_flags.resize(count);
+  for (auto &t : user_flags) {
+    if (!read(data, pos, t)) return false;
+  }
+
+  if (!read(data, pos, count)) return false;
+  signals.resize(count);
+  for (auto &s : signals) {
+    if (!read(data, pos, s.mono_time) || !read(data, pos, s.v_ego) || !read(data, pos, s.steering_angle_deg)) return false;
+  }
+  return pos == data.size();
+}
+
+// class Timeline
+
+void Timeline::build(const std::map<int, SegmentTimeline> &segments, uint64_t route_start_ts) {
+  auto to_seconds = [=](uint64_t mono_time) { return (double(mono_time) - route_start_ts) / 1e9; };
+
+  entries_.clear();
+  signals_.clear();
+  uint64_t engaged_begin = 0;
+  uint64_t alert_begin = 0;
+  TimelineType alert_type = TimelineType::None;
+  for (auto &[n, seg] : segments) {
+    for (auto &s : seg.states) {
+      if (!engaged_begin && s.engaged) {
+        engaged_begin = s.mono_time;
+      } else if (engaged_begin && !s.engaged) {
+        entries_[TimelineType::Engaged].push_back({to_seconds(engaged_begin), to_seconds(s.mono_time)});
+        engaged_begin = 0;
+      }
+
+      if (!alert_begin && s.alert != TimelineType::None) {
+        alert_begin = s.mono_time;
+        alert_type = s.alert;
+      } else if (alert_begin && s.alert == TimelineType::None) {
+        entries_[alert_type].push_back({to_seconds(alert_begin), to_seconds(s.mono_time)});
+        alert_begin = 0;
+      }
+    }
+    for (auto t : seg.user_flags) {
+      entries_[TimelineType::UserFlag].push_back({to_seconds(t), to_seconds(t)});
+    }
+    for (auto &s : seg.signals) {
+      signals_.push_back({.sec = to_seconds(s.mono_time), .v_ego = s.v_ego, .steering_angle_deg = s.steering_angle_deg});
+    }
+  }
+}
+
+std::optional<double> Timeline::nextStart(TimelineType type, double sec) const {
+  auto it = entries_.find(type);
+  if (it == entries_.end()) return std::nullopt;
+
+  auto &v = it->second;
+  auto e = std::upper_bound(v.begin(), v.end(), sec, [](double t, const Entry &e) { return t < e.start; });
+  return e != v.end() ? std::optional(e->start) : std::nullopt;
+}
+
+std::optional<double> Timeline::nextEnd(TimelineType type, double sec) const {
+  auto it = entries_.find(type);
+  if (it == entries_.end()) return std::nullopt;
+
+  auto &v = it->second;
+  auto e = std::upper_bound(v.begin(), v.end(), sec, [](double t, const Entry &e) { return t < e.end; });
+  return e != v.end() ? std::optional(e->end) : std::nullopt;
+}
+
+std::optional<Timeline::Signal> Timeline::signalAt(double sec) const {
+  auto it = std::upper_bound(signals_.begin(), signals_.end(), sec, [](double t, const Signal &s) { return t < s.sec; });
+  return it != signals_.begin() ? std::optional(*(--it)) : std::nullopt;
+}
+
+std::vector<std::tuple<int, int, TimelineType>> Timeline::entries() const {
+  std::vector<std::tuple<int, int, TimelineType>> result;
+  for (auto &[type, v] : entries_) {
+    for (auto &e : v) {
+      result.push_back({(int)e.start, (int)e.end, type});
+    }
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+enum class TimelineType { None, Engaged, AlertInfo, AlertWarning, AlertCritical, UserFlag };
+
+// Compact summary of one segment's qlog: controlsState changes, user flags and sampled
+// key signals. It's cached per qlog, so reopening a route doesn't need to parse the logs again.
+struct SegmentTimeline {
+  struct State {
+    uint64_t mono_time;
+    bool engaged;
+    TimelineType alert;
+  };
+  struct Signal {
+    uint64_t mono_time;
+    float v_ego;
+    float steering_angle_deg;
+  };
+
+  static SegmentTimeline load(const std::string &qlog, bool local_cache, std::atomic<bool> *abort);
+  std::string serialize() const;
+  bool deserialize(const std::string &data);
+
+  std::vector<State> states;
+  std::vector<uint64_t> user_flags;
+  std::vector<Signal> signals;
+};
+
+class Timeline {
+public:
+  struct Signal {
+    double sec;
+    float v_ego;
+    float steering_angle_deg;
+  };
+
+  void build(const std::map<int, SegmentTimeline> &segments, uint64_t route_start_ts);
+  // start time of the next entry of type after sec
+  std::optional<double> nextStart(TimelineType type, double sec) const;
+  // end time of the next entry of type after sec
+  std::optional<double> nextEnd(TimelineType type, double sec) const;
+  // the last sample at or before sec
+  std::optional<Signal> signalAt(double sec) const;
+  std::vector<std::tuple<int, int, TimelineType>> entries() const;
+
+private:
+  struct Entry {
+    double start;
+    double end;
+  };
+  // sorted by start time. entries of the same type don't overlap, so end times are sorted as well.
+  std::map<TimelineType, std::vector<Entry>> entries_;
+  std::vector<Signal> signals_;
+};